@@ -38,13 +38,18 @@
 #include <stdlib.h>
 #include "../src/ota/ota_manager.h"
 #include "../src/tasks/tcp_client_task.h"
+#include "../src/tasks/uplink_task.h"
+#include "../src/tasks/poll_task.h"
 #include "../src/tasks/rs485_task.h"
+#include "../src/tasks/bus_task.h"
+#include "../src/tasks/modbus_tcp_task.h"
 #include "../src/tasks/uart_rx_task.h"
 #include "../src/tasks/ble_task.h"
 #include "../src/utils/heartbeat.h"
 #include "../src/utils/poll_timer.h"
 #include "../src/utils/factory_test.h"
 #include "../src/protocol/modbus_protocol.h"
+#include "../src/protocol/device_routes.h"
 
 static const char *TAG = "main";
 
@@ -53,7 +58,6 @@ static data_process_handle_t s_rs485_tcp_data_handle = NULL;
 
 // Forward declarations
 static void rs485_frame_to_tcp_callback(uint8_t *frame, size_t len);
-static void rs485_tcp_send_wrapper(const uint8_t *data, size_t len);
 
 void app_main(void)
 {
@@ -65,6 +69,9 @@ void app_main(void)
     // 2. Initialize parameter manager
     ESP_ERROR_CHECK(param_manager_init());
 
+    // Device routing table (slave addresses come from the parameters)
+    ESP_ERROR_CHECK(device_routes_init());
+
     // 3. Check factory test flag (param ID 10)
     int32_t factory_test = 0;
     esp_err_t ret = param_get_int(PARAM_ID_10, &factory_test);
@@ -104,45 +111,60 @@ void app_main(void)
     ESP_ERROR_CHECK(heartbeat_init());
     ESP_ERROR_CHECK(poll_timer_init());
 
-    // 12. Initialize data processing module for RS485-TCP routing
-    // Create a data handle that forwards to TCP client
-    // We'll create a wrapper callback since tcp_client_task_send has different signature
-    s_rs485_tcp_data_handle = data_process_create(
-        rs485_tcp_send_wrapper,  // Send callback wrapper
-        NULL  // Receive callback not needed for this routing
-    );
+    // 12. Initialize OTA manager
+    ESP_ERROR_CHECK(ota_manager_init());
+
+    // 13. Initialize TCP client (last, as it depends on WiFi)
+    ESP_ERROR_CHECK(tcp_client_task_init());
+
+    // 14. RS485 uplink and heartbeat share the TCP client's data handle, so
+    // they draw from the connection's sequence numbers and ack window
+    s_rs485_tcp_data_handle = tcp_client_task_get_data_handle();
     if (s_rs485_tcp_data_handle == NULL) {
-        ESP_LOGE(TAG, "Failed to create RS485-TCP data process handle");
+        ESP_LOGE(TAG, "TCP client data process handle unavailable");
     }
-    
-    // Global data handle for heartbeat
     data_process_handle_t data_handle = s_rs485_tcp_data_handle;
 
-    // 13. Initialize OTA manager
-    ESP_ERROR_CHECK(ota_manager_init());
-
-    // 14. Initialize TCP client (last, as it depends on WiFi)
-    ESP_ERROR_CHECK(tcp_client_task_init());
+    // 15. Start the uplink writer so the RS485 task never waits on the cloud
+    ESP_ERROR_CHECK(uplink_task_init());
 
-    // 15. Initialize RS485 task
+    // 16. Initialize RS485 task
     ESP_ERROR_CHECK(rs485_task_init());
 
-    // 16. Set up data routing between RS485 and TCP client
+    // 17. Set up data routing between RS485 and TCP client
     // RS485 frames will be forwarded to TCP client via data processing
     rs485_task_set_callback(rs485_frame_to_tcp_callback);
 
-    // 17. Start heartbeat for TCP client connection
+    // 18. Start the bus transaction engine; all RS485 requests go through it
+    ESP_ERROR_CHECK(bus_task_init());
+
+    // First boot (no stored line settings): find the fastest the inverter answers on
+    if (rs485_task_needs_probe()) {
+        bus_task_probe_line();
+    }
+
+    // 19. Serve Modbus TCP clients through the bus engine
+    ESP_ERROR_CHECK(modbus_tcp_task_init());
+
+    // 20. Start heartbeat for TCP client connection
     if (data_handle != NULL) {
         heartbeat_start(data_handle);
     }
 
+    // 21. Plan the inverter register sweep and run it every query period
+    ESP_ERROR_CHECK(poll_task_init());
+
     ESP_LOGI(TAG, "Application initialization complete");
 }
 
 /**
  * @brief Callback to forward RS485 frames to TCP client
  * 
- * Converts Modbus frames to protocol frames and sends via TCP client
+ * Converts Modbus frames to protocol frames and sends via TCP client.
+ * A response goes up as its body (no address, function code or CRC). An
+ * exception that ends a cloud request goes up as the function code with
+ * bit 7 set followed by the exception code; no response body is two bytes
+ * long, so the cloud can tell the two apart.
  * 
  * Original: Data routing from RS485 to TCP (sub_42011F22)
  */
@@ -153,6 +175,11 @@ static void rs485_frame_to_tcp_callback(uint8_t *frame, size_t len)
     }
 
     ESP_LOGD(TAG, "RS485 frame received: %zu bytes, forwarding to TCP", len);
+
+    // Complete the request on the bus; answers to local clients stop here
+    if (bus_task_on_frame(frame, len)) {
+        return;
+    }
     
     // Check if TCP client is connected
     if (!tcp_client_task_is_connected()) {
@@ -172,19 +199,28 @@ static void rs485_frame_to_tcp_callback(uint8_t *frame, size_t len)
     if (len > 4) {  // At least addr, func, and 2 CRC bytes
         // Extract data (skip addr and func, remove CRC)
         size_t data_len = len - 4;  // Remove addr, func, and 2 CRC bytes
-        if (data_len > 0 && data_len < 500) {
-            uint8_t *modbus_data = frame + 2;  // Skip addr and func
-            
-            // Send as data transmission frame via TCP client's data handle
+        uint8_t *modbus_data = frame + 2;  // Skip addr and func (referenced in place)
+        // An exception code alone would pass for a one-byte data block. 0x88 and
+        // 0xFE replies have bit 7 set themselves and still go up as bodies
+        if ((modbus_func & 0x80) && modbus_func != MODBUS_FC_CUSTOM_88 &&
+            modbus_func != MODBUS_FC_CUSTOM_FE) {
+            data_len = len - 3;
+            modbus_data = frame + 1;
+            ESP_LOGW(TAG, "Slave 0x%02X exception 0x%02X to fc=0x%02X, forwarding to TCP",
+                     modbus_addr, frame[2], modbus_func & 0x7F);
+        }
+        if (data_len > 0) {
+            // Queue for the uplink task, which sends it as a data transmission
+            // frame; this runs on the RS485 task and must not block
             if (s_rs485_tcp_data_handle != NULL) {
-                esp_err_t ret = data_process_send(s_rs485_tcp_data_handle, 
-                                                  PROTOCOL_FC_DATA_TRANSMISSION,
-                                                  modbus_data, 
-                                                  data_len);
+                // Tag the response with the device on that slave address
+                const device_route_t *route = device_routes_by_slave(modbus_addr);
+                uint8_t device_id = (route != NULL) ? route->device_id : PROTOCOL_DEVICE_DEFAULT;
+                esp_err_t ret = uplink_task_submit(device_id, modbus_data, data_len);
                 if (ret != ESP_OK) {
-                    ESP_LOGW(TAG, "Failed to forward RS485 data to TCP: %d", ret);
+                    ESP_LOGD(TAG, "RS485 data not queued for TCP: %d", ret);
                 } else {
-                    ESP_LOGD(TAG, "Forwarded RS485 data to TCP: %zu bytes", data_len);
+                    ESP_LOGD(TAG, "Queued RS485 data for TCP: %zu bytes", data_len);
                 }
             } else {
                 // Fallback: send raw data via TCP client
@@ -196,20 +232,3 @@ static void rs485_frame_to_tcp_callback(uint8_t *frame, size_t len)
         }
     }
 }
-
-/**
- * @brief Wrapper to send data to TCP client from data processing module
- */
-static void rs485_tcp_send_wrapper(const uint8_t *data, size_t len)
-{
-    if (data == NULL || len == 0) {
-        return;
-    }
-    
-    // Forward to TCP client
-    esp_err_t ret = tcp_client_task_send(data, len);
-    if (ret != ESP_OK) {
-        ESP_LOGW(TAG, "Failed to send data to TCP client: %d", ret);
-    }
-}
-
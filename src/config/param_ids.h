@@ -14,7 +14,7 @@ extern "C" {
 #endif
 
 /**
- * @brief Parameter IDs (0-15)
+ * @brief Parameter IDs (0-19)
  * 
  * These correspond to the parameter IDs used in the original code.
  * Each parameter can be either a string or an integer value.
@@ -36,7 +36,11 @@ typedef enum {
     PARAM_ID_13 = 13, // Reserved/Unknown
     PARAM_ID_14 = 14, // IP Configuration (int)
     PARAM_ID_15 = 15, // Reserved/Unknown
-    PARAM_ID_MAX = 16
+    PARAM_ID_16 = 16, // RS485 Baud Rate (int, 0 = probe at next boot)
+    PARAM_ID_17 = 17, // RS485 Parity (int, 0=None, 1=Odd, 2=Even)
+    PARAM_ID_18 = 18, // BMS Slave Address (int, 0 = not fitted)
+    PARAM_ID_19 = 19, // Energy Meter Slave Address (int, 0 = not fitted)
+    PARAM_ID_MAX = 20
 } param_id_t;
 
 #ifdef __cplusplus
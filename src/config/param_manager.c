@@ -43,6 +43,10 @@ static const param_metadata_t s_param_metadata[PARAM_ID_MAX] = {
     [PARAM_ID_13] = {PARAM_TYPE_INT, "param_13", NULL, 0, 0, 0, 0},
     [PARAM_ID_14] = {PARAM_TYPE_INT, "ip_config", NULL, 0, 0, 1, 0}, // 0=DHCP, 1=Static
     [PARAM_ID_15] = {PARAM_TYPE_INT, "param_15", NULL, 0, 0, 0, 0},
+    [PARAM_ID_16] = {PARAM_TYPE_INT, "rs485_baud", NULL, 9600, 0, 115200, 0}, // 0=probe
+    [PARAM_ID_17] = {PARAM_TYPE_INT, "rs485_parity", NULL, 2, 0, 2, 0}, // 0=None, 1=Odd, 2=Even
+    [PARAM_ID_18] = {PARAM_TYPE_INT, "bms_addr", NULL, 0, 0, 247, 0}, // 0=not fitted
+    [PARAM_ID_19] = {PARAM_TYPE_INT, "meter_addr", NULL, 0, 0, 247, 0}, // 0=not fitted
 };
 
 /**
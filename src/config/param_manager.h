@@ -3,7 +3,7 @@
  * @brief Parameter management system
  * 
  * This module provides functions for managing device parameters stored in NVS.
- * Parameters can be strings or integers, and are identified by parameter IDs (0-15).
+ * Parameters can be strings or integers, and are identified by parameter IDs (0-19).
  * 
  * Original functions:
  * - sub_420107A4 -> param_set
@@ -45,7 +45,7 @@ esp_err_t param_manager_init(void);
  * Original: sub_420107A4 (for string parameters)
  * Sets a string parameter value. The value is validated and stored in NVS.
  * 
- * @param id Parameter ID (0-15)
+ * @param id Parameter ID (0-19)
  * @param value String value to set
  * @return ESP_OK on success, error code otherwise
  */
@@ -56,7 +56,7 @@ esp_err_t param_set_string(param_id_t id, const char *value);
  * 
  * Sets an integer parameter value. The value is validated and stored in NVS.
  * 
- * @param id Parameter ID (0-15)
+ * @param id Parameter ID (0-19)
  * @param value Integer value to set
  * @return ESP_OK on success, error code otherwise
  */
@@ -68,7 +68,7 @@ esp_err_t param_set_int(param_id_t id, int32_t value);
  * Original: sub_42010952 (for string parameters)
  * Retrieves a string parameter value from NVS or returns default if not set.
  * 
- * @param id Parameter ID (0-15)
+ * @param id Parameter ID (0-19)
  * @param value Buffer to store the value
  * @param max_len Maximum length of the buffer
  * @return ESP_OK on success, ESP_ERR_NOT_FOUND if not set, error code otherwise
@@ -81,7 +81,7 @@ esp_err_t param_get_string(param_id_t id, char *value, size_t max_len);
  * Original: sub_42010952 (for integer parameters)
  * Retrieves an integer parameter value from NVS or returns default if not set.
  * 
- * @param id Parameter ID (0-15)
+ * @param id Parameter ID (0-19)
  * @param value Pointer to store the value
  * @return ESP_OK on success, ESP_ERR_NOT_FOUND if not set, error code otherwise
  */
@@ -16,11 +16,63 @@
 extern "C" {
 #endif
 
+/**
+ * @brief CRC implementation variants
+ * 
+ * The value is the number of bytes consumed per step (and of 256-entry
+ * tables used). Select one at compile time with -DCRC16_IMPL=...
+ * Slice-by-4 is the default: it roughly halves the per-byte cost on
+ * 32-bit cores for 2 KB of flash tables; slice-by-8 adds 2 KB more.
+ */
+#define CRC16_IMPL_TABLE   1   // Original byte-at-a-time table method
+#define CRC16_IMPL_SLICE4  4   // Slice-by-4
+#define CRC16_IMPL_SLICE8  8   // Slice-by-8
+
+#ifndef CRC16_IMPL
+#define CRC16_IMPL CRC16_IMPL_SLICE4
+#endif
+
+/**
+ * @brief Streaming CRC-16 state
+ * 
+ * Lets a frame be checksummed piecewise while it is received or built.
+ */
+typedef struct {
+    uint16_t crc;
+} crc16_state_t;
+
+/**
+ * @brief Start a streaming Modbus CRC-16
+ * 
+ * @param state CRC state
+ */
+void crc16_init(crc16_state_t *state);
+
+/**
+ * @brief Feed bytes into a streaming CRC
+ * 
+ * @param state CRC state
+ * @param data Data buffer
+ * @param length Data length in bytes
+ */
+void crc16_update(crc16_state_t *state, const uint8_t *data, size_t length);
+
+/**
+ * @brief Get the CRC of all bytes fed so far
+ * 
+ * Does not modify the state, so more bytes may still be fed afterwards.
+ * 
+ * @param state CRC state
+ * @return CRC-16 value
+ */
+uint16_t crc16_final(const crc16_state_t *state);
+
 /**
  * @brief Calculate Modbus CRC-16
  * 
  * Original: sub_420157EE
  * Calculates CRC-16 for Modbus protocol using the standard polynomial.
+ * Equivalent to crc16_init() + crc16_update() + crc16_final().
  * 
  * @param data Data buffer
  * @param length Data length in bytes
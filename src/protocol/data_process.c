@@ -6,57 +6,370 @@
 #include "data_process.h"
 #include "crc_utils.h"
 #include "function_codes.h"
+#include "../utils/frame_pool.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
 static const char *TAG = "data_process";
 
+// Largest protocol frame the reassembler will hold across reads
+#define DATA_PROCESS_MAX_FRAME_SIZE   2048
+// Bytes needed before any frame length can be determined
+#define DATA_PROCESS_LENGTH_PROBE     21
+#define DATA_PROCESS_LENGTH_INVALID   ((size_t)-1)
+// Largest fixed part in front of the payload (get-param frame)
+#define DATA_PROCESS_PREFIX_MAX       22
+// 0xC2 frame with a zero data length: header(18), data_len(2), crc(2)
+#define DATA_PROCESS_ACK_FRAME_SIZE   22
+// Frames up to this size are gathered on the stack for flat send callbacks
+#define DATA_PROCESS_FLAT_STACK_SIZE  256
+
+/**
+ * @brief Unacknowledged 0xC2 frame kept for retransmission
+ */
+typedef struct {
+    frame_buf_t *frame;     // NULL once acknowledged
+    uint16_t sequence;
+} data_process_unacked_t;
+
 struct data_process_handle {
     void (*send_callback)(const uint8_t *data, size_t len);
     void (*receive_callback)(const uint8_t *data, size_t len);
+    data_process_sendv_callback_t sendv_callback;
+    uint8_t *rx_buffer;     // Partial frame carried over between reads (lazy)
+    size_t rx_len;          // Receive side only; read under stats_lock for the stats
+    data_process_rx_stats_t rx_stats;   // Guarded by stats_lock
+    atomic_uint_fast32_t tx_sequence;   // Frames built on this handle
+    // Acknowledgement window (0xC2 frames in flight), enabled on demand
+    SemaphoreHandle_t window_mutex;
+    data_process_unacked_t window[DATA_PROCESS_ACK_WINDOW_MAX];
+    uint8_t window_size;
+    uint8_t window_head;    // Oldest slot
+    uint8_t window_count;   // Slots in use, including acknowledged holes
+    data_process_ack_callback_t ack_callback;
+    void *ack_ctx;
+    data_process_tx_stats_t tx_stats;   // Guarded by stats_lock
+    portMUX_TYPE stats_lock;
 };
 
 data_process_handle_t data_process_create(void (*send_callback)(const uint8_t *data, size_t len),
                                           void (*receive_callback)(const uint8_t *data, size_t len))
 {
-    struct data_process_handle *handle = malloc(sizeof(struct data_process_handle));
+    struct data_process_handle *handle = calloc(1, sizeof(struct data_process_handle));
     if (handle == NULL) {
         return NULL;
     }
 
     handle->send_callback = send_callback;
     handle->receive_callback = receive_callback;
+    atomic_init(&handle->tx_sequence, 0);
+    handle->stats_lock = (portMUX_TYPE)portMUX_INITIALIZER_UNLOCKED;
 
     return handle;
 }
 
+/**
+ * @brief Determine total length of the protocol frame at the start of a buffer
+ * 
+ * Uses the length fields in bytes 18-20 (layout depends on function code).
+ * Get-param frames have no length field: only requests, which carry no
+ * values, are received, so a get-param frame is taken to be 24 bytes. A
+ * reply with values cannot be delimited from its header and is only ever
+ * sent, never received.
+ * 
+ * @return Total frame length including CRC, 0 if more bytes are needed,
+ *         DATA_PROCESS_LENGTH_INVALID if the buffer does not start a frame
+ */
+static size_t frame_expected_length(const uint8_t *buf, size_t avail)
+{
+    if (avail >= 1 && buf[0] != 0xA1) {
+        return DATA_PROCESS_LENGTH_INVALID;
+    }
+    if (avail >= 2 && buf[1] != 0x1A) {
+        return DATA_PROCESS_LENGTH_INVALID;
+    }
+    if (avail < DATA_PROCESS_LENGTH_PROBE) {
+        return 0;
+    }
+
+    size_t total;
+    switch (buf[7]) {
+        case PROTOCOL_FC_HEARTBEAT:
+            // [header(18)][data_len(1)][crc(2)]
+            total = 21;
+            break;
+        case PROTOCOL_FC_DATA_TRANSMISSION:
+            // [header(18)][data_len(2)][data][crc(2)]
+            total = 22 + (size_t)(buf[18] | (buf[19] << 8));
+            break;
+        case PROTOCOL_FC_GET_PARAM:
+            // Request: [header(18)][param_id(2)][end_param(2)][crc(2)]
+            total = 24;
+            break;
+        case PROTOCOL_FC_SET_PARAM:
+            // [header(18)][param_id(2)][data_len(1)][data][crc(2)]
+            total = 23 + (size_t)buf[20];
+            break;
+        default:
+            return DATA_PROCESS_LENGTH_INVALID;
+    }
+
+    if (total > DATA_PROCESS_MAX_FRAME_SIZE) {
+        return DATA_PROCESS_LENGTH_INVALID;
+    }
+    return total;
+}
+
+/**
+ * @brief Find the next candidate frame start (0xA1 0x1A, or 0xA1 at the tail)
+ */
+static size_t frame_find_magic(const uint8_t *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    const uint8_t *end = buf + len;
+
+    while ((p = memchr(p, 0xA1, end - p)) != NULL) {
+        if (p + 1 == end || p[1] == 0x1A) {
+            return p - buf;
+        }
+        p++;
+    }
+    return len;
+}
+
+/**
+ * @brief Pop acknowledged slots off the front of the window
+ * 
+ * Caller holds window_mutex.
+ */
+static void data_process_window_compact(struct data_process_handle *handle)
+{
+    while (handle->window_count > 0 && handle->window[handle->window_head].frame == NULL) {
+        handle->window_head = (handle->window_head + 1) % handle->window_size;
+        handle->window_count--;
+    }
+}
+
+/**
+ * @brief Release the in-flight frame matching an acknowledged sequence number
+ */
+static void data_process_window_ack(struct data_process_handle *handle, uint16_t sequence)
+{
+    if (xSemaphoreTake(handle->window_mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+
+    bool acked = false;
+    for (uint8_t i = 0; i < handle->window_count; i++) {
+        data_process_unacked_t *slot = &handle->window[(handle->window_head + i) % handle->window_size];
+        if (slot->frame != NULL && slot->sequence == sequence) {
+            frame_buf_unref(slot->frame);
+            slot->frame = NULL;
+            portENTER_CRITICAL(&handle->stats_lock);
+            handle->tx_stats.acked++;
+            handle->tx_stats.in_flight--;
+            portEXIT_CRITICAL(&handle->stats_lock);
+            data_process_window_compact(handle);
+            acked = true;
+            break;
+        }
+    }
+
+    xSemaphoreGive(handle->window_mutex);
+
+    if (acked && handle->ack_callback != NULL) {
+        handle->ack_callback(sequence, true, handle->ack_ctx);
+    }
+}
+
+/**
+ * @brief Verify CRC of a complete frame and hand it to the receive callback
+ * 
+ * @return true if the frame was valid
+ */
+static bool frame_deliver(struct data_process_handle *handle, const uint8_t *frame, size_t len)
+{
+    uint16_t calculated_crc = modbus_crc16(frame, len - 2);
+    uint16_t frame_crc = frame[len - 2] | (frame[len - 1] << 8);
+    if (calculated_crc != frame_crc) {
+        portENTER_CRITICAL(&handle->stats_lock);
+        handle->rx_stats.crc_errors++;
+        portEXIT_CRITICAL(&handle->stats_lock);
+        ESP_LOGW(TAG, "Frame CRC mismatch: func_code=0x%02X, len=%zu", frame[7], len);
+        return false;
+    }
+
+    portENTER_CRITICAL(&handle->stats_lock);
+    handle->rx_stats.frames++;
+    portEXIT_CRITICAL(&handle->stats_lock);
+    // An ack is a 0xC2 frame with no data; frames carrying data are commands
+    if (handle->window_size > 0 && frame[7] == PROTOCOL_FC_DATA_TRANSMISSION &&
+        len == DATA_PROCESS_ACK_FRAME_SIZE) {
+        data_process_window_ack(handle, frame[2] | (frame[3] << 8));
+    }
+    if (handle->receive_callback != NULL) {
+        handle->receive_callback(frame, len);
+    }
+    return true;
+}
+
+/**
+ * @brief Deliver every complete frame found in a contiguous buffer
+ * 
+ * Frames are passed to the callback in place. Stops at the first incomplete
+ * frame and returns the number of bytes consumed.
+ */
+static size_t frame_scan(struct data_process_handle *handle, const uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+        size_t skip = frame_find_magic(buf + pos, len - pos);
+        if (skip > 0) {
+            portENTER_CRITICAL(&handle->stats_lock);
+            handle->rx_stats.discarded_bytes += skip;
+            portEXIT_CRITICAL(&handle->stats_lock);
+            pos += skip;
+            continue;
+        }
+
+        size_t total = frame_expected_length(buf + pos, len - pos);
+        if (total == 0 || (total != DATA_PROCESS_LENGTH_INVALID && total > len - pos)) {
+            break;  // Partial frame, wait for more data
+        }
+
+        if (total == DATA_PROCESS_LENGTH_INVALID || !frame_deliver(handle, buf + pos, total)) {
+            // Not a frame start after all, resync from the next byte
+            portENTER_CRITICAL(&handle->stats_lock);
+            handle->rx_stats.discarded_bytes++;
+            portEXIT_CRITICAL(&handle->stats_lock);
+            pos++;
+            continue;
+        }
+        pos += total;
+    }
+
+    return pos;
+}
+
+/**
+ * @brief Drop the first byte of the carried-over buffer and resync on the next magic
+ */
+static void frame_resync_pending(struct data_process_handle *handle)
+{
+    size_t skip = 1 + frame_find_magic(handle->rx_buffer + 1, handle->rx_len - 1);
+    portENTER_CRITICAL(&handle->stats_lock);
+    handle->rx_stats.discarded_bytes += skip;
+    portEXIT_CRITICAL(&handle->stats_lock);
+    handle->rx_len -= skip;
+    memmove(handle->rx_buffer, handle->rx_buffer + skip, handle->rx_len);
+}
+
 esp_err_t data_process_receive(data_process_handle_t handle, const uint8_t *data, size_t len)
 {
     if (handle == NULL || data == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    // Process received data and call callback
-    if (handle->receive_callback != NULL) {
-        handle->receive_callback(data, len);
+    // Complete a frame left over from a previous read, copying only what it needs
+    while (handle->rx_len > 0) {
+        size_t total = frame_expected_length(handle->rx_buffer, handle->rx_len);
+        if (total == DATA_PROCESS_LENGTH_INVALID) {
+            frame_resync_pending(handle);
+            continue;
+        }
+
+        size_t target = (total == 0) ? DATA_PROCESS_LENGTH_PROBE : total;
+        if (handle->rx_len < target) {
+            if (len == 0) {
+                return ESP_OK;
+            }
+            size_t take = target - handle->rx_len;
+            if (take > len) {
+                take = len;
+            }
+            memcpy(handle->rx_buffer + handle->rx_len, data, take);
+            handle->rx_len += take;
+            data += take;
+            len -= take;
+            continue;
+        }
+
+        if (!frame_deliver(handle, handle->rx_buffer, total)) {
+            frame_resync_pending(handle);
+            continue;
+        }
+        // Anything past the frame is still pending
+        handle->rx_len -= total;
+        memmove(handle->rx_buffer, handle->rx_buffer + total, handle->rx_len);
+    }
+
+    // Deliver complete frames straight from the caller's buffer
+    size_t consumed = frame_scan(handle, data, len);
+    if (consumed == len) {
+        return ESP_OK;
+    }
+
+    // Carry the partial tail over to the next read
+    if (handle->rx_buffer == NULL) {
+        handle->rx_buffer = malloc(DATA_PROCESS_MAX_FRAME_SIZE);
+        if (handle->rx_buffer == NULL) {
+            ESP_LOGE(TAG, "Failed to allocate reassembly buffer");
+            portENTER_CRITICAL(&handle->stats_lock);
+            handle->rx_stats.discarded_bytes += len - consumed;
+            portEXIT_CRITICAL(&handle->stats_lock);
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    memcpy(handle->rx_buffer, data + consumed, len - consumed);
+    handle->rx_len = len - consumed;
+
+    return ESP_OK;
+}
+
+esp_err_t data_process_get_rx_stats(data_process_handle_t handle, data_process_rx_stats_t *stats)
+{
+    if (handle == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
     }
 
+    portENTER_CRITICAL(&handle->stats_lock);
+    *stats = handle->rx_stats;
+    stats->pending_bytes = handle->rx_len;
+    portEXIT_CRITICAL(&handle->stats_lock);
     return ESP_OK;
 }
 
-// Protocol frame sequence number (incremented for each frame)
-static uint16_t s_frame_sequence = 0;
+/**
+ * @brief Take the next frame sequence number for a handle
+ * 
+ * Lock-free; safe to call from several tasks. The first frame uses 0, after
+ * that the sequence runs 1..65535 and wraps skipping 0.
+ */
+static uint16_t data_process_next_sequence(struct data_process_handle *handle)
+{
+    uint32_t n = atomic_fetch_add(&handle->tx_sequence, 1);
+    if (n == 0) {
+        return 0;
+    }
+    return (uint16_t)((n - 1) % 0xFFFF + 1);
+}
 
 /**
  * @brief Build protocol frame header
  * 
  * Original: sub_42013470
  * Builds the base protocol frame header
- * Header format: [0xA1][0x1A][seq(2)][0][0][1][func_code][data(10)]
+ * Header format: [0xA1][0x1A][seq(2)][0][0][device][func_code][data(10)]
  */
-static int build_protocol_header(uint8_t *buffer, uint8_t func_code, const uint8_t *header_data)
+static int build_protocol_header(uint8_t *buffer, uint16_t sequence, uint8_t device_id,
+                                 uint8_t func_code, const uint8_t *header_data)
 {
     if (buffer == NULL) {
         return -1;
@@ -65,11 +378,11 @@ static int build_protocol_header(uint8_t *buffer, uint8_t func_code, const uint8
     // Protocol header
     buffer[0] = 0xA1;  // Protocol identifier
     buffer[1] = 0x1A;  // Protocol version/type
-    buffer[2] = s_frame_sequence & 0xFF;
-    buffer[3] = (s_frame_sequence >> 8) & 0xFF;
+    buffer[2] = sequence & 0xFF;
+    buffer[3] = (sequence >> 8) & 0xFF;
     buffer[4] = 0;
     buffer[5] = 0;
-    buffer[6] = 1;
+    buffer[PROTOCOL_DEVICE_OFFSET] = device_id;
     buffer[7] = func_code;
     
     // Copy header data (10 bytes)
@@ -79,50 +392,87 @@ static int build_protocol_header(uint8_t *buffer, uint8_t func_code, const uint8
         memset(&buffer[8], 0, 10);
     }
     
-    s_frame_sequence++;
-    if (s_frame_sequence == 0) {
-        s_frame_sequence = 1;  // Skip 0
-    }
-    
     return 0;
 }
 
+/**
+ * @brief Outgoing frame as segments: built prefix, payload in place, CRC suffix
+ */
+typedef struct {
+    uint8_t prefix[DATA_PROCESS_PREFIX_MAX];
+    uint16_t prefix_len;
+    const uint8_t *payload;
+    size_t payload_len;
+    uint8_t suffix[2];
+} protocol_frame_t;
+
+/**
+ * @brief Compute the CRC over prefix and payload and store it in the suffix
+ */
+static void protocol_frame_finish(protocol_frame_t *frame)
+{
+    crc16_state_t crc_state;
+    crc16_init(&crc_state);
+    crc16_update(&crc_state, frame->prefix, frame->prefix_len);
+    if (frame->payload_len > 0) {
+        crc16_update(&crc_state, frame->payload, frame->payload_len);
+    }
+    uint16_t crc = crc16_final(&crc_state);
+    frame->suffix[0] = crc & 0xFF;
+    frame->suffix[1] = (crc >> 8) & 0xFF;
+}
+
 /**
  * @brief Build data transmission frame (function code 194)
  * 
  * Original: sub_4201357E
  * Frame format: [header(18)][data_len(2)][data][crc(2)]
  */
-static int build_data_transmission_frame(uint8_t *buffer, size_t buffer_size,
-                                         const uint8_t *data, uint16_t data_len,
-                                         uint16_t *actual_len)
+static int build_data_transmission_frame(protocol_frame_t *frame, uint16_t sequence,
+                                         uint8_t device_id, const uint8_t *data, size_t data_len)
 {
-    if (buffer == NULL || buffer_size < 20 + data_len) {
+    if (data_len > 0xFFFF || (data == NULL && data_len > 0)) {
         return -1;
     }
 
     // Build header
-    build_protocol_header(buffer, PROTOCOL_FC_DATA_TRANSMISSION, NULL);
+    build_protocol_header(frame->prefix, sequence, device_id, PROTOCOL_FC_DATA_TRANSMISSION, NULL);
     
     // Data length (bytes 18-19, little-endian)
-    buffer[18] = data_len & 0xFF;
-    buffer[19] = (data_len >> 8) & 0xFF;
+    frame->prefix[18] = data_len & 0xFF;
+    frame->prefix[19] = (data_len >> 8) & 0xFF;
+    frame->prefix_len = 20;
     
-    // Copy data
-    if (data != NULL && data_len > 0) {
-        memcpy(&buffer[20], data, data_len);
-    }
-    
-    // Calculate CRC for frame without CRC bytes
-    uint16_t frame_len = 20 + data_len;
-    uint16_t crc = modbus_crc16(buffer, frame_len);
-    buffer[frame_len] = crc & 0xFF;
-    buffer[frame_len + 1] = (crc >> 8) & 0xFF;
+    // Data is referenced in place
+    frame->payload = data;
+    frame->payload_len = data_len;
     
-    if (actual_len != NULL) {
-        *actual_len = frame_len + 2;
+    protocol_frame_finish(frame);
+    return 0;
+}
+
+/**
+ * @brief Build data delta frame (function code 197)
+ * 
+ * Same layout as a data transmission frame; the payload is an
+ * uplink_delta.h delta.
+ */
+static int build_data_delta_frame(protocol_frame_t *frame, uint16_t sequence,
+                                  uint8_t device_id, const uint8_t *data, size_t data_len)
+{
+    if (data_len > 0xFFFF || (data == NULL && data_len > 0)) {
+        return -1;
     }
-    
+
+    build_protocol_header(frame->prefix, sequence, device_id, PROTOCOL_FC_DATA_DELTA, NULL);
+    frame->prefix[18] = data_len & 0xFF;
+    frame->prefix[19] = (data_len >> 8) & 0xFF;
+    frame->prefix_len = 20;
+
+    frame->payload = data;
+    frame->payload_len = data_len;
+
+    protocol_frame_finish(frame);
     return 0;
 }
 
@@ -132,41 +482,30 @@ static int build_data_transmission_frame(uint8_t *buffer, size_t buffer_size,
  * Original: sub_420134AE
  * Frame format: [header(18)][param_id(2)][end_param(2)][data][crc(2)]
  */
-static int build_get_param_frame(uint8_t *buffer, size_t buffer_size,
-                                 uint16_t param_id, uint16_t end_param,
-                                 const uint8_t *data, uint16_t data_len,
-                                 uint16_t *actual_len)
+static int build_get_param_frame(protocol_frame_t *frame, uint16_t sequence,
+                                 uint8_t device_id, uint16_t param_id, uint16_t end_param,
+                                 const uint8_t *data, size_t data_len)
 {
-    if (buffer == NULL || buffer_size < 22 + data_len) {
+    if (data == NULL && data_len > 0) {
         return -1;
     }
 
     // Build header
-    build_protocol_header(buffer, PROTOCOL_FC_GET_PARAM, NULL);
+    build_protocol_header(frame->prefix, sequence, device_id, PROTOCOL_FC_GET_PARAM, NULL);
     
     // Parameter ID (bytes 18-19, little-endian)
-    buffer[18] = param_id & 0xFF;
-    buffer[19] = (param_id >> 8) & 0xFF;
+    frame->prefix[18] = param_id & 0xFF;
+    frame->prefix[19] = (param_id >> 8) & 0xFF;
     
     // End parameter ID (bytes 20-21, little-endian)
-    buffer[20] = end_param & 0xFF;
-    buffer[21] = (end_param >> 8) & 0xFF;
+    frame->prefix[20] = end_param & 0xFF;
+    frame->prefix[21] = (end_param >> 8) & 0xFF;
+    frame->prefix_len = 22;
     
-    // Copy data if present
-    if (data != NULL && data_len > 0) {
-        memcpy(&buffer[22], data, data_len);
-    }
-    
-    // Calculate CRC
-    uint16_t frame_len = 22 + data_len;
-    uint16_t crc = modbus_crc16(buffer, frame_len);
-    buffer[frame_len] = crc & 0xFF;
-    buffer[frame_len + 1] = (crc >> 8) & 0xFF;
-    
-    if (actual_len != NULL) {
-        *actual_len = frame_len + 2;
-    }
+    frame->payload = data;
+    frame->payload_len = data_len;
     
+    protocol_frame_finish(frame);
     return 0;
 }
 
@@ -176,40 +515,29 @@ static int build_get_param_frame(uint8_t *buffer, size_t buffer_size,
  * Original: sub_4201352C
  * Frame format: [header(18)][param_id(2)][data_len(1)][data][crc(2)]
  */
-static int build_set_param_frame(uint8_t *buffer, size_t buffer_size,
-                                 uint16_t param_id, uint8_t data_len,
-                                 const uint8_t *data,
-                                 uint16_t *actual_len)
+static int build_set_param_frame(protocol_frame_t *frame, uint16_t sequence,
+                                 uint8_t device_id, uint16_t param_id,
+                                 const uint8_t *data, size_t data_len)
 {
-    if (buffer == NULL || buffer_size < 21 + data_len) {
+    if (data_len > 0xFF || (data == NULL && data_len > 0)) {
         return -1;
     }
 
     // Build header
-    build_protocol_header(buffer, PROTOCOL_FC_SET_PARAM, NULL);
+    build_protocol_header(frame->prefix, sequence, device_id, PROTOCOL_FC_SET_PARAM, NULL);
     
     // Parameter ID (bytes 18-19, little-endian)
-    buffer[18] = param_id & 0xFF;
-    buffer[19] = (param_id >> 8) & 0xFF;
+    frame->prefix[18] = param_id & 0xFF;
+    frame->prefix[19] = (param_id >> 8) & 0xFF;
     
     // Data length (byte 20)
-    buffer[20] = data_len;
-    
-    // Copy data
-    if (data != NULL && data_len > 0) {
-        memcpy(&buffer[21], data, data_len);
-    }
+    frame->prefix[20] = (uint8_t)data_len;
+    frame->prefix_len = 21;
     
-    // Calculate CRC
-    uint16_t frame_len = 21 + data_len;
-    uint16_t crc = modbus_crc16(buffer, frame_len);
-    buffer[frame_len] = crc & 0xFF;
-    buffer[frame_len + 1] = (crc >> 8) & 0xFF;
-    
-    if (actual_len != NULL) {
-        *actual_len = frame_len + 2;
-    }
+    frame->payload = data;
+    frame->payload_len = data_len;
     
+    protocol_frame_finish(frame);
     return 0;
 }
 
@@ -219,57 +547,197 @@ static int build_set_param_frame(uint8_t *buffer, size_t buffer_size,
  * Original: sub_420135EA
  * Frame format: [header(18)][data_len(1)][crc(2)]
  */
-static int build_heartbeat_frame(uint8_t *buffer, size_t buffer_size,
-                                 uint16_t *actual_len)
+static int build_heartbeat_frame(protocol_frame_t *frame, uint16_t sequence)
 {
-    if (buffer == NULL || buffer_size < 20) {
-        return -1;
-    }
-
     // Build header
-    build_protocol_header(buffer, PROTOCOL_FC_HEARTBEAT, NULL);
+    build_protocol_header(frame->prefix, sequence, PROTOCOL_DEVICE_DEFAULT, PROTOCOL_FC_HEARTBEAT, NULL);
     
     // Data length (byte 18)
-    buffer[18] = 6;
+    frame->prefix[18] = 6;
+    frame->prefix_len = 19;
     
-    // Calculate CRC
-    uint16_t frame_len = 19;
-    uint16_t crc = modbus_crc16(buffer, frame_len);
-    buffer[frame_len] = crc & 0xFF;
-    buffer[frame_len + 1] = (crc >> 8) & 0xFF;
-    
-    if (actual_len != NULL) {
-        *actual_len = frame_len + 2;
-    }
+    frame->payload = NULL;
+    frame->payload_len = 0;
     
+    protocol_frame_finish(frame);
     return 0;
 }
 
+/**
+ * @brief Copy a segmented frame into one contiguous buffer
+ */
+static void protocol_frame_gather(const protocol_frame_t *frame, uint8_t *buffer)
+{
+    size_t frame_len = frame->prefix_len + frame->payload_len + 2;
+
+    memcpy(buffer, frame->prefix, frame->prefix_len);
+    if (frame->payload_len > 0) {
+        memcpy(&buffer[frame->prefix_len], frame->payload, frame->payload_len);
+    }
+    memcpy(&buffer[frame_len - 2], frame->suffix, 2);
+}
+
+/**
+ * @brief Gather a segmented frame into one buffer for a flat send callback
+ */
+static esp_err_t protocol_frame_send_flat(data_process_handle_t handle, const protocol_frame_t *frame)
+{
+    uint8_t stack_buffer[DATA_PROCESS_FLAT_STACK_SIZE];
+    size_t frame_len = frame->prefix_len + frame->payload_len + 2;
+    frame_buf_t *pooled = NULL;
+    uint8_t *buffer = stack_buffer;
+
+    if (frame_len > sizeof(stack_buffer)) {
+        pooled = frame_pool_alloc(frame_len);
+        if (pooled == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        buffer = pooled->data;
+    }
+
+    protocol_frame_gather(frame, buffer);
+    handle->send_callback(buffer, frame_len);
+
+    frame_buf_unref(pooled);
+    return ESP_OK;
+}
+
+/**
+ * @brief Keep a copy of an outgoing 0xC2 frame until the cloud acknowledges it
+ * 
+ * When the window is full the oldest unacknowledged frame is given up and
+ * reported to the ack callback as not acknowledged.
+ */
+static void data_process_window_track(data_process_handle_t handle, const protocol_frame_t *frame,
+                                      uint16_t sequence)
+{
+    size_t frame_len = frame->prefix_len + frame->payload_len + 2;
+    frame_buf_t *copy = frame_pool_alloc(frame_len);
+    if (copy == NULL) {
+        portENTER_CRITICAL(&handle->stats_lock);
+        handle->tx_stats.track_failures++;
+        portEXIT_CRITICAL(&handle->stats_lock);
+        return;
+    }
+    protocol_frame_gather(frame, copy->data);
+    copy->len = frame_len;
+
+    if (xSemaphoreTake(handle->window_mutex, portMAX_DELAY) != pdTRUE) {
+        frame_buf_unref(copy);
+        return;
+    }
+
+    bool evicted = false;
+    uint16_t evicted_sequence = 0;
+    if (handle->window_count == handle->window_size) {
+        data_process_unacked_t *oldest = &handle->window[handle->window_head];
+        ESP_LOGW(TAG, "Ack window full, dropping seq=%u", oldest->sequence);
+        evicted = true;
+        evicted_sequence = oldest->sequence;
+        frame_buf_unref(oldest->frame);
+        oldest->frame = NULL;
+        portENTER_CRITICAL(&handle->stats_lock);
+        handle->tx_stats.evicted++;
+        handle->tx_stats.in_flight--;
+        portEXIT_CRITICAL(&handle->stats_lock);
+        data_process_window_compact(handle);
+    }
+
+    data_process_unacked_t *slot =
+        &handle->window[(handle->window_head + handle->window_count) % handle->window_size];
+    slot->frame = copy;
+    slot->sequence = sequence;
+    handle->window_count++;
+    portENTER_CRITICAL(&handle->stats_lock);
+    handle->tx_stats.in_flight++;
+    portEXIT_CRITICAL(&handle->stats_lock);
+
+    xSemaphoreGive(handle->window_mutex);
+
+    if (evicted && handle->ack_callback != NULL) {
+        handle->ack_callback(evicted_sequence, false, handle->ack_ctx);
+    }
+}
+
+size_t data_process_iov_length(const data_process_iovec_t *iov, size_t iovcnt)
+{
+    size_t len = 0;
+    for (size_t i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+    return len;
+}
+
+size_t data_process_iov_copy(const data_process_iovec_t *iov, size_t iovcnt, size_t offset,
+                             uint8_t *dst, size_t dst_size)
+{
+    size_t copied = 0;
+    for (size_t i = 0; i < iovcnt && copied < dst_size; i++) {
+        if (offset >= iov[i].iov_len) {
+            offset -= iov[i].iov_len;
+            continue;
+        }
+        size_t n = iov[i].iov_len - offset;
+        if (n > dst_size - copied) {
+            n = dst_size - copied;
+        }
+        memcpy(dst + copied, (const uint8_t *)iov[i].iov_base + offset, n);
+        copied += n;
+        offset = 0;
+    }
+    return copied;
+}
+
+/**
+ * @brief Send an already built frame through whichever callback is set
+ */
+static void data_process_emit(data_process_handle_t handle, const uint8_t *frame, size_t len)
+{
+    if (handle->sendv_callback != NULL) {
+        data_process_iovec_t iov = {
+            .iov_base = frame,
+            .iov_len = len,
+        };
+        handle->sendv_callback(&iov, 1);
+    } else if (handle->send_callback != NULL) {
+        handle->send_callback(frame, len);
+    }
+}
+
 esp_err_t data_process_send(data_process_handle_t handle, uint8_t func_code, const uint8_t *data, size_t len)
+{
+    return data_process_send_to(handle, PROTOCOL_DEVICE_DEFAULT, func_code, data, len, NULL);
+}
+
+esp_err_t data_process_send_to(data_process_handle_t handle, uint8_t device_id, uint8_t func_code,
+                               const uint8_t *data, size_t len, uint16_t *sequence_out)
 {
     if (handle == NULL) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    if (handle->send_callback == NULL) {
+    if (handle->send_callback == NULL && handle->sendv_callback == NULL) {
         return ESP_ERR_INVALID_STATE;
     }
 
     // Build protocol frame based on function code
-    uint8_t frame_buffer[512];
-    uint16_t frame_len = 0;
+    protocol_frame_t frame;
     int ret = -1;
     uint16_t param_id = 0;
     uint16_t end_param = 0;
+    uint16_t sequence = data_process_next_sequence(handle);
     
     switch (func_code) {
         case PROTOCOL_FC_HEARTBEAT:
-            ret = build_heartbeat_frame(frame_buffer, sizeof(frame_buffer), &frame_len);
+            ret = build_heartbeat_frame(&frame, sequence);
             break;
             
         case PROTOCOL_FC_DATA_TRANSMISSION:
-            ret = build_data_transmission_frame(frame_buffer, sizeof(frame_buffer),
-                                                data, (uint16_t)len, &frame_len);
+            ret = build_data_transmission_frame(&frame, sequence, device_id, data, len);
+            break;
+
+        case PROTOCOL_FC_DATA_DELTA:
+            ret = build_data_delta_frame(&frame, sequence, device_id, data, len);
             break;
             
         case PROTOCOL_FC_GET_PARAM: {
@@ -280,11 +748,9 @@ esp_err_t data_process_send(data_process_handle_t handle, uint8_t func_code, con
             if (len >= 4) {
                 end_param = data[2] | (data[3] << 8);
             }
-            ret = build_get_param_frame(frame_buffer, sizeof(frame_buffer),
-                                       param_id, end_param,
-                                       (len > 4) ? &data[4] : NULL,
-                                       (len > 4) ? (uint16_t)(len - 4) : 0,
-                                       &frame_len);
+            ret = build_get_param_frame(&frame, sequence, device_id, param_id, end_param,
+                                        (len > 4) ? &data[4] : NULL,
+                                        (len > 4) ? len - 4 : 0);
             break;
         }
             
@@ -293,11 +759,9 @@ esp_err_t data_process_send(data_process_handle_t handle, uint8_t func_code, con
             if (len >= 2) {
                 param_id = data[0] | (data[1] << 8);
             }
-            ret = build_set_param_frame(frame_buffer, sizeof(frame_buffer),
-                                        param_id,
-                                        (len > 2) ? (uint8_t)(len - 2) : 0,
+            ret = build_set_param_frame(&frame, sequence, device_id, param_id,
                                         (len > 2) ? &data[2] : NULL,
-                                        &frame_len);
+                                        (len > 2) ? len - 2 : 0);
             break;
         }
             
@@ -311,10 +775,137 @@ esp_err_t data_process_send(data_process_handle_t handle, uint8_t func_code, con
         return ESP_FAIL;
     }
     
-    // Send frame through callback
-    handle->send_callback(frame_buffer, frame_len);
+    size_t frame_len = frame.prefix_len + frame.payload_len + 2;
+
+    if (handle->window_size > 0 && func_code == PROTOCOL_FC_DATA_TRANSMISSION) {
+        data_process_window_track(handle, &frame, sequence);
+    }
+
+    // Prefer handing the segments to the transport as-is
+    if (handle->sendv_callback != NULL) {
+        data_process_iovec_t iov[DATA_PROCESS_MAX_IOV];
+        size_t iovcnt = 0;
+        iov[iovcnt].iov_base = frame.prefix;
+        iov[iovcnt++].iov_len = frame.prefix_len;
+        if (frame.payload_len > 0) {
+            iov[iovcnt].iov_base = frame.payload;
+            iov[iovcnt++].iov_len = frame.payload_len;
+        }
+        iov[iovcnt].iov_base = frame.suffix;
+        iov[iovcnt++].iov_len = sizeof(frame.suffix);
+        handle->sendv_callback(iov, iovcnt);
+    } else {
+        esp_err_t err = protocol_frame_send_flat(handle, &frame);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to gather frame: func_code=0x%02X, len=%zu", func_code, frame_len);
+            return err;
+        }
+    }
     
-    ESP_LOGD(TAG, "Sent frame: func_code=0x%02X, len=%u", func_code, frame_len);
+    portENTER_CRITICAL(&handle->stats_lock);
+    handle->tx_stats.frames_sent++;
+    portEXIT_CRITICAL(&handle->stats_lock);
+    if (sequence_out != NULL) {
+        *sequence_out = sequence;
+    }
+    ESP_LOGD(TAG, "Sent frame: func_code=0x%02X, seq=%u, len=%zu", func_code, sequence, frame_len);
+    return ESP_OK;
+}
+
+esp_err_t data_process_enable_ack_window(data_process_handle_t handle, uint8_t depth)
+{
+    if (handle == NULL || depth == 0 || depth > DATA_PROCESS_ACK_WINDOW_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (handle->window_size != 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    handle->window_mutex = xSemaphoreCreateMutex();
+    if (handle->window_mutex == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    handle->window_head = 0;
+    handle->window_count = 0;
+    handle->window_size = depth;
+    return ESP_OK;
+}
+
+esp_err_t data_process_retransmit_unacked(data_process_handle_t handle)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (handle->window_size == 0) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Take references under the lock and send without it: a send may block on
+    // the network, and the window is needed by every other sender meanwhile
+    frame_buf_t *frames[DATA_PROCESS_ACK_WINDOW_MAX];
+    uint16_t sequences[DATA_PROCESS_ACK_WINDOW_MAX];
+    size_t count = 0;
+
+    if (xSemaphoreTake(handle->window_mutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+    for (uint8_t i = 0; i < handle->window_count; i++) {
+        data_process_unacked_t *slot = &handle->window[(handle->window_head + i) % handle->window_size];
+        if (slot->frame != NULL) {
+            frames[count] = frame_buf_ref(slot->frame);
+            sequences[count] = slot->sequence;
+            count++;
+        }
+    }
+    xSemaphoreGive(handle->window_mutex);
+
+    for (size_t i = 0; i < count; i++) {
+        ESP_LOGD(TAG, "Retransmitting seq=%u, len=%u", sequences[i], frames[i]->len);
+        data_process_emit(handle, frames[i]->data, frames[i]->len);
+        frame_buf_unref(frames[i]);
+    }
+
+    portENTER_CRITICAL(&handle->stats_lock);
+    handle->tx_stats.retransmitted += count;
+    portEXIT_CRITICAL(&handle->stats_lock);
+    return ESP_OK;
+}
+
+esp_err_t data_process_get_tx_stats(data_process_handle_t handle, data_process_tx_stats_t *stats)
+{
+    if (handle == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&handle->stats_lock);
+    *stats = handle->tx_stats;
+    portEXIT_CRITICAL(&handle->stats_lock);
+    return ESP_OK;
+}
+
+esp_err_t data_process_set_ack_callback(data_process_handle_t handle,
+                                        data_process_ack_callback_t callback, void *ctx)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    handle->ack_callback = callback;
+    handle->ack_ctx = ctx;
+    return ESP_OK;
+}
+
+esp_err_t data_process_set_sendv_callback(data_process_handle_t handle,
+                                          data_process_sendv_callback_t sendv_callback)
+{
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    handle->sendv_callback = sendv_callback;
     return ESP_OK;
 }
 
@@ -425,6 +1016,13 @@ int parse_get_param_frame(const uint8_t *frame, size_t frame_len,
 void data_process_destroy(data_process_handle_t handle)
 {
     if (handle != NULL) {
+        for (uint8_t i = 0; i < handle->window_size; i++) {
+            frame_buf_unref(handle->window[i].frame);
+        }
+        if (handle->window_mutex != NULL) {
+            vSemaphoreDelete(handle->window_mutex);
+        }
+        free(handle->rx_buffer);
         free(handle);
     }
 }
@@ -18,6 +18,7 @@
 #include "esp_err.h"
 #include "function_codes.h"
 #include <stdint.h>
+#include <stdbool.h>
 #include <stddef.h>
 
 #ifdef __cplusplus
@@ -26,10 +27,95 @@ extern "C" {
 
 typedef struct data_process_handle* data_process_handle_t;
 
+/**
+ * @brief Header byte naming the logical device a frame is for or from
+ * 
+ * Frames without routing carry PROTOCOL_DEVICE_DEFAULT (the inverter).
+ */
+#define PROTOCOL_DEVICE_OFFSET  6
+#define PROTOCOL_DEVICE_DEFAULT 1
+
+/**
+ * @brief One segment of an outgoing frame
+ */
+typedef struct {
+    const void *iov_base;
+    size_t iov_len;
+} data_process_iovec_t;
+
+/**
+ * @brief Maximum number of segments passed to a sendv callback
+ * 
+ * Frames are emitted as [header + length fields][payload][crc].
+ */
+#define DATA_PROCESS_MAX_IOV 3
+
+/**
+ * @brief Scatter-gather send callback
+ * 
+ * The segments (including the payload, which is referenced in place) are only
+ * valid for the duration of the call and must be sent in order as one frame.
+ */
+typedef void (*data_process_sendv_callback_t)(const data_process_iovec_t *iov, size_t iovcnt);
+
+/**
+ * @brief Total length of a segment list
+ * 
+ * @param iov Segment list
+ * @param iovcnt Number of segments
+ * @return Sum of the segment lengths
+ */
+size_t data_process_iov_length(const data_process_iovec_t *iov, size_t iovcnt);
+
+/**
+ * @brief Copy part of a segment list into one contiguous buffer
+ * 
+ * Copies from offset bytes into the frame until the frame ends or the
+ * buffer is full, so a frame can be gathered whole or in pieces.
+ * 
+ * @param iov Segment list
+ * @param iovcnt Number of segments
+ * @param offset Frame offset to start copying from
+ * @param dst Destination buffer
+ * @param dst_size Destination buffer size
+ * @return Bytes copied
+ */
+size_t data_process_iov_copy(const data_process_iovec_t *iov, size_t iovcnt, size_t offset,
+                             uint8_t *dst, size_t dst_size);
+
+/**
+ * @brief Maximum depth of the 0xC2 acknowledgement window
+ */
+#define DATA_PROCESS_ACK_WINDOW_MAX 8
+
+/**
+ * @brief Transmit-side statistics
+ */
+typedef struct {
+    uint32_t frames_sent;       // Frames built and handed to the transport
+    uint32_t acked;             // 0xC2 frames acknowledged by the peer
+    uint32_t retransmitted;     // 0xC2 frames resent after a reconnect
+    uint32_t evicted;           // Unacknowledged frames dropped from a full window
+    uint32_t track_failures;    // Frames not tracked for lack of memory
+    uint32_t in_flight;         // 0xC2 frames currently awaiting acknowledgement
+} data_process_tx_stats_t;
+
+/**
+ * @brief Receive-side frame reassembly statistics
+ */
+typedef struct {
+    uint32_t frames;            // Complete, CRC-valid frames delivered
+    uint32_t crc_errors;        // Frames dropped on CRC mismatch
+    uint32_t discarded_bytes;   // Bytes skipped while resyncing on 0xA1 0x1A
+    size_t pending_bytes;       // Partial frame currently held for the next read
+} data_process_rx_stats_t;
+
 /**
  * @brief Create data processing module
  * 
  * Original: sub_420116AA
+ * 
+ * Each handle numbers its own frames, so one handle per connection.
  */
 data_process_handle_t data_process_create(void (*send_callback)(const uint8_t *data, size_t len),
                                           void (*receive_callback)(const uint8_t *data, size_t len));
@@ -38,16 +124,112 @@ data_process_handle_t data_process_create(void (*send_callback)(const uint8_t *d
  * @brief Receive and process data
  * 
  * Original: sub_42010E36
+ * Accepts arbitrary stream segments. Frames are reassembled per handle,
+ * resynchronised on the 0xA1 0x1A magic, CRC-checked and passed whole to the
+ * receive callback. Frames that arrive complete are delivered in place.
  */
 esp_err_t data_process_receive(data_process_handle_t handle, const uint8_t *data, size_t len);
 
+/**
+ * @brief Get receive-side reassembly statistics
+ * 
+ * @param handle Data processing handle
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t data_process_get_rx_stats(data_process_handle_t handle, data_process_rx_stats_t *stats);
+
 /**
  * @brief Send data
  * 
  * Original: sub_42011012
+ * The payload is not copied when a sendv callback is set; otherwise the frame
+ * is gathered into one buffer for the flat send callback.
  */
 esp_err_t data_process_send(data_process_handle_t handle, uint8_t func_code, const uint8_t *data, size_t len);
 
+/**
+ * @brief Send data on behalf of a logical device
+ * 
+ * As data_process_send(), with device_id in the header instead of
+ * PROTOCOL_DEVICE_DEFAULT.
+ * 
+ * @param sequence Output header sequence number of the frame (may be NULL)
+ */
+esp_err_t data_process_send_to(data_process_handle_t handle, uint8_t device_id, uint8_t func_code,
+                               const uint8_t *data, size_t len, uint16_t *sequence);
+
+/**
+ * @brief Set a scatter-gather send callback
+ * 
+ * When set it is used instead of the flat send callback given to
+ * data_process_create().
+ * 
+ * @param handle Data processing handle
+ * @param sendv_callback Scatter-gather send callback (NULL to clear)
+ * @return ESP_OK on success
+ */
+esp_err_t data_process_set_sendv_callback(data_process_handle_t handle,
+                                          data_process_sendv_callback_t sendv_callback);
+
+/**
+ * @brief Enable the 0xC2 acknowledgement window on a handle
+ * 
+ * Each data transmission frame sent on the handle is kept until an ack is
+ * received on the same handle: a 0xC2 frame with no data (data length 0)
+ * carrying the same sequence number (bytes 2-3). 0xC2 frames with data are
+ * commands and never acknowledge anything. Frames are still sent immediately, so several can be in
+ * flight at once; when the window is full the oldest is given up.
+ * 
+ * @param handle Data processing handle
+ * @param depth Number of frames kept (1..DATA_PROCESS_ACK_WINDOW_MAX)
+ * @return ESP_OK on success
+ */
+esp_err_t data_process_enable_ack_window(data_process_handle_t handle, uint8_t depth);
+
+/**
+ * @brief Acknowledgement callback
+ * 
+ * Runs on the receiving task for each 0xC2 frame acknowledged through the
+ * window (acked true), and on the sending task for each frame given up
+ * from a full window (acked false): an acknowledgement for that frame
+ * will not be reported. Either way it must not block.
+ */
+typedef void (*data_process_ack_callback_t)(uint16_t sequence, bool acked, void *ctx);
+
+/**
+ * @brief Be told when the peer acknowledges a 0xC2 frame, or the window gives it up
+ * 
+ * Only frames tracked by the acknowledgement window are reported.
+ * 
+ * @param handle Data processing handle
+ * @param callback Callback (NULL to clear)
+ * @param ctx Passed to the callback
+ * @return ESP_OK on success
+ */
+esp_err_t data_process_set_ack_callback(data_process_handle_t handle,
+                                        data_process_ack_callback_t callback, void *ctx);
+
+/**
+ * @brief Resend every unacknowledged 0xC2 frame, oldest first
+ * 
+ * Intended to be called once a connection has been re-established. Frames
+ * keep their original sequence numbers.
+ * 
+ * @param handle Data processing handle
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if no window is enabled
+ */
+esp_err_t data_process_retransmit_unacked(data_process_handle_t handle);
+
+/**
+ * @brief Get transmit-side statistics
+ * 
+ * @param handle Data processing handle
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t data_process_get_tx_stats(data_process_handle_t handle, data_process_tx_stats_t *stats);
+
 /**
  * @brief Destroy data processing module
  * 
@@ -0,0 +1,183 @@
+/**
+ * @file device_routes.c
+ * @brief Logical device to RS485 slave routing table implementation
+ */
+
+#include "device_routes.h"
+#include "function_codes.h"
+#include "../config/param_manager.h"
+#include "../config/param_ids.h"
+#include "esp_log.h"
+
+static const char *TAG = "device_routes";
+
+#define DEVICE_ROUTE_INVERTER_ADDR  0x01
+#define DEVICE_ROUTE_MIN_ADDR       1       // Modbus unicast slave addresses
+#define DEVICE_ROUTE_MAX_ADDR       247
+
+/**
+ * @brief Inverter registers, listed the way the cloud consumes them
+ * (40-register blocks); the planner decides how they go on the wire
+ */
+static const poll_range_t s_inverter_ranges[] = {
+    { 0, MODBUS_FC_READ_INPUT_REGISTERS,     0, 40 },
+    { 0, MODBUS_FC_READ_INPUT_REGISTERS,    40, 40 },
+    { 0, MODBUS_FC_READ_INPUT_REGISTERS,    80, 40 },
+    { 0, MODBUS_FC_READ_HOLDING_REGISTERS,   0, 40 },
+    { 0, MODBUS_FC_READ_HOLDING_REGISTERS,  40, 40 },
+    { 0, MODBUS_FC_READ_HOLDING_REGISTERS,  80, 40 },
+    { 0, MODBUS_FC_READ_HOLDING_REGISTERS, 120, 40 },
+    { 0, MODBUS_FC_READ_HOLDING_REGISTERS, 160, 40 },
+};
+
+// BMS pack summary: voltages, currents, SOC/SOH, cell extremes, alarms
+static const poll_range_t s_bms_ranges[] = {
+    { 0, MODBUS_FC_READ_HOLDING_REGISTERS,   0, 48 },
+};
+
+// Energy meter measurements: per-phase and total power and energy
+static const poll_range_t s_meter_ranges[] = {
+    { 0, MODBUS_FC_READ_INPUT_REGISTERS,     0, 80 },
+};
+
+#define RANGES(r)   (r), (sizeof(r) / sizeof((r)[0]))
+
+/**
+ * @brief Known devices; slave 0 means not fitted until configured
+ */
+static const device_route_t s_route_templates[] = {
+    { DEVICE_ID_INVERTER, DEVICE_ROUTE_INVERTER_ADDR, MODBUS_FC_READ_HOLDING_REGISTERS, 1,
+      RANGES(s_inverter_ranges), "inverter" },
+    { DEVICE_ID_BMS,      0, MODBUS_FC_READ_HOLDING_REGISTERS, 2,
+      RANGES(s_bms_ranges), "bms" },
+    { DEVICE_ID_METER,    0, MODBUS_FC_READ_INPUT_REGISTERS,   1,
+      RANGES(s_meter_ranges), "meter" },
+};
+
+#define DEVICE_ROUTE_TEMPLATE_COUNT (sizeof(s_route_templates) / sizeof(s_route_templates[0]))
+
+static device_route_t s_routes[DEVICE_ROUTE_MAX];
+static size_t s_route_count = 0;
+
+/**
+ * @brief Slave address configured for an optional device
+ * 
+ * @return Address, or 0 if none is set or it is not a unicast address
+ */
+static uint8_t device_routes_configured_addr(uint8_t device_id)
+{
+    param_id_t param;
+    switch (device_id) {
+        case DEVICE_ID_BMS:
+            param = PARAM_ID_18;
+            break;
+        case DEVICE_ID_METER:
+            param = PARAM_ID_19;
+            break;
+        default:
+            return 0;
+    }
+
+    int32_t addr = 0;
+    if (param_get_int(param, &addr) != ESP_OK || addr == 0) {
+        return 0;
+    }
+    if (addr < DEVICE_ROUTE_MIN_ADDR || addr > DEVICE_ROUTE_MAX_ADDR) {
+        ESP_LOGW(TAG, "Device %u: slave address %ld out of range, ignored",
+                 device_id, (long)addr);
+        return 0;
+    }
+    return (uint8_t)addr;
+}
+
+/**
+ * @brief Load the routing table
+ */
+esp_err_t device_routes_init(void)
+{
+    s_route_count = 0;
+
+    for (size_t i = 0; i < DEVICE_ROUTE_TEMPLATE_COUNT && s_route_count < DEVICE_ROUTE_MAX; i++) {
+        device_route_t route = s_route_templates[i];
+        if (route.slave_addr == 0) {
+            route.slave_addr = device_routes_configured_addr(route.device_id);
+            if (route.slave_addr == 0) {
+                continue;
+            }
+        }
+        if (device_routes_by_slave(route.slave_addr) != NULL) {
+            ESP_LOGW(TAG, "%s: slave %u already routed, ignored", route.name, route.slave_addr);
+            continue;
+        }
+
+        s_routes[s_route_count++] = route;
+        ESP_LOGI(TAG, "Device %u (%s) -> slave %u, reads fc 0x%02X, polled every %u periods",
+                 route.device_id, route.name, route.slave_addr, route.read_fc,
+                 route.poll_every);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Route for a logical device
+ */
+const device_route_t *device_routes_by_id(uint8_t device_id)
+{
+    for (size_t i = 0; i < s_route_count; i++) {
+        if (s_routes[i].device_id == device_id) {
+            return &s_routes[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Route for the device ID of a received frame
+ */
+const device_route_t *device_routes_for_frame(uint8_t device_id)
+{
+    const device_route_t *route = device_routes_by_id(device_id);
+    if (route != NULL) {
+        return route;
+    }
+
+    // A known device that is not configured has no slave to answer for it
+    for (size_t i = 0; i < DEVICE_ROUTE_TEMPLATE_COUNT; i++) {
+        if (s_route_templates[i].device_id == device_id) {
+            return NULL;
+        }
+    }
+
+    ESP_LOGD(TAG, "Unknown device %u, routed to the inverter", device_id);
+    return device_routes_by_id(DEVICE_ID_INVERTER);
+}
+
+/**
+ * @brief Route for a slave address
+ */
+const device_route_t *device_routes_by_slave(uint8_t slave_addr)
+{
+    for (size_t i = 0; i < s_route_count; i++) {
+        if (s_routes[i].slave_addr == slave_addr) {
+            return &s_routes[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Number of configured routes
+ */
+size_t device_routes_count(void)
+{
+    return s_route_count;
+}
+
+/**
+ * @brief Route by position
+ */
+const device_route_t *device_routes_at(size_t index)
+{
+    return (index < s_route_count) ? &s_routes[index] : NULL;
+}
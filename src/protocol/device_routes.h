@@ -0,0 +1,105 @@
+/**
+ * @file device_routes.h
+ * @brief Logical device to RS485 slave routing table
+ * 
+ * Cloud and local protocol frames name a logical device in header byte 6
+ * (1, the inverter, for every frame sent before routing existed). The
+ * routing table maps each device to its slave address on the shared
+ * RS485 bus, the function code used for its register reads, and the
+ * register ranges the poll sweep keeps cached for it. Devices other than
+ * the inverter are present only when their slave address is configured.
+ */
+
+#ifndef DEVICE_ROUTES_H
+#define DEVICE_ROUTES_H
+
+#include "esp_err.h"
+#include "poll_planner.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DEVICE_ROUTE_MAX            4       // Devices on one bus
+
+/**
+ * @brief Logical device IDs
+ */
+typedef enum {
+    DEVICE_ID_INVERTER = 1,     // Default route
+    DEVICE_ID_BMS = 2,
+    DEVICE_ID_METER = 3,
+} device_id_t;
+
+/**
+ * @brief One route
+ */
+typedef struct {
+    uint8_t device_id;
+    uint8_t slave_addr;
+    uint8_t read_fc;            // Function code for 0xC2/0xC3 reads
+    uint8_t poll_every;         // Sweep every Nth query period, 0 = not polled
+    const poll_range_t *poll_ranges;    // slave_addr is filled from the route
+    size_t poll_range_count;
+    const char *name;
+} device_route_t;
+
+/**
+ * @brief Load the routing table
+ * 
+ * Slave addresses of the optional devices come from PARAM_ID_18 (BMS) and
+ * PARAM_ID_19 (meter), 0 if absent. param_manager_init() must have run.
+ * 
+ * @return ESP_OK on success
+ */
+esp_err_t device_routes_init(void);
+
+/**
+ * @brief Route for a logical device
+ * 
+ * @param device_id Device ID from a protocol frame
+ * @return Route, or NULL if the device is not configured
+ */
+const device_route_t *device_routes_by_id(uint8_t device_id);
+
+/**
+ * @brief Route for the device ID of a received frame
+ * 
+ * Servers that predate device routing leave protocol header byte 6 at
+ * whatever they like; an ID no device uses gets the inverter's route, the
+ * device every frame addressed before routing existed. A known device
+ * that is not configured still gets no route.
+ * 
+ * @param device_id Device ID from a protocol frame
+ * @return Route, or NULL if the device is known but not configured
+ */
+const device_route_t *device_routes_for_frame(uint8_t device_id);
+
+/**
+ * @brief Route for a slave address
+ * 
+ * @param slave_addr Modbus slave address
+ * @return Route, or NULL if no device uses the address
+ */
+const device_route_t *device_routes_by_slave(uint8_t slave_addr);
+
+/**
+ * @brief Number of configured routes
+ */
+size_t device_routes_count(void);
+
+/**
+ * @brief Route by position
+ * 
+ * @param index 0 .. device_routes_count() - 1
+ * @return Route, or NULL if out of range
+ */
+const device_route_t *device_routes_at(size_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_ROUTES_H
@@ -23,6 +23,8 @@ typedef enum {
     // Modbus standard function codes
     MODBUS_FC_READ_HOLDING_REGISTERS = 0x03,
     MODBUS_FC_READ_INPUT_REGISTERS = 0x04,
+    MODBUS_FC_WRITE_SINGLE_REGISTER = 0x06,
+    MODBUS_FC_WRITE_MULTIPLE_REGISTERS = 0x10,
     
     // Custom function codes (from original code)
     MODBUS_FC_CUSTOM_21 = 0x21,  // Custom function code 21
@@ -35,8 +37,27 @@ typedef enum {
     PROTOCOL_FC_DATA_TRANSMISSION = 194,  // Data transmission (0xC2)
     PROTOCOL_FC_GET_PARAM = 195,      // Get parameter (0xC3)
     PROTOCOL_FC_SET_PARAM = 196,      // Set parameter (0xC4)
+    PROTOCOL_FC_DATA_DELTA = 197,     // Changed registers since a keyframe (0xC5)
 } protocol_function_code_t;
 
+/**
+ * @brief Modbus exception codes
+ * 
+ * Carried in the byte after the function code of an exception response
+ * (function code with bit 7 set).
+ */
+typedef enum {
+    MODBUS_EXC_ILLEGAL_FUNCTION = 0x01,
+    MODBUS_EXC_ILLEGAL_ADDRESS = 0x02,
+    MODBUS_EXC_ILLEGAL_VALUE = 0x03,
+    MODBUS_EXC_SLAVE_FAILURE = 0x04,
+    MODBUS_EXC_ACKNOWLEDGE = 0x05,      // Accepted, still processing
+    MODBUS_EXC_SLAVE_BUSY = 0x06,
+    MODBUS_EXC_MEMORY_PARITY = 0x08,
+    MODBUS_EXC_GATEWAY_PATH = 0x0A,
+    MODBUS_EXC_GATEWAY_TARGET = 0x0B,   // Gateway got no response from its target
+} modbus_exception_code_t;
+
 /**
  * @brief Protocol frame structure offsets
  */
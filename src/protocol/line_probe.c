@@ -0,0 +1,137 @@
+/**
+ * @file line_probe.c
+ * @brief RS485 line settings auto-probe implementation
+ */
+
+#include "line_probe.h"
+#include "modbus_protocol.h"
+#include "crc_utils.h"
+#include "function_codes.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "line_probe";
+
+#define LINE_PROBE_RESPONSE_SIZE    16
+#define LINE_PROBE_EXCEPTION_BIT    0x80
+
+// Candidate baud rates, fastest first
+static const uint32_t s_probe_bauds[] = {
+    115200, 57600, 38400, 19200, 9600,
+};
+
+#define LINE_PROBE_BAUD_COUNT   (sizeof(s_probe_bauds) / sizeof(s_probe_bauds[0]))
+
+// Parities in the order inverters most often use them
+static const line_parity_t s_probe_parities[] = {
+    LINE_PARITY_EVEN, LINE_PARITY_NONE, LINE_PARITY_ODD,
+};
+
+#define LINE_PROBE_PARITY_COUNT (sizeof(s_probe_parities) / sizeof(s_probe_parities[0]))
+
+/**
+ * @brief Check line settings
+ */
+bool line_settings_valid(const line_settings_t *line)
+{
+    return line != NULL &&
+           line->baud_rate >= LINE_PROBE_MIN_BAUD && line->baud_rate <= LINE_PROBE_MAX_BAUD &&
+           (line->parity == LINE_PARITY_NONE || line->parity == LINE_PARITY_ODD ||
+            line->parity == LINE_PARITY_EVEN);
+}
+
+/**
+ * @brief Check that a frame answers the probe read
+ */
+static bool line_probe_answered(const uint8_t *frame, size_t len, uint8_t slave_addr)
+{
+    if (len < 5 || frame[0] != slave_addr || modbus_verify_crc(frame, (uint16_t)len) != 0) {
+        return false;
+    }
+    if (frame[1] == (MODBUS_FC_READ_HOLDING_REGISTERS | LINE_PROBE_EXCEPTION_BIT)) {
+        return len == 5;
+    }
+    // addr, fc, byte count, one register, crc
+    return frame[1] == MODBUS_FC_READ_HOLDING_REGISTERS && frame[2] == 2 && len == 7;
+}
+
+/**
+ * @brief Try one candidate
+ * 
+ * Stops at the first read that goes unanswered, so a wrong setting costs
+ * a single response timeout.
+ */
+static bool line_probe_candidate(const line_probe_port_t *port, const line_settings_t *line,
+                                 const uint8_t *request, size_t request_len,
+                                 uint8_t slave_addr, line_probe_result_t *result)
+{
+    if (port->set_line(line, port->ctx) != ESP_OK) {
+        return false;
+    }
+    result->candidates++;
+
+    for (int i = 0; i < LINE_PROBE_ATTEMPTS; i++) {
+        uint8_t response[LINE_PROBE_RESPONSE_SIZE];
+        size_t response_len = 0;
+
+        result->exchanges++;
+        if (port->exchange(request, request_len, response, sizeof(response),
+                           &response_len, port->ctx) != ESP_OK ||
+            !line_probe_answered(response, response_len, slave_addr)) {
+            ESP_LOGD(TAG, "%lu baud parity %d: no answer on read %d",
+                     (unsigned long)line->baud_rate, line->parity, i + 1);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Search for the fastest working line settings
+ */
+esp_err_t line_probe_run(const line_probe_port_t *port, uint8_t slave_addr,
+                         const line_settings_t *current, line_probe_result_t *result)
+{
+    if (port == NULL || port->set_line == NULL || port->exchange == NULL ||
+        !line_settings_valid(current) || result == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(result, 0, sizeof(*result));
+    result->line = *current;
+
+    uint8_t body[4] = {
+        (uint8_t)(LINE_PROBE_REGISTER >> 8), (uint8_t)(LINE_PROBE_REGISTER & 0xFF), 0x00, 0x01,
+    };
+    uint8_t request[8];
+    uint16_t request_len = 0;
+    if (modbus_build_frame(request, sizeof(request), slave_addr,
+                           MODBUS_FC_READ_HOLDING_REGISTERS, body, sizeof(body),
+                           &request_len) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (size_t b = 0; b < LINE_PROBE_BAUD_COUNT; b++) {
+        // The parity in use goes first; the others follow in table order
+        for (size_t p = 0; p <= LINE_PROBE_PARITY_COUNT; p++) {
+            line_settings_t line = { s_probe_bauds[b], current->parity };
+            if (p > 0) {
+                line.parity = s_probe_parities[p - 1];
+                if (line.parity == current->parity) {
+                    continue;
+                }
+            }
+            if (line_probe_candidate(port, &line, request, request_len, slave_addr, result)) {
+                result->line = line;
+                ESP_LOGI(TAG, "Accepted %lu baud parity %d after %u candidates",
+                         (unsigned long)line.baud_rate, line.parity, result->candidates);
+                return ESP_OK;
+            }
+        }
+    }
+
+    ESP_LOGW(TAG, "No candidate answered, keeping %lu baud parity %d",
+             (unsigned long)current->baud_rate, current->parity);
+    port->set_line(current, port->ctx);
+    return ESP_ERR_NOT_FOUND;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file line_probe.h
+ * @brief RS485 line settings auto-probe
+ * 
+ * Finds the fastest baud rate and parity the inverter answers on. Each
+ * candidate is tried from the fastest down with a one-register holding
+ * read; a candidate is accepted once LINE_PROBE_ATTEMPTS reads in a row
+ * come back as CRC-valid responses (a Modbus exception counts, it proves
+ * the slave decoded the request). The serial port is reached through
+ * line_probe_port_t, so the same search runs against the UART driver on
+ * the dongle and against a simulated slave on a host serial device.
+ */
+
+#ifndef LINE_PROBE_H
+#define LINE_PROBE_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LINE_PROBE_ATTEMPTS         5       // Consecutive good reads to accept a candidate
+#define LINE_PROBE_SLAVE_ADDR       0x01
+#define LINE_PROBE_REGISTER         0       // Holding register read by the probe
+#define LINE_PROBE_MIN_BAUD         1200
+#define LINE_PROBE_MAX_BAUD         115200
+
+/**
+ * @brief Parity (8 data bits; no parity uses 2 stop bits as Modbus RTU requires)
+ */
+typedef enum {
+    LINE_PARITY_NONE = 0,
+    LINE_PARITY_ODD = 1,
+    LINE_PARITY_EVEN = 2,
+} line_parity_t;
+
+/**
+ * @brief Serial line settings
+ */
+typedef struct {
+    uint32_t baud_rate;
+    line_parity_t parity;
+} line_settings_t;
+
+/**
+ * @brief Serial port used by the probe
+ */
+typedef struct {
+    /**
+     * Switch the port to new settings.
+     */
+    esp_err_t (*set_line)(const line_settings_t *line, void *ctx);
+
+    /**
+     * Send a request frame and return the first frame received in reply,
+     * ESP_ERR_TIMEOUT if nothing arrived in time.
+     */
+    esp_err_t (*exchange)(const uint8_t *request, size_t request_len,
+                          uint8_t *response, size_t response_size,
+                          size_t *response_len, void *ctx);
+
+    void *ctx;
+} line_probe_port_t;
+
+/**
+ * @brief Probe result
+ */
+typedef struct {
+    line_settings_t line;       // Accepted settings (the original ones on failure)
+    uint8_t candidates;         // Settings tried
+    uint16_t exchanges;         // Requests sent
+} line_probe_result_t;
+
+/**
+ * @brief Check line settings
+ * 
+ * @param line Settings
+ * @return true if the baud rate and parity are usable
+ */
+bool line_settings_valid(const line_settings_t *line);
+
+/**
+ * @brief Search for the fastest working line settings
+ * 
+ * Leaves the port on the accepted settings, or back on current if no
+ * candidate passed.
+ * 
+ * @param port Serial port
+ * @param slave_addr Slave to probe
+ * @param current Settings in use, tried first among equal baud rates
+ * @param result Output result
+ * @return ESP_OK if a candidate passed, ESP_ERR_NOT_FOUND if none did
+ */
+esp_err_t line_probe_run(const line_probe_port_t *port, uint8_t slave_addr,
+                         const line_settings_t *current, line_probe_result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LINE_PROBE_H
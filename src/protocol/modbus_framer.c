@@ -0,0 +1,166 @@
+/**
+ * @file modbus_framer.c
+ * @brief Incremental Modbus RTU frame delimiter implementation
+ */
+
+#include "modbus_framer.h"
+#include "modbus_protocol.h"
+#include "crc_utils.h"
+#include <string.h>
+#include <stdbool.h>
+
+/**
+ * @brief Initialize a framer over a caller-provided buffer
+ */
+void modbus_framer_init(modbus_framer_t *framer, uint8_t *buffer, size_t size,
+                        modbus_framer_callback_t callback, void *ctx)
+{
+    memset(framer, 0, sizeof(*framer));
+    framer->buffer = buffer;
+    framer->size = size;
+    framer->callback = callback;
+    framer->ctx = ctx;
+}
+
+/**
+ * @brief Deliver a frame to the callback
+ */
+static void modbus_framer_emit(modbus_framer_t *framer, uint8_t *frame, size_t len)
+{
+    if (framer->callback != NULL) {
+        framer->callback(frame, len, framer->ctx);
+    }
+}
+
+/**
+ * @brief Scan pending bytes and deliver every CRC-valid frame
+ * 
+ * Bytes in front of a valid frame are treated as noise. Without a gap, an
+ * incomplete candidate at the head is kept so it can complete on the next
+ * read; on a gap everything left over is dropped.
+ */
+static void modbus_framer_scan(modbus_framer_t *framer, bool at_gap)
+{
+    uint8_t *buf = framer->buffer;
+    size_t head = 0;  // First byte not yet delivered or discarded
+    size_t pos = 0;   // Candidate frame start
+
+    while (pos < framer->len) {
+        size_t avail = framer->len - pos;
+        size_t frame_len = modbus_rtu_response_length(&buf[pos], avail);
+
+        if (frame_len != MODBUS_RTU_LENGTH_INVALID && frame_len != 0 && frame_len <= avail) {
+            if (modbus_verify_crc(&buf[pos], frame_len) == 0) {
+                framer->stats.discarded_bytes += pos - head;
+                framer->stats.frames++;
+                modbus_framer_emit(framer, &buf[pos], frame_len);
+                pos += frame_len;
+                head = pos;
+                continue;
+            }
+            if (pos == head) {
+                framer->stats.crc_errors++;
+            }
+        }
+
+        // 0x88/0xFE have bit 7 set, so their exception responses share the
+        // function code byte; try the 5-byte exception form as well
+        if (frame_len != MODBUS_RTU_LENGTH_INVALID && frame_len != 5 &&
+            avail >= 5 && (buf[pos + 1] & 0x80) &&
+            modbus_verify_crc(&buf[pos], 5) == 0) {
+            framer->stats.discarded_bytes += pos - head;
+            framer->stats.frames++;
+            modbus_framer_emit(framer, &buf[pos], 5);
+            pos += 5;
+            head = pos;
+            continue;
+        }
+
+        // Fallback: the line went idle, so the pending bytes may be one frame
+        // the length table does not describe
+        if (at_gap && avail >= MODBUS_RTU_MIN_FRAME_SIZE &&
+            frame_len != MODBUS_RTU_LENGTH_INVALID &&
+            modbus_verify_crc(&buf[pos], avail) == 0) {
+            framer->stats.discarded_bytes += pos - head;
+            framer->stats.gap_frames++;
+            modbus_framer_emit(framer, &buf[pos], avail);
+            pos += avail;
+            head = pos;
+            continue;
+        }
+
+        pos++;
+    }
+
+    if (at_gap) {
+        framer->stats.discarded_bytes += framer->len - head;
+        head = framer->len;
+    } else if (head == 0 && framer->len == framer->size) {
+        // Full buffer and nothing delimited: make room for the next byte
+        framer->stats.overflows++;
+        head = 1;
+    }
+
+    framer->len -= head;
+    if (framer->len > 0 && head > 0) {
+        memmove(buf, &buf[head], framer->len);
+    }
+}
+
+/**
+ * @brief Get the free tail of the buffer
+ */
+uint8_t *modbus_framer_write_ptr(modbus_framer_t *framer, size_t *space)
+{
+    *space = framer->size - framer->len;
+    return &framer->buffer[framer->len];
+}
+
+/**
+ * @brief Account for bytes written at the write pointer
+ */
+void modbus_framer_commit(modbus_framer_t *framer, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    if (len > framer->size - framer->len) {
+        len = framer->size - framer->len;
+    }
+    framer->len += len;
+    modbus_framer_scan(framer, false);
+}
+
+/**
+ * @brief Copy bytes into the framer
+ */
+void modbus_framer_push(modbus_framer_t *framer, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        size_t space;
+        uint8_t *dst = modbus_framer_write_ptr(framer, &space);
+        size_t chunk = (len < space) ? len : space;
+        memcpy(dst, data, chunk);
+        modbus_framer_commit(framer, chunk);
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+/**
+ * @brief Signal an inter-frame gap
+ */
+void modbus_framer_flush(modbus_framer_t *framer)
+{
+    if (framer->len > 0) {
+        modbus_framer_scan(framer, true);
+    }
+}
+
+/**
+ * @brief Drop any pending bytes
+ */
+void modbus_framer_reset(modbus_framer_t *framer)
+{
+    framer->len = 0;
+}
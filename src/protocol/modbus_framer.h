@@ -0,0 +1,112 @@
+/**
+ * @file modbus_framer.h
+ * @brief Incremental Modbus RTU frame delimiter
+ * 
+ * Splits the RS485 byte stream into Modbus RTU frames. Frame boundaries come
+ * from the function code length table and byte-count field; the
+ * inter-character gap is only used as a fallback for frames the table cannot
+ * delimit. After noise the framer slides forward one byte at a time until a
+ * CRC-valid frame lines up, so several frames in one read, or one frame split
+ * across reads, are all recovered.
+ */
+
+#ifndef MODBUS_FRAMER_H
+#define MODBUS_FRAMER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Called for each complete, CRC-valid frame
+ * 
+ * The frame points into the framer buffer and is only valid during the call.
+ */
+typedef void (*modbus_framer_callback_t)(uint8_t *frame, size_t len, void *ctx);
+
+/**
+ * @brief Framer statistics
+ */
+typedef struct {
+    uint32_t frames;            // Frames delimited by the length table
+    uint32_t gap_frames;        // Frames delimited by the inter-character gap
+    uint32_t crc_errors;        // Candidate frames at the stream head failing CRC
+    uint32_t discarded_bytes;   // Noise bytes skipped while resyncing
+    uint32_t overflows;         // Bytes dropped because the buffer was full
+} modbus_framer_stats_t;
+
+/**
+ * @brief Framer state
+ */
+typedef struct {
+    uint8_t *buffer;
+    size_t size;
+    size_t len;
+    modbus_framer_callback_t callback;
+    void *ctx;
+    modbus_framer_stats_t stats;
+} modbus_framer_t;
+
+/**
+ * @brief Initialize a framer over a caller-provided buffer
+ * 
+ * @param framer Framer state
+ * @param buffer Receive buffer (at least one maximum-size frame, 256 bytes)
+ * @param size Buffer size
+ * @param callback Frame callback
+ * @param ctx Context passed to the callback
+ */
+void modbus_framer_init(modbus_framer_t *framer, uint8_t *buffer, size_t size,
+                        modbus_framer_callback_t callback, void *ctx);
+
+/**
+ * @brief Get the free tail of the buffer for reading directly into it
+ * 
+ * @param framer Framer state
+ * @param space Output: number of bytes that may be written
+ * @return Write pointer
+ */
+uint8_t *modbus_framer_write_ptr(modbus_framer_t *framer, size_t *space);
+
+/**
+ * @brief Account for bytes written at modbus_framer_write_ptr() and deliver frames
+ * 
+ * @param framer Framer state
+ * @param len Number of bytes written
+ */
+void modbus_framer_commit(modbus_framer_t *framer, size_t len);
+
+/**
+ * @brief Copy bytes into the framer and deliver frames
+ * 
+ * @param framer Framer state
+ * @param data Received bytes
+ * @param len Number of bytes
+ */
+void modbus_framer_push(modbus_framer_t *framer, const uint8_t *data, size_t len);
+
+/**
+ * @brief Signal an inter-frame gap (line idle)
+ * 
+ * Delivers any pending bytes that form a CRC-valid frame on their own and
+ * discards the rest.
+ * 
+ * @param framer Framer state
+ */
+void modbus_framer_flush(modbus_framer_t *framer);
+
+/**
+ * @brief Drop any pending bytes without delivering them
+ * 
+ * @param framer Framer state
+ */
+void modbus_framer_reset(modbus_framer_t *framer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODBUS_FRAMER_H
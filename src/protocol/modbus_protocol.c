@@ -6,6 +6,45 @@
 #include "modbus_protocol.h"
 #include <string.h>
 
+#define MODBUS_RTU_MAX_SLAVE_ADDR   247
+#define MODBUS_EXCEPTION_BIT        0x80
+
+/**
+ * @brief How the response length is encoded for a function code
+ */
+typedef enum {
+    MODBUS_LEN_BYTE_COUNT,  // [addr][func][byte_count][data][crc(2)]
+    MODBUS_LEN_FIXED,       // Fixed total length
+} modbus_len_kind_t;
+
+typedef struct {
+    uint8_t func_code;
+    modbus_len_kind_t kind;
+    uint8_t fixed_len;
+} modbus_len_rule_t;
+
+// Response length table for the function codes used on the bus
+static const modbus_len_rule_t s_response_len_rules[] = {
+    {MODBUS_FC_READ_HOLDING_REGISTERS, MODBUS_LEN_BYTE_COUNT, 0},
+    {MODBUS_FC_READ_INPUT_REGISTERS,   MODBUS_LEN_BYTE_COUNT, 0},
+    {MODBUS_FC_WRITE_SINGLE_REGISTER,  MODBUS_LEN_FIXED,      8},  // Echo of the request
+    {MODBUS_FC_WRITE_MULTIPLE_REGISTERS, MODBUS_LEN_FIXED,    8},  // addr, fc, start, qty, crc
+    {MODBUS_FC_CUSTOM_21,              MODBUS_LEN_BYTE_COUNT, 0},
+    {MODBUS_FC_CUSTOM_22,              MODBUS_LEN_BYTE_COUNT, 0},
+    {MODBUS_FC_CUSTOM_88,              MODBUS_LEN_BYTE_COUNT, 0},
+    {MODBUS_FC_CUSTOM_FE,              MODBUS_LEN_BYTE_COUNT, 0},
+};
+
+static const modbus_len_rule_t *modbus_find_len_rule(uint8_t func_code)
+{
+    for (size_t i = 0; i < sizeof(s_response_len_rules) / sizeof(s_response_len_rules[0]); i++) {
+        if (s_response_len_rules[i].func_code == func_code) {
+            return &s_response_len_rules[i];
+        }
+    }
+    return NULL;
+}
+
 /**
  * @brief Build a Modbus frame
  * 
@@ -50,3 +89,50 @@ int modbus_build_frame(uint8_t *buffer, size_t buffer_size,
     return 0;
 }
 
+
+/**
+ * @brief Work out the length of a Modbus RTU response from its header
+ */
+size_t modbus_rtu_response_length(const uint8_t *frame, size_t avail)
+{
+    if (avail < 1) {
+        return 0;
+    }
+    if (frame[0] == 0 || frame[0] > MODBUS_RTU_MAX_SLAVE_ADDR) {
+        return MODBUS_RTU_LENGTH_INVALID;
+    }
+    if (avail < 2) {
+        return 0;
+    }
+
+    // Exact match first: 0x88 and 0xFE are real function codes with bit 7 set
+    const modbus_len_rule_t *rule = modbus_find_len_rule(frame[1]);
+    if (rule == NULL) {
+        if ((frame[1] & MODBUS_EXCEPTION_BIT) &&
+            modbus_find_len_rule(frame[1] & ~MODBUS_EXCEPTION_BIT) != NULL) {
+            // Exception response: [addr][func|0x80][exception_code][crc(2)]
+            return 5;
+        }
+        return MODBUS_RTU_LENGTH_INVALID;
+    }
+
+    if (rule->kind == MODBUS_LEN_FIXED) {
+        return rule->fixed_len;
+    }
+    if (avail < 3) {
+        return 0;
+    }
+    return 5 + (size_t)frame[2];
+}
+
+/**
+ * @brief Check whether a function code is handled by the RS485 path
+ */
+int modbus_rtu_is_supported(uint8_t func_code)
+{
+    if (modbus_find_len_rule(func_code) != NULL) {
+        return 1;
+    }
+    return ((func_code & MODBUS_EXCEPTION_BIT) &&
+            modbus_find_len_rule(func_code & ~MODBUS_EXCEPTION_BIT) != NULL) ? 1 : 0;
+}
@@ -18,6 +18,16 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Returned by modbus_rtu_response_length() when the bytes cannot start a frame
+ */
+#define MODBUS_RTU_LENGTH_INVALID  ((size_t)-1)
+
+/**
+ * @brief Minimum Modbus RTU frame size (addr + func + 2 CRC bytes)
+ */
+#define MODBUS_RTU_MIN_FRAME_SIZE  4
+
 /**
  * @brief Build a Modbus frame
  * 
@@ -38,6 +48,28 @@ int modbus_build_frame(uint8_t *buffer, size_t buffer_size,
                        const uint8_t *data, uint16_t data_len,
                        uint16_t *actual_len);
 
+/**
+ * @brief Work out the length of a Modbus RTU response from its header
+ * 
+ * Uses the function code length table (0x03, 0x04, 0x06, 0x10, 0x21, 0x22,
+ * 0x88, 0xFE and their exception responses) and the byte-count field where
+ * present.
+ * 
+ * @param frame Start of the candidate frame
+ * @param avail Number of bytes available at frame
+ * @return Total frame length including CRC, 0 if more bytes are needed to
+ *         tell, MODBUS_RTU_LENGTH_INVALID if the bytes cannot start a response
+ */
+size_t modbus_rtu_response_length(const uint8_t *frame, size_t avail);
+
+/**
+ * @brief Check whether a function code is handled by the RS485 path
+ * 
+ * @param func_code Function code (exception bit included)
+ * @return 1 if supported, 0 otherwise
+ */
+int modbus_rtu_is_supported(uint8_t func_code);
+
 #ifdef __cplusplus
 }
 #endif
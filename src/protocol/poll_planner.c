@@ -0,0 +1,177 @@
+/**
+ * @file poll_planner.c
+ * @brief Modbus register block poll planner implementation
+ */
+
+#include "poll_planner.h"
+#include "esp_log.h"
+#include <string.h>
+
+static const char *TAG = "poll_planner";
+
+// Read request: addr, fc, start(2), count(2), crc(2)
+#define POLL_PLANNER_REQUEST_BYTES        8
+// Read response without data: addr, fc, byte count, crc(2)
+#define POLL_PLANNER_RESPONSE_OVERHEAD    5
+
+static uint32_t poll_planner_char_us(const poll_bus_timing_t *timing)
+{
+    return (uint32_t)((uint64_t)timing->bits_per_char * 1000000 / timing->baud_rate);
+}
+
+/**
+ * @brief Bus time of one read transaction
+ */
+uint32_t poll_planner_transaction_us(const poll_bus_timing_t *timing, uint16_t count)
+{
+    uint32_t char_us = poll_planner_char_us(timing);
+    uint32_t chars = POLL_PLANNER_REQUEST_BYTES + POLL_PLANNER_RESPONSE_OVERHEAD + 2 * count;
+
+    // Each frame is followed by a 3.5 character silent interval
+    return chars * char_us + 7 * char_us + timing->turnaround_us;
+}
+
+/**
+ * @brief Bus time of a list of read transactions
+ */
+uint32_t poll_planner_sweep_us(const poll_bus_timing_t *timing,
+                               const poll_range_t *ranges, size_t count)
+{
+    uint32_t total = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint16_t remaining = ranges[i].count;
+        while (remaining > POLL_PLANNER_MAX_REGISTERS) {
+            total += poll_planner_transaction_us(timing, POLL_PLANNER_MAX_REGISTERS);
+            remaining -= POLL_PLANNER_MAX_REGISTERS;
+        }
+        if (remaining > 0) {
+            total += poll_planner_transaction_us(timing, remaining);
+        }
+    }
+    return total;
+}
+
+static int poll_range_compare(const poll_range_t *a, const poll_range_t *b)
+{
+    if (a->slave_addr != b->slave_addr) {
+        return a->slave_addr - b->slave_addr;
+    }
+    if (a->func_code != b->func_code) {
+        return a->func_code - b->func_code;
+    }
+    return (int)a->start - (int)b->start;
+}
+
+/**
+ * @brief Append a request, splitting it at the register limit
+ */
+static esp_err_t poll_planner_emit(const poll_range_t *request, poll_range_t *requests,
+                                   size_t max_requests, size_t *request_count)
+{
+    poll_range_t chunk = *request;
+    uint32_t end = (uint32_t)request->start + request->count;
+    // 32 bits: a range ending at register 65535 puts end at 65536
+    uint32_t cursor = request->start;
+
+    while (cursor < end) {
+        if (*request_count >= max_requests) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        chunk.start = (uint16_t)cursor;
+        chunk.count = (end - cursor > POLL_PLANNER_MAX_REGISTERS) ?
+                      POLL_PLANNER_MAX_REGISTERS : (uint16_t)(end - cursor);
+        requests[(*request_count)++] = chunk;
+        cursor += chunk.count;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Build a poll plan
+ */
+esp_err_t poll_planner_build(const poll_range_t *ranges, size_t range_count,
+                             const poll_bus_timing_t *timing,
+                             poll_range_t *requests, size_t max_requests,
+                             size_t *request_count)
+{
+    if (ranges == NULL || timing == NULL || requests == NULL || request_count == NULL ||
+        range_count > POLL_PLANNER_MAX_RANGES || timing->baud_rate == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *request_count = 0;
+    if (range_count == 0) {
+        return ESP_OK;
+    }
+
+    // Insertion sort: the list is short and usually nearly ordered already
+    poll_range_t sorted[POLL_PLANNER_MAX_RANGES];
+    memcpy(sorted, ranges, range_count * sizeof(poll_range_t));
+    for (size_t i = 1; i < range_count; i++) {
+        poll_range_t key = sorted[i];
+        size_t j = i;
+        while (j > 0 && poll_range_compare(&sorted[j - 1], &key) > 0) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = key;
+    }
+
+    // A gap is worth reading through when its two bytes per register on
+    // the wire cost less than the fixed part of a separate transaction
+    uint32_t char_us = poll_planner_char_us(timing);
+    uint32_t round_trip_us = poll_planner_transaction_us(timing, 0);
+    uint32_t max_bridge = (char_us > 0) ? round_trip_us / (2 * char_us) : 0;
+
+    poll_range_t current = sorted[0];
+    uint32_t current_end = (uint32_t)current.start + current.count;
+    esp_err_t ret;
+
+    for (size_t i = 1; i < range_count; i++) {
+        const poll_range_t *next = &sorted[i];
+        uint32_t next_end = (uint32_t)next->start + next->count;
+
+        if (next->slave_addr == current.slave_addr && next->func_code == current.func_code) {
+            uint32_t gap = (next->start > current_end) ? next->start - current_end : 0;
+            uint32_t merged_end = (next_end > current_end) ? next_end : current_end;
+
+            // Overlapping and adjacent ranges always merge; gaps only
+            // within the register limit
+            if (next->start <= current_end ||
+                (gap < max_bridge && merged_end - current.start <= POLL_PLANNER_MAX_REGISTERS)) {
+                current_end = merged_end;
+
+                // Send full blocks off now so later gaps are judged against
+                // the partial block that is still open
+                while (current_end - current.start > POLL_PLANNER_MAX_REGISTERS) {
+                    current.count = POLL_PLANNER_MAX_REGISTERS;
+                    ret = poll_planner_emit(&current, requests, max_requests, request_count);
+                    if (ret != ESP_OK) {
+                        return ret;
+                    }
+                    current.start += POLL_PLANNER_MAX_REGISTERS;
+                }
+                continue;
+            }
+        }
+
+        current.count = (uint16_t)(current_end - current.start);
+        ret = poll_planner_emit(&current, requests, max_requests, request_count);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        current = *next;
+        current_end = next_end;
+    }
+
+    current.count = (uint16_t)(current_end - current.start);
+    ret = poll_planner_emit(&current, requests, max_requests, request_count);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    ESP_LOGD(TAG, "Planned %zu ranges into %zu requests (bridging gaps < %lu registers)",
+             range_count, *request_count, (unsigned long)max_bridge);
+    return ESP_OK;
+}
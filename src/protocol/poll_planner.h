@@ -0,0 +1,91 @@
+/**
+ * @file poll_planner.h
+ * @brief Modbus register block poll planner
+ * 
+ * Turns the register ranges the dongle needs from the inverter into the
+ * fewest FC 0x03/0x04 read requests. Overlapping and adjacent ranges are
+ * merged; ranges separated by a gap are bridged when reading the unwanted
+ * registers costs less bus time than another request/response round trip
+ * at the configured line speed. No request exceeds the 125-register limit.
+ */
+
+#ifndef POLL_PLANNER_H
+#define POLL_PLANNER_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POLL_PLANNER_MAX_REGISTERS   125     // Modbus limit for FC 0x03/0x04
+#define POLL_PLANNER_MAX_RANGES      32
+
+/**
+ * @brief One register block to read (also used for planned requests)
+ */
+typedef struct {
+    uint8_t slave_addr;
+    uint8_t func_code;      // MODBUS_FC_READ_HOLDING_REGISTERS or _INPUT_REGISTERS
+    uint16_t start;
+    uint16_t count;
+} poll_range_t;
+
+/**
+ * @brief Bus timing model
+ */
+typedef struct {
+    uint32_t baud_rate;
+    uint8_t bits_per_char;      // Start + data + parity + stop bits (11 for 8E1)
+    uint32_t turnaround_us;     // Slave processing time between request and response
+} poll_bus_timing_t;
+
+/**
+ * @brief Build a poll plan
+ * 
+ * @param ranges Wanted register ranges, in any order (may overlap)
+ * @param range_count Number of ranges (at most POLL_PLANNER_MAX_RANGES)
+ * @param timing Bus timing used to decide which gaps to bridge
+ * @param requests Output requests, sorted by slave, function code and start
+ * @param max_requests Capacity of requests
+ * @param request_count Number of requests written
+ * @return ESP_OK on success, ESP_ERR_INVALID_SIZE if requests is too small
+ */
+esp_err_t poll_planner_build(const poll_range_t *ranges, size_t range_count,
+                             const poll_bus_timing_t *timing,
+                             poll_range_t *requests, size_t max_requests,
+                             size_t *request_count);
+
+/**
+ * @brief Bus time of one read transaction
+ * 
+ * Request frame, turnaround, response frame and the 3.5-character silent
+ * interval after each frame.
+ * 
+ * @param timing Bus timing
+ * @param count Registers read
+ * @return Time in microseconds
+ */
+uint32_t poll_planner_transaction_us(const poll_bus_timing_t *timing, uint16_t count);
+
+/**
+ * @brief Bus time of a list of read transactions
+ * 
+ * Ranges longer than POLL_PLANNER_MAX_REGISTERS are costed as the requests
+ * they would have to be split into.
+ * 
+ * @param timing Bus timing
+ * @param ranges Ranges or planned requests
+ * @param count Number of entries
+ * @return Time in microseconds
+ */
+uint32_t poll_planner_sweep_us(const poll_bus_timing_t *timing,
+                               const poll_range_t *ranges, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POLL_PLANNER_H
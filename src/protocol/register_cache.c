@@ -0,0 +1,279 @@
+/**
+ * @file register_cache.c
+ * @brief Inverter register shadow cache implementation
+ */
+
+#include "register_cache.h"
+#include "function_codes.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <stdbool.h>
+
+static const char *TAG = "register_cache";
+
+#define REGISTER_CACHE_BANK_HOLDING  0
+#define REGISTER_CACHE_BANK_INPUT    1
+#define REGISTER_CACHE_BANK_COUNT    2
+#define REGISTER_CACHE_BITMAP_WORDS  (REGISTER_CACHE_SIZE / 32)
+
+/**
+ * @brief One register bank
+ * 
+ * Values and ticks are kept in separate arrays so a block read walks
+ * contiguous memory.
+ */
+typedef struct {
+    uint16_t values[REGISTER_CACHE_SIZE];
+    TickType_t updated[REGISTER_CACHE_SIZE];
+    uint32_t valid[REGISTER_CACHE_BITMAP_WORDS];
+} register_bank_t;
+
+/**
+ * @brief Registers of one slave; slave 0 (broadcast) marks a free partition
+ */
+typedef struct {
+    uint8_t slave_addr;
+    register_bank_t banks[REGISTER_CACHE_BANK_COUNT];
+} register_partition_t;
+
+static register_partition_t s_partitions[REGISTER_CACHE_PARTITIONS];
+static TickType_t s_max_age_ticks = pdMS_TO_TICKS(REGISTER_CACHE_DEFAULT_MAX_AGE);
+static register_cache_stats_t s_stats = {0};
+static portMUX_TYPE s_cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static int register_cache_bank_index(uint8_t func_code)
+{
+    switch (func_code) {
+        case MODBUS_FC_READ_HOLDING_REGISTERS:
+            return REGISTER_CACHE_BANK_HOLDING;
+        case MODBUS_FC_READ_INPUT_REGISTERS:
+            return REGISTER_CACHE_BANK_INPUT;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief Find the bank of a slave, claiming a free partition if asked
+ * 
+ * Called with s_cache_lock held.
+ */
+static register_bank_t *register_cache_bank(uint8_t slave_addr, uint8_t func_code, bool claim)
+{
+    int bank = register_cache_bank_index(func_code);
+    if (bank < 0 || slave_addr == 0) {
+        return NULL;
+    }
+
+    register_partition_t *free_partition = NULL;
+    for (int i = 0; i < REGISTER_CACHE_PARTITIONS; i++) {
+        if (s_partitions[i].slave_addr == slave_addr) {
+            return &s_partitions[i].banks[bank];
+        }
+        if (free_partition == NULL && s_partitions[i].slave_addr == 0) {
+            free_partition = &s_partitions[i];
+        }
+    }
+
+    if (!claim || free_partition == NULL) {
+        return NULL;
+    }
+    free_partition->slave_addr = slave_addr;
+    return &free_partition->banks[bank];
+}
+
+static bool register_cache_in_range(uint16_t start, uint16_t count)
+{
+    return count > 0 && (uint32_t)start + count <= REGISTER_CACHE_SIZE;
+}
+
+/**
+ * @brief Store a block of registers
+ */
+esp_err_t register_cache_store(uint8_t slave_addr, uint8_t func_code, uint16_t start,
+                               const uint8_t *data, uint16_t count)
+{
+    if (register_cache_bank_index(func_code) < 0 || slave_addr == 0 || data == NULL ||
+        !register_cache_in_range(start, count)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+
+    portENTER_CRITICAL(&s_cache_lock);
+    register_bank_t *bank = register_cache_bank(slave_addr, func_code, true);
+    if (bank == NULL) {
+        s_stats.no_partition++;
+        portEXIT_CRITICAL(&s_cache_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t reg = start + i;
+        bank->values[reg] = (uint16_t)((data[2 * i] << 8) | data[2 * i + 1]);
+        bank->updated[reg] = now;
+        bank->valid[reg / 32] |= 1UL << (reg % 32);
+    }
+    s_stats.stores++;
+    portEXIT_CRITICAL(&s_cache_lock);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Read a block of registers
+ */
+esp_err_t register_cache_read(uint8_t slave_addr, uint8_t func_code,
+                              uint16_t start, uint16_t count,
+                              uint32_t max_age_ms, uint8_t *out)
+{
+    if (register_cache_bank_index(func_code) < 0 || out == NULL ||
+        !register_cache_in_range(start, count)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    TickType_t now = xTaskGetTickCount();
+    esp_err_t ret = ESP_OK;
+
+    portENTER_CRITICAL(&s_cache_lock);
+    TickType_t max_age = (max_age_ms > 0) ? pdMS_TO_TICKS(max_age_ms) : s_max_age_ticks;
+    register_bank_t *bank = register_cache_bank(slave_addr, func_code, false);
+    if (bank == NULL) {
+        ret = ESP_ERR_NOT_FOUND;
+    }
+
+    // Check the whole block first so a miss leaves out untouched
+    for (uint16_t i = 0; bank != NULL && i < count; i++) {
+        uint16_t reg = start + i;
+        if (!(bank->valid[reg / 32] & (1UL << (reg % 32)))) {
+            ret = ESP_ERR_NOT_FOUND;
+            break;
+        }
+        if ((TickType_t)(now - bank->updated[reg]) > max_age) {
+            ret = ESP_ERR_TIMEOUT;
+            break;
+        }
+    }
+
+    if (ret == ESP_OK) {
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t value = bank->values[start + i];
+            out[2 * i] = (uint8_t)(value >> 8);
+            out[2 * i + 1] = (uint8_t)(value & 0xFF);
+        }
+        s_stats.hits++;
+    } else if (ret == ESP_ERR_NOT_FOUND) {
+        s_stats.misses++;
+    } else {
+        s_stats.stale++;
+    }
+    portEXIT_CRITICAL(&s_cache_lock);
+
+    return ret;
+}
+
+/**
+ * @brief Answer a 0xC2 register read payload from the cache
+ */
+esp_err_t register_cache_answer_read(uint8_t slave_addr, uint8_t func_code,
+                                     const uint8_t *payload, size_t payload_len,
+                                     uint8_t *response, size_t response_size,
+                                     size_t *response_len)
+{
+    if (payload == NULL || response == NULL || response_len == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (payload_len != 4) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    uint16_t start = (uint16_t)((payload[0] << 8) | payload[1]);
+    uint16_t count = (uint16_t)((payload[2] << 8) | payload[3]);
+    if (1 + 2 * (size_t)count > response_size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    esp_err_t ret = register_cache_read(slave_addr, func_code, start, count, 0, &response[1]);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    response[0] = (uint8_t)(2 * count);
+    *response_len = 1 + 2 * (size_t)count;
+    return ESP_OK;
+}
+
+/**
+ * @brief Set the default staleness limit
+ */
+void register_cache_set_max_age(uint32_t max_age_ms)
+{
+    portENTER_CRITICAL(&s_cache_lock);
+    s_max_age_ticks = pdMS_TO_TICKS(max_age_ms);
+    portEXIT_CRITICAL(&s_cache_lock);
+
+    ESP_LOGI(TAG, "Staleness limit %lu ms", (unsigned long)max_age_ms);
+}
+
+/**
+ * @brief Mark a block of registers invalid
+ */
+void register_cache_forget(uint8_t slave_addr, uint8_t func_code,
+                           uint16_t start, uint16_t count)
+{
+    if (start >= REGISTER_CACHE_SIZE) {
+        return;
+    }
+
+    uint32_t end = (uint32_t)start + count;
+    if (end > REGISTER_CACHE_SIZE) {
+        end = REGISTER_CACHE_SIZE;
+    }
+
+    portENTER_CRITICAL(&s_cache_lock);
+    register_bank_t *bank = register_cache_bank(slave_addr, func_code, false);
+    for (uint32_t reg = start; bank != NULL && reg < end; reg++) {
+        bank->valid[reg / 32] &= ~(1UL << (reg % 32));
+    }
+    portEXIT_CRITICAL(&s_cache_lock);
+}
+
+/**
+ * @brief Mark every register invalid
+ */
+void register_cache_invalidate(void)
+{
+    portENTER_CRITICAL(&s_cache_lock);
+    for (int p = 0; p < REGISTER_CACHE_PARTITIONS; p++) {
+        for (int b = 0; b < REGISTER_CACHE_BANK_COUNT; b++) {
+            memset(s_partitions[p].banks[b].valid, 0, sizeof(s_partitions[p].banks[b].valid));
+        }
+    }
+    portEXIT_CRITICAL(&s_cache_lock);
+}
+
+/**
+ * @brief Get cache statistics
+ */
+esp_err_t register_cache_get_stats(register_cache_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_cache_lock);
+    *stats = s_stats;
+    for (int b = 0; b < REGISTER_CACHE_BANK_COUNT; b++) {
+        uint16_t valid = 0;
+        for (int p = 0; p < REGISTER_CACHE_PARTITIONS; p++) {
+            for (int w = 0; w < REGISTER_CACHE_BITMAP_WORDS; w++) {
+                valid += __builtin_popcount(s_partitions[p].banks[b].valid[w]);
+            }
+        }
+        stats->valid[b] = valid;
+    }
+    portEXIT_CRITICAL(&s_cache_lock);
+
+    return ESP_OK;
+}
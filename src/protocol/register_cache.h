@@ -0,0 +1,134 @@
+/**
+ * @file register_cache.h
+ * @brief Inverter register shadow cache
+ * 
+ * RAM copy of the input (FC 0x04) and holding (FC 0x03) registers of
+ * each slave on the bus, filled from the poll sweep. Every slave gets its
+ * own partition, claimed on the first store. Each bank is a flat array
+ * indexed by register number with a per-register update tick and a
+ * validity bitmap, so local reads can be answered without going out on
+ * the bus while the values are fresher than the staleness limit.
+ */
+
+#ifndef REGISTER_CACHE_H
+#define REGISTER_CACHE_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define REGISTER_CACHE_SIZE             256     // Registers per bank (0..255)
+#define REGISTER_CACHE_PARTITIONS       4       // Slaves cached at once
+#define REGISTER_CACHE_DEFAULT_MAX_AGE  60000   // Staleness limit until configured (ms)
+
+/**
+ * @brief Cache statistics
+ */
+typedef struct {
+    uint32_t hits;              // Reads answered from the cache
+    uint32_t misses;            // Reads with a register never stored or invalidated
+    uint32_t stale;             // Reads with a register older than the limit
+    uint32_t stores;            // Register blocks stored
+    uint32_t no_partition;      // Stores dropped because every partition was taken
+    uint16_t valid[2];          // Valid registers, all slaves: [0] holding, [1] input
+} register_cache_stats_t;
+
+/**
+ * @brief Store a block of registers
+ * 
+ * @param slave_addr Slave the registers were read from
+ * @param func_code MODBUS_FC_READ_HOLDING_REGISTERS or _INPUT_REGISTERS
+ * @param start First register
+ * @param data Register values, big-endian as on the wire (2 bytes each)
+ * @param count Number of registers
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the block is outside the
+ *         cache, ESP_ERR_NO_MEM if the slave has no partition and none is free
+ */
+esp_err_t register_cache_store(uint8_t slave_addr, uint8_t func_code, uint16_t start,
+                               const uint8_t *data, uint16_t count);
+
+/**
+ * @brief Read a block of registers
+ * 
+ * Succeeds only if every register in the block is valid and younger than
+ * the staleness limit; nothing is written to out otherwise.
+ * 
+ * @param slave_addr Slave
+ * @param func_code MODBUS_FC_READ_HOLDING_REGISTERS or _INPUT_REGISTERS
+ * @param start First register
+ * @param count Number of registers
+ * @param max_age_ms Staleness limit, 0 for the configured default
+ * @param out Register values, big-endian (2 * count bytes)
+ * @return ESP_OK on a hit, ESP_ERR_NOT_FOUND if a register is not cached,
+ *         ESP_ERR_TIMEOUT if one is stale, ESP_ERR_INVALID_ARG if out of range
+ */
+esp_err_t register_cache_read(uint8_t slave_addr, uint8_t func_code,
+                              uint16_t start, uint16_t count,
+                              uint32_t max_age_ms, uint8_t *out);
+
+/**
+ * @brief Answer a 0xC2 register read payload from the cache
+ * 
+ * The payload is a Modbus read request without address, function code
+ * and CRC (start(2), count(2), big-endian); the route supplies the slave
+ * and function code. The response is the matching Modbus response body:
+ * byte count followed by the register values.
+ * 
+ * @param slave_addr Slave
+ * @param func_code MODBUS_FC_READ_HOLDING_REGISTERS or _INPUT_REGISTERS
+ * @param payload Request payload
+ * @param payload_len Payload length (must be 4)
+ * @param response Output response body
+ * @param response_size Capacity of response
+ * @param response_len Bytes written
+ * @return ESP_OK on a hit, ESP_ERR_NOT_SUPPORTED if the payload is not a
+ *         read, otherwise as register_cache_read()
+ */
+esp_err_t register_cache_answer_read(uint8_t slave_addr, uint8_t func_code,
+                                     const uint8_t *payload, size_t payload_len,
+                                     uint8_t *response, size_t response_size,
+                                     size_t *response_len);
+
+/**
+ * @brief Set the default staleness limit
+ * 
+ * @param max_age_ms Age after which a register no longer counts as a hit
+ */
+void register_cache_set_max_age(uint32_t max_age_ms);
+
+/**
+ * @brief Mark a block of registers invalid
+ * 
+ * Used after a write, so the next read goes to the inverter instead of
+ * returning the value from before the write.
+ * 
+ * @param slave_addr Slave
+ * @param func_code MODBUS_FC_READ_HOLDING_REGISTERS or _INPUT_REGISTERS
+ * @param start First register
+ * @param count Number of registers (clipped to the cache)
+ */
+void register_cache_forget(uint8_t slave_addr, uint8_t func_code,
+                           uint16_t start, uint16_t count);
+
+/**
+ * @brief Mark every register of every slave invalid
+ */
+void register_cache_invalidate(void);
+
+/**
+ * @brief Get cache statistics
+ * 
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t register_cache_get_stats(register_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // REGISTER_CACHE_H
@@ -0,0 +1,315 @@
+/**
+ * @file uplink_batcher.c
+ * @brief Uplink frame batcher implementation
+ */
+
+#include "uplink_batcher.h"
+#include "function_codes.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+static const char *TAG = "uplink_batcher";
+
+// Offset of the function code in a protocol frame header
+#define UPLINK_BATCHER_FC_OFFSET  7
+
+struct uplink_batcher {
+    uplink_batcher_config_t config;
+    uplink_batcher_write_t write;
+    void *ctx;
+    SemaphoreHandle_t mutex;
+    esp_timer_handle_t deadline_timer;
+    TaskHandle_t flush_task;    // Woken to write the batch when the deadline expires
+    atomic_bool deadline_due;   // Set by the timer, cleared by whoever flushes
+    uint8_t *buffer;            // byte_budget bytes
+    size_t fill;
+    uplink_batcher_stats_t stats;  // Guarded by mutex
+    // Reporting interval
+    int64_t report_start_us;
+    uint32_t report_frames;
+    uint32_t report_writes;
+};
+
+/**
+ * @brief Issue one transport write and account for it
+ * 
+ * Caller holds the mutex.
+ */
+static void uplink_batcher_write(struct uplink_batcher *batcher,
+                                 const data_process_iovec_t *iov, size_t iovcnt)
+{
+    batcher->write(iov, iovcnt, batcher->ctx);
+    batcher->stats.writes++;
+    batcher->report_writes++;
+
+    int64_t now = esp_timer_get_time();
+    int64_t elapsed_us = now - batcher->report_start_us;
+    if (elapsed_us >= (int64_t)UPLINK_BATCHER_REPORT_INTERVAL_MS * 1000) {
+        float seconds = elapsed_us / 1000000.0f;
+        ESP_LOGI(TAG, "%lu frames in %lu records over %.0f s (%.2f -> %.2f records/s)",
+                 (unsigned long)batcher->report_frames, (unsigned long)batcher->report_writes,
+                 seconds, batcher->report_frames / seconds, batcher->report_writes / seconds);
+        batcher->report_start_us = now;
+        batcher->report_frames = 0;
+        batcher->report_writes = 0;
+    }
+}
+
+/**
+ * @brief Write the pending batch, if any
+ * 
+ * Caller holds the mutex.
+ */
+static void uplink_batcher_flush_locked(struct uplink_batcher *batcher)
+{
+    if (batcher->fill == 0) {
+        return;
+    }
+
+    esp_timer_stop(batcher->deadline_timer);
+    atomic_store(&batcher->deadline_due, false);
+
+    data_process_iovec_t iov = {
+        .iov_base = batcher->buffer,
+        .iov_len = batcher->fill,
+    };
+    uplink_batcher_write(batcher, &iov, 1);
+    batcher->fill = 0;
+}
+
+/**
+ * @brief Deadline timer callback (esp_timer task)
+ * 
+ * The write blocks on the transport, so it is left to the flush task; the
+ * timer only marks the batch due and wakes it.
+ */
+static void uplink_batcher_deadline_callback(void *arg)
+{
+    struct uplink_batcher *batcher = arg;
+
+    atomic_store(&batcher->deadline_due, true);
+    TaskHandle_t task = batcher->flush_task;
+    if (task != NULL) {
+        xTaskNotifyGive(task);
+    }
+}
+
+uplink_batcher_handle_t uplink_batcher_create(const uplink_batcher_config_t *config,
+                                              uplink_batcher_write_t write, void *ctx)
+{
+    if (write == NULL) {
+        return NULL;
+    }
+
+    struct uplink_batcher *batcher = calloc(1, sizeof(struct uplink_batcher));
+    if (batcher == NULL) {
+        return NULL;
+    }
+
+    if (config != NULL) {
+        batcher->config = *config;
+    } else {
+        batcher->config.deadline_ms = UPLINK_BATCHER_DEFAULT_DEADLINE_MS;
+        batcher->config.byte_budget = UPLINK_BATCHER_DEFAULT_BYTE_BUDGET;
+    }
+    if (batcher->config.deadline_ms == 0) {
+        batcher->config.deadline_ms = UPLINK_BATCHER_DEFAULT_DEADLINE_MS;
+    }
+    if (batcher->config.byte_budget == 0) {
+        batcher->config.byte_budget = UPLINK_BATCHER_DEFAULT_BYTE_BUDGET;
+    }
+    batcher->write = write;
+    batcher->ctx = ctx;
+    atomic_init(&batcher->deadline_due, false);
+
+    batcher->buffer = malloc(batcher->config.byte_budget);
+    batcher->mutex = xSemaphoreCreateMutex();
+    if (batcher->buffer == NULL || batcher->mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate batcher");
+        uplink_batcher_destroy(batcher);
+        return NULL;
+    }
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = uplink_batcher_deadline_callback,
+        .name = "uplink_batch",
+        .arg = batcher,
+        .dispatch_method = ESP_TIMER_TASK,
+        .skip_unhandled_events = true,
+    };
+    if (esp_timer_create(&timer_args, &batcher->deadline_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create deadline timer");
+        uplink_batcher_destroy(batcher);
+        return NULL;
+    }
+
+    batcher->report_start_us = esp_timer_get_time();
+
+    ESP_LOGI(TAG, "Uplink batcher created (deadline: %lu ms, budget: %zu bytes)",
+             (unsigned long)batcher->config.deadline_ms, batcher->config.byte_budget);
+    return batcher;
+}
+
+esp_err_t uplink_batcher_submitv(uplink_batcher_handle_t batcher,
+                                 const data_process_iovec_t *iov, size_t iovcnt)
+{
+    if (batcher == NULL || iov == NULL || iovcnt == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t len = 0;
+    int func_code = -1;
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (func_code < 0 && len + iov[i].iov_len > UPLINK_BATCHER_FC_OFFSET) {
+            func_code = ((const uint8_t *)iov[i].iov_base)[UPLINK_BATCHER_FC_OFFSET - len];
+        }
+        len += iov[i].iov_len;
+    }
+    bool urgent = (func_code != PROTOCOL_FC_DATA_TRANSMISSION);
+
+    if (xSemaphoreTake(batcher->mutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+
+    batcher->stats.frames++;
+    batcher->report_frames++;
+
+    if (atomic_load(&batcher->deadline_due) && batcher->fill > 0) {
+        // The flush task has not got to it yet
+        batcher->stats.deadline_flushes++;
+        uplink_batcher_flush_locked(batcher);
+    }
+
+    if (batcher->fill + len > batcher->config.byte_budget) {
+        if (batcher->fill > 0) {
+            batcher->stats.budget_flushes++;
+            uplink_batcher_flush_locked(batcher);
+        }
+        if (len > batcher->config.byte_budget) {
+            // Too big to batch; already behind everything pending
+            batcher->stats.passthrough++;
+            uplink_batcher_write(batcher, iov, iovcnt);
+            xSemaphoreGive(batcher->mutex);
+            return ESP_OK;
+        }
+    }
+
+    bool was_empty = (batcher->fill == 0);
+    batcher->fill += data_process_iov_copy(iov, iovcnt, 0, &batcher->buffer[batcher->fill], len);
+
+    if (urgent) {
+        if (!was_empty) {
+            batcher->stats.urgent_flushes++;
+        }
+        uplink_batcher_flush_locked(batcher);
+    } else if (batcher->fill == batcher->config.byte_budget) {
+        batcher->stats.budget_flushes++;
+        uplink_batcher_flush_locked(batcher);
+    } else if (was_empty) {
+        esp_timer_start_once(batcher->deadline_timer, (uint64_t)batcher->config.deadline_ms * 1000);
+    }
+
+    xSemaphoreGive(batcher->mutex);
+    return ESP_OK;
+}
+
+void uplink_batcher_set_flush_task(uplink_batcher_handle_t batcher, TaskHandle_t task)
+{
+    if (batcher == NULL) {
+        return;
+    }
+
+    batcher->flush_task = task;
+}
+
+esp_err_t uplink_batcher_service(uplink_batcher_handle_t batcher)
+{
+    if (batcher == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!atomic_load(&batcher->deadline_due)) {
+        return ESP_OK;
+    }
+
+    if (xSemaphoreTake(batcher->mutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+    if (atomic_load(&batcher->deadline_due) && batcher->fill > 0) {
+        batcher->stats.deadline_flushes++;
+        uplink_batcher_flush_locked(batcher);
+    }
+    atomic_store(&batcher->deadline_due, false);
+    xSemaphoreGive(batcher->mutex);
+    return ESP_OK;
+}
+
+esp_err_t uplink_batcher_flush(uplink_batcher_handle_t batcher)
+{
+    if (batcher == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(batcher->mutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+    uplink_batcher_flush_locked(batcher);
+    xSemaphoreGive(batcher->mutex);
+    return ESP_OK;
+}
+
+void uplink_batcher_discard(uplink_batcher_handle_t batcher)
+{
+    if (batcher == NULL) {
+        return;
+    }
+
+    if (xSemaphoreTake(batcher->mutex, portMAX_DELAY) != pdTRUE) {
+        return;
+    }
+    esp_timer_stop(batcher->deadline_timer);
+    atomic_store(&batcher->deadline_due, false);
+    if (batcher->fill > 0) {
+        ESP_LOGD(TAG, "Discarding %zu pending bytes", batcher->fill);
+    }
+    batcher->fill = 0;
+    xSemaphoreGive(batcher->mutex);
+}
+
+esp_err_t uplink_batcher_get_stats(uplink_batcher_handle_t batcher, uplink_batcher_stats_t *stats)
+{
+    if (batcher == NULL || stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(batcher->mutex, portMAX_DELAY) != pdTRUE) {
+        return ESP_FAIL;
+    }
+    *stats = batcher->stats;
+    xSemaphoreGive(batcher->mutex);
+    return ESP_OK;
+}
+
+void uplink_batcher_destroy(uplink_batcher_handle_t batcher)
+{
+    if (batcher == NULL) {
+        return;
+    }
+
+    if (batcher->deadline_timer != NULL) {
+        esp_timer_stop(batcher->deadline_timer);
+        esp_timer_delete(batcher->deadline_timer);
+    }
+    if (batcher->mutex != NULL) {
+        vSemaphoreDelete(batcher->mutex);
+    }
+    free(batcher->buffer);
+    free(batcher);
+}
@@ -0,0 +1,153 @@
+/**
+ * @file uplink_batcher.h
+ * @brief Uplink frame batcher
+ * 
+ * Sits between a data processing handle and its transport. 0xC2 data
+ * transmission frames are held for a short deadline and written together,
+ * so a register sweep leaves as one TLS record instead of one per Modbus
+ * response. Any other function code (set-param replies, heartbeats) is
+ * latency sensitive: it is appended behind whatever is pending and the
+ * batch goes out immediately. Frames are never reordered or merged; the
+ * peer's reassembler sees the same byte stream as without batching.
+ * 
+ * The deadline timer never writes: it wakes the flush task registered with
+ * uplink_batcher_set_flush_task(), which calls uplink_batcher_service().
+ */
+
+#ifndef UPLINK_BATCHER_H
+#define UPLINK_BATCHER_H
+
+#include "esp_err.h"
+#include "data_process.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UPLINK_BATCHER_DEFAULT_DEADLINE_MS   50
+#define UPLINK_BATCHER_DEFAULT_BYTE_BUDGET   1024
+#define UPLINK_BATCHER_REPORT_INTERVAL_MS    60000
+
+typedef struct uplink_batcher* uplink_batcher_handle_t;
+
+/**
+ * @brief Batcher configuration
+ */
+typedef struct {
+    uint32_t deadline_ms;       // Longest a 0xC2 frame waits for company
+    size_t byte_budget;         // Batch is written once it would exceed this
+} uplink_batcher_config_t;
+
+/**
+ * @brief Transport write callback
+ * 
+ * Called with the batcher's lock held, so writes reach the transport in
+ * submission order.
+ */
+typedef void (*uplink_batcher_write_t)(const data_process_iovec_t *iov, size_t iovcnt, void *ctx);
+
+/**
+ * @brief Batcher statistics
+ */
+typedef struct {
+    uint32_t frames;            // Frames submitted
+    uint32_t writes;            // Transport writes issued (records on TLS)
+    uint32_t deadline_flushes;  // Batches written when the deadline expired
+    uint32_t budget_flushes;    // Batches written because the budget was reached
+    uint32_t urgent_flushes;    // Batches written early for a non-0xC2 frame
+    uint32_t passthrough;       // Frames larger than the budget, written directly
+} uplink_batcher_stats_t;
+
+/**
+ * @brief Create a batcher
+ * 
+ * @param config Configuration, or NULL for the defaults
+ * @param write Transport write callback
+ * @param ctx Context passed to write
+ * @return Batcher handle, or NULL on failure
+ */
+uplink_batcher_handle_t uplink_batcher_create(const uplink_batcher_config_t *config,
+                                              uplink_batcher_write_t write, void *ctx);
+
+/**
+ * @brief Submit one frame
+ * 
+ * Has the signature of a data_process sendv callback apart from the handle.
+ * 
+ * @param batcher Batcher handle
+ * @param iov Frame segments
+ * @param iovcnt Number of segments
+ * @return ESP_OK on success
+ */
+esp_err_t uplink_batcher_submitv(uplink_batcher_handle_t batcher,
+                                 const data_process_iovec_t *iov, size_t iovcnt);
+
+/**
+ * @brief Set the task that writes batches whose deadline expired
+ * 
+ * The task is notified with xTaskNotifyGive() and must then call
+ * uplink_batcher_service(). Until one is set, an expired batch goes out
+ * with the next submitted frame.
+ * 
+ * @param batcher Batcher handle
+ * @param task Flush task
+ */
+void uplink_batcher_set_flush_task(uplink_batcher_handle_t batcher, TaskHandle_t task);
+
+/**
+ * @brief Write the pending batch if its deadline has expired
+ * 
+ * Called by the flush task after each notification; does nothing when no
+ * deadline is due.
+ * 
+ * @param batcher Batcher handle
+ * @return ESP_OK on success
+ */
+esp_err_t uplink_batcher_service(uplink_batcher_handle_t batcher);
+
+/**
+ * @brief Write out any pending frames now
+ * 
+ * @param batcher Batcher handle
+ * @return ESP_OK on success
+ */
+esp_err_t uplink_batcher_flush(uplink_batcher_handle_t batcher);
+
+/**
+ * @brief Drop pending frames without writing them
+ * 
+ * Used when the connection goes away; unacknowledged 0xC2 frames are
+ * retransmitted from the ack window after reconnecting.
+ * 
+ * @param batcher Batcher handle
+ */
+void uplink_batcher_discard(uplink_batcher_handle_t batcher);
+
+/**
+ * @brief Get batcher statistics
+ * 
+ * frames / writes is the achieved reduction in records; the batcher also
+ * logs it with per-second rates every UPLINK_BATCHER_REPORT_INTERVAL_MS.
+ * 
+ * @param batcher Batcher handle
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t uplink_batcher_get_stats(uplink_batcher_handle_t batcher, uplink_batcher_stats_t *stats);
+
+/**
+ * @brief Destroy a batcher, discarding pending frames
+ * 
+ * @param batcher Batcher handle
+ */
+void uplink_batcher_destroy(uplink_batcher_handle_t batcher);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UPLINK_BATCHER_H
@@ -0,0 +1,207 @@
+/**
+ * @file uplink_delta.c
+ * @brief Change-only encoding of polled register blocks implementation
+ */
+
+#include "uplink_delta.h"
+#include <string.h>
+
+/**
+ * @brief Find the baseline of a block
+ */
+static uplink_delta_block_t *uplink_delta_find(uplink_delta_t *delta, uint8_t device_id,
+                                               uint8_t func_code, uint16_t start, uint16_t count)
+{
+    for (int i = 0; i < UPLINK_DELTA_MAX_BLOCKS; i++) {
+        uplink_delta_block_t *block = &delta->blocks[i];
+        if (block->func_code == func_code && block->device_id == device_id &&
+            block->start == start && block->count == count) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Append an unsigned LEB128 varint
+ * 
+ * @return Bytes written, 0 if it does not fit
+ */
+static size_t uplink_delta_put_varint(uint8_t *out, size_t size, uint32_t value)
+{
+    size_t n = 0;
+    do {
+        if (n == size) {
+            return 0;
+        }
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[n++] = byte | (value ? 0x80 : 0);
+    } while (value);
+    return n;
+}
+
+/**
+ * @brief Initialize the encoder with no baselines
+ */
+void uplink_delta_init(uplink_delta_t *delta, uint32_t keyframe_ms)
+{
+    memset(delta->blocks, 0, sizeof(delta->blocks));
+    delta->keyframe_ms = (keyframe_ms > 0) ? keyframe_ms : UPLINK_DELTA_DEFAULT_KEYFRAME_MS;
+}
+
+/**
+ * @brief Decide how to send a block and encode it if a delta is worth it
+ */
+uplink_delta_kind_t uplink_delta_encode(uplink_delta_t *delta, uint8_t device_id,
+                                        uint8_t func_code, uint16_t start, uint16_t count,
+                                        const uint8_t *values, uint32_t now_ms,
+                                        uint8_t *out, size_t out_size, size_t *out_len)
+{
+    *out_len = 0;
+    if (count == 0 || count > UPLINK_DELTA_MAX_REGISTERS) {
+        return UPLINK_DELTA_KEYFRAME;
+    }
+
+    const uplink_delta_block_t *block = uplink_delta_find(delta, device_id, func_code,
+                                                          start, count);
+    if (block == NULL || !block->acked ||
+        (uint32_t)(now_ms - block->sent_ms) >= delta->keyframe_ms) {
+        return UPLINK_DELTA_KEYFRAME;
+    }
+
+    // Not worth it unless strictly smaller than the keyframe body
+    size_t limit = 1 + 2 * (size_t)count;
+    if (out_size < limit) {
+        limit = out_size;
+    }
+    if (limit < UPLINK_DELTA_HEADER_SIZE) {
+        return UPLINK_DELTA_KEYFRAME;
+    }
+
+    out[0] = block->sequence & 0xFF;
+    out[1] = (block->sequence >> 8) & 0xFF;
+    out[2] = func_code;
+    out[3] = (uint8_t)(start >> 8);
+    out[4] = (uint8_t)(start & 0xFF);
+    out[5] = (uint8_t)(count >> 8);
+    out[6] = (uint8_t)(count & 0xFF);
+    size_t len = UPLINK_DELTA_HEADER_SIZE;
+
+    uint16_t run_end = 0;   // End of the previous run
+    uint16_t reg = 0;
+    while (reg < count) {
+        uint16_t value = (uint16_t)((values[2 * reg] << 8) | values[2 * reg + 1]);
+        if (value == block->values[reg]) {
+            reg++;
+            continue;
+        }
+
+        uint16_t run_start = reg;
+        while (reg < count &&
+               (uint16_t)((values[2 * reg] << 8) | values[2 * reg + 1]) != block->values[reg]) {
+            reg++;
+        }
+
+        size_t n = uplink_delta_put_varint(&out[len], limit - len, run_start - run_end);
+        if (n == 0) {
+            return UPLINK_DELTA_KEYFRAME;
+        }
+        len += n;
+        n = uplink_delta_put_varint(&out[len], limit - len, reg - run_start);
+        if (n == 0) {
+            return UPLINK_DELTA_KEYFRAME;
+        }
+        len += n;
+        size_t bytes = 2 * (size_t)(reg - run_start);
+        if (bytes >= limit - len) {
+            return UPLINK_DELTA_KEYFRAME;
+        }
+        memcpy(&out[len], &values[2 * run_start], bytes);
+        len += bytes;
+        run_end = reg;
+    }
+
+    if (len == UPLINK_DELTA_HEADER_SIZE) {
+        return UPLINK_DELTA_UNCHANGED;
+    }
+
+    *out_len = len;
+    return UPLINK_DELTA_CHANGES;
+}
+
+/**
+ * @brief Record a keyframe handed to the cloud connection
+ */
+esp_err_t uplink_delta_keyframe_sent(uplink_delta_t *delta, uint8_t device_id,
+                                     uint8_t func_code, uint16_t start, uint16_t count,
+                                     const uint8_t *values, uint16_t sequence,
+                                     uint32_t now_ms)
+{
+    if (func_code == 0 || count == 0 || count > UPLINK_DELTA_MAX_REGISTERS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uplink_delta_block_t *block = uplink_delta_find(delta, device_id, func_code, start, count);
+    if (block != NULL && !block->acked &&
+        (uint32_t)(now_ms - block->sent_ms) < UPLINK_DELTA_ACK_TIMEOUT_MS) {
+        // Its acknowledgement may still be on the way; replacing it would orphan it
+        return ESP_OK;
+    }
+    if (block == NULL) {
+        block = uplink_delta_find(delta, 0, 0, 0, 0);
+        if (block == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    block->device_id = device_id;
+    block->func_code = func_code;
+    block->start = start;
+    block->count = count;
+    block->acked = false;
+    block->sequence = sequence;
+    block->sent_ms = now_ms;
+    for (uint16_t i = 0; i < count; i++) {
+        block->values[i] = (uint16_t)((values[2 * i] << 8) | values[2 * i + 1]);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Mark the keyframe sent with a sequence number acknowledged
+ */
+bool uplink_delta_ack(uplink_delta_t *delta, uint16_t sequence)
+{
+    for (int i = 0; i < UPLINK_DELTA_MAX_BLOCKS; i++) {
+        uplink_delta_block_t *block = &delta->blocks[i];
+        if (block->func_code != 0 && !block->acked && block->sequence == sequence) {
+            block->acked = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Drop the keyframe sent with a sequence number that will not be acknowledged
+ */
+bool uplink_delta_lost(uplink_delta_t *delta, uint16_t sequence)
+{
+    for (int i = 0; i < UPLINK_DELTA_MAX_BLOCKS; i++) {
+        uplink_delta_block_t *block = &delta->blocks[i];
+        if (block->func_code != 0 && !block->acked && block->sequence == sequence) {
+            memset(block, 0, sizeof(*block));
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Forget every baseline
+ */
+void uplink_delta_reset(uplink_delta_t *delta)
+{
+    memset(delta->blocks, 0, sizeof(delta->blocks));
+}
@@ -0,0 +1,150 @@
+/**
+ * @file uplink_delta.h
+ * @brief Change-only encoding of polled register blocks
+ * 
+ * Each polled register block is sent to the cloud either as a keyframe,
+ * the plain 0xC2 response body (byte count, register values) the cloud
+ * has always received, or as a 0xC5 delta listing only the registers
+ * that differ from the last keyframe the cloud acknowledged. Deltas are
+ * always taken against that acknowledged keyframe, never against an
+ * earlier delta, so a lost delta costs nothing but its own update.
+ * 
+ * A block is sent as a keyframe when it has no acknowledged keyframe yet,
+ * when its keyframe is older than the keyframe interval, and when the
+ * delta would not be smaller. Blocks that match their keyframe exactly
+ * are not sent at all.
+ * 
+ * Delta payload (function code 0xC5):
+ *   [base_seq(2) LE][func_code(1)][start(2) BE][count(2) BE] runs...
+ * with each run
+ *   [skip (varint)][len (varint)][len register values (2 bytes each, BE)]
+ * where skip counts the unchanged registers since the end of the previous
+ * run (or since start) and varints are unsigned LEB128. base_seq is the
+ * header sequence number of the keyframe the delta applies to; a peer
+ * that does not hold that keyframe drops the delta and waits for the
+ * next keyframe.
+ */
+
+#ifndef UPLINK_DELTA_H
+#define UPLINK_DELTA_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UPLINK_DELTA_MAX_BLOCKS         16      // Blocks with a keyframe baseline
+#define UPLINK_DELTA_MAX_REGISTERS      125     // Modbus limit for one read
+#define UPLINK_DELTA_HEADER_SIZE        7       // base_seq, func_code, start, count
+#define UPLINK_DELTA_DEFAULT_KEYFRAME_MS (15 * 60 * 1000)
+#define UPLINK_DELTA_ACK_TIMEOUT_MS     (60 * 1000)     // Outstanding keyframe given up after this
+
+/**
+ * @brief How a block is to be sent
+ */
+typedef enum {
+    UPLINK_DELTA_KEYFRAME = 0,      // Send the full body, then uplink_delta_keyframe_sent()
+    UPLINK_DELTA_CHANGES,           // Send the encoded delta
+    UPLINK_DELTA_UNCHANGED,         // Nothing to send
+} uplink_delta_kind_t;
+
+/**
+ * @brief Keyframe baseline of one block
+ */
+typedef struct {
+    uint8_t device_id;
+    uint8_t func_code;              // 0 for an unused entry
+    uint16_t start;
+    uint16_t count;
+    bool acked;                     // Cloud acknowledged the keyframe
+    uint16_t sequence;              // Header sequence number of the keyframe
+    uint32_t sent_ms;               // When the keyframe was sent
+    uint16_t values[UPLINK_DELTA_MAX_REGISTERS];
+} uplink_delta_block_t;
+
+/**
+ * @brief Encoder state
+ */
+typedef struct {
+    uplink_delta_block_t blocks[UPLINK_DELTA_MAX_BLOCKS];
+    uint32_t keyframe_ms;           // Longest a baseline is used
+} uplink_delta_t;
+
+/**
+ * @brief Initialize the encoder with no baselines
+ * 
+ * @param delta Encoder
+ * @param keyframe_ms Keyframe interval, 0 for UPLINK_DELTA_DEFAULT_KEYFRAME_MS
+ */
+void uplink_delta_init(uplink_delta_t *delta, uint32_t keyframe_ms);
+
+/**
+ * @brief Decide how to send a block and encode it if a delta is worth it
+ * 
+ * @param delta Encoder
+ * @param device_id Logical device the block belongs to
+ * @param func_code Read function code
+ * @param start First register
+ * @param count Registers (at most UPLINK_DELTA_MAX_REGISTERS)
+ * @param values Register values, big-endian (2 * count bytes)
+ * @param now_ms Current time
+ * @param out Output delta payload (UPLINK_DELTA_CHANGES only)
+ * @param out_size Capacity of out; a delta that does not fit is sent as a keyframe
+ * @param out_len Bytes written to out
+ * @return How to send the block
+ */
+uplink_delta_kind_t uplink_delta_encode(uplink_delta_t *delta, uint8_t device_id,
+                                        uint8_t func_code, uint16_t start, uint16_t count,
+                                        const uint8_t *values, uint32_t now_ms,
+                                        uint8_t *out, size_t out_size, size_t *out_len);
+
+/**
+ * @brief Record a keyframe handed to the cloud connection
+ * 
+ * The keyframe becomes the block's baseline once acknowledged. While an
+ * earlier keyframe of the block is still waiting for its acknowledgement,
+ * younger than UPLINK_DELTA_ACK_TIMEOUT_MS, that one is kept and this one
+ * is not tracked, so an acknowledgement slower than the poll period still
+ * finds its keyframe. When every baseline is taken the block is simply
+ * always sent as a keyframe.
+ * 
+ * @param sequence Header sequence number the keyframe was sent with
+ * @return ESP_OK (also when an outstanding keyframe is kept), or
+ *         ESP_ERR_NO_MEM if no baseline entry is free
+ */
+esp_err_t uplink_delta_keyframe_sent(uplink_delta_t *delta, uint8_t device_id,
+                                     uint8_t func_code, uint16_t start, uint16_t count,
+                                     const uint8_t *values, uint16_t sequence,
+                                     uint32_t now_ms);
+
+/**
+ * @brief Mark the keyframe sent with a sequence number acknowledged
+ * 
+ * @return true if a keyframe was waiting for this acknowledgement
+ */
+bool uplink_delta_ack(uplink_delta_t *delta, uint16_t sequence);
+
+/**
+ * @brief Drop the keyframe sent with a sequence number that will not be acknowledged
+ * 
+ * The block's next send is a keyframe again instead of waiting out
+ * UPLINK_DELTA_ACK_TIMEOUT_MS.
+ * 
+ * @return true if a keyframe was waiting for this acknowledgement
+ */
+bool uplink_delta_lost(uplink_delta_t *delta, uint16_t sequence);
+
+/**
+ * @brief Forget every baseline (new connection, peer state unknown)
+ */
+void uplink_delta_reset(uplink_delta_t *delta);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UPLINK_DELTA_H
@@ -5,8 +5,8 @@
  * Original: sub_4200D91E (terminal_service_init), sub_42012BB0 (command_handler)
  * 
  * Handles UART terminal commands:
- * - LPTS1-7: Set parameters
- * - LPTQ1-7: Query parameters
+ * - LPTS1-8: Set parameters
+ * - LPTQ1-8: Query parameters
  * - SHELL: Enable shell mode
  */
 
@@ -15,6 +15,8 @@
 #include "../config/param_ids.h"
 #include "../tasks/uart_rx_task.h"
 #include "../tasks/wifi_task.h"
+#include "../tasks/rs485_task.h"
+#include "../tasks/bus_task.h"
 #include "esp_log.h"
 #include "driver/uart.h"
 #include "esp_system.h"
@@ -151,6 +153,32 @@ static void cmd_lpts7(const char *args)
     }
 }
 
+/**
+ * @brief Handle LPTS8 command: Set RS485 line (param 16 and 17)
+ * Format: LPTS8:<baud>,<parity>\r\n (parity 0=None, 1=Odd, 2=Even)
+ *         LPTS8:PROBE\r\n probes the inverter and stores the fastest working line
+ */
+static void cmd_lpts8(const char *args)
+{
+    int baud;
+    int parity;
+    if (strcmp(args, "LPTS8:PROBE") == 0) {
+        terminal_send_response(bus_task_probe_line() == ESP_OK ? "OK\r\n" : "Fail\r\n");
+    } else if (sscanf(args, "LPTS8:%d,%d", &baud, &parity) == 2) {
+        // Takes effect at the next boot
+        line_settings_t line = { (uint32_t)baud, (line_parity_t)parity };
+        if (line_settings_valid(&line) &&
+            param_set_int(PARAM_ID_16, baud) == ESP_OK &&
+            param_set_int(PARAM_ID_17, parity) == ESP_OK) {
+            terminal_send_response("OK\r\n");
+        } else {
+            terminal_send_response("Fail\r\n");
+        }
+    } else {
+        terminal_send_response("Fail\r\n");
+    }
+}
+
 /**
  * @brief Handle LPTQ1 command: Query device SN (param 9)
  */
@@ -241,6 +269,21 @@ static void cmd_lptq7(const char *args)
     }
 }
 
+/**
+ * @brief Handle LPTQ8 command: Query RS485 line in use
+ */
+static void cmd_lptq8(const char *args)
+{
+    (void)args;  // Unused
+    line_settings_t line;
+    char response[MAX_RESPONSE_LEN];
+
+    rs485_task_get_line(&line);
+    snprintf(response, sizeof(response), "RS485:%lu,%d%s\r\n", (unsigned long)line.baud_rate,
+             (int)line.parity, rs485_task_needs_probe() ? ",UNPROBED" : "");
+    terminal_send_response(response);
+}
+
 /**
  * @brief Handle SHELL command: Enable shell mode
  */
@@ -290,6 +333,8 @@ static void terminal_process_command(const char *cmd, size_t len)
         cmd_lpts5(cmd_buf);
     } else if (strncmp(cmd_buf, "LPTS7:", 6) == 0) {
         cmd_lpts7(cmd_buf);
+    } else if (strncmp(cmd_buf, "LPTS8:", 6) == 0) {
+        cmd_lpts8(cmd_buf);
     } else if (strncmp(cmd_buf, "LPTQ1:", 6) == 0) {
         cmd_lptq1(cmd_buf);
     } else if (strncmp(cmd_buf, "LPTQ2:", 6) == 0) {
@@ -302,6 +347,8 @@ static void terminal_process_command(const char *cmd, size_t len)
         cmd_lptq6(cmd_buf);
     } else if (strncmp(cmd_buf, "LPTQ7:", 6) == 0) {
         cmd_lptq7(cmd_buf);
+    } else if (strncmp(cmd_buf, "LPTQ8:", 6) == 0) {
+        cmd_lptq8(cmd_buf);
     } else if (strncmp(cmd_buf, "SHELL:", 6) == 0) {
         cmd_shell(cmd_buf);
     } else {
@@ -347,7 +394,7 @@ esp_err_t terminal_service_init(void)
     uart_rx_task_set_callback(terminal_rx_callback);
 
     ESP_LOGI(TAG, "Terminal service initialized");
-    ESP_LOGI(TAG, "Supported commands: LPTS1-7, LPTQ1-7, SHELL");
+    ESP_LOGI(TAG, "Supported commands: LPTS1-8, LPTQ1-8, SHELL");
     
     return ESP_OK;
 }
@@ -4,6 +4,7 @@
  */
 
 #include "sdk_init.h"
+#include "../utils/frame_pool.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
@@ -52,6 +53,9 @@ esp_err_t sdk_init(void)
     }
     ESP_LOGI(TAG, "Network interface initialized");
 
+    // Frame buffers are shared by every transport task started after this
+    ESP_ERROR_CHECK(frame_pool_init());
+
     ESP_LOGI(TAG, "SDK initialization complete");
     return ESP_OK;
 }
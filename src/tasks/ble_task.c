@@ -14,8 +14,11 @@
 #include "ble_task.h"
 #include "../protocol/data_process.h"
 #include "../protocol/function_codes.h"
+#include "../protocol/register_cache.h"
+#include "../protocol/device_routes.h"
 #include "../config/param_manager.h"
 #include "../config/param_ids.h"
+#include "../utils/frame_pool.h"
 #include "esp_log.h"
 #include "esp_nimble_hci.h"
 #include "nimble/nimble_port.h"
@@ -35,6 +38,7 @@ static const char *TAG = "ble_task";
 #define BLE_DEVICE_NAME            "LuxWiFiDongle"
 #define BLE_SERVICE_UUID           0x1800  // Generic Access Profile
 #define BLE_CHAR_RX_UUID            0x2A00  // Device Name
+#define BLE_CACHE_RESPONSE_SIZE    251     // Byte count + 125 registers
 #define BLE_CHAR_TX_UUID            0x2A01  // Appearance
 
 // BLE characteristic handles
@@ -46,49 +50,105 @@ static uint16_t s_conn_handle = BLE_HS_CONN_HANDLE_NONE;  // Current connection
 // Forward declaration
 static int ble_gap_event(struct ble_gap_event *event, void *arg);
 
-// Static buffer for BLE TX data
-static uint8_t s_ble_tx_buffer[512];
-static size_t s_ble_tx_len = 0;
+// Last notified frame, returned when the TX characteristic is read
+static frame_buf_t *s_ble_tx_frame = NULL;
+static portMUX_TYPE s_ble_tx_lock = portMUX_INITIALIZER_UNLOCKED;
 
 /**
- * @brief BLE send callback
+ * @brief BLE scatter-gather send callback
+ * 
+ * Chains the segments into an mbuf and notifies it directly, so frame size
+ * is not limited by the read-back buffer.
  */
-static void ble_send_callback(const uint8_t *data, size_t len)
+static void ble_sendv_callback(const data_process_iovec_t *iov, size_t iovcnt)
 {
-    // Send data via BLE notify/indicate
-    if (s_conn_handle != BLE_HS_CONN_HANDLE_NONE && s_char_tx_handle != 0) {
-        // In ESP-IDF v5.5, ble_gatts_notify only takes conn_handle and chr_val_handle
-        // We need to store the data and send it via the characteristic value
-        // For now, use a simple approach: store data and trigger notification
-        if (len <= sizeof(s_ble_tx_buffer)) {
-            memcpy(s_ble_tx_buffer, data, len);
-            s_ble_tx_len = len;
-            
-            // Send notification (will send current characteristic value)
-            int rc = ble_gatts_notify(s_conn_handle, s_char_tx_handle);
-            if (rc != 0) {
-                ESP_LOGE(TAG, "Failed to send BLE notify: %d", rc);
-            } else {
-                ESP_LOGD(TAG, "BLE notify sent: %zu bytes", len);
-            }
-        } else {
+    size_t len = data_process_iov_length(iov, iovcnt);
+
+    if (s_conn_handle == BLE_HS_CONN_HANDLE_NONE || s_char_tx_handle == 0) {
+        ESP_LOGD(TAG, "BLE send: %zu bytes (no connection)", len);
+        return;
+    }
+
+    struct os_mbuf *om = ble_hs_mbuf_att_pkt();
+    if (om == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate BLE mbuf");
+        return;
+    }
+
+    // Keep a read-back copy if the pool has room for it
+    frame_buf_t *snapshot = frame_pool_alloc(len);
+    for (size_t i = 0; i < iovcnt; i++) {
+        if (os_mbuf_append(om, iov[i].iov_base, iov[i].iov_len) != 0) {
             ESP_LOGE(TAG, "BLE data too large: %zu bytes", len);
+            os_mbuf_free_chain(om);
+            frame_buf_unref(snapshot);
+            return;
         }
+    }
+    if (snapshot != NULL) {
+        snapshot->len = (uint16_t)data_process_iov_copy(iov, iovcnt, 0, snapshot->data, len);
+    }
+
+    portENTER_CRITICAL(&s_ble_tx_lock);
+    frame_buf_t *previous = s_ble_tx_frame;
+    s_ble_tx_frame = snapshot;
+    portEXIT_CRITICAL(&s_ble_tx_lock);
+    frame_buf_unref(previous);
+
+    // ble_gatts_notify_custom() consumes the mbuf in all cases
+    int rc = ble_gatts_notify_custom(s_conn_handle, s_char_tx_handle, om);
+    if (rc != 0) {
+        ESP_LOGE(TAG, "Failed to send BLE notify: %d", rc);
     } else {
-        ESP_LOGD(TAG, "BLE send: %zu bytes (no connection)", len);
+        ESP_LOGD(TAG, "BLE notify sent: %zu bytes", len);
     }
 }
 
+/**
+ * @brief BLE send callback
+ */
+static void ble_send_callback(const uint8_t *data, size_t len)
+{
+    data_process_iovec_t iov = {
+        .iov_base = data,
+        .iov_len = len,
+    };
+    ble_sendv_callback(&iov, 1);
+}
+
 /**
  * @brief BLE receive callback
+ * 
+ * Called with each reassembled frame. Register reads are answered from
+ * the register cache; the BLE link never drives the RS485 bus itself.
  */
 static void ble_receive_callback(const uint8_t *data, size_t len)
 {
-    // Process received data
     ESP_LOGD(TAG, "BLE receive: %zu bytes", len);
-    
-    if (s_data_handle) {
-        data_process_receive(s_data_handle, data, len);
+
+    uint8_t *payload = NULL;
+    uint16_t payload_len = 0;
+    if (parse_data_transmission_frame(data, len, &payload, &payload_len) != 0) {
+        return;
+    }
+
+    uint8_t device_id = data[PROTOCOL_DEVICE_OFFSET];
+    const device_route_t *route = device_routes_for_frame(device_id);
+    if (route == NULL) {
+        ESP_LOGD(TAG, "No route for device %u", device_id);
+        return;
+    }
+
+    uint8_t response[BLE_CACHE_RESPONSE_SIZE];
+    size_t response_len = 0;
+    esp_err_t ret = register_cache_answer_read(route->slave_addr, route->read_fc,
+                                               payload, payload_len, response,
+                                               sizeof(response), &response_len);
+    if (ret == ESP_OK) {
+        data_process_send_to(s_data_handle, device_id, PROTOCOL_FC_DATA_TRANSMISSION,
+                             response, response_len, NULL);
+    } else {
+        ESP_LOGD(TAG, "Read not served from register cache: %d", ret);
     }
 }
 
@@ -106,8 +166,13 @@ static int ble_gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
         // Read characteristic
         if (attr_handle == s_char_tx_handle) {
             // Return stored TX data if available, otherwise return status
-            if (s_ble_tx_len > 0) {
-                rc = os_mbuf_append(ctxt->om, s_ble_tx_buffer, s_ble_tx_len);
+            portENTER_CRITICAL(&s_ble_tx_lock);
+            frame_buf_t *snapshot = frame_buf_ref(s_ble_tx_frame);
+            portEXIT_CRITICAL(&s_ble_tx_lock);
+
+            if (snapshot != NULL) {
+                rc = os_mbuf_append(ctxt->om, snapshot->data, snapshot->len);
+                frame_buf_unref(snapshot);
                 return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
             } else {
                 const char *status = "OK";
@@ -119,19 +184,20 @@ static int ble_gatt_svr_chr_access(uint16_t conn_handle, uint16_t attr_handle,
         // Write characteristic
         if (attr_handle == s_char_rx_handle) {
             // Process received data
-            uint8_t *data = malloc(ctxt->om->om_len);
+            // The write may span several chained mbufs
+            frame_buf_t *data = frame_pool_alloc(OS_MBUF_PKTLEN(ctxt->om));
             if (data == NULL) {
                 return BLE_ATT_ERR_INSUFFICIENT_RES;
             }
             
-            ble_hs_mbuf_to_flat(ctxt->om, data, ctxt->om->om_len, NULL);
+            ble_hs_mbuf_to_flat(ctxt->om, data->data, data->capacity, &data->len);
             
             // Process through data processing module
             if (s_data_handle) {
-                data_process_receive(s_data_handle, data, ctxt->om->om_len);
+                data_process_receive(s_data_handle, data->data, data->len);
             }
             
-            free(data);
+            frame_buf_unref(data);
             return 0;
         }
     }
@@ -356,6 +422,7 @@ esp_err_t ble_task_init(void)
         ESP_LOGE(TAG, "Failed to create data process handle");
         return ESP_FAIL;
     }
+    data_process_set_sendv_callback(s_data_handle, ble_sendv_callback);
 
     // Start BLE host task
     nimble_port_freertos_init(ble_host_task);
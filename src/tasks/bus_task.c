@@ -0,0 +1,1034 @@
+/**
+ * @file bus_task.c
+ * @brief RS485 bus transaction engine implementation
+ */
+
+#include "bus_task.h"
+#include "rs485_task.h"
+#include "../protocol/modbus_protocol.h"
+#include "../protocol/function_codes.h"
+#include "../protocol/poll_planner.h"
+#include "../protocol/line_probe.h"
+#include "../utils/frame_pool.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include <string.h>
+#include <limits.h>
+
+static const char *TAG = "bus_task";
+
+#define BUS_TASK_QUEUE_DEPTH        8       // Requests per priority class
+#define BUS_TASK_STACK_SIZE         3072
+#define BUS_TASK_PRIORITY           9       // Below the RS485 task (10), above the poll task (6)
+#define BUS_TASK_BITS_PER_CHAR      11      // 8E1: start + 8 data + parity + stop
+#define BUS_TASK_RESPONSE_MARGIN    100     // Extra wait beyond the modelled time (ms)
+#define BUS_TASK_CALIBRATED_MARGIN  20      // Extra wait once the turnaround is measured (ms)
+#define BUS_TASK_CALIBRATION_SAMPLES 8      // Measured responses before using the smaller margin
+#define BUS_TASK_DEFAULT_TIMEOUT    1000    // Wait when the response size is unknown (ms)
+#define BUS_TASK_EXCEPTION_BIT      0x80
+#define BUS_TASK_REPORT_INTERVAL    60000   // Wait percentile log interval (ms)
+#define BUS_TASK_FAIR_WINDOW_US     1000000 // Bus time a slave may bank while idle
+#define BUS_TASK_MAX_BACKOFF_MS     200     // Longest wait before retrying after an exception
+
+// Upper bounds of the wait histogram buckets (ms); the last bucket is open
+static const uint32_t s_wait_bucket_ms[BUS_TASK_WAIT_BUCKETS - 1] = {
+    1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000,
+};
+
+/**
+ * @brief Retry policy for one exception code
+ */
+typedef struct {
+    uint8_t code;
+    uint8_t retries;            // Extra attempts after this exception
+    uint16_t backoff_ms;        // Wait before the first of them, doubled for each next one
+} bus_exception_policy_t;
+
+// Exceptions not listed complete the request: asking again gets the same answer
+static const bus_exception_policy_t s_exception_policies[] = {
+    {MODBUS_EXC_SLAVE_BUSY,      3, 20},
+    {MODBUS_EXC_ACKNOWLEDGE,     2, 50},
+    {MODBUS_EXC_GATEWAY_TARGET,  1, 0},
+};
+
+/**
+ * @brief Requester that joined an identical read
+ */
+typedef struct {
+    bus_complete_cb_t callback;
+    void *ctx;
+} bus_joiner_t;
+
+/**
+ * @brief Queued request
+ */
+typedef struct {
+    frame_buf_t *frame;         // Request frame, CRC included
+    uint8_t slave_addr;
+    uint8_t func_code;
+    uint16_t start;
+    uint16_t count;
+    bool shareable;             // Plain register read others may join
+    uint32_t timeout_ms;        // 0 for the modelled time at each attempt
+    uint8_t retries;
+    uint8_t attempts;
+    uint8_t exception_retries;  // Attempts made after a retryable exception
+    uint8_t retry_exception;    // Retryable exception that ended the attempt, 0 if none
+    bus_class_t priority;
+    bool local;
+    int64_t submitted_us;
+    int64_t deadline_us;        // 0 for no deadline
+    esp_err_t status;           // Set by the RS485 task when answered
+    bus_complete_cb_t callback;
+    void *ctx;
+    bus_joiner_t joiners[BUS_TASK_MAX_JOINERS];
+    uint8_t joiner_count;
+} bus_txn_t;
+
+/**
+ * @brief FIFO of one priority class
+ */
+typedef struct {
+    bus_txn_t slots[BUS_TASK_QUEUE_DEPTH];
+    uint8_t head;
+    uint8_t count;
+} bus_class_queue_t;
+
+static struct {
+    TaskHandle_t task_handle;
+    SemaphoreHandle_t pending;  // Counts queued requests
+    bus_class_queue_t queues[BUS_CLASS_COUNT];
+    poll_bus_timing_t timing;   // Turnaround refreshed from RS485 measurements
+    uint32_t margin_ms;
+    bus_txn_t *active;          // Request on the bus, NULL when idle
+    int64_t slave_vtime_us[BUS_TASK_MAX_SLAVES];   // Bus time used, relative to the least
+    bool probe_requested;       // Line probe to run before the next request
+    int64_t last_report_us;
+    portMUX_TYPE lock;
+    bus_task_stats_t stats;
+} s_bus = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static uint32_t bus_task_default_timeout(uint16_t count)
+{
+    if (count == 0) {
+        return BUS_TASK_DEFAULT_TIMEOUT;
+    }
+    return poll_planner_transaction_us(&s_bus.timing, count) / 1000 + s_bus.margin_ms;
+}
+
+/**
+ * @brief Take the measured slave turnaround into the timing model
+ */
+static void bus_task_refresh_timing(void)
+{
+    rs485_timing_t timing;
+    if (rs485_task_get_timing(&timing) != ESP_OK) {
+        return;
+    }
+    s_bus.timing.baud_rate = timing.baud_rate;
+    s_bus.timing.turnaround_us = timing.turnaround_us;
+    s_bus.margin_ms = (timing.samples >= BUS_TASK_CALIBRATION_SAMPLES) ?
+                      BUS_TASK_CALIBRATED_MARGIN : BUS_TASK_RESPONSE_MARGIN;
+}
+
+/**
+ * @brief Check whether a frame answers a request
+ */
+static bool bus_task_matches(const bus_txn_t *txn, const uint8_t *frame, size_t len)
+{
+    if (frame[0] != txn->slave_addr) {
+        return false;
+    }
+
+    if (frame[1] == txn->func_code) {
+        // Reads must return exactly the registers asked for
+        if ((txn->func_code == MODBUS_FC_READ_HOLDING_REGISTERS ||
+             txn->func_code == MODBUS_FC_READ_INPUT_REGISTERS) && txn->count > 0) {
+            return len >= 3 && frame[2] == 2 * txn->count;
+        }
+        return true;
+    }
+
+    // Exception response; 0x88 and 0xFE already have bit 7 set
+    return !(txn->func_code & BUS_TASK_EXCEPTION_BIT) &&
+           frame[1] == (txn->func_code | BUS_TASK_EXCEPTION_BIT);
+}
+
+static const bus_exception_policy_t *bus_task_exception_policy(uint8_t code)
+{
+    for (size_t i = 0; i < sizeof(s_exception_policies) / sizeof(s_exception_policies[0]); i++) {
+        if (s_exception_policies[i].code == code) {
+            return &s_exception_policies[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Wait before the next retry after an exception
+ * 
+ * @param policy Policy of the exception
+ * @param retried Retries already made after exceptions
+ */
+static uint32_t bus_task_exception_backoff_ms(const bus_exception_policy_t *policy,
+                                              uint8_t retried)
+{
+    uint32_t backoff = (uint32_t)policy->backoff_ms << (retried < 8 ? retried : 8);
+    return (backoff < BUS_TASK_MAX_BACKOFF_MS) ? backoff : BUS_TASK_MAX_BACKOFF_MS;
+}
+
+/**
+ * @brief Decide whether an exception ends the request or only the attempt
+ * 
+ * Called with s_bus.lock held.
+ * 
+ * @return true if the request is to be retried after a backoff
+ */
+static bool bus_task_should_retry(const bus_txn_t *txn, uint8_t code, int64_t now_us)
+{
+    const bus_exception_policy_t *policy = bus_task_exception_policy(code);
+    if (policy == NULL || txn->exception_retries >= policy->retries) {
+        return false;
+    }
+
+    // Not worth it if the deadline passes while backing off
+    int64_t retry_us = now_us +
+        (int64_t)bus_task_exception_backoff_ms(policy, txn->exception_retries) * 1000;
+    return txn->deadline_us == 0 || retry_us < txn->deadline_us;
+}
+
+/**
+ * @brief Complete a request and every requester that joined it
+ * 
+ * Joiners get the same result; latency is measured from the first
+ * submission.
+ */
+static void bus_task_complete(const bus_txn_t *txn, esp_err_t status, uint8_t exception_code,
+                              const uint8_t *frame, size_t len)
+{
+    bus_result_t result = {
+        .status = status,
+        .exception_code = exception_code,
+        .attempts = txn->attempts,
+        .latency_us = (uint32_t)(esp_timer_get_time() - txn->submitted_us),
+    };
+
+    if (txn->callback != NULL) {
+        txn->callback(&result, frame, len, txn->ctx);
+    }
+    for (uint8_t i = 0; i < txn->joiner_count; i++) {
+        if (txn->joiners[i].callback != NULL) {
+            txn->joiners[i].callback(&result, frame, len, txn->joiners[i].ctx);
+        }
+    }
+}
+
+static bool bus_task_is_shareable(const bus_request_t *request)
+{
+    // A body other than start/count means it is not a plain read
+    return (request->func_code == MODBUS_FC_READ_HOLDING_REGISTERS ||
+            request->func_code == MODBUS_FC_READ_INPUT_REGISTERS) &&
+           request->count > 0 && (request->body == NULL || request->body_len == 4);
+}
+
+/**
+ * @brief Attach a request to an identical one
+ * 
+ * Caller holds s_bus.lock.
+ */
+static bool bus_task_join(bus_txn_t *txn, const bus_request_t *request)
+{
+    if (txn == NULL || !txn->shareable || txn->joiner_count >= BUS_TASK_MAX_JOINERS ||
+        txn->slave_addr != request->slave_addr || txn->func_code != request->func_code ||
+        txn->start != request->start || txn->count != request->count) {
+        return false;
+    }
+
+    txn->joiners[txn->joiner_count].callback = request->callback;
+    txn->joiners[txn->joiner_count].ctx = request->ctx;
+    txn->joiner_count++;
+
+    // The cloud still sees the response if any requester wants it to
+    txn->local = txn->local && request->local;
+    return true;
+}
+
+/**
+ * @brief Join an identical read in flight or queued
+ * 
+ * Only queues of the same or a higher class are searched, so joining
+ * never makes a request wait longer than it would on its own.
+ * 
+ * @return true if the request joined another one
+ */
+static bool bus_task_try_join(const bus_request_t *request)
+{
+    bool joined = false;
+
+    portENTER_CRITICAL(&s_bus.lock);
+    joined = bus_task_join(s_bus.active, request);
+    for (int c = 0; !joined && c <= (int)request->priority; c++) {
+        bus_class_queue_t *queue = &s_bus.queues[c];
+        for (uint8_t i = 0; !joined && i < queue->count; i++) {
+            joined = bus_task_join(&queue->slots[(queue->head + i) % BUS_TASK_QUEUE_DEPTH],
+                                   request);
+        }
+    }
+    if (joined) {
+        s_bus.stats.coalesced++;
+        s_bus.stats.saved_bus_ms +=
+            poll_planner_transaction_us(&s_bus.timing, request->count) / 1000;
+    }
+    portEXIT_CRITICAL(&s_bus.lock);
+
+    return joined;
+}
+
+/**
+ * @brief Put one attempt on the bus and wait for its response
+ * 
+ * @return true if the request was answered
+ */
+static bool bus_task_attempt(bus_txn_t *txn)
+{
+    uint32_t wait_ms = txn->timeout_ms > 0 ? txn->timeout_ms :
+                       bus_task_default_timeout(txn->count);
+    if (txn->deadline_us != 0) {
+        int64_t remaining_ms = (txn->deadline_us - esp_timer_get_time()) / 1000;
+        if (remaining_ms < (int64_t)wait_ms) {
+            wait_ms = (remaining_ms > 0) ? (uint32_t)remaining_ms : 0;
+        }
+    }
+
+    // Drop a wake-up left over from a response that raced the last timeout
+    ulTaskNotifyTake(pdTRUE, 0);
+
+    portENTER_CRITICAL(&s_bus.lock);
+    s_bus.active = txn;
+    portEXIT_CRITICAL(&s_bus.lock);
+
+    if (rs485_task_send_frame(txn->frame->data, txn->frame->len) == ESP_OK &&
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait_ms)) > 0) {
+        return true;
+    }
+
+    portENTER_CRITICAL(&s_bus.lock);
+    bool answered = (s_bus.active != txn);
+    s_bus.active = NULL;
+    portEXIT_CRITICAL(&s_bus.lock);
+
+    if (answered) {
+        // The response arrived as the wait ran out; let its completion finish
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    return answered;
+}
+
+/**
+ * @brief Find the statistics slot of a slave, claiming a free one
+ * 
+ * Called with s_bus.lock held.
+ * 
+ * @return Slot index, -1 if every slot belongs to another slave
+ */
+static int bus_task_slave_slot(uint8_t slave_addr)
+{
+    int free_slot = -1;
+    for (int i = 0; i < BUS_TASK_MAX_SLAVES; i++) {
+        if (s_bus.stats.slaves[i].slave_addr == slave_addr) {
+            return i;
+        }
+        if (free_slot < 0 && s_bus.stats.slaves[i].slave_addr == 0) {
+            free_slot = i;
+        }
+    }
+    if (free_slot >= 0) {
+        s_bus.stats.slaves[free_slot].slave_addr = slave_addr;
+        s_bus.slave_vtime_us[free_slot] = 0;
+    }
+    return free_slot;
+}
+
+static int64_t bus_task_slave_vtime(uint8_t slave_addr)
+{
+    int slot = bus_task_slave_slot(slave_addr);
+    return (slot >= 0) ? s_bus.slave_vtime_us[slot] : 0;
+}
+
+/**
+ * @brief Charge bus time to a slave
+ * 
+ * Usage is kept relative to the slave that has used the least, and capped
+ * at BUS_TASK_FAIR_WINDOW_US ahead of it, so a slave returning from idle
+ * gets priority only until it has caught up with one window.
+ */
+static void bus_task_charge_slave(const bus_txn_t *txn, esp_err_t status, int64_t bus_us)
+{
+    portENTER_CRITICAL(&s_bus.lock);
+    int slot = bus_task_slave_slot(txn->slave_addr);
+    if (slot >= 0) {
+        bus_slave_stats_t *stats = &s_bus.stats.slaves[slot];
+        stats->requests++;
+        stats->bus_ms += (uint32_t)(bus_us / 1000);
+        stats->exception_retries += txn->exception_retries;
+        if (status == ESP_OK) {
+            stats->completed++;
+        } else if (status == ESP_ERR_INVALID_RESPONSE) {
+            stats->exceptions++;
+        } else {
+            stats->timeouts++;
+        }
+        s_bus.slave_vtime_us[slot] += bus_us;
+
+        int64_t least = INT64_MAX;
+        for (int i = 0; i < BUS_TASK_MAX_SLAVES; i++) {
+            if (s_bus.stats.slaves[i].slave_addr != 0 && s_bus.slave_vtime_us[i] < least) {
+                least = s_bus.slave_vtime_us[i];
+            }
+        }
+        for (int i = 0; i < BUS_TASK_MAX_SLAVES; i++) {
+            if (s_bus.stats.slaves[i].slave_addr == 0) {
+                continue;
+            }
+            s_bus.slave_vtime_us[i] -= least;
+            if (s_bus.slave_vtime_us[i] > BUS_TASK_FAIR_WINDOW_US) {
+                s_bus.slave_vtime_us[i] = BUS_TASK_FAIR_WINDOW_US;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&s_bus.lock);
+}
+
+/**
+ * @brief Count an exception response against its slave and code
+ * 
+ * Called with s_bus.lock held.
+ */
+static void bus_task_count_exception(uint8_t slave_addr, uint8_t code)
+{
+    int slot = bus_task_slave_slot(slave_addr);
+    if (slot >= 0) {
+        bus_slave_stats_t *stats = &s_bus.stats.slaves[slot];
+        stats->exception_codes[(code < BUS_TASK_EXCEPTION_CODES) ? code : 0]++;
+    }
+}
+
+/**
+ * @brief Pick the request to serve from a class queue
+ * 
+ * The first queued request of the slave with the least bus time used;
+ * the head wins ties. Called with s_bus.lock held.
+ * 
+ * @return Position in the queue, 0 for the head
+ */
+static uint8_t bus_task_pick_fair(const bus_class_queue_t *queue)
+{
+    uint8_t best = 0;
+    int64_t best_vtime = INT64_MAX;
+
+    for (uint8_t i = 0; i < queue->count; i++) {
+        const bus_txn_t *txn = &queue->slots[(queue->head + i) % BUS_TASK_QUEUE_DEPTH];
+        int64_t vtime = bus_task_slave_vtime(txn->slave_addr);
+        if (vtime < best_vtime) {
+            best = i;
+            best_vtime = vtime;
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Take the next request off the class queues
+ * 
+ * The oldest request of each class decides which class is served: its
+ * class is raised by one for every BUS_TASK_AGING_MS it has waited; ties
+ * go to the higher class. Within that class the slaves share the bus
+ * fairly (bus_task_pick_fair()).
+ * 
+ * @return false if every queue is empty
+ */
+static bool bus_task_dequeue(bus_txn_t *txn, int64_t now_us)
+{
+    int best = -1;
+    int best_rank = INT_MAX;
+
+    portENTER_CRITICAL(&s_bus.lock);
+    for (int c = 0; c < BUS_CLASS_COUNT; c++) {
+        const bus_class_queue_t *queue = &s_bus.queues[c];
+        if (queue->count == 0) {
+            continue;
+        }
+        int64_t waited_ms = (now_us - queue->slots[queue->head].submitted_us) / 1000;
+        int rank = c - (int)(waited_ms / BUS_TASK_AGING_MS);
+        if (rank < 0) {
+            rank = 0;
+        }
+        if (rank < best_rank) {
+            best = c;
+            best_rank = rank;
+        }
+    }
+
+    if (best >= 0) {
+        bus_class_queue_t *queue = &s_bus.queues[best];
+        uint8_t pick = bus_task_pick_fair(queue);
+        *txn = queue->slots[(queue->head + pick) % BUS_TASK_QUEUE_DEPTH];
+
+        if (pick == 0) {
+            queue->head = (queue->head + 1) % BUS_TASK_QUEUE_DEPTH;
+        } else {
+            // Close the gap behind the picked request, keeping the order
+            for (uint8_t i = pick; i + 1 < queue->count; i++) {
+                queue->slots[(queue->head + i) % BUS_TASK_QUEUE_DEPTH] =
+                    queue->slots[(queue->head + i + 1) % BUS_TASK_QUEUE_DEPTH];
+            }
+        }
+        queue->count--;
+
+        s_bus.stats.classes[best].served++;
+        for (int c = 0; c < best; c++) {
+            if (s_bus.queues[c].count > 0) {
+                s_bus.stats.classes[best].promoted++;
+                break;
+            }
+        }
+    }
+    portEXIT_CRITICAL(&s_bus.lock);
+
+    return best >= 0;
+}
+
+/**
+ * @brief Add a queue wait to its class histogram
+ * 
+ * Called with s_bus.lock held.
+ */
+static void bus_task_record_wait(bus_class_t priority, uint32_t wait_us)
+{
+    bus_class_stats_t *stats = &s_bus.stats.classes[priority];
+    uint32_t wait_ms = wait_us / 1000;
+    size_t bucket = 0;
+
+    while (bucket < BUS_TASK_WAIT_BUCKETS - 1 && wait_ms >= s_wait_bucket_ms[bucket]) {
+        bucket++;
+    }
+    stats->wait_histogram[bucket]++;
+    if (wait_us > stats->max_wait_us) {
+        stats->max_wait_us = wait_us;
+    }
+}
+
+/**
+ * @brief Log per-class wait percentiles every BUS_TASK_REPORT_INTERVAL
+ */
+static void bus_task_report(int64_t now_us)
+{
+    static const char *const class_names[BUS_CLASS_COUNT] = {
+        "control", "interactive", "background",
+    };
+
+    if (now_us - s_bus.last_report_us < (int64_t)BUS_TASK_REPORT_INTERVAL * 1000) {
+        return;
+    }
+    s_bus.last_report_us = now_us;
+
+    // The RS485 task updates the counters too; log a consistent copy
+    static bus_task_stats_t snapshot;
+    bus_task_get_stats(&snapshot);
+
+    uint32_t transaction_ms =
+        poll_planner_transaction_us(&s_bus.timing, POLL_PLANNER_MAX_REGISTERS) / 1000;
+    for (int c = 0; c < BUS_CLASS_COUNT; c++) {
+        const bus_class_stats_t *stats = &snapshot.classes[c];
+        if (stats->served == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%s: %lu served, wait p50 <%lu ms, p99 <%lu ms, max %lu ms "
+                 "(longest transaction %lu ms)", class_names[c],
+                 (unsigned long)stats->served,
+                 (unsigned long)bus_task_wait_percentile_ms(stats, 50),
+                 (unsigned long)bus_task_wait_percentile_ms(stats, 99),
+                 (unsigned long)(stats->max_wait_us / 1000),
+                 (unsigned long)transaction_ms);
+    }
+
+    for (int i = 0; i < BUS_TASK_MAX_SLAVES; i++) {
+        const bus_slave_stats_t *slave = &snapshot.slaves[i];
+        uint32_t exceptions = 0;
+        for (int code = 0; code < BUS_TASK_EXCEPTION_CODES; code++) {
+            exceptions += slave->exception_codes[code];
+        }
+        if (slave->slave_addr == 0 || exceptions == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "Slave %u: %lu exceptions (%lu illegal address, %lu busy), "
+                 "%lu retried, %lu final", slave->slave_addr, (unsigned long)exceptions,
+                 (unsigned long)slave->exception_codes[MODBUS_EXC_ILLEGAL_ADDRESS],
+                 (unsigned long)slave->exception_codes[MODBUS_EXC_SLAVE_BUSY],
+                 (unsigned long)slave->exception_retries, (unsigned long)slave->exceptions);
+    }
+
+    rs485_timing_t timing;
+    if (rs485_task_get_timing(&timing) == ESP_OK && timing.samples > 0) {
+        ESP_LOGI(TAG, "Turnaround avg %lu us, dev %lu us, max %lu us over %lu responses; "
+                 "in-frame gap %lu us", (unsigned long)timing.turnaround_avg_us,
+                 (unsigned long)timing.turnaround_dev_us,
+                 (unsigned long)timing.turnaround_max_us, (unsigned long)timing.samples,
+                 (unsigned long)timing.frame_gap_us);
+    }
+
+    rs485_rx_stats_t rx;
+    if (rs485_task_get_rx_stats(&rx) == ESP_OK &&
+        rx.fifo_overflows + rx.buffer_full + rx.frame_errors + rx.parity_errors > 0) {
+        ESP_LOGW(TAG, "RS485 RX losses: %lu FIFO overflows, %lu buffer full, %lu partial "
+                 "frames dropped, %lu framing / %lu parity errors",
+                 (unsigned long)rx.fifo_overflows, (unsigned long)rx.buffer_full,
+                 (unsigned long)rx.dropped_partial, (unsigned long)rx.frame_errors,
+                 (unsigned long)rx.parity_errors);
+    }
+}
+
+/**
+ * @brief Probe exchange state
+ */
+typedef struct {
+    uint8_t *response;
+    size_t response_size;
+    size_t response_len;
+} bus_probe_exchange_t;
+
+static void bus_task_probe_complete(const bus_result_t *result,
+                                    const uint8_t *frame, size_t len, void *ctx)
+{
+    bus_probe_exchange_t *exchange = (bus_probe_exchange_t *)ctx;
+    (void)result;
+
+    if (frame != NULL && len <= exchange->response_size) {
+        memcpy(exchange->response, frame, len);
+        exchange->response_len = len;
+    }
+}
+
+static esp_err_t bus_task_probe_set_line(const line_settings_t *line, void *ctx)
+{
+    (void)ctx;
+    esp_err_t ret = rs485_task_set_line(line, false);
+    bus_task_refresh_timing();
+    return ret;
+}
+
+/**
+ * @brief Put one probe read on the bus, bypassing the class queues
+ */
+static esp_err_t bus_task_probe_exchange(const uint8_t *request, size_t request_len,
+                                         uint8_t *response, size_t response_size,
+                                         size_t *response_len, void *ctx)
+{
+    (void)ctx;
+    if (request_len < MODBUS_RTU_MIN_FRAME_SIZE + 4) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    frame_buf_t *frame = frame_pool_alloc(request_len);
+    if (frame == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(frame->data, request, request_len);
+    frame->len = request_len;
+
+    bus_probe_exchange_t exchange = {
+        .response = response,
+        .response_size = response_size,
+        .response_len = 0,
+    };
+    bus_txn_t txn = {
+        .frame = frame,
+        .slave_addr = request[0],
+        .func_code = request[1],
+        .start = (uint16_t)((request[2] << 8) | request[3]),
+        .count = (uint16_t)((request[4] << 8) | request[5]),
+        .attempts = 1,
+        .priority = BUS_CLASS_CONTROL,
+        .local = true,
+        .submitted_us = esp_timer_get_time(),
+        .callback = bus_task_probe_complete,
+        .ctx = &exchange,
+    };
+
+    bool answered = bus_task_attempt(&txn);
+    frame_buf_unref(frame);
+
+    *response_len = exchange.response_len;
+    return (answered && exchange.response_len > 0) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**
+ * @brief Search for the fastest line settings and store them
+ * 
+ * When no slave answers, the settings in use are stored instead, so the
+ * probe does not run again at every boot. Setting PARAM_ID_16 to 0 asks
+ * for a new probe.
+ */
+static void bus_task_run_probe(void)
+{
+    line_settings_t current;
+    rs485_task_get_line(&current);
+
+    line_probe_port_t port = {
+        .set_line = bus_task_probe_set_line,
+        .exchange = bus_task_probe_exchange,
+        .ctx = NULL,
+    };
+    line_probe_result_t result;
+
+    ESP_LOGI(TAG, "Probing RS485 line settings");
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = line_probe_run(&port, LINE_PROBE_SLAVE_ADDR, &current, &result);
+    if (ret == ESP_OK || ret == ESP_ERR_NOT_FOUND) {
+        // result.line is the current line when no candidate answered
+        rs485_task_set_line(&result.line, true);
+    }
+    bus_task_refresh_timing();
+
+    ESP_LOGI(TAG, "Line probe %s: %lu baud parity %d, %u candidates, %u reads, %lu ms",
+             ret == ESP_OK ? "done" : "failed", (unsigned long)result.line.baud_rate,
+             result.line.parity, result.candidates, result.exchanges,
+             (unsigned long)((esp_timer_get_time() - start) / 1000));
+}
+
+/**
+ * @brief Bus task: runs queued requests one at a time
+ */
+static void bus_task(void *pvParameters)
+{
+    bus_txn_t txn;
+
+    while (1) {
+        if (xSemaphoreTake(s_bus.pending, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        portENTER_CRITICAL(&s_bus.lock);
+        bool probe = s_bus.probe_requested;
+        s_bus.probe_requested = false;
+        portEXIT_CRITICAL(&s_bus.lock);
+        if (probe) {
+            bus_task_run_probe();
+            continue;
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (!bus_task_dequeue(&txn, now)) {
+            continue;
+        }
+        portENTER_CRITICAL(&s_bus.lock);
+        bus_task_record_wait(txn.priority, (uint32_t)(now - txn.submitted_us));
+        portEXIT_CRITICAL(&s_bus.lock);
+
+        bool answered = false;
+        bool expired = false;
+        uint8_t timeouts = 0;
+        int64_t bus_start = esp_timer_get_time();
+        while (!answered && timeouts <= txn.retries) {
+            if (txn.deadline_us != 0 && esp_timer_get_time() >= txn.deadline_us) {
+                expired = true;
+                break;
+            }
+            if (txn.attempts > 0) {
+                portENTER_CRITICAL(&s_bus.lock);
+                s_bus.stats.retries++;
+                portEXIT_CRITICAL(&s_bus.lock);
+            }
+            txn.attempts++;
+            txn.retry_exception = 0;
+            bus_task_refresh_timing();
+            answered = bus_task_attempt(&txn);
+
+            if (answered && txn.retry_exception != 0) {
+                // The slave asked to be asked again later; the bus stays ours meanwhile
+                uint32_t backoff_ms = bus_task_exception_backoff_ms(
+                    bus_task_exception_policy(txn.retry_exception), txn.exception_retries);
+                ESP_LOGD(TAG, "Exception 0x%02X from slave %u, retrying in %lu ms",
+                         txn.retry_exception, txn.slave_addr, (unsigned long)backoff_ms);
+                txn.exception_retries++;
+                portENTER_CRITICAL(&s_bus.lock);
+                s_bus.stats.exception_retries++;
+                portEXIT_CRITICAL(&s_bus.lock);
+                answered = false;
+                if (backoff_ms > 0) {
+                    vTaskDelay(pdMS_TO_TICKS(backoff_ms));
+                }
+            } else if (!answered) {
+                timeouts++;
+            }
+        }
+
+        if (!answered) {
+            portENTER_CRITICAL(&s_bus.lock);
+            if (expired) {
+                s_bus.stats.expired++;
+            } else {
+                s_bus.stats.timeouts++;
+            }
+            portEXIT_CRITICAL(&s_bus.lock);
+            ESP_LOGD(TAG, "No response: slave=%u fc=0x%02X attempts=%u%s",
+                     txn.slave_addr, txn.func_code, txn.attempts, expired ? " (deadline)" : "");
+            bus_task_complete(&txn, ESP_ERR_TIMEOUT, 0, NULL, 0);
+        }
+        bus_task_charge_slave(&txn, answered ? txn.status : ESP_ERR_TIMEOUT,
+                              esp_timer_get_time() - bus_start);
+
+        frame_buf_unref(txn.frame);
+        bus_task_report(esp_timer_get_time());
+    }
+}
+
+/**
+ * @brief Initialize bus transaction engine
+ */
+esp_err_t bus_task_init(void)
+{
+    s_bus.timing.baud_rate = rs485_task_get_baud_rate();
+    s_bus.timing.bits_per_char = BUS_TASK_BITS_PER_CHAR;
+    bus_task_refresh_timing();
+
+    // One count per queue slot plus one for a line probe
+    s_bus.pending = xSemaphoreCreateCounting(BUS_TASK_QUEUE_DEPTH * BUS_CLASS_COUNT + 1, 0);
+    if (s_bus.pending == NULL) {
+        ESP_LOGE(TAG, "Failed to create request semaphore");
+        return ESP_ERR_NO_MEM;
+    }
+    s_bus.last_report_us = esp_timer_get_time();
+
+    BaseType_t ret = xTaskCreate(bus_task, "bus", BUS_TASK_STACK_SIZE, NULL,
+                                 BUS_TASK_PRIORITY, &s_bus.task_handle);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create bus task");
+        vSemaphoreDelete(s_bus.pending);
+        s_bus.pending = NULL;
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Bus transaction engine initialized (%d classes, queue depth %d)",
+             BUS_CLASS_COUNT, BUS_TASK_QUEUE_DEPTH);
+    return ESP_OK;
+}
+
+/**
+ * @brief Queue a request without waiting for it
+ */
+esp_err_t bus_task_submit(const bus_request_t *request)
+{
+    if (request == NULL || (request->body == NULL && request->body_len > 0) ||
+        request->body_len > UINT16_MAX || request->priority >= BUS_CLASS_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_bus.pending == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    bool shareable = bus_task_is_shareable(request);
+    if (shareable && bus_task_try_join(request)) {
+        return ESP_OK;
+    }
+
+    const uint8_t *body = request->body;
+    size_t body_len = request->body_len;
+    uint8_t read_body[4];
+    if (body == NULL) {
+        read_body[0] = (uint8_t)(request->start >> 8);
+        read_body[1] = (uint8_t)(request->start & 0xFF);
+        read_body[2] = (uint8_t)(request->count >> 8);
+        read_body[3] = (uint8_t)(request->count & 0xFF);
+        body = read_body;
+        body_len = sizeof(read_body);
+    }
+
+    frame_buf_t *frame = frame_pool_alloc(body_len + 4);
+    if (frame == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint16_t frame_len = 0;
+    if (modbus_build_frame(frame->data, frame->capacity, request->slave_addr,
+                           request->func_code, body, (uint16_t)body_len, &frame_len) != 0) {
+        frame_buf_unref(frame);
+        return ESP_ERR_INVALID_ARG;
+    }
+    frame->len = frame_len;
+
+    bus_txn_t txn = {
+        .frame = frame,
+        .slave_addr = request->slave_addr,
+        .func_code = request->func_code,
+        .start = request->start,
+        .count = request->count,
+        .shareable = shareable,
+        .timeout_ms = request->timeout_ms,
+        .retries = request->retries,
+        .attempts = 0,
+        .priority = request->priority,
+        .local = request->local,
+        .submitted_us = esp_timer_get_time(),
+        .deadline_us = 0,
+        .callback = request->callback,
+        .ctx = request->ctx,
+        .joiner_count = 0,
+    };
+    if (request->deadline_ms > 0) {
+        txn.deadline_us = txn.submitted_us + (int64_t)request->deadline_ms * 1000;
+    }
+
+    bus_class_stats_t *stats = &s_bus.stats.classes[txn.priority];
+    bus_class_queue_t *queue = &s_bus.queues[txn.priority];
+    bool queued = false;
+
+    portENTER_CRITICAL(&s_bus.lock);
+    if (queue->count < BUS_TASK_QUEUE_DEPTH) {
+        queue->slots[(queue->head + queue->count) % BUS_TASK_QUEUE_DEPTH] = txn;
+        queue->count++;
+        stats->submitted++;
+        queued = true;
+    } else {
+        stats->queue_full++;
+    }
+    portEXIT_CRITICAL(&s_bus.lock);
+
+    if (!queued) {
+        frame_buf_unref(frame);
+        return ESP_ERR_NO_MEM;
+    }
+
+    xSemaphoreGive(s_bus.pending);
+    return ESP_OK;
+}
+
+/**
+ * @brief Offer a received RS485 frame to the engine
+ */
+bool bus_task_on_frame(const uint8_t *frame, size_t len)
+{
+    if (frame == NULL || len < MODBUS_RTU_MIN_FRAME_SIZE) {
+        return false;
+    }
+
+    bool retry = false;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&s_bus.lock);
+    bus_txn_t *txn = s_bus.active;
+    if (txn != NULL && bus_task_matches(txn, frame, len)) {
+        s_bus.active = NULL;
+        if (frame[1] != txn->func_code) {
+            bus_task_count_exception(txn->slave_addr, frame[2]);
+            retry = bus_task_should_retry(txn, frame[2], now);
+        }
+    } else {
+        txn = NULL;
+        s_bus.stats.unmatched++;
+    }
+    portEXIT_CRITICAL(&s_bus.lock);
+
+    if (txn == NULL) {
+        ESP_LOGD(TAG, "Unmatched frame: addr=0x%02X fc=0x%02X len=%zu", frame[0], frame[1], len);
+        return false;
+    }
+
+    // The bus task is blocked on this request until notified, so txn stays valid
+    if (retry) {
+        // Only the attempt is over; nobody sees this exception
+        txn->retry_exception = frame[2];
+        xTaskNotifyGive(s_bus.task_handle);
+        return true;
+    }
+
+    bool local = txn->local;
+    bool exception = (frame[1] != txn->func_code);
+    portENTER_CRITICAL(&s_bus.lock);
+    if (exception) {
+        s_bus.stats.exceptions++;
+    } else {
+        s_bus.stats.completed++;
+    }
+    portEXIT_CRITICAL(&s_bus.lock);
+
+    if (!exception) {
+        txn->status = ESP_OK;
+        bus_task_complete(txn, ESP_OK, 0, frame, len);
+    } else {
+        txn->status = ESP_ERR_INVALID_RESPONSE;
+        bus_task_complete(txn, ESP_ERR_INVALID_RESPONSE, frame[2], frame, len);
+    }
+    xTaskNotifyGive(s_bus.task_handle);
+
+    return local;
+}
+
+/**
+ * @brief Run an RS485 line probe on the bus task
+ */
+esp_err_t bus_task_probe_line(void)
+{
+    if (s_bus.pending == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    portENTER_CRITICAL(&s_bus.lock);
+    bool queued = s_bus.probe_requested;
+    s_bus.probe_requested = true;
+    portEXIT_CRITICAL(&s_bus.lock);
+
+    if (!queued) {
+        xSemaphoreGive(s_bus.pending);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Get transaction engine statistics
+ */
+esp_err_t bus_task_get_stats(bus_task_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_bus.lock);
+    *stats = s_bus.stats;
+    portEXIT_CRITICAL(&s_bus.lock);
+    return ESP_OK;
+}
+
+/**
+ * @brief Wait percentile from a class histogram
+ */
+uint32_t bus_task_wait_percentile_ms(const bus_class_stats_t *stats, uint8_t percent)
+{
+    if (stats == NULL || percent == 0 || percent > 100) {
+        return 0;
+    }
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < BUS_TASK_WAIT_BUCKETS; i++) {
+        total += stats->wait_histogram[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    // Smallest bucket whose cumulative count reaches the percentile rank
+    uint64_t rank = (total * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUS_TASK_WAIT_BUCKETS - 1; i++) {
+        seen += stats->wait_histogram[i];
+        if (seen >= rank) {
+            return s_wait_bucket_ms[i];
+        }
+    }
+    return UINT32_MAX;
+}
@@ -0,0 +1,212 @@
+/**
+ * @file bus_task.h
+ * @brief RS485 bus transaction engine
+ * 
+ * Serializes every request on the RS485 bus through one task. Each request
+ * names the slave, function code and register range it expects back; the
+ * engine sends it, matches the response against it and completes the
+ * requester with the response, an exception or a timeout. Only one request
+ * is on the bus at a time, so concurrent users (cloud downlink, local
+ * clients, poll sweep) can no longer take each other's responses.
+ * 
+ * Queued requests wait in one queue per priority class: control writes
+ * go first, then interactive reads, then background polls. A request that
+ * has waited BUS_TASK_AGING_MS is treated as one class higher, so polls
+ * still get the bus under sustained interactive load.
+ * 
+ * A register read identical to one already in flight, or queued in the
+ * same or a higher class, is not sent again: the new requester joins the
+ * existing request and gets the same response.
+ * 
+ * Several slaves share the bus. Within a class, the slave that has used
+ * the least bus time recently goes next, so a slave that keeps timing out
+ * cannot crowd out the others; one slave's requests stay in order.
+ * 
+ * A Modbus exception response ends the attempt as soon as it arrives
+ * rather than at the response timeout. Whether the request is retried
+ * depends on the exception code: a busy slave (0x06) or one still
+ * processing (0x05) is asked again after a short, doubling backoff, and a
+ * gateway whose target did not answer (0x0B) once straight away. Other
+ * exceptions, such as an illegal function, address or value, complete the
+ * request at once: asking again would get the same answer.
+ */
+
+#ifndef BUS_TASK_H
+#define BUS_TASK_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BUS_TASK_AGING_MS           2000    // Wait that promotes a request by one class
+#define BUS_TASK_WAIT_BUCKETS       12      // Wait histogram buckets per class
+#define BUS_TASK_MAX_JOINERS        4       // Extra requesters sharing one read
+#define BUS_TASK_MAX_SLAVES         4       // Slaves with their own statistics and bus share
+#define BUS_TASK_EXCEPTION_CODES    12      // Exception counters per slave (codes 1-11)
+
+/**
+ * @brief Priority class, highest first
+ */
+typedef enum {
+    BUS_CLASS_CONTROL = 0,      // Register writes
+    BUS_CLASS_INTERACTIVE,      // Reads someone is waiting for
+    BUS_CLASS_BACKGROUND,       // Poll sweep
+    BUS_CLASS_COUNT
+} bus_class_t;
+
+/**
+ * @brief Transaction result
+ */
+typedef struct {
+    esp_err_t status;           // ESP_OK, ESP_ERR_TIMEOUT or ESP_ERR_INVALID_RESPONSE (exception)
+    uint8_t exception_code;     // Modbus exception code when status is ESP_ERR_INVALID_RESPONSE
+    uint8_t attempts;           // Times the request went on the bus
+    uint32_t latency_us;        // Submission to completion
+} bus_result_t;
+
+/**
+ * @brief Completion callback
+ * 
+ * Runs on the RS485 task when a response arrives and on the bus task when
+ * the request times out, so it must not block. frame is only valid during
+ * the call and is NULL unless a response arrived.
+ */
+typedef void (*bus_complete_cb_t)(const bus_result_t *result,
+                                  const uint8_t *frame, size_t len, void *ctx);
+
+/**
+ * @brief Bus request
+ */
+typedef struct {
+    uint8_t slave_addr;
+    uint8_t func_code;
+    uint16_t start;             // First register
+    uint16_t count;             // Registers expected back (FC 0x03/0x04), 0 if not a read
+    const uint8_t *body;        // Request after the function code, NULL to read start/count
+    size_t body_len;
+    uint32_t timeout_ms;        // Response wait per attempt, 0 for the modelled time
+    uint32_t deadline_ms;       // Give up this long after submission, 0 for no limit
+    uint8_t retries;            // Extra attempts after a timeout; exceptions follow their policy
+    bus_class_t priority;
+    bool local;                 // Response is for the requester only, not the cloud
+    bus_complete_cb_t callback; // NULL for fire-and-forget
+    void *ctx;
+} bus_request_t;
+
+/**
+ * @brief Per-class queueing statistics
+ * 
+ * The histogram counts the time from submission until the request first
+ * went on the bus. Bucket upper bounds are 1, 2, 5, 10, 20, 50, 100, 200,
+ * 500, 1000 and 2000 ms; the last bucket holds longer waits.
+ */
+typedef struct {
+    uint32_t submitted;         // Requests accepted into the class queue
+    uint32_t queue_full;        // Requests rejected because the class queue was full
+    uint32_t served;            // Requests taken off the queue
+    uint32_t promoted;          // Served ahead of a waiting higher class through aging
+    uint32_t max_wait_us;
+    uint32_t wait_histogram[BUS_TASK_WAIT_BUCKETS];
+} bus_class_stats_t;
+
+/**
+ * @brief Per-slave statistics
+ */
+typedef struct {
+    uint8_t slave_addr;         // 0 for an unused entry
+    uint32_t requests;          // Requests taken off the queues
+    uint32_t completed;         // Answered with a response
+    uint32_t exceptions;        // Answered with a Modbus exception
+    uint32_t timeouts;          // Unanswered after every attempt or past the deadline
+    uint32_t bus_ms;            // Bus time used, unanswered attempts included
+    uint32_t exception_retries; // Attempts after a retryable exception
+    uint32_t exception_codes[BUS_TASK_EXCEPTION_CODES]; // Exceptions by code, retried included;
+                                                        // [0] counts codes above 11
+} bus_slave_stats_t;
+
+/**
+ * @brief Transaction engine statistics
+ */
+typedef struct {
+    bus_class_stats_t classes[BUS_CLASS_COUNT];
+    bus_slave_stats_t slaves[BUS_TASK_MAX_SLAVES];
+    uint32_t completed;         // Requests answered with a response
+    uint32_t exceptions;        // Requests answered with a Modbus exception
+    uint32_t timeouts;          // Requests that used up their attempts
+    uint32_t expired;           // Requests past their deadline before an attempt
+    uint32_t retries;           // Attempts after the first
+    uint32_t exception_retries; // Attempts after a retryable exception
+    uint32_t unmatched;         // Frames that did not answer the request on the bus
+    uint32_t coalesced;         // Reads answered by joining an identical request
+    uint32_t saved_bus_ms;      // Modelled bus time of the coalesced reads
+} bus_task_stats_t;
+
+/**
+ * @brief Initialize bus transaction engine
+ * 
+ * rs485_task_init() must have run.
+ * 
+ * @return ESP_OK on success
+ */
+esp_err_t bus_task_init(void);
+
+/**
+ * @brief Queue a request without waiting for it
+ * 
+ * @param request Request (copied, body included); may join an identical read
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM if the class queue or frame
+ *         pool is full, ESP_ERR_INVALID_STATE before bus_task_init()
+ */
+esp_err_t bus_task_submit(const bus_request_t *request);
+
+/**
+ * @brief Offer a received RS485 frame to the engine
+ * 
+ * Call from the RS485 frame callback. Completes the request on the bus if
+ * the frame answers it.
+ * 
+ * @param frame Modbus frame
+ * @param len Frame length
+ * @return true if the frame answered a local request and should go no further
+ */
+bool bus_task_on_frame(const uint8_t *frame, size_t len);
+
+/**
+ * @brief Run an RS485 line probe on the bus task
+ * 
+ * Returns at once; the probe runs before the next queued request, holds
+ * the bus until it finishes and stores the settings it accepts in the
+ * parameter store. Requests queued meanwhile wait.
+ * 
+ * @return ESP_OK if the probe is queued, ESP_ERR_INVALID_STATE before bus_task_init()
+ */
+esp_err_t bus_task_probe_line(void);
+
+/**
+ * @brief Get transaction engine statistics
+ * 
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t bus_task_get_stats(bus_task_stats_t *stats);
+
+/**
+ * @brief Wait percentile from a class histogram
+ * 
+ * @param stats Class statistics
+ * @param percent Percentile (1-100)
+ * @return Upper bound in ms of the bucket holding the percentile,
+ *         UINT32_MAX if it is the overflow bucket, 0 if nothing was served
+ */
+uint32_t bus_task_wait_percentile_ms(const bus_class_stats_t *stats, uint8_t percent);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BUS_TASK_H
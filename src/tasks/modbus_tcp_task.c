@@ -0,0 +1,736 @@
+/**
+ * @file modbus_tcp_task.c
+ * @brief Modbus TCP (MBAP) gateway implementation
+ * 
+ * One task serves every connection with select(). Requests go to the bus
+ * engine with bus_task_submit(), tagged with a pending slot; the completion
+ * callback runs on the RS485 or bus task, so it only copies the response
+ * into a pool buffer, queues it and wakes the select() through a loopback
+ * UDP socket. The gateway task then builds the MBAP response.
+ * 
+ * Pending slots outlive their connection: a slot whose connection closed
+ * stays taken until its bus request completes, and the completion is
+ * dropped. The completion queue has one entry per slot, so it never fills.
+ * 
+ * When the bus engine's queue is full the request stays in the receive
+ * buffer and is offered again every MODBUS_TCP_RETRY_MS; meanwhile the
+ * connection is not read, so the client is held back by TCP flow control
+ * rather than answered with exceptions.
+ */
+
+#include "modbus_tcp_task.h"
+#include "bus_task.h"
+#include "../protocol/function_codes.h"
+#include "../protocol/modbus_protocol.h"
+#include "../protocol/register_cache.h"
+#include "../protocol/device_routes.h"
+#include "../utils/frame_pool.h"
+#include "esp_log.h"
+#include "lwip/sockets.h"
+#include "lwip/inet.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+
+static const char *TAG = "modbus_tcp";
+
+#define MODBUS_TCP_BACKLOG          2
+#define MODBUS_TCP_MBAP_SIZE        7       // tid(2) pid(2) length(2) unit(1)
+#define MODBUS_TCP_MAX_PDU          253
+#define MODBUS_TCP_MAX_ADU          (MODBUS_TCP_MBAP_SIZE + MODBUS_TCP_MAX_PDU)
+#define MODBUS_TCP_TX_BUF_SIZE      1024    // Responses waiting for socket space
+#define MODBUS_TCP_SLOTS            (MODBUS_TCP_MAX_CLIENTS * MODBUS_TCP_MAX_PENDING)
+#define MODBUS_TCP_BUS_RETRIES      1
+#define MODBUS_TCP_MAX_READ         125     // Registers in one FC 0x03/0x04 read
+#define MODBUS_TCP_MAX_WRITE        123     // Registers in one FC 0x10 write
+#define MODBUS_TCP_RETRY_MS         5       // Bus queue full: offer held requests again
+
+/**
+ * @brief Request waiting for the bus
+ */
+typedef struct {
+    bool in_use;
+    uint8_t conn;               // Owning connection
+    uint16_t generation;        // Connection generation when the request arrived
+    uint16_t tid;               // MBAP transaction ID
+    uint8_t unit;               // MBAP unit ID, echoed back
+    uint8_t slave_addr;
+    uint8_t func_code;
+    uint16_t start;
+    uint16_t count;             // Registers read or written
+} modbus_tcp_slot_t;
+
+/**
+ * @brief Client connection
+ */
+typedef struct {
+    int sock;                   // -1 when free
+    uint16_t generation;        // Bumped on accept; older completions are dropped
+    uint8_t pending;            // Slots this connection has outstanding
+    bool held;                  // Next request waits for room in the bus queue
+    size_t rx_len;
+    size_t tx_len;
+    uint8_t rx[MODBUS_TCP_MAX_ADU];
+    uint8_t tx[MODBUS_TCP_TX_BUF_SIZE];
+} modbus_tcp_conn_t;
+
+/**
+ * @brief Completed bus request, queued for the gateway task
+ */
+typedef struct {
+    uint8_t slot;
+    uint8_t exception_code;
+    esp_err_t status;
+    frame_buf_t *frame;         // RTU response when status is ESP_OK
+} modbus_tcp_completion_t;
+
+typedef struct {
+    int listen_sock;
+    int ctrl_sock;              // Loopback UDP socket connected to itself
+    QueueHandle_t completions;
+    TaskHandle_t task_handle;
+    modbus_tcp_conn_t conns[MODBUS_TCP_MAX_CLIENTS];
+    modbus_tcp_slot_t slots[MODBUS_TCP_SLOTS];
+    modbus_tcp_stats_t stats;
+    portMUX_TYPE lock;          // Guards stats
+} modbus_tcp_t;
+
+static modbus_tcp_t s_mbtcp = {
+    .listen_sock = -1,
+    .ctrl_sock = -1,
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static void modbus_tcp_count(uint32_t *counter)
+{
+    portENTER_CRITICAL(&s_mbtcp.lock);
+    (*counter)++;
+    portEXIT_CRITICAL(&s_mbtcp.lock);
+}
+
+static int modbus_tcp_set_nonblocking(int sock)
+{
+    int flags = fcntl(sock, F_GETFL, 0);
+    return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ * @brief Wake the gateway task out of select()
+ * 
+ * Safe from any task; never blocks.
+ */
+static void modbus_tcp_wake(void)
+{
+    uint8_t byte = 0;
+    send(s_mbtcp.ctrl_sock, &byte, 1, MSG_DONTWAIT);
+}
+
+static void modbus_tcp_close(modbus_tcp_conn_t *conn)
+{
+    if (conn->sock < 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "Client %d closed (%u requests outstanding)",
+             (int)(conn - s_mbtcp.conns), conn->pending);
+    close(conn->sock);
+    conn->sock = -1;
+    conn->rx_len = 0;
+    conn->tx_len = 0;
+    conn->pending = 0;
+    conn->held = false;
+}
+
+/**
+ * @brief Write as much of the transmit buffer as the socket takes
+ */
+static void modbus_tcp_flush(modbus_tcp_conn_t *conn)
+{
+    while (conn->tx_len > 0) {
+        int n = send(conn->sock, conn->tx, conn->tx_len, MSG_DONTWAIT);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                modbus_tcp_close(conn);
+            }
+            return;
+        }
+        memmove(conn->tx, &conn->tx[n], conn->tx_len - n);
+        conn->tx_len -= n;
+    }
+}
+
+/**
+ * @brief Queue an MBAP response on a connection
+ * 
+ * A client that does not read its responses is disconnected once they
+ * fill the transmit buffer.
+ */
+static void modbus_tcp_respond(modbus_tcp_conn_t *conn, uint16_t tid, uint8_t unit,
+                               const uint8_t *pdu, size_t pdu_len)
+{
+    size_t adu_len = MODBUS_TCP_MBAP_SIZE + pdu_len;
+    if (conn->tx_len + adu_len > sizeof(conn->tx)) {
+        ESP_LOGW(TAG, "Client %d not reading responses, disconnecting",
+                 (int)(conn - s_mbtcp.conns));
+        modbus_tcp_count(&s_mbtcp.stats.slow_clients);
+        modbus_tcp_close(conn);
+        return;
+    }
+
+    uint8_t *out = &conn->tx[conn->tx_len];
+    out[0] = (uint8_t)(tid >> 8);
+    out[1] = (uint8_t)(tid & 0xFF);
+    out[2] = 0;
+    out[3] = 0;
+    out[4] = (uint8_t)((pdu_len + 1) >> 8);
+    out[5] = (uint8_t)((pdu_len + 1) & 0xFF);
+    out[6] = unit;
+    memcpy(&out[MODBUS_TCP_MBAP_SIZE], pdu, pdu_len);
+    conn->tx_len += adu_len;
+
+    portENTER_CRITICAL(&s_mbtcp.lock);
+    s_mbtcp.stats.responses++;
+    // Bit 7 alone does not tell: 0x88 and 0xFE responses carry it too
+    if ((pdu[0] & 0x80) && pdu_len == 2) {
+        s_mbtcp.stats.exceptions++;
+    }
+    portEXIT_CRITICAL(&s_mbtcp.lock);
+
+    modbus_tcp_flush(conn);
+}
+
+static void modbus_tcp_respond_exception(modbus_tcp_conn_t *conn, uint16_t tid, uint8_t unit,
+                                         uint8_t func_code, uint8_t code)
+{
+    uint8_t pdu[2] = { (uint8_t)(func_code | 0x80), code };
+    modbus_tcp_respond(conn, tid, unit, pdu, sizeof(pdu));
+}
+
+/**
+ * @brief Bus completion; runs on the RS485 or bus task
+ */
+static void modbus_tcp_bus_complete(const bus_result_t *result,
+                                    const uint8_t *frame, size_t len, void *ctx)
+{
+    modbus_tcp_completion_t completion = {
+        .slot = (uint8_t)(uintptr_t)ctx,
+        .exception_code = result->exception_code,
+        .status = result->status,
+        .frame = NULL,
+    };
+
+    if (result->status == ESP_OK && frame != NULL) {
+        completion.frame = frame_pool_alloc(len);
+        if (completion.frame == NULL) {
+            completion.status = ESP_ERR_NO_MEM;
+        } else {
+            memcpy(completion.frame->data, frame, len);
+            completion.frame->len = (uint16_t)len;
+        }
+    }
+
+    // One queue entry per slot: this cannot fail
+    xQueueSend(s_mbtcp.completions, &completion, 0);
+    modbus_tcp_wake();
+}
+
+/**
+ * @brief Answer the request of a completed slot, if its client is still there
+ */
+static void modbus_tcp_finish(const modbus_tcp_completion_t *completion)
+{
+    modbus_tcp_slot_t *slot = &s_mbtcp.slots[completion->slot];
+    modbus_tcp_conn_t *conn = &s_mbtcp.conns[slot->conn];
+    bool connected = conn->sock >= 0 && conn->generation == slot->generation;
+    const frame_buf_t *frame = completion->frame;
+
+    if (completion->status == ESP_OK && frame != NULL && frame->len >= 4) {
+        // RTU: addr, PDU, crc(2)
+        const uint8_t *pdu = &frame->data[1];
+        size_t pdu_len = frame->len - 3;
+        if (slot->func_code == MODBUS_FC_READ_HOLDING_REGISTERS ||
+            slot->func_code == MODBUS_FC_READ_INPUT_REGISTERS) {
+            register_cache_store(slot->slave_addr, slot->func_code, slot->start,
+                                 &pdu[2], slot->count);
+        }
+        if (connected) {
+            modbus_tcp_respond(conn, slot->tid, slot->unit, pdu, pdu_len);
+        }
+    } else if (connected) {
+        uint8_t code = MODBUS_EXC_SLAVE_FAILURE;
+        if (completion->status == ESP_ERR_INVALID_RESPONSE) {
+            code = completion->exception_code;
+        } else if (completion->status == ESP_ERR_TIMEOUT) {
+            code = MODBUS_EXC_GATEWAY_TARGET;
+            modbus_tcp_count(&s_mbtcp.stats.timeouts);
+        }
+        modbus_tcp_respond_exception(conn, slot->tid, slot->unit, slot->func_code, code);
+    }
+
+    // A write makes the cached values stale whatever the outcome
+    if (slot->func_code == MODBUS_FC_WRITE_SINGLE_REGISTER ||
+        slot->func_code == MODBUS_FC_WRITE_MULTIPLE_REGISTERS) {
+        register_cache_forget(slot->slave_addr, MODBUS_FC_READ_HOLDING_REGISTERS,
+                              slot->start, slot->count);
+    }
+
+    if (frame != NULL) {
+        frame_buf_unref(completion->frame);
+    }
+    if (connected) {
+        conn->pending--;
+    }
+    slot->in_use = false;
+}
+
+static int modbus_tcp_alloc_slot(void)
+{
+    for (int i = 0; i < MODBUS_TCP_SLOTS; i++) {
+        if (!s_mbtcp.slots[i].in_use) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Map a unit ID to an RS485 slave, 0 if unknown
+ */
+static uint8_t modbus_tcp_unit_slave(uint8_t unit)
+{
+    if (unit == 0 || unit == 0xFF) {
+        const device_route_t *route = device_routes_by_id(DEVICE_ID_INVERTER);
+        return (route != NULL) ? route->slave_addr : 0;
+    }
+    return (device_routes_by_slave(unit) != NULL) ? unit : 0;
+}
+
+/**
+ * @brief Handle one MBAP request
+ * 
+ * Answered at once from the cache or with an exception, or handed to the
+ * bus engine.
+ * 
+ * @return false if the bus queue is full and the request must be offered again
+ */
+static bool modbus_tcp_request(modbus_tcp_conn_t *conn, uint16_t tid, uint8_t unit,
+                               const uint8_t *pdu, size_t pdu_len)
+{
+    uint8_t fc = pdu[0];
+    bool retry = conn->held;
+    if (!retry) {
+        modbus_tcp_count(&s_mbtcp.stats.requests);
+    }
+    conn->held = false;
+
+    uint8_t slave_addr = modbus_tcp_unit_slave(unit);
+    if (slave_addr == 0) {
+        modbus_tcp_respond_exception(conn, tid, unit, fc, MODBUS_EXC_GATEWAY_PATH);
+        return true;
+    }
+
+    bus_request_t request = {
+        .slave_addr = slave_addr,
+        .func_code = fc,
+        .body = &pdu[1],
+        .body_len = pdu_len - 1,
+        .retries = MODBUS_TCP_BUS_RETRIES,
+        .priority = BUS_CLASS_INTERACTIVE,
+        .local = true,
+        .callback = modbus_tcp_bus_complete,
+    };
+    bool valid = true;
+
+    switch (fc) {
+        case MODBUS_FC_READ_HOLDING_REGISTERS:
+        case MODBUS_FC_READ_INPUT_REGISTERS: {
+            if (pdu_len != 5) {
+                valid = false;
+                break;
+            }
+            request.start = (uint16_t)((pdu[1] << 8) | pdu[2]);
+            request.count = (uint16_t)((pdu[3] << 8) | pdu[4]);
+            if (request.count == 0 || request.count > MODBUS_TCP_MAX_READ) {
+                valid = false;
+                break;
+            }
+
+            uint8_t response[2 + 2 * MODBUS_TCP_MAX_READ];
+            if (register_cache_read(slave_addr, fc, request.start, request.count, 0,
+                                    &response[2]) == ESP_OK) {
+                response[0] = fc;
+                response[1] = (uint8_t)(2 * request.count);
+                modbus_tcp_count(&s_mbtcp.stats.cache_hits);
+                modbus_tcp_respond(conn, tid, unit, response, 2 + 2 * (size_t)request.count);
+                return true;
+            }
+
+            // Let identical reads share one bus request
+            request.body = NULL;
+            request.body_len = 0;
+            break;
+        }
+
+        case MODBUS_FC_WRITE_SINGLE_REGISTER:
+            valid = (pdu_len == 5);
+            request.start = (uint16_t)((pdu[1] << 8) | pdu[2]);
+            request.count = 1;
+            request.priority = BUS_CLASS_CONTROL;
+            break;
+
+        case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+            request.start = (uint16_t)((pdu[1] << 8) | pdu[2]);
+            request.count = (pdu_len >= 6) ? (uint16_t)((pdu[3] << 8) | pdu[4]) : 0;
+            valid = pdu_len >= 6 && request.count > 0 && request.count <= MODBUS_TCP_MAX_WRITE &&
+                    pdu[5] == 2 * request.count && pdu_len == 6 + (size_t)pdu[5];
+            request.priority = BUS_CLASS_CONTROL;
+            break;
+
+        default:
+            // Custom function codes pass through; the bus engine matches on the code alone.
+            // 0x88 and 0xFE have bit 7 set but are requests: refuse only exception codes
+            if (!modbus_rtu_is_supported(fc) ||
+                ((fc & 0x80) != 0 && modbus_rtu_is_supported((uint8_t)(fc & ~0x80)))) {
+                modbus_tcp_respond_exception(conn, tid, unit, fc, MODBUS_EXC_ILLEGAL_FUNCTION);
+                return true;
+            }
+            break;
+    }
+
+    if (!valid) {
+        modbus_tcp_respond_exception(conn, tid, unit, fc, MODBUS_EXC_ILLEGAL_VALUE);
+        return true;
+    }
+
+    // Slots of closed connections may still be waiting for the bus
+    int index = modbus_tcp_alloc_slot();
+    if (index < 0) {
+        conn->held = true;
+        if (!retry) {
+            modbus_tcp_count(&s_mbtcp.stats.held);
+        }
+        return false;
+    }
+
+    modbus_tcp_slot_t *slot = &s_mbtcp.slots[index];
+    slot->in_use = true;
+    slot->conn = (uint8_t)(conn - s_mbtcp.conns);
+    slot->generation = conn->generation;
+    slot->tid = tid;
+    slot->unit = unit;
+    slot->slave_addr = slave_addr;
+    slot->func_code = fc;
+    slot->start = request.start;
+    slot->count = request.count;
+    request.ctx = (void *)(uintptr_t)index;
+
+    esp_err_t ret = bus_task_submit(&request);
+    if (ret == ESP_ERR_NO_MEM) {
+        slot->in_use = false;
+        conn->held = true;
+        if (!retry) {
+            modbus_tcp_count(&s_mbtcp.stats.held);
+        }
+        return false;
+    }
+    if (ret != ESP_OK) {
+        // Offering it again would fail the same way
+        ESP_LOGD(TAG, "Client %d request not queued: %d", (int)(conn - s_mbtcp.conns), ret);
+        slot->in_use = false;
+        modbus_tcp_respond_exception(conn, tid, unit, fc, MODBUS_EXC_GATEWAY_TARGET);
+        return true;
+    }
+
+    conn->pending++;
+    portENTER_CRITICAL(&s_mbtcp.lock);
+    s_mbtcp.stats.bus_requests++;
+    if (conn->pending > s_mbtcp.stats.max_pending) {
+        s_mbtcp.stats.max_pending = conn->pending;
+    }
+    portEXIT_CRITICAL(&s_mbtcp.lock);
+    return true;
+}
+
+/**
+ * @brief Handle the complete requests in a connection's receive buffer
+ * 
+ * Stops at MODBUS_TCP_MAX_PENDING outstanding requests or a full bus
+ * queue; the rest wait in the buffer, and the socket is not read until
+ * they can go, so TCP flow control holds the client back.
+ */
+static void modbus_tcp_parse(modbus_tcp_conn_t *conn)
+{
+    size_t offset = 0;
+
+    while (conn->sock >= 0 && conn->pending < MODBUS_TCP_MAX_PENDING &&
+           conn->rx_len - offset >= MODBUS_TCP_MBAP_SIZE) {
+        const uint8_t *adu = &conn->rx[offset];
+        uint16_t tid = (uint16_t)((adu[0] << 8) | adu[1]);
+        uint16_t protocol = (uint16_t)((adu[2] << 8) | adu[3]);
+        uint16_t length = (uint16_t)((adu[4] << 8) | adu[5]);
+
+        // length counts the unit ID and the PDU
+        if (protocol != 0 || length < 2 || length > MODBUS_TCP_MAX_PDU + 1) {
+            ESP_LOGW(TAG, "Client %d sent a bad MBAP header, disconnecting",
+                     (int)(conn - s_mbtcp.conns));
+            modbus_tcp_count(&s_mbtcp.stats.bad_frames);
+            modbus_tcp_close(conn);
+            return;
+        }
+
+        size_t adu_len = 6 + (size_t)length;
+        if (conn->rx_len - offset < adu_len) {
+            break;
+        }
+
+        if (!modbus_tcp_request(conn, tid, adu[6], &adu[MODBUS_TCP_MBAP_SIZE],
+                                adu_len - MODBUS_TCP_MBAP_SIZE)) {
+            break;
+        }
+        offset += adu_len;
+    }
+
+    if (conn->sock >= 0 && offset > 0) {
+        memmove(conn->rx, &conn->rx[offset], conn->rx_len - offset);
+        conn->rx_len -= offset;
+    }
+}
+
+static void modbus_tcp_receive(modbus_tcp_conn_t *conn)
+{
+    int n = recv(conn->sock, &conn->rx[conn->rx_len], sizeof(conn->rx) - conn->rx_len,
+                 MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        modbus_tcp_close(conn);
+        return;
+    }
+    if (n > 0) {
+        conn->rx_len += n;
+        modbus_tcp_parse(conn);
+    }
+}
+
+static void modbus_tcp_accept(void)
+{
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_len = sizeof(client_addr);
+    int sock = accept(s_mbtcp.listen_sock, (struct sockaddr *)&client_addr, &client_addr_len);
+    if (sock < 0) {
+        return;
+    }
+
+    modbus_tcp_conn_t *conn = NULL;
+    for (int i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++) {
+        if (s_mbtcp.conns[i].sock < 0) {
+            conn = &s_mbtcp.conns[i];
+            break;
+        }
+    }
+    if (conn == NULL) {
+        ESP_LOGW(TAG, "No free connection, refusing %s", inet_ntoa(client_addr.sin_addr));
+        modbus_tcp_count(&s_mbtcp.stats.rejected);
+        close(sock);
+        return;
+    }
+
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    modbus_tcp_set_nonblocking(sock);
+
+    conn->sock = sock;
+    conn->generation++;
+    conn->pending = 0;
+    conn->rx_len = 0;
+    conn->tx_len = 0;
+    modbus_tcp_count(&s_mbtcp.stats.connections);
+
+    ESP_LOGI(TAG, "Client %d connected from %s:%d", (int)(conn - s_mbtcp.conns),
+             inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+}
+
+/**
+ * @brief Create the listening socket and the loopback wake-up socket
+ */
+static esp_err_t modbus_tcp_open_sockets(void)
+{
+    struct sockaddr_in addr;
+    int opt = 1;
+
+    s_mbtcp.listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (s_mbtcp.listen_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create socket: %d", errno);
+        return ESP_FAIL;
+    }
+    setsockopt(s_mbtcp.listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(MODBUS_TCP_PORT);
+    if (bind(s_mbtcp.listen_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(s_mbtcp.listen_sock, MODBUS_TCP_BACKLOG) < 0) {
+        ESP_LOGE(TAG, "Failed to listen on port %d: %d", MODBUS_TCP_PORT, errno);
+        return ESP_FAIL;
+    }
+    modbus_tcp_set_nonblocking(s_mbtcp.listen_sock);
+
+    // Bound to an ephemeral loopback port and connected to itself
+    s_mbtcp.ctrl_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s_mbtcp.ctrl_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create control socket: %d", errno);
+        return ESP_FAIL;
+    }
+    socklen_t addr_len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(s_mbtcp.ctrl_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        getsockname(s_mbtcp.ctrl_sock, (struct sockaddr *)&addr, &addr_len) < 0 ||
+        connect(s_mbtcp.ctrl_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        ESP_LOGE(TAG, "Failed to set up control socket: %d", errno);
+        return ESP_FAIL;
+    }
+    modbus_tcp_set_nonblocking(s_mbtcp.ctrl_sock);
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Gateway task
+ */
+static void modbus_tcp_task(void *pvParameters)
+{
+    ESP_LOGI(TAG, "Modbus TCP gateway listening on port %d", MODBUS_TCP_PORT);
+
+    while (1) {
+        fd_set read_fds;
+        fd_set write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        FD_SET(s_mbtcp.listen_sock, &read_fds);
+        FD_SET(s_mbtcp.ctrl_sock, &read_fds);
+        int max_fd = (s_mbtcp.listen_sock > s_mbtcp.ctrl_sock) ?
+                     s_mbtcp.listen_sock : s_mbtcp.ctrl_sock;
+        bool held = false;
+
+        for (int i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++) {
+            modbus_tcp_conn_t *conn = &s_mbtcp.conns[i];
+            if (conn->sock < 0) {
+                continue;
+            }
+            // No reading while buffered requests are held back
+            if (conn->pending < MODBUS_TCP_MAX_PENDING && !conn->held &&
+                conn->rx_len < sizeof(conn->rx)) {
+                FD_SET(conn->sock, &read_fds);
+            }
+            held |= conn->held;
+            if (conn->tx_len > 0) {
+                FD_SET(conn->sock, &write_fds);
+            }
+            if (conn->sock > max_fd) {
+                max_fd = conn->sock;
+            }
+        }
+
+        struct timeval retry = { .tv_sec = 0, .tv_usec = MODBUS_TCP_RETRY_MS * 1000 };
+        if (select(max_fd + 1, &read_fds, &write_fds, NULL, held ? &retry : NULL) < 0) {
+            if (errno != EINTR) {
+                ESP_LOGE(TAG, "select failed: %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(100));
+            }
+            continue;
+        }
+
+        if (FD_ISSET(s_mbtcp.ctrl_sock, &read_fds)) {
+            uint8_t drain[16];
+            while (recv(s_mbtcp.ctrl_sock, drain, sizeof(drain), MSG_DONTWAIT) > 0) {
+            }
+        }
+
+        // Completions first: they free slots for requests already buffered
+        modbus_tcp_completion_t completion;
+        while (xQueueReceive(s_mbtcp.completions, &completion, 0) == pdTRUE) {
+            modbus_tcp_finish(&completion);
+        }
+
+        for (int i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++) {
+            modbus_tcp_conn_t *conn = &s_mbtcp.conns[i];
+            if (conn->sock < 0) {
+                continue;
+            }
+            if (FD_ISSET(conn->sock, &write_fds)) {
+                modbus_tcp_flush(conn);
+            }
+            if (conn->sock >= 0 && FD_ISSET(conn->sock, &read_fds)) {
+                modbus_tcp_receive(conn);
+            } else if (conn->sock >= 0 && conn->rx_len > 0) {
+                modbus_tcp_parse(conn);
+            }
+        }
+
+        if (FD_ISSET(s_mbtcp.listen_sock, &read_fds)) {
+            modbus_tcp_accept();
+        }
+    }
+}
+
+/**
+ * @brief Initialize the Modbus TCP gateway
+ */
+esp_err_t modbus_tcp_task_init(void)
+{
+    for (int i = 0; i < MODBUS_TCP_MAX_CLIENTS; i++) {
+        s_mbtcp.conns[i].sock = -1;
+    }
+
+    s_mbtcp.completions = xQueueCreate(MODBUS_TCP_SLOTS, sizeof(modbus_tcp_completion_t));
+    if (s_mbtcp.completions == NULL) {
+        ESP_LOGE(TAG, "Failed to create completion queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_err_t ret = modbus_tcp_open_sockets();
+    if (ret != ESP_OK) {
+        if (s_mbtcp.listen_sock >= 0) {
+            close(s_mbtcp.listen_sock);
+            s_mbtcp.listen_sock = -1;
+        }
+        if (s_mbtcp.ctrl_sock >= 0) {
+            close(s_mbtcp.ctrl_sock);
+            s_mbtcp.ctrl_sock = -1;
+        }
+        vQueueDelete(s_mbtcp.completions);
+        return ret;
+    }
+
+    // Same priority as the TCP server
+    BaseType_t task_ret = xTaskCreate(modbus_tcp_task, "modbus_tcp", 4096, NULL, 5,
+                                      &s_mbtcp.task_handle);
+    if (task_ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create Modbus TCP task");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Modbus TCP gateway initialized (%d clients, %d requests each)",
+             MODBUS_TCP_MAX_CLIENTS, MODBUS_TCP_MAX_PENDING);
+    return ESP_OK;
+}
+
+/**
+ * @brief Get gateway statistics
+ */
+esp_err_t modbus_tcp_task_get_stats(modbus_tcp_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_mbtcp.lock);
+    *stats = s_mbtcp.stats;
+    portEXIT_CRITICAL(&s_mbtcp.lock);
+
+    return ESP_OK;
+}
@@ -0,0 +1,77 @@
+/**
+ * @file modbus_tcp_task.h
+ * @brief Modbus TCP (MBAP) gateway
+ * 
+ * Serves standard Modbus TCP clients (SCADA, Home Assistant) on port 502
+ * alongside the proprietary local server. Each MBAP request is translated
+ * to RTU and run through the bus transaction engine; the response goes
+ * back with the request's transaction ID and unit ID.
+ * 
+ * A connection may have up to MODBUS_TCP_MAX_PENDING requests outstanding.
+ * They are answered as they complete, which need not be the order they
+ * were sent in: register reads the cache can answer are answered at once,
+ * and writes go ahead of reads on the bus. Clients match responses by
+ * transaction ID, as the protocol requires.
+ * 
+ * The unit ID is the RS485 slave address; 0 and 255 mean the inverter.
+ * Only slaves in the routing table are reachable.
+ */
+
+#ifndef MODBUS_TCP_TASK_H
+#define MODBUS_TCP_TASK_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef MODBUS_TCP_PORT
+#define MODBUS_TCP_PORT             502
+#endif
+#define MODBUS_TCP_MAX_CLIENTS      4
+#define MODBUS_TCP_MAX_PENDING      8       // Outstanding requests per connection
+
+/**
+ * @brief Gateway statistics
+ */
+typedef struct {
+    uint32_t connections;       // Connections accepted
+    uint32_t rejected;          // Connections refused, every slot in use
+    uint32_t requests;          // MBAP requests received
+    uint32_t cache_hits;        // Reads answered from the register cache
+    uint32_t bus_requests;      // Requests run on the RS485 bus
+    uint32_t responses;         // Responses sent, exceptions included
+    uint32_t exceptions;        // Exception responses sent
+    uint32_t timeouts;          // Bus requests unanswered (sent as exception 0x0B)
+    uint32_t held;              // Requests that waited for room in the bus queue
+    uint32_t bad_frames;        // Malformed MBAP headers (connection closed)
+    uint32_t slow_clients;      // Connections closed with responses backed up
+    uint32_t max_pending;       // Most requests outstanding on one connection
+} modbus_tcp_stats_t;
+
+/**
+ * @brief Initialize the Modbus TCP gateway
+ * 
+ * bus_task_init() and device_routes_init() must have run.
+ * 
+ * @return ESP_OK on success
+ */
+esp_err_t modbus_tcp_task_init(void);
+
+/**
+ * @brief Get gateway statistics
+ * 
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t modbus_tcp_task_get_stats(modbus_tcp_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MODBUS_TCP_TASK_H
@@ -0,0 +1,277 @@
+/**
+ * @file poll_task.c
+ * @brief Inverter register poll task implementation
+ */
+
+#include "poll_task.h"
+#include "rs485_task.h"
+#include "bus_task.h"
+#include "uplink_task.h"
+#include "tcp_server_task.h"
+#include "../protocol/poll_planner.h"
+#include "../protocol/register_cache.h"
+#include "../protocol/device_routes.h"
+#include "../protocol/data_process.h"
+#include "../utils/poll_timer.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+
+static const char *TAG = "poll_task";
+
+#define POLL_TASK_BITS_PER_CHAR     11      // 8E1: start + 8 data + parity + stop
+#define POLL_TASK_TURNAROUND_US     20000   // Slave processing time per request
+#define POLL_TASK_STACK_SIZE        3072
+#define POLL_TASK_PRIORITY          6       // Below the RS485 (10) and bus (9) tasks
+#define POLL_TASK_CACHE_PERIODS     2       // Cached registers stay fresh for this many sweeps
+
+static struct {
+    TaskHandle_t task_handle;
+    poll_bus_timing_t timing;
+    poll_range_t ranges[POLL_PLANNER_MAX_RANGES];   // Every routed device's ranges
+    size_t range_count;
+    poll_range_t plan[POLL_PLANNER_MAX_RANGES];
+    size_t plan_len;
+    volatile bool sweeping;
+    uint32_t tick;              // Query periods since start, for per-device schedules
+    uint32_t outstanding;       // Requests of the running sweep not yet completed
+    int64_t sweep_start_us;
+    portMUX_TYPE lock;
+    poll_task_stats_t stats;
+} s_poll = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+/**
+ * @brief Poll timer callback (esp_timer task)
+ */
+static void poll_task_trigger(void)
+{
+    if (s_poll.sweeping) {
+        portENTER_CRITICAL(&s_poll.lock);
+        s_poll.stats.overruns++;
+        portEXIT_CRITICAL(&s_poll.lock);
+        return;
+    }
+    xTaskNotifyGive(s_poll.task_handle);
+}
+
+/**
+ * @brief Account for one finished request; the last one closes the sweep
+ */
+static void poll_task_request_done(bool timed_out)
+{
+    portENTER_CRITICAL(&s_poll.lock);
+    if (timed_out) {
+        s_poll.stats.timeouts++;
+    }
+    bool last = (--s_poll.outstanding == 0);
+    if (last) {
+        s_poll.stats.last_sweep_us = (uint32_t)(esp_timer_get_time() - s_poll.sweep_start_us);
+        s_poll.stats.sweeps++;
+    }
+    portEXIT_CRITICAL(&s_poll.lock);
+
+    if (last) {
+        s_poll.sweeping = false;
+    }
+}
+
+/**
+ * @brief Completion of one planned read
+ * 
+ * Runs on the RS485 task (response) or the bus task (timeout).
+ */
+static void poll_task_on_complete(const bus_result_t *result,
+                                  const uint8_t *frame, size_t len, void *ctx)
+{
+    const poll_range_t *request = (const poll_range_t *)ctx;
+
+    if (result->status == ESP_OK && frame != NULL) {
+        // addr, fc, byte count, data, crc(2); the engine checked the byte count
+        register_cache_store(request->slave_addr, request->func_code, request->start,
+                             &frame[3], request->count);
+
+        // The cloud gets the block change-only through the uplink task,
+        // subscribed local clients in full
+        const device_route_t *route = device_routes_by_slave(request->slave_addr);
+        uint8_t device_id = (route != NULL) ? route->device_id : PROTOCOL_DEVICE_DEFAULT;
+        uplink_task_submit_block(device_id, request->func_code, request->start,
+                                 &frame[2], 1 + 2 * (size_t)request->count);
+        tcp_server_task_publish(device_id, &frame[2], 1 + 2 * (size_t)request->count);
+    } else {
+        ESP_LOGD(TAG, "Read failed (%d): slave=%u fc=0x%02X start=%u count=%u",
+                 result->status, request->slave_addr, request->func_code,
+                 request->start, request->count);
+    }
+    poll_task_request_done(result->status == ESP_ERR_TIMEOUT);
+}
+
+/**
+ * @brief Check whether a device is due in this query period
+ */
+static bool poll_task_due(uint8_t slave_addr, uint32_t tick)
+{
+    const device_route_t *route = device_routes_by_slave(slave_addr);
+    return route != NULL && route->poll_every > 0 && tick % route->poll_every == 0;
+}
+
+/**
+ * @brief Collect the poll ranges of every routed device
+ */
+static void poll_task_collect_ranges(void)
+{
+    s_poll.range_count = 0;
+    for (size_t r = 0; r < device_routes_count(); r++) {
+        const device_route_t *route = device_routes_at(r);
+        for (size_t i = 0; i < route->poll_range_count; i++) {
+            if (s_poll.range_count == POLL_PLANNER_MAX_RANGES) {
+                ESP_LOGW(TAG, "Poll list full, %s ranges dropped", route->name);
+                return;
+            }
+            poll_range_t range = route->poll_ranges[i];
+            range.slave_addr = route->slave_addr;
+            s_poll.ranges[s_poll.range_count++] = range;
+        }
+    }
+}
+
+/**
+ * @brief Build the poll plan for the current line speed
+ */
+static esp_err_t poll_task_plan(void)
+{
+    s_poll.timing.baud_rate = rs485_task_get_baud_rate();
+    s_poll.timing.bits_per_char = POLL_TASK_BITS_PER_CHAR;
+    s_poll.timing.turnaround_us = POLL_TASK_TURNAROUND_US;
+
+    esp_err_t ret = poll_planner_build(s_poll.ranges, s_poll.range_count, &s_poll.timing,
+                                       s_poll.plan, POLL_PLANNER_MAX_RANGES, &s_poll.plan_len);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to build poll plan: %d", ret);
+        return ret;
+    }
+
+    s_poll.stats.ranges = s_poll.range_count;
+    s_poll.stats.planned_requests = s_poll.plan_len;
+    s_poll.stats.naive_sweep_us = poll_planner_sweep_us(&s_poll.timing, s_poll.ranges,
+                                                        s_poll.range_count);
+    s_poll.stats.planned_sweep_us = poll_planner_sweep_us(&s_poll.timing, s_poll.plan,
+                                                          s_poll.plan_len);
+
+    ESP_LOGI(TAG, "Poll plan: %u ranges -> %u requests, bus time %lu ms (per-range %lu ms)",
+             s_poll.stats.ranges, s_poll.stats.planned_requests,
+             (unsigned long)(s_poll.stats.planned_sweep_us / 1000),
+             (unsigned long)(s_poll.stats.naive_sweep_us / 1000));
+
+    return ESP_OK;
+}
+
+/**
+ * @brief Poll task
+ * 
+ * Queues every read due in this period at once, so the bus engine can
+ * interleave the devices; the sweep ends when the last read completes.
+ */
+static void poll_task(void *pvParameters)
+{
+    while (1) {
+        if (ulTaskNotifyTake(pdTRUE, portMAX_DELAY) == 0) {
+            continue;
+        }
+
+        s_poll.sweeping = true;
+        if (rs485_task_get_baud_rate() != s_poll.timing.baud_rate) {
+            // The line was reprobed; gaps worth bridging depend on its speed
+            poll_task_plan();
+        }
+
+        uint32_t tick = s_poll.tick++;
+        s_poll.sweep_start_us = esp_timer_get_time();
+        s_poll.outstanding = 1;     // Held until every read is queued
+        size_t queued = 0;
+
+        for (size_t i = 0; i < s_poll.plan_len; i++) {
+            const poll_range_t *request = &s_poll.plan[i];
+            if (!poll_task_due(request->slave_addr, tick)) {
+                continue;
+            }
+
+            bus_request_t bus_request = {
+                .slave_addr = request->slave_addr,
+                .func_code = request->func_code,
+                .start = request->start,
+                .count = request->count,
+                .priority = BUS_CLASS_BACKGROUND,
+                .local = true,
+                .callback = poll_task_on_complete,
+                .ctx = (void *)request,
+            };
+
+            portENTER_CRITICAL(&s_poll.lock);
+            s_poll.outstanding++;
+            s_poll.stats.requests++;
+            portEXIT_CRITICAL(&s_poll.lock);
+
+            esp_err_t ret = bus_task_submit(&bus_request);
+            if (ret != ESP_OK) {
+                ESP_LOGD(TAG, "Read not queued (%d): slave=%u fc=0x%02X start=%u",
+                         ret, request->slave_addr, request->func_code, request->start);
+                poll_task_request_done(false);
+                continue;
+            }
+            queued++;
+        }
+
+        ESP_LOGD(TAG, "Sweep %lu: %zu requests queued", (unsigned long)tick, queued);
+        poll_task_request_done(false);
+    }
+}
+
+/**
+ * @brief Initialize poll task
+ */
+esp_err_t poll_task_init(void)
+{
+    poll_task_collect_ranges();
+    esp_err_t ret = poll_task_plan();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    BaseType_t task_ret = xTaskCreate(poll_task, "poll", POLL_TASK_STACK_SIZE, NULL,
+                                      POLL_TASK_PRIORITY, &s_poll.task_handle);
+    if (task_ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create poll task");
+        return ESP_FAIL;
+    }
+
+    // Registers stay fresh for a few sweeps of the least often polled device
+    uint32_t period_ms = poll_timer_get_configured_period();
+    uint32_t max_every = 1;
+    for (size_t r = 0; r < device_routes_count(); r++) {
+        if (device_routes_at(r)->poll_every > max_every) {
+            max_every = device_routes_at(r)->poll_every;
+        }
+    }
+    register_cache_set_max_age(period_ms * max_every * POLL_TASK_CACHE_PERIODS);
+
+    return poll_timer_start(poll_task_trigger, period_ms);
+}
+
+/**
+ * @brief Get poll sweep statistics
+ */
+esp_err_t poll_task_get_stats(poll_task_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_poll.lock);
+    *stats = s_poll.stats;
+    portEXIT_CRITICAL(&s_poll.lock);
+    return ESP_OK;
+}
@@ -0,0 +1,63 @@
+/**
+ * @file poll_task.h
+ * @brief Register poll task
+ * 
+ * Plans the register sweep of every routed device (see device_routes.h)
+ * once at start-up with the poll planner and runs it from the poll timer
+ * at the query period (param ID 8). Each device is swept every
+ * poll_every periods. A sweep queues its reads on the bus transaction
+ * engine together, so devices are interleaved fairly. Responses refresh
+ * the register cache partition of their slave and go to the cloud through
+ * the uplink task, which sends only what changed.
+ */
+
+#ifndef POLL_TASK_H
+#define POLL_TASK_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Poll sweep statistics
+ */
+typedef struct {
+    uint32_t sweeps;            // Sweeps completed
+    uint32_t overruns;          // Timer ticks that found a sweep still running
+    uint32_t requests;          // Read requests queued
+    uint32_t timeouts;          // Requests with no response in time
+    uint16_t ranges;            // Register ranges in the poll list
+    uint16_t planned_requests;  // Requests the planner merged them into
+    uint32_t naive_sweep_us;    // Estimated bus time reading each range separately
+    uint32_t planned_sweep_us;  // Estimated bus time of the planned sweep
+    uint32_t last_sweep_us;     // Measured duration of the last sweep
+} poll_task_stats_t;
+
+/**
+ * @brief Initialize poll task
+ * 
+ * Builds the poll plan for the RS485 line speed, starts the task and
+ * starts the poll timer at the configured query period. poll_timer_init(),
+ * device_routes_init(), rs485_task_init() and bus_task_init() must have run.
+ * 
+ * @return ESP_OK on success
+ */
+esp_err_t poll_task_init(void);
+
+/**
+ * @brief Get poll sweep statistics
+ * 
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t poll_task_get_stats(poll_task_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // POLL_TASK_H
@@ -7,20 +7,32 @@
  * This task handles:
  * - UART initialization for RS485 half-duplex mode
  * - Modbus frame reception and transmission
- * - CRC validation
- * - Function code processing (0x03, 0x04, 0x21, 0x22, 0x88, 0xFE)
+ * - Incremental frame delimiting and CRC validation (modbus_framer)
+ * - Function code processing (0x03, 0x04, 0x06, 0x10, 0x21, 0x22, 0x88, 0xFE)
+ *   and their exception responses
  * - Frame timeout handling
+ * 
+ * Inter-frame timing follows the Modbus RTU rules for the configured line
+ * speed (t1.5 / t3.5, fixed above 19200 baud). The slave's turnaround and
+ * the pauses it leaves inside a frame are measured on every response, so
+ * the bus task can size its response deadlines from observed behaviour.
  */
 
 #include "rs485_task.h"
 #include "../protocol/modbus_protocol.h"
+#include "../protocol/modbus_framer.h"
 #include "../protocol/crc_utils.h"
 #include "../protocol/function_codes.h"
+#include "../config/param_manager.h"
+#include "../config/param_ids.h"
+#include "../utils/frame_pool.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "driver/uart.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -29,11 +41,21 @@ static const char *TAG = "rs485_task";
 #define RS485_UART_NUM           UART_NUM_2
 #define RS485_RX_BUF_SIZE        512
 #define RS485_TX_BUF_SIZE        0
-#define RS485_BAUD_RATE          9600
+#define RS485_BAUD_RATE          9600    // Until configured or probed
 #define RS485_DATA_BITS          UART_DATA_8_BITS
-#define RS485_PARITY             UART_PARITY_EVEN
-#define RS485_STOP_BITS          UART_STOP_BITS_1
-#define RS485_RX_TIMEOUT         5  // 5ms timeout
+#define RS485_PARITY             LINE_PARITY_EVEN
+#define RS485_BITS_PER_CHAR      11      // 8E1: start + 8 data + parity + stop
+#define RS485_FIXED_TIMING_BAUD  19200   // Above this t1.5/t3.5 are fixed
+#define RS485_FIXED_T15_US       750
+#define RS485_FIXED_T35_US       1750
+#define RS485_RX_TOUT_MAX        100     // UART RX timeout limit (symbols)
+#define RS485_DEFAULT_TURNAROUND_US  20000   // Response deadline until measured
+#define RS485_TURNAROUND_MIN_SAMPLES 8       // Measurements before trusting them
+#define RS485_TURNAROUND_MAX_US  1000000 // Longer samples are not responses
+#define RS485_FRAME_GAP_MAX_US   50000   // Longest pause tolerated inside a frame
+#define RS485_EVENT_QUEUE_DEPTH  20
+#define RS485_LINE_RESET_TIMEOUT_MS 100
+#define RS485_EXCEPTION_BIT      0x80
 #define RS485_TX_PIN             17
 #define RS485_RX_PIN             16
 #define RS485_RTS_PIN            4
@@ -45,97 +67,349 @@ typedef struct {
     uint8_t rx_pin;
     uint8_t rts_pin;
     uint32_t rx_buf_size;
-    uint32_t rx_timeout;
+    line_settings_t line;
+    bool needs_probe;           // No line settings stored yet
+    uint32_t rx_timeout;        // UART RX timeout (symbols), covers t3.5
+    uint32_t char_us;
+    uint32_t t15_us;
+    uint32_t t35_us;
+    TickType_t gap_ticks;       // Wait for the rest of a partial frame
+    int64_t tx_done_us;         // End of the unanswered request, 0 if none
+    int64_t last_rx_us;         // Last chunk of the frame being received
+    int32_t srtt_us;            // Smoothed turnaround
+    int32_t rttvar_us;          // Smoothed turnaround deviation
+    uint32_t turnaround_max_us;
+    uint32_t frame_gap_us;      // Decaying maximum of in-frame pauses
+    uint32_t samples;
+    portMUX_TYPE timing_lock;
+    frame_buf_t *rx_frame;      // Pooled framer stream buffer
     uint8_t *rx_buffer;
-    QueueHandle_t frame_queue;
+    modbus_framer_t framer;
+    QueueHandle_t uart_queue;   // Driver events
+    SemaphoreHandle_t line_change;  // Given by rs485_task_set_line() to have the input cleared
+    SemaphoreHandle_t line_reset;   // Given once a line change has cleared the receive path
+    QueueSetHandle_t events;    // Driver events and line changes, waited on together
+    rs485_rx_stats_t rx_stats;
     void (*frame_callback)(uint8_t *frame, size_t len);
 } rs485_service_t;
 
-static rs485_service_t s_rs485_service = {0};
+static rs485_service_t s_rs485_service = {
+    .timing_lock = portMUX_INITIALIZER_UNLOCKED,
+};
 
 /**
- * @brief RS485 service task
+ * @brief Derive character and silent-interval times from the line speed
+ */
+static void rs485_timing_init(rs485_service_t *service, uint32_t baud_rate)
+{
+    service->char_us = (RS485_BITS_PER_CHAR * 1000000UL + baud_rate - 1) / baud_rate;
+    if (baud_rate > RS485_FIXED_TIMING_BAUD) {
+        service->t15_us = RS485_FIXED_T15_US;
+        service->t35_us = RS485_FIXED_T35_US;
+    } else {
+        service->t15_us = service->char_us + service->char_us / 2;
+        service->t35_us = 3 * service->char_us + service->char_us / 2;
+    }
+
+    // The UART counts its RX timeout in symbols; round t3.5 up
+    uint32_t tout = (service->t35_us + service->char_us - 1) / service->char_us;
+    if (tout < 1) {
+        tout = 1;
+    } else if (tout > RS485_RX_TOUT_MAX) {
+        tout = RS485_RX_TOUT_MAX;
+    }
+    service->rx_timeout = tout;
+    service->gap_ticks = pdMS_TO_TICKS((service->t35_us + 999) / 1000);
+    if (service->gap_ticks == 0) {
+        service->gap_ticks = 1;
+    }
+
+    // Measurements taken at another speed no longer apply
+    service->tx_done_us = 0;
+    service->last_rx_us = 0;
+    service->srtt_us = 0;
+    service->rttvar_us = 0;
+    service->turnaround_max_us = 0;
+    service->frame_gap_us = 0;
+    service->samples = 0;
+}
+
+/**
+ * @brief Load line settings from the parameter store
  * 
- * Original: sub_420136F8
- * Main loop that:
- * 1. Waits for data from UART
- * 2. Validates CRC
- * 3. Processes function codes
- * 4. Sends responses
+ * A missing or zero baud rate means the line has never been set up; the
+ * defaults are used until a probe finds something better.
  */
-static void rs485_service_task(void *pvParameters)
+static void rs485_load_line(rs485_service_t *service)
 {
-    rs485_service_t *service = (rs485_service_t *)pvParameters;
-    uint8_t *rx_buffer = service->rx_buffer;
-    int len;
-    uint16_t crc;
-    uint16_t frame_crc;
-    uint8_t func_code;
-    int retry_count = 0;
-    const int max_retries = 50;
+    int32_t baud_rate = RS485_BAUD_RATE;
+    int32_t parity = RS485_PARITY;
 
-    ESP_LOGI(TAG, "RS485 service task started on UART%d", service->uart_num);
+    esp_err_t ret = param_get_int(PARAM_ID_16, &baud_rate);
+    service->needs_probe = (ret == ESP_ERR_NOT_FOUND || baud_rate == 0);
+    param_get_int(PARAM_ID_17, &parity);
 
-    while (1) {
-        // Read data from UART with timeout
-        len = uart_read_bytes(service->uart_num, rx_buffer, service->rx_buf_size,
-                             pdMS_TO_TICKS(service->rx_timeout * 100));
+    service->line.baud_rate = (uint32_t)baud_rate;
+    service->line.parity = (line_parity_t)parity;
+    if (!line_settings_valid(&service->line)) {
+        service->line.baud_rate = RS485_BAUD_RATE;
+        service->line.parity = RS485_PARITY;
+    }
+}
 
-        if (len <= 0) {
-            // Timeout - check if we should retry
-            if (retry_count < max_retries) {
-                retry_count++;
-                vTaskDelay(pdMS_TO_TICKS(10));
-                continue;
-            } else {
-                ESP_LOGD(TAG, "RS485 receive timeout");
-                retry_count = 0;
-                continue;
+static uart_parity_t rs485_uart_parity(line_parity_t parity)
+{
+    switch (parity) {
+        case LINE_PARITY_ODD:
+            return UART_PARITY_ODD;
+        case LINE_PARITY_EVEN:
+            return UART_PARITY_EVEN;
+        default:
+            return UART_PARITY_DISABLE;
+    }
+}
+
+static uart_stop_bits_t rs485_uart_stop_bits(line_parity_t parity)
+{
+    // Modbus RTU keeps 11 bits per character: no parity means 2 stop bits
+    return (parity == LINE_PARITY_NONE) ? UART_STOP_BITS_2 : UART_STOP_BITS_1;
+}
+
+/**
+ * @brief Account for a chunk of received bytes
+ * 
+ * The driver hands data over when its FIFO fills or the RX timeout fires,
+ * so the first byte of a chunk went on the wire about len characters (plus
+ * the timeout, if that is what ended the chunk) before now. At the start
+ * of a frame this gives the slave's turnaround since the last request;
+ * inside a frame, time not covered by the chunk is a pause the slave left
+ * between characters.
+ */
+static void rs485_timing_on_chunk(rs485_service_t *service, size_t len, bool frame_start,
+                                  bool idle)
+{
+    int64_t now = esp_timer_get_time();
+    int64_t chunk_us = (int64_t)(len + (idle ? service->rx_timeout : 0)) * service->char_us;
+
+    portENTER_CRITICAL(&service->timing_lock);
+    if (frame_start) {
+        if (service->tx_done_us != 0) {
+            int64_t sample = now - chunk_us - service->tx_done_us;
+            service->tx_done_us = 0;
+            if (sample < 0) {
+                sample = 0;
             }
+            if (sample < RS485_TURNAROUND_MAX_US) {
+                // Smoothed mean and deviation as for TCP round-trip times
+                int32_t s = (int32_t)sample;
+                if (service->samples == 0) {
+                    service->srtt_us = s;
+                    service->rttvar_us = s / 2;
+                } else {
+                    int32_t err = s - service->srtt_us;
+                    service->srtt_us += err / 8;
+                    service->rttvar_us += ((err < 0 ? -err : err) - service->rttvar_us) / 4;
+                }
+                if ((uint32_t)s > service->turnaround_max_us) {
+                    service->turnaround_max_us = (uint32_t)s;
+                }
+                service->samples++;
+            }
+        }
+    } else if (service->last_rx_us != 0) {
+        int64_t stall = now - service->last_rx_us - chunk_us;
+        if (stall > RS485_FRAME_GAP_MAX_US) {
+            stall = RS485_FRAME_GAP_MAX_US;
+        }
+        if (stall > (int64_t)service->frame_gap_us) {
+            service->frame_gap_us = (uint32_t)stall;
+        } else {
+            service->frame_gap_us -= service->frame_gap_us / 8;
         }
 
-        retry_count = 0;
+        // Wait out the longest pause seen, with headroom, before closing a frame
+        uint32_t wait_us = 2 * service->frame_gap_us;
+        if (wait_us < service->t35_us) {
+            wait_us = service->t35_us;
+        }
+        service->gap_ticks = pdMS_TO_TICKS((wait_us + 999) / 1000);
+        if (service->gap_ticks == 0) {
+            service->gap_ticks = 1;
+        }
+    }
+    service->last_rx_us = now;
+    portEXIT_CRITICAL(&service->timing_lock);
+}
+
+/**
+ * @brief Framer callback: one complete, CRC-valid Modbus frame
+ */
+static void rs485_handle_frame(uint8_t *frame, size_t len, void *ctx)
+{
+    rs485_service_t *service = (rs485_service_t *)ctx;
+    uint8_t func_code = frame[1];
+
+    ESP_LOGD(TAG, "Received valid Modbus frame: addr=0x%02X, func=0x%02X, len=%zu",
+             frame[0], func_code, len);
+
+    // Process function code
+    switch (func_code) {
+        case MODBUS_FC_READ_HOLDING_REGISTERS:
+        case MODBUS_FC_READ_INPUT_REGISTERS:
+        case MODBUS_FC_WRITE_SINGLE_REGISTER:
+        case MODBUS_FC_WRITE_MULTIPLE_REGISTERS:
+        case MODBUS_FC_CUSTOM_21:
+        case MODBUS_FC_CUSTOM_22:
+        case MODBUS_FC_CUSTOM_88:
+        case MODBUS_FC_CUSTOM_FE:
+            // Call frame callback if registered
+            if (service->frame_callback) {
+                service->frame_callback(frame, len);
+            }
+            break;
+
+        default:
+            // Exception response: pass it on so the request completes now, not at its timeout
+            if ((func_code & RS485_EXCEPTION_BIT) && modbus_rtu_is_supported(func_code)) {
+                ESP_LOGD(TAG, "Exception response: addr=0x%02X, func=0x%02X, code=0x%02X",
+                         frame[0], func_code, frame[2]);
+                service->rx_stats.exceptions++;
+                if (service->frame_callback) {
+                    service->frame_callback(frame, len);
+                }
+                break;
+            }
+            ESP_LOGW(TAG, "Unsupported function code: 0x%02X", func_code);
+            break;
+    }
+}
 
-        // Minimum frame size is 4 bytes (addr + func + 2 CRC bytes)
-        if (len < 4) {
-            ESP_LOGW(TAG, "Frame too short: %d bytes", len);
+/**
+ * @brief Move everything the driver holds into the framer
+ * 
+ * @param idle The driver's RX timeout ended the data (t3.5 of silence)
+ */
+static void rs485_service_read(rs485_service_t *service, bool idle)
+{
+    size_t buffered = 0;
+    while (uart_get_buffered_data_len(service->uart_num, &buffered) == ESP_OK && buffered > 0) {
+        size_t space;
+        uint8_t *rx_ptr = modbus_framer_write_ptr(&service->framer, &space);
+        if (space == 0) {
+            modbus_framer_flush(&service->framer);
             continue;
         }
 
-        // Extract CRC from frame (last 2 bytes, little-endian)
-        frame_crc = rx_buffer[len - 2] | (rx_buffer[len - 1] << 8);
+        bool frame_start = (service->framer.len == 0);
+        int len = uart_read_bytes(service->uart_num, rx_ptr,
+                                  (buffered < space) ? buffered : space, 0);
+        if (len <= 0) {
+            break;
+        }
+
+        rs485_timing_on_chunk(service, len, frame_start, idle);
+        modbus_framer_commit(&service->framer, len);
+    }
+}
+
+/**
+ * @brief Drop received data after the driver lost some
+ * 
+ * Whatever is buffered has a hole in it, so it cannot make a valid frame.
+ * The driver queue is a queue set member and is not reset: data events
+ * still queued find nothing to read.
+ */
+static void rs485_service_discard(rs485_service_t *service)
+{
+    uart_flush_input(service->uart_num);
+    if (service->framer.len > 0) {
+        service->rx_stats.dropped_partial++;
+    }
+    modbus_framer_flush(&service->framer);
+}
+
+/**
+ * @brief Drop everything received at the previous line settings
+ * 
+ * Runs on the service task, which owns the driver's input, its event
+ * queue and the framer.
+ */
+static void rs485_service_reset_line(rs485_service_t *service)
+{
+    uart_flush_input(service->uart_num);
+    modbus_framer_reset(&service->framer);
+    xSemaphoreGive(service->line_reset);
+}
+
+/**
+ * @brief RS485 service task
+ * 
+ * Original: sub_420136F8
+ * Main loop that:
+ * 1. Sleeps on the UART event queue and line changes until either arrives
+ * 2. Reads whatever the driver holds straight into the framer buffer
+ * 3. Delimits frames by function code length and validates CRC
+ * 4. Treats silence longer than the measured in-frame gap as the end of a frame
+ * 5. Drops the partial frame when the FIFO or ring buffer overflowed
+ */
+static void rs485_service_task(void *pvParameters)
+{
+    rs485_service_t *service = (rs485_service_t *)pvParameters;
+    uart_event_t event;
 
-        // Calculate CRC for frame without CRC bytes
-        crc = modbus_crc16(rx_buffer, len - 2);
+    ESP_LOGI(TAG, "RS485 service task started on UART%d", service->uart_num);
 
-        // Validate CRC
-        if (crc != frame_crc) {
-            ESP_LOGW(TAG, "CRC mismatch: calculated=0x%04X, received=0x%04X", crc, frame_crc);
+    while (1) {
+        // Idle line: sleep until data; partial frame: wait only for the rest
+        TickType_t wait = (service->framer.len == 0) ? portMAX_DELAY : service->gap_ticks;
+        QueueSetMemberHandle_t member = xQueueSelectFromSet(service->events, wait);
+        if (member == NULL) {
+            // Line idle: close out any frame the length table could not delimit
+            modbus_framer_flush(&service->framer);
+            continue;
+        }
+        if (member == service->line_change) {
+            xSemaphoreTake(service->line_change, 0);
+            rs485_service_reset_line(service);
+            continue;
+        }
+        if (xQueueReceive(service->uart_queue, &event, 0) != pdTRUE) {
             continue;
         }
 
-        // Extract function code
-        func_code = rx_buffer[1];
-
-        ESP_LOGD(TAG, "Received valid Modbus frame: addr=0x%02X, func=0x%02X, len=%d",
-                 rx_buffer[0], func_code, len);
-
-        // Process function code
-        switch (func_code) {
-            case MODBUS_FC_READ_HOLDING_REGISTERS:
-            case MODBUS_FC_READ_INPUT_REGISTERS:
-            case MODBUS_FC_CUSTOM_21:
-            case MODBUS_FC_CUSTOM_22:
-            case MODBUS_FC_CUSTOM_88:
-            case MODBUS_FC_CUSTOM_FE:
-                // Call frame callback if registered
-                if (service->frame_callback) {
-                    service->frame_callback(rx_buffer, len);
+        service->rx_stats.events++;
+        switch (event.type) {
+            case UART_DATA:
+                if (event.timeout_flag) {
+                    service->rx_stats.idle_events++;
                 }
+                rs485_service_read(service, event.timeout_flag);
+                break;
+
+            case UART_FIFO_OVF:
+                service->rx_stats.fifo_overflows++;
+                rs485_service_discard(service);
+                break;
+
+            case UART_BUFFER_FULL:
+                service->rx_stats.buffer_full++;
+                rs485_service_discard(service);
+                break;
+
+            case UART_FRAME_ERR:
+                // The damaged character still arrives; the frame CRC rejects it
+                service->rx_stats.frame_errors++;
+                break;
+
+            case UART_PARITY_ERR:
+                service->rx_stats.parity_errors++;
+                break;
+
+            case UART_BREAK:
+                service->rx_stats.breaks++;
                 break;
 
             default:
-                ESP_LOGW(TAG, "Unsupported function code: 0x%02X", func_code);
                 break;
         }
     }
@@ -146,30 +420,53 @@ static void rs485_service_task(void *pvParameters)
  */
 esp_err_t rs485_task_init(void)
 {
+    rs485_load_line(&s_rs485_service);
+
     uart_config_t uart_config = {
-        .baud_rate = RS485_BAUD_RATE,
+        .baud_rate = (int)s_rs485_service.line.baud_rate,
         .data_bits = RS485_DATA_BITS,
-        .parity = RS485_PARITY,
-        .stop_bits = RS485_STOP_BITS,
+        .parity = rs485_uart_parity(s_rs485_service.line.parity),
+        .stop_bits = rs485_uart_stop_bits(s_rs485_service.line.parity),
         .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
         .source_clk = UART_SCLK_DEFAULT,
     };
 
     // Configure UART parameters
     ESP_ERROR_CHECK(uart_driver_install(RS485_UART_NUM, RS485_RX_BUF_SIZE * 2,
-                                        RS485_TX_BUF_SIZE, 0, NULL, 0));
+                                        RS485_TX_BUF_SIZE, RS485_EVENT_QUEUE_DEPTH,
+                                        &s_rs485_service.uart_queue, 0));
+
+    // Line changes wake the service task alongside the driver's events; the
+    // driver queue joins the set while it is still empty
+    s_rs485_service.line_change = xSemaphoreCreateBinary();
+    s_rs485_service.events = xQueueCreateSet(RS485_EVENT_QUEUE_DEPTH + 1);
+    if (s_rs485_service.line_change == NULL || s_rs485_service.events == NULL ||
+        xQueueAddToSet(s_rs485_service.uart_queue, s_rs485_service.events) != pdPASS ||
+        xQueueAddToSet(s_rs485_service.line_change, s_rs485_service.events) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to set up the RS485 event set");
+        return ESP_ERR_NO_MEM;
+    }
     ESP_ERROR_CHECK(uart_param_config(RS485_UART_NUM, &uart_config));
     ESP_ERROR_CHECK(uart_set_pin(RS485_UART_NUM, RS485_TX_PIN, RS485_RX_PIN,
                                  RS485_RTS_PIN, UART_PIN_NO_CHANGE));
     ESP_ERROR_CHECK(uart_set_mode(RS485_UART_NUM, UART_MODE_RS485_HALF_DUPLEX));
-    ESP_ERROR_CHECK(uart_set_rx_timeout(RS485_UART_NUM, RS485_RX_TIMEOUT));
+    rs485_timing_init(&s_rs485_service, s_rs485_service.line.baud_rate);
+    ESP_ERROR_CHECK(uart_set_rx_timeout(RS485_UART_NUM, s_rs485_service.rx_timeout));
 
     // Allocate receive buffer
-    s_rs485_service.rx_buffer = malloc(RS485_RX_BUF_SIZE);
-    if (s_rs485_service.rx_buffer == NULL) {
+    s_rs485_service.rx_frame = frame_pool_alloc(RS485_RX_BUF_SIZE);
+    if (s_rs485_service.rx_frame == NULL) {
         ESP_LOGE(TAG, "Failed to allocate RX buffer");
         return ESP_ERR_NO_MEM;
     }
+    s_rs485_service.rx_buffer = s_rs485_service.rx_frame->data;
+
+    s_rs485_service.line_reset = xSemaphoreCreateBinary();
+    if (s_rs485_service.line_reset == NULL) {
+        ESP_LOGE(TAG, "Failed to create line reset semaphore");
+        frame_buf_unref(s_rs485_service.rx_frame);
+        return ESP_ERR_NO_MEM;
+    }
 
     // Initialize service structure
     s_rs485_service.uart_num = RS485_UART_NUM;
@@ -177,19 +474,24 @@ esp_err_t rs485_task_init(void)
     s_rs485_service.rx_pin = RS485_RX_PIN;
     s_rs485_service.rts_pin = RS485_RTS_PIN;
     s_rs485_service.rx_buf_size = RS485_RX_BUF_SIZE;
-    s_rs485_service.rx_timeout = RS485_RX_TIMEOUT;
     s_rs485_service.frame_callback = NULL;
+    modbus_framer_init(&s_rs485_service.framer, s_rs485_service.rx_buffer,
+                       RS485_RX_BUF_SIZE, rs485_handle_frame, &s_rs485_service);
 
     // Create RS485 service task (priority 10)
     BaseType_t ret = xTaskCreate(rs485_service_task, "rs485_service", 4096,
                                   &s_rs485_service, 10, NULL);
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create RS485 task");
-        free(s_rs485_service.rx_buffer);
+        frame_buf_unref(s_rs485_service.rx_frame);
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "RS485 task initialized");
+    ESP_LOGI(TAG, "RS485 task initialized: %lu baud parity %d%s, t1.5 %lu us, t3.5 %lu us, "
+             "RX timeout %lu symbols", (unsigned long)s_rs485_service.line.baud_rate,
+             s_rs485_service.line.parity, s_rs485_service.needs_probe ? " (not probed)" : "",
+             (unsigned long)s_rs485_service.t15_us,
+             (unsigned long)s_rs485_service.t35_us, (unsigned long)s_rs485_service.rx_timeout);
     return ESP_OK;
 }
 
@@ -223,7 +525,139 @@ esp_err_t rs485_task_send_frame(const uint8_t *frame, size_t len)
         return ret;
     }
 
+    // Turnaround is measured from here to the first byte of the response
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_rs485_service.timing_lock);
+    s_rs485_service.tx_done_us = now;
+    portEXIT_CRITICAL(&s_rs485_service.timing_lock);
+
     ESP_LOGD(TAG, "Sent Modbus frame: %zu bytes", len);
     return ESP_OK;
 }
 
+/**
+ * @brief Get the RS485 line speed
+ */
+uint32_t rs485_task_get_baud_rate(void)
+{
+    return s_rs485_service.line.baud_rate;
+}
+
+/**
+ * @brief Get the RS485 line settings
+ */
+void rs485_task_get_line(line_settings_t *line)
+{
+    portENTER_CRITICAL(&s_rs485_service.timing_lock);
+    *line = s_rs485_service.line;
+    portEXIT_CRITICAL(&s_rs485_service.timing_lock);
+}
+
+/**
+ * @brief Check whether the line settings still need probing
+ */
+bool rs485_task_needs_probe(void)
+{
+    return s_rs485_service.needs_probe;
+}
+
+/**
+ * @brief Switch the RS485 line settings
+ */
+esp_err_t rs485_task_set_line(const line_settings_t *line, bool save)
+{
+    if (!line_settings_valid(line)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    rs485_service_t *service = &s_rs485_service;
+    esp_err_t ret = uart_set_baudrate(service->uart_num, line->baud_rate);
+    if (ret == ESP_OK) {
+        ret = uart_set_parity(service->uart_num, rs485_uart_parity(line->parity));
+    }
+    if (ret == ESP_OK) {
+        ret = uart_set_stop_bits(service->uart_num, rs485_uart_stop_bits(line->parity));
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set line %lu baud parity %d: %s",
+                 (unsigned long)line->baud_rate, line->parity, esp_err_to_name(ret));
+        return ret;
+    }
+
+    portENTER_CRITICAL(&service->timing_lock);
+    service->line = *line;
+    rs485_timing_init(service, line->baud_rate);
+    portEXIT_CRITICAL(&service->timing_lock);
+
+    // The UART counts its RX timeout in symbols of the new speed
+    uart_set_rx_timeout(service->uart_num, service->rx_timeout);
+
+    // The service task clears its own input; wait so no stale byte reaches the next response
+    xSemaphoreTake(service->line_reset, 0);     // Left over from a change that timed out
+    xSemaphoreGive(service->line_change);
+    if (xSemaphoreTake(service->line_reset, pdMS_TO_TICKS(RS485_LINE_RESET_TIMEOUT_MS)) != pdTRUE) {
+        ESP_LOGW(TAG, "RS485 service did not clear its input after the line change");
+    }
+
+    if (save) {
+        ret = param_set_int(PARAM_ID_16, (int32_t)line->baud_rate);
+        if (ret == ESP_OK) {
+            ret = param_set_int(PARAM_ID_17, (int32_t)line->parity);
+        }
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        service->needs_probe = false;
+    }
+
+    ESP_LOGI(TAG, "Line set to %lu baud parity %d%s", (unsigned long)line->baud_rate,
+             line->parity, save ? " (saved)" : "");
+    return ESP_OK;
+}
+
+/**
+ * @brief Get line timing and turnaround measurements
+ */
+esp_err_t rs485_task_get_timing(rs485_timing_t *timing)
+{
+    if (timing == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    rs485_service_t *service = &s_rs485_service;
+
+    portENTER_CRITICAL(&service->timing_lock);
+    timing->baud_rate = service->line.baud_rate;
+    timing->char_us = service->char_us;
+    timing->t15_us = service->t15_us;
+    timing->t35_us = service->t35_us;
+    timing->turnaround_avg_us = (uint32_t)service->srtt_us;
+    timing->turnaround_dev_us = (uint32_t)service->rttvar_us;
+    timing->turnaround_max_us = service->turnaround_max_us;
+    timing->frame_gap_us = service->frame_gap_us;
+    timing->samples = service->samples;
+    if (service->samples >= RS485_TURNAROUND_MIN_SAMPLES) {
+        timing->turnaround_us = (uint32_t)(service->srtt_us + 4 * service->rttvar_us);
+    } else {
+        timing->turnaround_us = RS485_DEFAULT_TURNAROUND_US;
+    }
+    portEXIT_CRITICAL(&service->timing_lock);
+
+    if (timing->turnaround_us < timing->t35_us) {
+        timing->turnaround_us = timing->t35_us;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Get receive event statistics
+ */
+esp_err_t rs485_task_get_rx_stats(rs485_rx_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *stats = s_rs485_service.rx_stats;
+    return ESP_OK;
+}
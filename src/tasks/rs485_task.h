@@ -9,8 +9,10 @@
 #define RS485_TASK_H
 
 #include "esp_err.h"
+#include "../protocol/line_probe.h"
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,10 +23,43 @@ extern "C" {
  */
 typedef void (*rs485_frame_callback_t)(uint8_t *frame, size_t len);
 
+/**
+ * @brief Line timing and slave turnaround measurements
+ */
+typedef struct {
+    uint32_t baud_rate;
+    uint32_t char_us;           // One character on the wire
+    uint32_t t15_us;            // Longest pause allowed between characters
+    uint32_t t35_us;            // Silent interval between frames
+    uint32_t turnaround_us;     // Response bound: average + 4 deviations, default until calibrated
+    uint32_t turnaround_avg_us; // Smoothed measured turnaround
+    uint32_t turnaround_dev_us; // Smoothed deviation of the turnaround
+    uint32_t turnaround_max_us; // Longest turnaround measured
+    uint32_t frame_gap_us;      // Recent longest pause inside a response
+    uint32_t samples;           // Responses measured
+} rs485_timing_t;
+
+/**
+ * @brief Receive event statistics
+ */
+typedef struct {
+    uint32_t events;            // UART driver events handled (task wakeups)
+    uint32_t idle_events;       // Data events ended by the RX timeout
+    uint32_t fifo_overflows;    // Hardware FIFO overflowed, bytes lost
+    uint32_t buffer_full;       // Driver ring buffer full, bytes lost
+    uint32_t dropped_partial;   // Partial frames discarded after a loss
+    uint32_t frame_errors;      // Characters with a framing error
+    uint32_t parity_errors;     // Characters with a parity error
+    uint32_t breaks;            // Break conditions on the line
+    uint32_t exceptions;        // Modbus exception responses received
+} rs485_rx_stats_t;
+
 /**
  * @brief Initialize RS485 task
  * 
  * Sets up UART for RS485 half-duplex communication and starts the service task.
+ * Line settings come from PARAM_ID_16 (baud) and PARAM_ID_17 (parity),
+ * 9600 8E1 if they are not set. param_manager_init() must have run.
  * 
  * @return ESP_OK on success
  */
@@ -40,12 +75,69 @@ void rs485_task_set_callback(rs485_frame_callback_t callback);
 /**
  * @brief Send Modbus frame
  * 
+ * Blocks until the frame is on the wire. Only the bus task should call
+ * this; everything else queues requests with bus_task_submit() so
+ * responses are matched to their requests.
+ * 
  * @param frame Frame data (including address, function code, data, CRC)
  * @param len Frame length
  * @return ESP_OK on success
  */
 esp_err_t rs485_task_send_frame(const uint8_t *frame, size_t len);
 
+/**
+ * @brief Get the RS485 line speed
+ * 
+ * @return Baud rate
+ */
+uint32_t rs485_task_get_baud_rate(void);
+
+/**
+ * @brief Get the RS485 line settings
+ * 
+ * @param line Output settings
+ */
+void rs485_task_get_line(line_settings_t *line);
+
+/**
+ * @brief Check whether the line settings still need probing
+ * 
+ * @return true if no baud rate is stored, or it is stored as 0
+ */
+bool rs485_task_needs_probe(void);
+
+/**
+ * @brief Switch the RS485 line settings
+ * 
+ * Reconfigures the UART and restarts the timing measurements, then has
+ * the service task drop whatever it received at the old settings and
+ * waits for it. Only the bus task should call this, between requests.
+ * 
+ * @param line New settings
+ * @param save Also store them in the parameter store
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for unusable settings
+ */
+esp_err_t rs485_task_set_line(const line_settings_t *line, bool save);
+
+/**
+ * @brief Get line timing and turnaround measurements
+ * 
+ * The turnaround is the time from the end of a request to the first byte
+ * of its response, measured on every response.
+ * 
+ * @param timing Output timing
+ * @return ESP_OK on success
+ */
+esp_err_t rs485_task_get_timing(rs485_timing_t *timing);
+
+/**
+ * @brief Get receive event statistics
+ * 
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t rs485_task_get_rx_stats(rs485_rx_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,9 +18,15 @@
 #include "../protocol/data_process.h"
 #include "../protocol/function_codes.h"
 #include "../protocol/crc_utils.h"
+#include "../protocol/uplink_batcher.h"
+#include "../protocol/register_cache.h"
+#include "../protocol/device_routes.h"
+#include "../utils/frame_pool.h"
 #include "../tasks/wifi_task.h"
-#include "../tasks/rs485_task.h"
+#include "../tasks/bus_task.h"
+#include "../tasks/uplink_task.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "esp_https_ota.h"
 #include "lwip/sockets.h"
@@ -31,20 +37,30 @@
 #include "mbedtls/entropy.h"
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/md5.h"
+#include <errno.h>
 
 static const char *TAG = "tcp_client";
 
 // TLS wrapper using mbedtls directly (esp_tls.h not available in v5.5)
 typedef struct {
     mbedtls_ssl_context ssl;
-    mbedtls_ssl_config conf;
     mbedtls_net_context server_fd;
-    mbedtls_entropy_context entropy;
-    mbedtls_ctr_drbg_context ctr_drbg;
     int sockfd;
     bool initialized;
+    bool resumed;               // Abbreviated handshake: the server took the offered session
+    // Outgoing records, followed until our ChangeCipherSpec
+    uint8_t record_header[5];
+    uint8_t header_fill;
+    size_t record_left;
+    uint8_t handshake_records;  // Handshake records sent before the ChangeCipherSpec
+    bool change_cipher_sent;
 } esp_tls_t;
 
+// Negotiated session kept across connections to resume it
+typedef struct {
+    mbedtls_ssl_session saved_session;
+} esp_tls_client_session_t;
+
 typedef struct {
     int timeout_ms;
     const char *psk_hint_key;
@@ -59,52 +75,213 @@ typedef struct {
     size_t servercert_buf_len;
     const unsigned char *cacert_buf;
     size_t cacert_buf_len;
+    esp_tls_client_session_t *client_session;  // Offered for resumption if set
 } esp_tls_cfg_t;
 
-// TLS wrapper functions using mbedtls
-static esp_tls_t *esp_tls_conn_new_sync(const char *hostname, size_t hostname_len, int port, const esp_tls_cfg_t *cfg)
+#define TLS_RECORD_CHANGE_CIPHER_SPEC   20
+#define TLS_RECORD_HANDSHAKE            22
+
+// Configuration and random generator outlive a connection: the generator is
+// seeded once, the configuration built again only when the PSK changes
+static struct {
+    mbedtls_ssl_config conf;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    uint8_t psk[32];
+    size_t psk_len;
+    bool seeded;
+    bool configured;
+} s_tls_client;
+
+static const mbedtls_ssl_config *esp_tls_client_conf(const esp_tls_cfg_t *cfg)
 {
-    if (!cfg) return NULL;
-    
-    esp_tls_t *tls = calloc(1, sizeof(esp_tls_t));
-    if (!tls) return NULL;
-    
-    mbedtls_ssl_init(&tls->ssl);
-    mbedtls_ssl_config_init(&tls->conf);
-    mbedtls_net_init(&tls->server_fd);
-    mbedtls_entropy_init(&tls->entropy);
-    mbedtls_ctr_drbg_init(&tls->ctr_drbg);
-    
-    tls->sockfd = cfg->sockfd;
-    tls->server_fd.fd = cfg->sockfd;
-    
-    const char *pers = "tls_client";
-    int ret = mbedtls_ctr_drbg_seed(&tls->ctr_drbg, mbedtls_entropy_func, &tls->entropy, (const unsigned char *)pers, strlen(pers));
-    if (ret != 0) {
-        ESP_LOGE(TAG, "mbedtls_ctr_drbg_seed failed: %d", ret);
-        goto error;
+    if (!s_tls_client.seeded) {
+        mbedtls_entropy_init(&s_tls_client.entropy);
+        mbedtls_ctr_drbg_init(&s_tls_client.ctr_drbg);
+        const char *pers = "tls_client";
+        int ret = mbedtls_ctr_drbg_seed(&s_tls_client.ctr_drbg, mbedtls_entropy_func, &s_tls_client.entropy, (const unsigned char *)pers, strlen(pers));
+        if (ret != 0) {
+            ESP_LOGE(TAG, "mbedtls_ctr_drbg_seed failed: %d", ret);
+            mbedtls_ctr_drbg_free(&s_tls_client.ctr_drbg);
+            mbedtls_entropy_free(&s_tls_client.entropy);
+            return NULL;
+        }
+        s_tls_client.seeded = true;
     }
-    
-    ret = mbedtls_ssl_config_defaults(&tls->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+
+    if (s_tls_client.configured && cfg->psk_key_len == s_tls_client.psk_len &&
+        (cfg->psk_key_len == 0 || memcmp(cfg->psk_key, s_tls_client.psk, cfg->psk_key_len) == 0)) {
+        return &s_tls_client.conf;
+    }
+    if (cfg->psk_key_len > sizeof(s_tls_client.psk)) {
+        ESP_LOGE(TAG, "PSK too long: %zu", cfg->psk_key_len);
+        return NULL;
+    }
+    if (s_tls_client.configured) {
+        mbedtls_ssl_config_free(&s_tls_client.conf);
+        s_tls_client.configured = false;
+    }
+
+    mbedtls_ssl_config_init(&s_tls_client.conf);
+    int ret = mbedtls_ssl_config_defaults(&s_tls_client.conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
     if (ret != 0) {
         ESP_LOGE(TAG, "mbedtls_ssl_config_defaults failed: %d", ret);
         goto error;
     }
-    
+
     // Configure PSK
     if (cfg->psk_key && cfg->psk_key_len > 0) {
-        ret = mbedtls_ssl_conf_psk(&tls->conf, cfg->psk_key, cfg->psk_key_len, 
+        ret = mbedtls_ssl_conf_psk(&s_tls_client.conf, cfg->psk_key, cfg->psk_key_len,
                                    (const unsigned char *)cfg->psk_hint_key, cfg->psk_hint_key_len);
         if (ret != 0) {
             ESP_LOGE(TAG, "mbedtls_ssl_conf_psk failed: %d", ret);
             goto error;
         }
     }
+
+    mbedtls_ssl_conf_authmode(&s_tls_client.conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&s_tls_client.conf, mbedtls_ctr_drbg_random, &s_tls_client.ctr_drbg);
+    mbedtls_ssl_conf_session_tickets(&s_tls_client.conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+
+    if (cfg->psk_key_len > 0) {
+        memcpy(s_tls_client.psk, cfg->psk_key, cfg->psk_key_len);
+    }
+    s_tls_client.psk_len = cfg->psk_key_len;
+    s_tls_client.configured = true;
+    return &s_tls_client.conf;
+
+error:
+    mbedtls_ssl_config_free(&s_tls_client.conf);
+    return NULL;
+}
+
+/**
+ * @brief Socket send that follows the outgoing records through the handshake
+ * 
+ * mbedtls has no call that tells a resumed handshake from a full one. A
+ * resumed one is abbreviated: the client's ChangeCipherSpec follows its
+ * ClientHello with no key exchange in between. The handshake records sent
+ * before the ChangeCipherSpec are counted here to tell them apart.
+ * 
+ * The send never blocks: a full socket buffer is WANT_WRITE, and the
+ * caller waits for room with esp_tls_conn_wait() under its deadline.
+ */
+static int esp_tls_client_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    esp_tls_t *tls = (esp_tls_t *)ctx;
+    int ret = send(tls->sockfd, buf, len, MSG_DONTWAIT);
+    if (ret < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
+        if (errno == EPIPE || errno == ECONNRESET) {
+            return MBEDTLS_ERR_NET_CONN_RESET;
+        }
+        return MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+
+    size_t i = 0;
+    while (ret > 0 && i < (size_t)ret && !tls->change_cipher_sent) {
+        if (tls->record_left > 0) {
+            size_t n = (size_t)ret - i;
+            if (n > tls->record_left) {
+                n = tls->record_left;
+            }
+            i += n;
+            tls->record_left -= n;
+            continue;
+        }
+        tls->record_header[tls->header_fill++] = buf[i++];
+        if (tls->header_fill == sizeof(tls->record_header)) {
+            tls->header_fill = 0;
+            tls->record_left = (tls->record_header[3] << 8) | tls->record_header[4];
+            if (tls->record_header[0] == TLS_RECORD_CHANGE_CIPHER_SPEC) {
+                tls->change_cipher_sent = true;
+            } else if (tls->record_header[0] == TLS_RECORD_HANDSHAKE) {
+                tls->handshake_records++;
+            }
+        }
+    }
+    return ret;
+}
+
+/**
+ * @brief Socket receive that never blocks
+ * 
+ * No data yet is WANT_READ, so a handshake or read waits for the peer with
+ * esp_tls_conn_wait() under its deadline instead of inside recv().
+ */
+static int esp_tls_client_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    esp_tls_t *tls = (esp_tls_t *)ctx;
+    int ret = recv(tls->sockfd, buf, len, MSG_DONTWAIT);
+    if (ret < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return MBEDTLS_ERR_SSL_WANT_READ;
+        }
+        if (errno == EPIPE || errno == ECONNRESET) {
+            return MBEDTLS_ERR_NET_CONN_RESET;
+        }
+        return MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+    return ret;
+}
+
+/**
+ * @brief Wait until the socket is ready for what mbedtls asked for
+ * 
+ * @param want MBEDTLS_ERR_SSL_WANT_READ or MBEDTLS_ERR_SSL_WANT_WRITE
+ * @param deadline_us esp_timer_get_time() value to give up at
+ * @return 0 when ready, MBEDTLS_ERR_SSL_TIMEOUT past the deadline,
+ *         MBEDTLS_ERR_NET_RECV_FAILED or MBEDTLS_ERR_NET_SEND_FAILED if
+ *         select() fails
+ */
+static int esp_tls_conn_wait(esp_tls_t *tls, int want, int64_t deadline_us)
+{
+    for (;;) {
+        int64_t remaining_us = deadline_us - esp_timer_get_time();
+        if (remaining_us <= 0) {
+            return MBEDTLS_ERR_SSL_TIMEOUT;
+        }
+
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(tls->sockfd, &fds);
+        struct timeval timeout = {
+            .tv_sec = remaining_us / 1000000,
+            .tv_usec = remaining_us % 1000000,
+        };
+        int ret = select(tls->sockfd + 1,
+                         want == MBEDTLS_ERR_SSL_WANT_READ ? &fds : NULL,
+                         want == MBEDTLS_ERR_SSL_WANT_WRITE ? &fds : NULL,
+                         NULL, &timeout);
+        if (ret > 0) {
+            return 0;
+        }
+        if (ret < 0 && errno != EINTR) {
+            return want == MBEDTLS_ERR_SSL_WANT_READ ? MBEDTLS_ERR_NET_RECV_FAILED :
+                                                       MBEDTLS_ERR_NET_SEND_FAILED;
+        }
+    }
+}
+
+// TLS wrapper functions using mbedtls
+static esp_tls_t *esp_tls_conn_new_sync(const char *hostname, size_t hostname_len, int port, const esp_tls_cfg_t *cfg)
+{
+    if (!cfg) return NULL;
+
+    const mbedtls_ssl_config *conf = esp_tls_client_conf(cfg);
+    if (!conf) return NULL;
+
+    esp_tls_t *tls = calloc(1, sizeof(esp_tls_t));
+    if (!tls) return NULL;
     
-    mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_NONE);
-    mbedtls_ssl_conf_rng(&tls->conf, mbedtls_ctr_drbg_random, &tls->ctr_drbg);
+    mbedtls_ssl_init(&tls->ssl);
     
-    ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf);
+    tls->sockfd = cfg->sockfd;
+    tls->server_fd.fd = cfg->sockfd;
+    
+    int ret = mbedtls_ssl_setup(&tls->ssl, conf);
     if (ret != 0) {
         ESP_LOGE(TAG, "mbedtls_ssl_setup failed: %d", ret);
         goto error;
@@ -117,30 +294,67 @@ static esp_tls_t *esp_tls_conn_new_sync(const char *hostname, size_t hostname_le
             goto error;
         }
     }
+
+    // A session the client cannot offer only costs the abbreviated handshake
+    if (cfg->client_session) {
+        ret = mbedtls_ssl_set_session(&tls->ssl, &cfg->client_session->saved_session);
+        if (ret != 0) {
+            ESP_LOGW(TAG, "mbedtls_ssl_set_session failed: %d", ret);
+        }
+    }
     
-    mbedtls_ssl_set_bio(&tls->ssl, &tls->server_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+    mbedtls_ssl_set_bio(&tls->ssl, tls, esp_tls_client_send, esp_tls_client_recv, NULL);
     
     // Perform handshake
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)cfg->timeout_ms * 1000;
     while ((ret = mbedtls_ssl_handshake(&tls->ssl)) != 0) {
-        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            ret = esp_tls_conn_wait(tls, ret, deadline_us);
+        }
+        if (ret != 0) {
             ESP_LOGE(TAG, "mbedtls_ssl_handshake failed: %d", ret);
             goto error;
         }
     }
     
     tls->initialized = true;
+    tls->resumed = cfg->client_session && tls->change_cipher_sent && tls->handshake_records == 1;
     return tls;
     
 error:
     mbedtls_ssl_free(&tls->ssl);
-    mbedtls_ssl_config_free(&tls->conf);
-    mbedtls_net_free(&tls->server_fd);
-    mbedtls_entropy_free(&tls->entropy);
-    mbedtls_ctr_drbg_free(&tls->ctr_drbg);
     free(tls);
     return NULL;
 }
 
+/**
+ * @brief Copy the connection's negotiated session, to resume it on a later connection
+ */
+static esp_tls_client_session_t *esp_tls_get_client_session(esp_tls_t *tls)
+{
+    if (!tls || !tls->initialized) return NULL;
+
+    esp_tls_client_session_t *session = calloc(1, sizeof(esp_tls_client_session_t));
+    if (!session) return NULL;
+
+    mbedtls_ssl_session_init(&session->saved_session);
+    int ret = mbedtls_ssl_get_session(&tls->ssl, &session->saved_session);
+    if (ret != 0) {
+        ESP_LOGW(TAG, "mbedtls_ssl_get_session failed: %d", ret);
+        mbedtls_ssl_session_free(&session->saved_session);
+        free(session);
+        return NULL;
+    }
+    return session;
+}
+
+static void esp_tls_free_client_session(esp_tls_client_session_t *session)
+{
+    if (!session) return;
+    mbedtls_ssl_session_free(&session->saved_session);
+    free(session);
+}
+
 static int esp_tls_conn_read(esp_tls_t *tls, void *data, size_t datalen)
 {
     if (!tls || !tls->initialized) return -1;
@@ -153,17 +367,62 @@ static int esp_tls_conn_write(esp_tls_t *tls, const void *data, size_t datalen)
     return mbedtls_ssl_write(&tls->ssl, (const unsigned char *)data, datalen);
 }
 
+/**
+ * @brief Write all of a buffer, waiting for the socket up to a deadline
+ * 
+ * @return Bytes written, or a negative mbedtls error; MBEDTLS_ERR_SSL_TIMEOUT
+ *         if the peer did not take the data in time. A record may then be
+ *         half written, so the connection cannot be used any more.
+ */
+static int esp_tls_conn_write_all(esp_tls_t *tls, const uint8_t *data, size_t datalen,
+                                  int64_t deadline_us)
+{
+    size_t written = 0;
+    while (written < datalen) {
+        int ret = esp_tls_conn_write(tls, data + written, datalen - written);
+        if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            ret = esp_tls_conn_wait(tls, ret, deadline_us);
+            if (ret != 0) {
+                return ret;
+            }
+            continue;
+        }
+        if (ret < 0) {
+            return ret;
+        }
+        written += ret;
+    }
+    return (int)written;
+}
+
+// mbedtls has no gather write: pack segments into the staging buffer so a
+// frame goes out as one record instead of one record per segment.
+static int esp_tls_conn_writev(esp_tls_t *tls, uint8_t *staging, size_t staging_size,
+                               const data_process_iovec_t *iov, size_t iovcnt, int timeout_ms)
+{
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    size_t total = data_process_iov_length(iov, iovcnt);
+    size_t offset = 0;
+
+    while (offset < total) {
+        size_t n = data_process_iov_copy(iov, iovcnt, offset, staging, staging_size);
+        int ret = esp_tls_conn_write_all(tls, staging, n, deadline_us);
+        if (ret < 0) {
+            return ret;
+        }
+        offset += n;
+    }
+    return (int)total;
+}
+
 static void esp_tls_conn_delete(esp_tls_t *tls)
 {
     if (!tls) return;
     if (tls->initialized) {
         mbedtls_ssl_close_notify(&tls->ssl);
     }
+    // The socket is the caller's to close; mbedtls_net_free() would close it too
     mbedtls_ssl_free(&tls->ssl);
-    mbedtls_ssl_config_free(&tls->conf);
-    mbedtls_net_free(&tls->server_fd);
-    mbedtls_entropy_free(&tls->entropy);
-    mbedtls_ctr_drbg_free(&tls->ctr_drbg);
     free(tls);
 }
 
@@ -178,8 +437,16 @@ static void esp_tls_conn_delete(esp_tls_t *tls)
 #define TCP_CLIENT_PSK_IDENTITY     "psk_identity_dongle"
 #define TCP_CLIENT_PSK_KEY_PREFIX   "LuxD1ngl2X"
 #define TCP_CLIENT_RECV_BUF_SIZE   2048
+#define TCP_CLIENT_TLS_STAGING_SIZE 1024  // Plaintext gathered per TLS record
+#define TCP_CLIENT_ACK_WINDOW       4      // 0xC2 frames in flight awaiting ack
+#define TCP_CLIENT_BATCH_DEADLINE   50     // Longest an uplink frame is held (ms)
+#define TCP_CLIENT_CACHE_READ_MAX   125    // Registers one cached read may return
+#define TCP_CLIENT_BUS_RETRIES      1      // Extra bus attempts for a forwarded request
+#define TCP_CLIENT_WRITE_MAX        123    // Modbus limit for one 0x10 write
 #define TCP_CLIENT_CONNECT_TIMEOUT  10000  // 10 seconds
 #define TCP_CLIENT_RECONNECT_DELAY  5000   // 5 seconds
+#define TCP_CLIENT_SEND_TIMEOUT     5000   // Longest a write waits for the peer (ms)
+#define TCP_CLIENT_POLL_INTERVAL    100    // Longest the receive loop waits for data (ms)
 #define TCP_CLIENT_HEARTBEAT_INTERVAL 10000  // 10 seconds
 
 // TCP client state
@@ -200,17 +467,27 @@ typedef struct {
     char host[128];
     uint16_t port;
     uint8_t psk[16];
+    esp_tls_client_session_t *session;  // Last negotiated session, offered on reconnect
+    frame_buf_t *recv_frame;            // Pooled receive buffer
     uint8_t *recv_buffer;
-    SemaphoreHandle_t mutex;
+    uint8_t tls_staging[TCP_CLIENT_TLS_STAGING_SIZE];  // Guarded by mutex
+    SemaphoreHandle_t mutex;  // Serializes use of the connection; the client task closes it under this
     TaskHandle_t task_handle;
     data_process_handle_t data_handle;
+    uplink_batcher_handle_t batcher;    // Coalesces 0xC2 uplink into fewer records
     void (*receive_callback)(const uint8_t *data, size_t len);
     void (*send_callback)(const uint8_t *data, size_t len);
     uint32_t last_heartbeat;
     bool use_tls;
+    volatile bool write_failed;         // A write failed on another task; the client task drops the connection
+    volatile uint32_t connection_id;    // Connections established; written by the client task only
+    tcp_client_stats_t stats;           // Guarded by lock
+    portMUX_TYPE lock;
 } tcp_client_t;
 
-static tcp_client_t s_tcp_client = {0};
+static tcp_client_t s_tcp_client = {
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
 
 /**
  * @brief Generate PSK key from device SN
@@ -239,11 +516,174 @@ static esp_err_t tcp_client_generate_psk(const char *device_sn, uint8_t *psk_out
     return ESP_OK;
 }
 
+/**
+ * @brief Forward a request body (start, count, ...) to a routed slave
+ * 
+ * Queued on the bus transaction engine without waiting; the response
+ * reaches the cloud through the normal RS485 frame path.
+ */
+static void tcp_client_forward_to_rs485(const device_route_t *route, uint8_t func_code,
+                                        const uint8_t *modbus_data, uint16_t modbus_data_len)
+{
+    ESP_LOGD(TAG, "Forwarding TCP data to RS485 slave %u: %u bytes",
+             route->slave_addr, modbus_data_len);
+    
+    bus_request_t request = {
+        .slave_addr = route->slave_addr,
+        .func_code = func_code,
+        .body = modbus_data,
+        .body_len = modbus_data_len,
+        .retries = TCP_CLIENT_BUS_RETRIES,
+        .priority = BUS_CLASS_INTERACTIVE,
+    };
+    if (modbus_data_len >= 4) {
+        request.start = (modbus_data[0] << 8) | modbus_data[1];
+        request.count = (modbus_data[2] << 8) | modbus_data[3];
+    }
+
+    esp_err_t send_ret = bus_task_submit(&request);
+    if (send_ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to queue frame for RS485: %d", send_ret);
+    }
+}
+
+/**
+ * @brief Completion of a cloud register write
+ * 
+ * Runs on the RS485 task; drops the written registers from the cache so
+ * the next read fetches them from the slave.
+ */
+static void tcp_client_write_complete(const bus_result_t *result,
+                                      const uint8_t *frame, size_t len, void *ctx)
+{
+    if (result->status != ESP_OK || frame == NULL || len < 8) {
+        ESP_LOGW(TAG, "Register write failed: %d (exception 0x%02X)",
+                 result->status, result->exception_code);
+        return;
+    }
+
+    // Both responses carry the start register; 0x10 also the quantity
+    uint16_t start = (frame[2] << 8) | frame[3];
+    uint16_t count = (frame[1] == MODBUS_FC_WRITE_MULTIPLE_REGISTERS) ?
+                     ((frame[4] << 8) | frame[5]) : 1;
+    register_cache_forget(frame[0], MODBUS_FC_READ_HOLDING_REGISTERS, start, count);
+}
+
+/**
+ * @brief Completion of a 0xC3 get-param read that missed the cache
+ * 
+ * ctx carries the device ID and the first parameter ID. A response arrives
+ * on the RS485 task, the uplink task's producer, which sends the reply up
+ * as a 0xC3 frame like a cache hit. Timeouts complete on the bus task and
+ * are only logged; the cloud asks again.
+ */
+static void tcp_client_get_param_complete(const bus_result_t *result,
+                                          const uint8_t *frame, size_t len, void *ctx)
+{
+    uint8_t device_id = (uint8_t)((uintptr_t)ctx >> 16);
+    uint16_t first = (uint16_t)((uintptr_t)ctx & 0xFFFF);
+
+    // Response: addr, fc, byte count, data, crc(2)
+    if (result->status != ESP_OK || frame == NULL || len < 5 || frame[2] == 0 ||
+        frame[2] % 2 != 0 || len < 5 + (size_t)frame[2] ||
+        frame[2] / 2 > TCP_CLIENT_CACHE_READ_MAX) {
+        ESP_LOGW(TAG, "Get-param read failed: %d (exception 0x%02X)",
+                 result->status, result->exception_code);
+        return;
+    }
+
+    uint16_t count = frame[2] / 2;
+    uint16_t last = first + count - 1;
+    uint8_t reply[4 + 2 * TCP_CLIENT_CACHE_READ_MAX];
+    reply[0] = first & 0xFF;
+    reply[1] = (first >> 8) & 0xFF;
+    reply[2] = last & 0xFF;
+    reply[3] = (last >> 8) & 0xFF;
+    memcpy(&reply[4], &frame[3], frame[2]);
+
+    register_cache_store(frame[0], MODBUS_FC_READ_HOLDING_REGISTERS, first, &frame[3], count);
+    uplink_task_submit_frame(device_id, PROTOCOL_FC_GET_PARAM, reply, 4 + (size_t)frame[2]);
+}
+
+/**
+ * @brief Read parameters through from the slave for a 0xC3 cache miss
+ * 
+ * The response only goes to tcp_client_get_param_complete(), not up as a
+ * data transmission frame.
+ */
+static void tcp_client_read_params(const device_route_t *route, uint8_t device_id,
+                                   uint16_t first, uint16_t count)
+{
+    bus_request_t request = {
+        .slave_addr = route->slave_addr,
+        .func_code = MODBUS_FC_READ_HOLDING_REGISTERS,
+        .start = first,
+        .count = count,
+        .retries = TCP_CLIENT_BUS_RETRIES,
+        .priority = BUS_CLASS_INTERACTIVE,
+        .local = true,
+        .callback = tcp_client_get_param_complete,
+        .ctx = (void *)(((uintptr_t)device_id << 16) | first),
+    };
+
+    esp_err_t ret = bus_task_submit(&request);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to queue get-param read: %d", ret);
+    }
+}
+
+/**
+ * @brief Write holding registers for a 0xC4 set-param frame
+ * 
+ * The parameter ID is the first register and the data the big-endian
+ * register values, as for 0xC3. Queued ahead of reads and polls.
+ */
+static void tcp_client_write_registers(const device_route_t *route, uint16_t start,
+                                       const uint8_t *values, uint16_t len)
+{
+    uint8_t body[5 + 2 * TCP_CLIENT_WRITE_MAX];
+    uint16_t count = len / 2;
+    bus_request_t request = {
+        .slave_addr = route->slave_addr,
+        .body = body,
+        .retries = TCP_CLIENT_BUS_RETRIES,
+        .priority = BUS_CLASS_CONTROL,
+        .callback = tcp_client_write_complete,
+    };
+
+    if (len == 0 || len % 2 != 0 || count > TCP_CLIENT_WRITE_MAX) {
+        ESP_LOGW(TAG, "Invalid set-param length: %u", len);
+        return;
+    }
+
+    body[0] = (uint8_t)(start >> 8);
+    body[1] = (uint8_t)(start & 0xFF);
+    if (count == 1) {
+        request.func_code = MODBUS_FC_WRITE_SINGLE_REGISTER;
+        body[2] = values[0];
+        body[3] = values[1];
+        request.body_len = 4;
+    } else {
+        request.func_code = MODBUS_FC_WRITE_MULTIPLE_REGISTERS;
+        body[2] = (uint8_t)(count >> 8);
+        body[3] = (uint8_t)(count & 0xFF);
+        body[4] = (uint8_t)len;
+        memcpy(&body[5], values, len);
+        request.body_len = 5 + len;
+    }
+
+    esp_err_t ret = bus_task_submit(&request);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to queue register write: %d", ret);
+    }
+}
+
 /**
  * @brief TCP client receive callback
  * 
  * Original: sub_420118A4 (tcp_client_receive)
  * 
+ * Called once per complete, CRC-checked frame by the data processing module.
  * Parses protocol frames and forwards data transmission frames to RS485
  */
 static void tcp_client_receive_callback(const uint8_t *data, size_t len)
@@ -253,40 +693,62 @@ static void tcp_client_receive_callback(const uint8_t *data, size_t len)
     // Parse protocol frame if it's a data transmission frame (function code 194)
     if (len >= 20 && data[0] == 0xA1 && data[1] == 0x1A) {
         uint8_t func_code = data[7];
+        uint8_t device_id = data[PROTOCOL_DEVICE_OFFSET];
+        const device_route_t *route = device_routes_for_frame(device_id);
         
-        if (func_code == PROTOCOL_FC_DATA_TRANSMISSION) {
+        if (route == NULL) {
+            ESP_LOGW(TAG, "No route for device %u, dropping frame 0x%02X", device_id, func_code);
+        } else if (func_code == PROTOCOL_FC_DATA_TRANSMISSION) {
             // Parse data transmission frame
             uint8_t *modbus_data = NULL;
             uint16_t modbus_data_len = 0;
             
             if (parse_data_transmission_frame(data, len, &modbus_data, &modbus_data_len) == 0) {
-                // Forward to RS485 as Modbus frame
-                if (modbus_data != NULL && modbus_data_len > 0) {
-                    ESP_LOGD(TAG, "Forwarding TCP data to RS485: %u bytes", modbus_data_len);
-                    
-                    // Build Modbus frame: [addr][func][data][crc(2)]
-                    // Note: The protocol frame doesn't preserve the original Modbus address/function code,
-                    // so we use defaults. The actual address/func should be extracted from the protocol
-                    // frame header if available, or configured via parameters.
-                    uint8_t modbus_frame[512];
-                    if (modbus_data_len + 4 <= sizeof(modbus_frame)) {
-                        modbus_frame[0] = 0x01;  // Modbus address (default - should be configurable)
-                        modbus_frame[1] = 0x03;  // Function code (default - should match original frame)
-                        memcpy(&modbus_frame[2], modbus_data, modbus_data_len);
-                        
-                        // Calculate CRC
-                        uint16_t crc = modbus_crc16(modbus_frame, modbus_data_len + 2);
-                        modbus_frame[modbus_data_len + 2] = crc & 0xFF;
-                        modbus_frame[modbus_data_len + 3] = (crc >> 8) & 0xFF;
-                        
-                        // Send to RS485
-                        esp_err_t send_ret = rs485_task_send_frame(modbus_frame, modbus_data_len + 4);
-                        if (send_ret != ESP_OK) {
-                            ESP_LOGW(TAG, "Failed to send frame to RS485: %d", send_ret);
-                        }
-                    }
+                // Register reads the poll sweep keeps fresh never reach the bus
+                uint8_t response[1 + 2 * TCP_CLIENT_CACHE_READ_MAX];
+                size_t response_len = 0;
+                if (register_cache_answer_read(route->slave_addr, route->read_fc,
+                                               modbus_data, modbus_data_len, response,
+                                               sizeof(response), &response_len) == ESP_OK) {
+                    ESP_LOGD(TAG, "Answered read from register cache: %zu bytes", response_len);
+                    data_process_send_to(s_tcp_client.data_handle, device_id,
+                                         PROTOCOL_FC_DATA_TRANSMISSION, response, response_len,
+                                         NULL);
+                } else if (modbus_data != NULL && modbus_data_len > 0) {
+                    tcp_client_forward_to_rs485(route, route->read_fc, modbus_data, modbus_data_len);
+                }
+            }
+        } else if (func_code == PROTOCOL_FC_GET_PARAM) {
+            uint16_t first = 0;
+            uint16_t last = 0;
+
+            // Parameter IDs are holding registers of the device, end ID inclusive
+            if (parse_get_param_frame(data, len, &first, &last) == 0 && last >= first &&
+                last - first < TCP_CLIENT_CACHE_READ_MAX) {
+                uint16_t count = last - first + 1;
+                uint8_t reply[4 + 2 * TCP_CLIENT_CACHE_READ_MAX];
+                reply[0] = first & 0xFF;
+                reply[1] = (first >> 8) & 0xFF;
+                reply[2] = last & 0xFF;
+                reply[3] = (last >> 8) & 0xFF;
+
+                if (register_cache_read(route->slave_addr, MODBUS_FC_READ_HOLDING_REGISTERS,
+                                        first, count, 0, &reply[4]) == ESP_OK) {
+                    data_process_send_to(s_tcp_client.data_handle, device_id,
+                                         PROTOCOL_FC_GET_PARAM, reply, 4 + 2 * (size_t)count,
+                                         NULL);
+                } else {
+                    tcp_client_read_params(route, device_id, first, count);
                 }
             }
+        } else if (func_code == PROTOCOL_FC_SET_PARAM) {
+            uint16_t first = 0;
+            uint16_t values_len = 0;
+            uint8_t *values = NULL;
+
+            if (parse_set_param_frame(data, len, &first, &values_len, &values) == 0) {
+                tcp_client_write_registers(route, first, values, values_len);
+            }
         }
     }
     
@@ -297,24 +759,66 @@ static void tcp_client_receive_callback(const uint8_t *data, size_t len)
 }
 
 /**
- * @brief TCP client send callback
+ * @brief Write segments to the connection
  * 
- * Original: sub_42011AA8 (tcp_client_send)
+ * Plain sockets send the segments with one sendmsg(); TLS connections pack
+ * them into as few records as possible. Also the uplink batcher's write
+ * callback, so it runs on the uplink task: a failed write, or a TLS write
+ * the peer does not take within TCP_CLIENT_SEND_TIMEOUT, only flags the
+ * connection. The client task sees the flag and drops the connection; it
+ * alone closes and reopens the socket.
  */
-static void tcp_client_send_callback(const uint8_t *data, size_t len)
+static void tcp_client_writev(const data_process_iovec_t *iov, size_t iovcnt, void *ctx)
 {
     if (s_tcp_client.sock < 0 || s_tcp_client.state != TCP_CLIENT_STATE_READY) {
         ESP_LOGW(TAG, "Cannot send: not connected");
         return;
     }
 
+    if (iovcnt == 0 || iovcnt > DATA_PROCESS_MAX_IOV) {
+        ESP_LOGE(TAG, "Invalid segment count: %zu", iovcnt);
+        return;
+    }
+
+    size_t len = data_process_iov_length(iov, iovcnt);
+
+    if (xSemaphoreTake(s_tcp_client.mutex, pdMS_TO_TICKS(1000)) != pdTRUE) {
+        ESP_LOGW(TAG, "Send timed out waiting for connection");
+        return;
+    }
+
+    // The client task may have dropped the connection while we waited
+    if (s_tcp_client.state != TCP_CLIENT_STATE_READY || s_tcp_client.write_failed) {
+        xSemaphoreGive(s_tcp_client.mutex);
+        ESP_LOGW(TAG, "Cannot send: not connected");
+        return;
+    }
+
     int sent = 0;
     if (s_tcp_client.use_tls && s_tcp_client.tls) {
-        sent = esp_tls_conn_write(s_tcp_client.tls, data, len);
+        sent = esp_tls_conn_writev(s_tcp_client.tls, s_tcp_client.tls_staging,
+                                   sizeof(s_tcp_client.tls_staging), iov, iovcnt,
+                                   TCP_CLIENT_SEND_TIMEOUT);
     } else {
-        sent = send(s_tcp_client.sock, data, len, 0);
+        struct iovec vec[DATA_PROCESS_MAX_IOV];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        for (size_t i = 0; i < iovcnt; i++) {
+            vec[i].iov_base = (void *)iov[i].iov_base;
+            vec[i].iov_len = iov[i].iov_len;
+        }
+        msg.msg_iov = vec;
+        msg.msg_iovlen = iovcnt;
+        sent = sendmsg(s_tcp_client.sock, &msg, 0);
     }
 
+    if (sent < 0) {
+        // A record may be half written; the client task drops the connection
+        s_tcp_client.write_failed = true;
+    }
+
+    xSemaphoreGive(s_tcp_client.mutex);
+
     if (sent < 0) {
         ESP_LOGE(TAG, "Failed to send data: %d", sent);
     } else if (sent != len) {
@@ -322,6 +826,40 @@ static void tcp_client_send_callback(const uint8_t *data, size_t len)
     }
 }
 
+/**
+ * @brief TCP client scatter-gather send callback
+ * 
+ * Frames go through the uplink batcher, which writes non-0xC2 frames
+ * straight away and holds 0xC2 frames briefly to share a record.
+ */
+static void tcp_client_sendv_callback(const data_process_iovec_t *iov, size_t iovcnt)
+{
+    if (s_tcp_client.sock < 0 || s_tcp_client.state != TCP_CLIENT_STATE_READY) {
+        ESP_LOGW(TAG, "Cannot send: not connected");
+        return;
+    }
+
+    if (s_tcp_client.batcher != NULL) {
+        uplink_batcher_submitv(s_tcp_client.batcher, iov, iovcnt);
+    } else {
+        tcp_client_writev(iov, iovcnt, NULL);
+    }
+}
+
+/**
+ * @brief TCP client send callback
+ * 
+ * Original: sub_42011AA8 (tcp_client_send)
+ */
+static void tcp_client_send_callback(const uint8_t *data, size_t len)
+{
+    data_process_iovec_t iov = {
+        .iov_base = data,
+        .iov_len = len,
+    };
+    tcp_client_sendv_callback(&iov, 1);
+}
+
 /**
  * @brief Send heartbeat
  * 
@@ -434,8 +972,14 @@ static void tcp_client_task(void *pvParameters)
             strncpy(device_sn, "default", sizeof(device_sn) - 1);
         }
         
-        // Generate PSK
-        tcp_client_generate_psk(device_sn, s_tcp_client.psk);
+        // Generate PSK; a session negotiated under another key cannot be resumed
+        uint8_t psk[16];
+        tcp_client_generate_psk(device_sn, psk);
+        if (memcmp(psk, s_tcp_client.psk, sizeof(psk)) != 0) {
+            esp_tls_free_client_session(s_tcp_client.session);
+            s_tcp_client.session = NULL;
+            memcpy(s_tcp_client.psk, psk, sizeof(psk));
+        }
 
         // Configure TLS
         memset(&s_tcp_client.tls_cfg, 0, sizeof(s_tcp_client.tls_cfg));
@@ -447,12 +991,21 @@ static void tcp_client_task(void *pvParameters)
         s_tcp_client.tls_cfg.alpn_protos = NULL;
         s_tcp_client.tls_cfg.skip_common_name = true;
         s_tcp_client.tls_cfg.use_global_ca_store = false;
+        s_tcp_client.tls_cfg.client_session = s_tcp_client.session;
 
         // Create TLS connection (using existing socket)
         s_tcp_client.tls_cfg.sockfd = s_tcp_client.sock;
+        int64_t handshake_start = esp_timer_get_time();
         s_tcp_client.tls = esp_tls_conn_new_sync(host, strlen(host), port, &s_tcp_client.tls_cfg);
+        uint32_t handshake_ms = (uint32_t)((esp_timer_get_time() - handshake_start) / 1000);
         if (s_tcp_client.tls == NULL) {
             ESP_LOGE(TAG, "TLS handshake failed");
+            // The server may have lost the session state; start afresh next time
+            esp_tls_free_client_session(s_tcp_client.session);
+            s_tcp_client.session = NULL;
+            portENTER_CRITICAL(&s_tcp_client.lock);
+            s_tcp_client.stats.handshake_failures++;
+            portEXIT_CRITICAL(&s_tcp_client.lock);
             close(s_tcp_client.sock);
             s_tcp_client.sock = -1;
             s_tcp_client.state = TCP_CLIENT_STATE_DISCONNECTED;
@@ -460,11 +1013,36 @@ static void tcp_client_task(void *pvParameters)
             continue;
         }
 
+        bool resumed = s_tcp_client.tls->resumed;
+        portENTER_CRITICAL(&s_tcp_client.lock);
+        if (resumed) {
+            s_tcp_client.stats.resumed_handshakes++;
+            s_tcp_client.stats.resumed_handshake_ms += handshake_ms;
+        } else {
+            s_tcp_client.stats.full_handshakes++;
+            s_tcp_client.stats.full_handshake_ms += handshake_ms;
+            if (s_tcp_client.session) {
+                s_tcp_client.stats.resume_misses++;
+            }
+        }
+        s_tcp_client.stats.last_handshake_ms = handshake_ms;
+        portEXIT_CRITICAL(&s_tcp_client.lock);
+
+        // Keep this connection's session (and any new ticket) for the next reconnect
+        esp_tls_free_client_session(s_tcp_client.session);
+        s_tcp_client.session = esp_tls_get_client_session(s_tcp_client.tls);
+
         s_tcp_client.use_tls = true;
+        s_tcp_client.write_failed = false;
+        s_tcp_client.connection_id++;
         s_tcp_client.state = TCP_CLIENT_STATE_READY;
         s_tcp_client.last_heartbeat = xTaskGetTickCount();
         
-        ESP_LOGI(TAG, "TLS connection established");
+        ESP_LOGI(TAG, "TLS connection established (%s handshake, %lu ms)",
+                 resumed ? "resumed" : "full", (unsigned long)handshake_ms);
+
+        // Resend uplink frames the cloud never acknowledged before the drop
+        data_process_retransmit_unacked(s_tcp_client.data_handle);
 
         // Main receive loop
         while (s_tcp_client.state == TCP_CLIENT_STATE_READY) {
@@ -474,7 +1052,14 @@ static void tcp_client_task(void *pvParameters)
                 tcp_client_send_heartbeat();
             }
 
-            // Receive data
+            if (s_tcp_client.write_failed) {
+                ESP_LOGW(TAG, "Dropping connection after a failed write");
+                break;
+            }
+
+            // Receive data; reads never block, so the loop comes round at least
+            // every TCP_CLIENT_POLL_INTERVAL
+            xSemaphoreTake(s_tcp_client.mutex, portMAX_DELAY);
             if (s_tcp_client.use_tls && s_tcp_client.tls) {
                 bytes_received = esp_tls_conn_read(s_tcp_client.tls, 
                                                    s_tcp_client.recv_buffer, 
@@ -482,18 +1067,30 @@ static void tcp_client_task(void *pvParameters)
             } else {
                 bytes_received = recv(s_tcp_client.sock, 
                                       s_tcp_client.recv_buffer, 
-                                      TCP_CLIENT_RECV_BUF_SIZE, 0);
+                                      TCP_CLIENT_RECV_BUF_SIZE, MSG_DONTWAIT);
             }
+            xSemaphoreGive(s_tcp_client.mutex);
 
             if (bytes_received > 0) {
-                // Process received data
+                // Reassemble frames; complete frames reach tcp_client_receive_callback
                 if (s_tcp_client.data_handle) {
                     data_process_receive(s_tcp_client.data_handle, 
                                         s_tcp_client.recv_buffer, 
                                         bytes_received);
                 }
-                tcp_client_receive_callback(s_tcp_client.recv_buffer, bytes_received);
             } else if (bytes_received < 0) {
+                if (bytes_received == MBEDTLS_ERR_SSL_WANT_READ ||
+                    bytes_received == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                    // A timeout is only the end of this poll
+                    int64_t poll_deadline_us = esp_timer_get_time() +
+                                               (int64_t)TCP_CLIENT_POLL_INTERVAL * 1000;
+                    ret = esp_tls_conn_wait(s_tcp_client.tls, bytes_received, poll_deadline_us);
+                    if (ret == 0 || ret == MBEDTLS_ERR_SSL_TIMEOUT) {
+                        continue;
+                    }
+                    ESP_LOGE(TAG, "Receive wait failed: %d", ret);
+                    break;
+                }
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
                     vTaskDelay(pdMS_TO_TICKS(10));
                     continue;
@@ -507,7 +1104,9 @@ static void tcp_client_task(void *pvParameters)
             }
         }
 
-        // Cleanup
+        // Cleanup; a write in progress on another task finishes first
+        xSemaphoreTake(s_tcp_client.mutex, portMAX_DELAY);
+        s_tcp_client.state = TCP_CLIENT_STATE_DISCONNECTED;
         if (s_tcp_client.tls) {
             esp_tls_conn_delete(s_tcp_client.tls);
             s_tcp_client.tls = NULL;
@@ -516,8 +1115,9 @@ static void tcp_client_task(void *pvParameters)
             close(s_tcp_client.sock);
             s_tcp_client.sock = -1;
         }
-        s_tcp_client.state = TCP_CLIENT_STATE_DISCONNECTED;
         s_tcp_client.use_tls = false;
+        xSemaphoreGive(s_tcp_client.mutex);
+        uplink_batcher_discard(s_tcp_client.batcher);
 
         ESP_LOGI(TAG, "Disconnected, reconnecting in %d ms...", TCP_CLIENT_RECONNECT_DELAY);
         vTaskDelay(pdMS_TO_TICKS(TCP_CLIENT_RECONNECT_DELAY));
@@ -532,17 +1132,18 @@ static void tcp_client_task(void *pvParameters)
 esp_err_t tcp_client_task_init(void)
 {
     // Allocate receive buffer
-    s_tcp_client.recv_buffer = malloc(TCP_CLIENT_RECV_BUF_SIZE);
-    if (s_tcp_client.recv_buffer == NULL) {
+    s_tcp_client.recv_frame = frame_pool_alloc(TCP_CLIENT_RECV_BUF_SIZE);
+    if (s_tcp_client.recv_frame == NULL) {
         ESP_LOGE(TAG, "Failed to allocate receive buffer");
         return ESP_ERR_NO_MEM;
     }
+    s_tcp_client.recv_buffer = s_tcp_client.recv_frame->data;
 
     // Create mutex
     s_tcp_client.mutex = xSemaphoreCreateMutex();
     if (s_tcp_client.mutex == NULL) {
         ESP_LOGE(TAG, "Failed to create mutex");
-        free(s_tcp_client.recv_buffer);
+        frame_buf_unref(s_tcp_client.recv_frame);
         return ESP_ERR_NO_MEM;
     }
 
@@ -563,18 +1164,28 @@ esp_err_t tcp_client_task_init(void)
     if (s_tcp_client.data_handle == NULL) {
         ESP_LOGE(TAG, "Failed to create data process handle");
         vSemaphoreDelete(s_tcp_client.mutex);
-        free(s_tcp_client.recv_buffer);
+        frame_buf_unref(s_tcp_client.recv_frame);
         return ESP_FAIL;
     }
+    data_process_set_sendv_callback(s_tcp_client.data_handle, tcp_client_sendv_callback);
+    data_process_enable_ack_window(s_tcp_client.data_handle, TCP_CLIENT_ACK_WINDOW);
+
+    // Batching is an optimization; send unbatched if it cannot be set up
+    const uplink_batcher_config_t batch_config = {
+        .deadline_ms = TCP_CLIENT_BATCH_DEADLINE,
+        .byte_budget = TCP_CLIENT_TLS_STAGING_SIZE,
+    };
+    s_tcp_client.batcher = uplink_batcher_create(&batch_config, tcp_client_writev, NULL);
 
     // Create TCP client task (priority 5)
     BaseType_t ret = xTaskCreate(tcp_client_task, "tcp_client", 8192, NULL, 5, 
                                   &s_tcp_client.task_handle);
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create TCP client task");
+        uplink_batcher_destroy(s_tcp_client.batcher);
         data_process_destroy(s_tcp_client.data_handle);
         vSemaphoreDelete(s_tcp_client.mutex);
-        free(s_tcp_client.recv_buffer);
+        frame_buf_unref(s_tcp_client.recv_frame);
         return ESP_FAIL;
     }
 
@@ -590,6 +1201,14 @@ bool tcp_client_task_is_connected(void)
     return (s_tcp_client.state == TCP_CLIENT_STATE_READY);
 }
 
+/**
+ * @brief Get the number of the current cloud connection
+ */
+uint32_t tcp_client_task_get_connection_id(void)
+{
+    return s_tcp_client.connection_id;
+}
+
 /**
  * @brief Send data through TCP client
  */
@@ -607,3 +1226,51 @@ esp_err_t tcp_client_task_send(const uint8_t *data, size_t len)
     return ESP_OK;
 }
 
+
+/**
+ * @brief Send a segmented frame through TCP client
+ */
+esp_err_t tcp_client_task_sendv(const data_process_iovec_t *iov, size_t iovcnt)
+{
+    if (iov == NULL || iovcnt == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!tcp_client_task_is_connected()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    tcp_client_sendv_callback(iov, iovcnt);
+    return ESP_OK;
+}
+
+/**
+ * @brief Get the data processing handle bound to the cloud connection
+ */
+data_process_handle_t tcp_client_task_get_data_handle(void)
+{
+    return s_tcp_client.data_handle;
+}
+
+/**
+ * @brief Get the batcher in front of the cloud connection
+ */
+uplink_batcher_handle_t tcp_client_task_get_batcher(void)
+{
+    return s_tcp_client.batcher;
+}
+
+/**
+ * @brief Get TLS handshake statistics
+ */
+esp_err_t tcp_client_task_get_stats(tcp_client_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_tcp_client.lock);
+    *stats = s_tcp_client.stats;
+    portEXIT_CRITICAL(&s_tcp_client.lock);
+    return ESP_OK;
+}
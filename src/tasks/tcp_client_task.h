@@ -9,6 +9,8 @@
 #define TCP_CLIENT_TASK_H
 
 #include "esp_err.h"
+#include "../protocol/data_process.h"
+#include "../protocol/uplink_batcher.h"
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
@@ -17,6 +19,23 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Cloud connection TLS handshake statistics
+ * 
+ * A reconnect offers the previous connection's session (ticket or session
+ * ID); the server either resumes it with an abbreviated handshake or falls
+ * back to a full one, counted as a resume miss.
+ */
+typedef struct {
+    uint32_t full_handshakes;
+    uint32_t resumed_handshakes;
+    uint32_t resume_misses;         // Session offered, full handshake done
+    uint32_t handshake_failures;
+    uint32_t full_handshake_ms;     // Total time spent in full handshakes
+    uint32_t resumed_handshake_ms;  // Total time spent in resumed handshakes
+    uint32_t last_handshake_ms;
+} tcp_client_stats_t;
+
 /**
  * @brief Initialize TCP client task
  * 
@@ -34,6 +53,17 @@ esp_err_t tcp_client_task_init(void);
  */
 bool tcp_client_task_is_connected(void);
 
+/**
+ * @brief Get the number of the current cloud connection
+ * 
+ * Incremented each time a connection becomes ready, before it is reported
+ * connected. A reader that sees it change knows the peer may have lost any
+ * state tied to an earlier connection, however briefly the link was down.
+ * 
+ * @return Connections established so far (0 before the first)
+ */
+uint32_t tcp_client_task_get_connection_id(void);
+
 /**
  * @brief Send data through TCP client
  * 
@@ -43,6 +73,46 @@ bool tcp_client_task_is_connected(void);
  */
 esp_err_t tcp_client_task_send(const uint8_t *data, size_t len);
 
+/**
+ * @brief Send a segmented frame through TCP client
+ * 
+ * The segments are written in order as one frame without being gathered
+ * into an intermediate frame buffer first.
+ * 
+ * @param iov Segment list
+ * @param iovcnt Number of segments (at most DATA_PROCESS_MAX_IOV)
+ * @return ESP_OK on success
+ */
+esp_err_t tcp_client_task_sendv(const data_process_iovec_t *iov, size_t iovcnt);
+
+/**
+ * @brief Get the data processing handle bound to the cloud connection
+ * 
+ * Frames sent through this handle share the connection's sequence
+ * numbering and 0xC2 acknowledgement window.
+ * 
+ * @return Data processing handle, or NULL before tcp_client_task_init()
+ */
+data_process_handle_t tcp_client_task_get_data_handle(void);
+
+/**
+ * @brief Get the batcher in front of the cloud connection
+ * 
+ * The uplink task registers itself as its flush task, so batches whose
+ * deadline expires are written from that task rather than the timer.
+ * 
+ * @return Batcher handle, or NULL before tcp_client_task_init()
+ */
+uplink_batcher_handle_t tcp_client_task_get_batcher(void);
+
+/**
+ * @brief Get TLS handshake statistics of the cloud connection
+ * 
+ * @param stats Filled with a snapshot of the counters
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t tcp_client_task_get_stats(tcp_client_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -9,12 +9,43 @@
  * - TLS server setup
  * - Multiple client connection management
  * - Data reception and transmission
+ * 
+ * Every client is served by one event-loop task with select() and
+ * non-blocking sockets. A connection costs its slot and its data process
+ * handle, a few hundred bytes; the receive buffer is shared, since the
+ * loop handles one client's bytes at a time. Register reads that miss the
+ * cache complete asynchronously through the bus engine, and the loop is
+ * woken through a loopback UDP socket when they do.
+ * 
+ * Outgoing frames are built into pooled buffers and queued on their
+ * client; the loop writes them as the socket takes them, resuming part
+ * way through a frame, and selects for writability while a queue is not
+ * empty.
+ * 
+ * With TLS (TCP_SERVER_USE_TLS, PSK from the device SN), a connection's
+ * handshake is a state of that connection: the loop takes it one step
+ * whenever its socket is readable or writable, as mbedtls asked, and
+ * closes it if it has not finished TCP_SERVER_TLS_TIMEOUT_MS after the
+ * accept. A peer that stalls mid-handshake costs its slot and nothing
+ * else. The SSL configuration and random generator are shared.
+ * 
+ * The server issues session tickets (RFC 5077), so a client that comes
+ * back resumes with an abbreviated handshake: no key exchange, one round
+ * trip less. Tickets are sealed with a key the server holds in RAM, so the
+ * server keeps no per-session state and a reboot simply makes the next
+ * handshake a full one.
  */
 
 #include "tcp_server_task.h"
+#include "../config/param_manager.h"
+#include "../config/param_ids.h"
 #include "../protocol/data_process.h"
+#include "../protocol/function_codes.h"
+#include "../protocol/register_cache.h"
+#include "../protocol/device_routes.h"
+#include "bus_task.h"
+#include "../utils/frame_pool.h"
 #include "esp_log.h"
-#include "esp_https_ota.h"
 #include "lwip/sockets.h"
 #include "lwip/netdb.h"
 #include "lwip/inet.h"
@@ -22,103 +53,143 @@
 #include "mbedtls/net_sockets.h"
 #include "mbedtls/entropy.h"
 #include "mbedtls/ctr_drbg.h"
+#include "mbedtls/md5.h"
+#include "mbedtls/ssl_ticket.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
+#include "freertos/queue.h"
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
 #include <stdbool.h>
 
 static const char *TAG = "tcp_server";
 
-// TLS wrapper using mbedtls directly (esp_tls.h not available in v5.5)
+// TLS wrapper using mbedtls directly (esp_tls.h not available in v5.5).
+// The configuration, entropy source and random generator are the server's,
+// shared by every connection; a connection holds its SSL context only.
 typedef struct {
-    mbedtls_ssl_context ssl;
     mbedtls_ssl_config conf;
-    mbedtls_net_context server_fd;
     mbedtls_entropy_context entropy;
     mbedtls_ctr_drbg_context ctr_drbg;
-    int sockfd;
-    bool initialized;
-} esp_tls_t;
+    mbedtls_ssl_ticket_context ticket;
+    uint8_t psk[16];
+} esp_tls_cfg_server_t;
 
 typedef struct {
-    int timeout_ms;
-    const char *psk_hint_key;
-    size_t psk_hint_key_len;
-    const uint8_t *psk_key;
-    size_t psk_key_len;
-    const char **alpn_protos;
-    bool skip_common_name;
-    bool use_global_ca_store;
+    mbedtls_ssl_context ssl;
+    mbedtls_net_context server_fd;
     int sockfd;
-    const unsigned char *servercert_buf;
-    size_t servercert_buf_len;
-    const unsigned char *cacert_buf;
-    size_t cacert_buf_len;
-} esp_tls_cfg_t;
+    bool initialized;           // Handshake complete
+    bool resumed;               // Handshake resumed a session from a ticket
+} esp_tls_t;
+
+static esp_tls_t *s_tls_handshaking;    // Session whose handshake step is running
+
+/**
+ * @brief Ticket parse callback: mark the session being handshaken as resumed
+ */
+static int esp_tls_server_ticket_parse(void *p_ticket, mbedtls_ssl_session *session,
+                                       unsigned char *buf, size_t len)
+{
+    int ret = mbedtls_ssl_ticket_parse(p_ticket, session, buf, len);
+    if (ret == 0 && s_tls_handshaking != NULL) {
+        s_tls_handshaking->resumed = true;
+    }
+    return ret;
+}
 
-// TLS wrapper functions using mbedtls
-static esp_tls_t *esp_tls_conn_new_sync(const char *hostname, size_t hostname_len, int port, const esp_tls_cfg_t *cfg)
+/**
+ * @brief Set up the server-wide TLS configuration: PSK cipher suites, no
+ *        certificate, session tickets
+ */
+static esp_err_t esp_tls_cfg_server_init(esp_tls_cfg_server_t *cfg, const char *psk_identity,
+                                         uint32_t ticket_lifetime_s)
 {
-    if (!cfg) return NULL;
-    
-    esp_tls_t *tls = calloc(1, sizeof(esp_tls_t));
-    if (!tls) return NULL;
-    
-    mbedtls_ssl_init(&tls->ssl);
-    mbedtls_ssl_config_init(&tls->conf);
-    mbedtls_net_init(&tls->server_fd);
-    mbedtls_entropy_init(&tls->entropy);
-    mbedtls_ctr_drbg_init(&tls->ctr_drbg);
-    
-    tls->sockfd = cfg->sockfd;
-    tls->server_fd.fd = cfg->sockfd;
-    
+    mbedtls_ssl_config_init(&cfg->conf);
+    mbedtls_entropy_init(&cfg->entropy);
+    mbedtls_ctr_drbg_init(&cfg->ctr_drbg);
+    mbedtls_ssl_ticket_init(&cfg->ticket);
+
     const char *pers = "tls_server";
-    int ret = mbedtls_ctr_drbg_seed(&tls->ctr_drbg, mbedtls_entropy_func, &tls->entropy, (const unsigned char *)pers, strlen(pers));
+    int ret = mbedtls_ctr_drbg_seed(&cfg->ctr_drbg, mbedtls_entropy_func, &cfg->entropy, (const unsigned char *)pers, strlen(pers));
     if (ret != 0) {
         ESP_LOGE(TAG, "mbedtls_ctr_drbg_seed failed: %d", ret);
-        goto error;
+        return ESP_FAIL;
     }
-    
-    ret = mbedtls_ssl_config_defaults(&tls->conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+
+    ret = mbedtls_ssl_config_defaults(&cfg->conf, MBEDTLS_SSL_IS_SERVER, MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
     if (ret != 0) {
         ESP_LOGE(TAG, "mbedtls_ssl_config_defaults failed: %d", ret);
-        goto error;
+        return ESP_FAIL;
     }
-    
-    mbedtls_ssl_conf_authmode(&tls->conf, MBEDTLS_SSL_VERIFY_NONE);
-    mbedtls_ssl_conf_rng(&tls->conf, mbedtls_ctr_drbg_random, &tls->ctr_drbg);
-    
-    ret = mbedtls_ssl_setup(&tls->ssl, &tls->conf);
+
+    ret = mbedtls_ssl_conf_psk(&cfg->conf, cfg->psk, sizeof(cfg->psk),
+                               (const unsigned char *)psk_identity, strlen(psk_identity));
+    if (ret != 0) {
+        ESP_LOGE(TAG, "mbedtls_ssl_conf_psk failed: %d", ret);
+        return ESP_FAIL;
+    }
+
+    // Ticket keys are random per boot; tickets from before a reboot fall back to a full handshake
+    ret = mbedtls_ssl_ticket_setup(&cfg->ticket, mbedtls_ctr_drbg_random, &cfg->ctr_drbg,
+                                   MBEDTLS_CIPHER_AES_256_GCM, ticket_lifetime_s);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "mbedtls_ssl_ticket_setup failed: %d", ret);
+        return ESP_FAIL;
+    }
+    mbedtls_ssl_conf_session_tickets_cb(&cfg->conf, mbedtls_ssl_ticket_write,
+                                        esp_tls_server_ticket_parse, &cfg->ticket);
+
+    mbedtls_ssl_conf_authmode(&cfg->conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&cfg->conf, mbedtls_ctr_drbg_random, &cfg->ctr_drbg);
+    return ESP_OK;
+}
+
+/**
+ * @brief Start a server session on an accepted, non-blocking socket
+ * 
+ * No handshake yet: esp_tls_server_session_continue_async() drives it.
+ */
+static esp_tls_t *esp_tls_server_session_create(esp_tls_cfg_server_t *cfg, int sockfd)
+{
+    esp_tls_t *tls = calloc(1, sizeof(esp_tls_t));
+    if (!tls) return NULL;
+
+    mbedtls_ssl_init(&tls->ssl);
+    tls->sockfd = sockfd;
+    tls->server_fd.fd = sockfd;
+
+    int ret = mbedtls_ssl_setup(&tls->ssl, &cfg->conf);
     if (ret != 0) {
         ESP_LOGE(TAG, "mbedtls_ssl_setup failed: %d", ret);
-        goto error;
+        mbedtls_ssl_free(&tls->ssl);
+        free(tls);
+        return NULL;
     }
-    
+
     mbedtls_ssl_set_bio(&tls->ssl, &tls->server_fd, mbedtls_net_send, mbedtls_net_recv, NULL);
-    
-    // Perform handshake
-    while ((ret = mbedtls_ssl_handshake(&tls->ssl)) != 0) {
-        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
-            ESP_LOGE(TAG, "mbedtls_ssl_handshake failed: %d", ret);
-            goto error;
-        }
-    }
-    
-    tls->initialized = true;
     return tls;
-    
-error:
-    mbedtls_ssl_free(&tls->ssl);
-    mbedtls_ssl_config_free(&tls->conf);
-    mbedtls_net_free(&tls->server_fd);
-    mbedtls_entropy_free(&tls->entropy);
-    mbedtls_ctr_drbg_free(&tls->ctr_drbg);
-    free(tls);
-    return NULL;
+}
+
+/**
+ * @brief Take the handshake as far as the socket allows
+ * 
+ * @return 0 once the handshake is complete, MBEDTLS_ERR_SSL_WANT_READ or
+ *         MBEDTLS_ERR_SSL_WANT_WRITE to call again when the socket is ready,
+ *         any other value if the handshake failed
+ */
+static int esp_tls_server_session_continue_async(esp_tls_t *tls)
+{
+    s_tls_handshaking = tls;
+    int ret = mbedtls_ssl_handshake(&tls->ssl);
+    s_tls_handshaking = NULL;
+    if (ret == 0) {
+        tls->initialized = true;
+    }
+    return ret;
 }
 
 static int esp_tls_conn_read(esp_tls_t *tls, void *data, size_t datalen)
@@ -139,185 +210,882 @@ static void esp_tls_conn_delete(esp_tls_t *tls)
     if (tls->initialized) {
         mbedtls_ssl_close_notify(&tls->ssl);
     }
+    // The socket is the caller's to close; mbedtls_net_free() would close it too
     mbedtls_ssl_free(&tls->ssl);
-    mbedtls_ssl_config_free(&tls->conf);
-    mbedtls_net_free(&tls->server_fd);
-    mbedtls_entropy_free(&tls->entropy);
-    mbedtls_ctr_drbg_free(&tls->ctr_drbg);
     free(tls);
 }
 
+#ifndef TCP_SERVER_PORT
 #define TCP_SERVER_PORT           8080
-#define TCP_SERVER_MAX_CLIENTS     4
-#define TCP_SERVER_RECV_BUF_SIZE   2048
-#define TCP_SERVER_BACKLOG         5
+#endif
+#define TCP_SERVER_RECV_BUF_SIZE   2048   // One buffer, shared by every connection
+#define TCP_SERVER_BACKLOG         TCP_SERVER_MAX_CLIENTS  // A burst of connects needs no SYN retries
+#ifndef TCP_SERVER_USE_TLS
+#define TCP_SERVER_USE_TLS         0      // PSK TLS on local connections
+#endif
+#define TCP_SERVER_TLS_TIMEOUT_MS  5000   // Whole handshake, from accept
+#define TCP_SERVER_PSK_IDENTITY    "psk_identity_dongle"
+#define TCP_SERVER_PSK_KEY_PREFIX  "LuxD1ngl2X"   // Same key as the cloud link: MD5(prefix + SN)
+#define TCP_SERVER_TICKET_LIFETIME_S  86400     // Session tickets are good for a day
+#define TCP_SERVER_READ_RESPONSE_SIZE 255  // Modbus response with 125 registers
+#define TCP_SERVER_BUS_RETRIES      1      // Extra bus attempts for a read-through
+#define TCP_SERVER_MAX_READS        16     // Read-throughs waiting for the bus, all clients
+#define TCP_SERVER_RETRY_MS         5      // Bus queue full: offer waiting read-throughs again
+#define TCP_SERVER_PUBLISH_DEPTH    8      // Telemetry blocks waiting for the event loop
 
 // Client connection state
 typedef enum {
     TCP_CLIENT_STATE_FREE,
-    TCP_CLIENT_STATE_CONNECTING,
-    TCP_CLIENT_STATE_CONNECTED,
     TCP_CLIENT_STATE_TLS_HANDSHAKE,
     TCP_CLIENT_STATE_READY
 } tcp_client_state_t;
 
-// Client structure
+// Client connection; everything else is shared by the event loop
 typedef struct {
     int sock;
-    esp_tls_t *tls;
-    esp_tls_cfg_t tls_cfg;
     tcp_client_state_t state;
-    TaskHandle_t task_handle;
+    uint16_t generation;        // Bumped on accept; older read-throughs are dropped
+    bool closing;               // Close once the current callback returns
+    bool handshake_write;       // Handshake waits for the socket to take data, not to bring it
+    TickType_t handshake_deadline;
+    esp_tls_t *tls;
     data_process_handle_t data_handle;
-    uint8_t *recv_buffer;
-    SemaphoreHandle_t mutex;
-    char name[32];
+    frame_buf_t *tx[TCP_SERVER_TX_QUEUE_DEPTH];    // Outbound queue, whole frames
+    uint8_t tx_head;
+    uint8_t tx_count;
+    uint16_t tx_offset;         // Bytes of the head frame already written
+    uint32_t tx_bytes;          // Unwritten bytes in the queue
+    uint8_t subscriptions;      // Device route bits
+    uint8_t telemetry_drop_run; // Telemetry frames dropped in a row
 } tcp_client_t;
 
+// Register read waiting for the bus
+typedef struct {
+    bool in_use;
+    bool queued;                // Accepted by the bus engine; false while the class queue is full
+    uint32_t ticket;            // Arrival order, so waiting reads go to the bus oldest first
+    uint8_t client;
+    uint16_t generation;
+    uint8_t device_id;
+    uint8_t slave_addr;
+    uint8_t func_code;
+    uint16_t start;
+    uint16_t count;
+} tcp_server_read_t;
+
+// Completed read-through, queued for the event loop
+typedef struct {
+    uint8_t read;
+    esp_err_t status;
+    frame_buf_t *frame;         // RTU response when status is ESP_OK
+} tcp_server_completion_t;
+
+// Telemetry block on its way to the event loop
+typedef struct {
+    uint8_t device_id;
+    frame_buf_t *frame;         // Response body: byte count, register values
+} tcp_server_publish_t;
+
 // TCP server structure
 typedef struct {
     int listen_sock;
+    int ctrl_sock;              // Loopback UDP socket connected to itself, wakes select()
     uint16_t port;
     tcp_client_t clients[TCP_SERVER_MAX_CLIENTS];
-    SemaphoreHandle_t mutex;
+    tcp_client_t *current;      // Client whose frames are being handled
+    tcp_server_read_t reads[TCP_SERVER_MAX_READS];
+    uint32_t next_ticket;
+    uint8_t waiting;            // Reads holding for room in the bus queue
+    QueueHandle_t completions;
+    QueueHandle_t publishes;
+    data_process_handle_t telemetry_handle;    // Frames each telemetry block once
+    frame_buf_t *encoded;       // Frame the telemetry handle just built
+    volatile uint8_t subscribed;    // Clients with a subscription; read by publishers
+    frame_buf_t *recv_frame;    // Pooled receive buffer, held for good
     TaskHandle_t server_task_handle;
     bool use_tls;
+    esp_tls_cfg_server_t *tls_cfg;  // Shared by every connection
+    tcp_server_stats_t stats;
+    portMUX_TYPE lock;          // Guards stats
 } tcp_server_t;
 
-static tcp_server_t s_tcp_server = {0};
+static tcp_server_t s_tcp_server = {
+    .listen_sock = -1,
+    .ctrl_sock = -1,
+    .lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+static int tcp_server_client_index(const tcp_client_t *client)
+{
+    return (int)(client - s_tcp_server.clients);
+}
 
 /**
- * @brief Client receive task
+ * @brief Wake the event loop out of select()
  * 
- * Original: sub_42014B6C (client_receive_task)
+ * Safe from any task; never blocks.
  */
-static void tcp_client_receive_task(void *pvParameters)
+static void tcp_server_wake(void)
 {
-    tcp_client_t *client = (tcp_client_t *)pvParameters;
-    int bytes_received;
-    
-    ESP_LOGI(TAG, "[%s] Client receive task started", client->name);
+    uint8_t byte = 0;
+    send(s_tcp_server.ctrl_sock, &byte, 1, MSG_DONTWAIT);
+}
+
+static void tcp_server_close_client(tcp_client_t *client)
+{
+    if (client->state == TCP_CLIENT_STATE_FREE) {
+        return;
+    }
+    if (client->tls) {
+        esp_tls_conn_delete(client->tls);
+        client->tls = NULL;
+    }
+    if (client->sock >= 0) {
+        close(client->sock);
+        client->sock = -1;
+    }
+    if (client->data_handle) {
+        data_process_destroy(client->data_handle);
+        client->data_handle = NULL;
+    }
+    while (client->tx_count > 0) {
+        frame_buf_unref(client->tx[client->tx_head]);
+        client->tx[client->tx_head] = NULL;
+        client->tx_head = (client->tx_head + 1) % TCP_SERVER_TX_QUEUE_DEPTH;
+        client->tx_count--;
+    }
+    client->tx_offset = 0;
+    client->tx_bytes = 0;
+    if (client->subscriptions != 0) {
+        s_tcp_server.subscribed--;
+        client->subscriptions = 0;
+    }
+    client->closing = false;
+    bool handshaking = (client->state == TCP_CLIENT_STATE_TLS_HANDSHAKE);
+    client->state = TCP_CLIENT_STATE_FREE;
+
+    portENTER_CRITICAL(&s_tcp_server.lock);
+    s_tcp_server.stats.active--;
+    if (handshaking) {
+        s_tcp_server.stats.handshaking--;
+    }
+    tcp_server_client_stats_t *stats = &s_tcp_server.stats.clients[tcp_server_client_index(client)];
+    stats->connected = false;
+    stats->subscriptions = 0;
+    stats->queue_depth = 0;
+    stats->queued_bytes = 0;
+    portEXIT_CRITICAL(&s_tcp_server.lock);
+
+    ESP_LOGI(TAG, "[client.%d] Connection closed", tcp_server_client_index(client));
+}
+
+/**
+ * @brief Copy an outgoing frame's segments into one pooled buffer
+ * 
+ * @return Buffer holding one reference, NULL if the pool is exhausted
+ */
+static frame_buf_t *tcp_server_gather(const data_process_iovec_t *iov, size_t iovcnt)
+{
+    size_t total = data_process_iov_length(iov, iovcnt);
+    frame_buf_t *frame = frame_pool_alloc(total);
+    if (frame == NULL) {
+        return NULL;
+    }
+    frame->len = (uint16_t)data_process_iov_copy(iov, iovcnt, 0, frame->data, total);
+    return frame;
+}
+
+/**
+ * @brief Publish a client's queue depth to its statistics
+ */
+static void tcp_server_update_queue_stats(const tcp_client_t *client, uint32_t sent)
+{
+    portENTER_CRITICAL(&s_tcp_server.lock);
+    tcp_server_client_stats_t *stats = &s_tcp_server.stats.clients[tcp_server_client_index(client)];
+    stats->queue_depth = client->tx_count;
+    stats->queued_bytes = client->tx_bytes;
+    if (client->tx_count > stats->queue_high_water) {
+        stats->queue_high_water = client->tx_count;
+    }
+    stats->sent += sent;
+    portEXIT_CRITICAL(&s_tcp_server.lock);
+}
+
+/**
+ * @brief Write queued frames until the queue is empty or the socket is full
+ * 
+ * A write error marks the client for closing.
+ */
+static void tcp_server_flush(tcp_client_t *client)
+{
+    uint32_t sent = 0;
+
+    while (client->tx_count > 0 && !client->closing) {
+        frame_buf_t *frame = client->tx[client->tx_head];
+        const uint8_t *data = frame->data + client->tx_offset;
+        size_t remaining = frame->len - client->tx_offset;
+        int written;
 
-    while (client->state == TCP_CLIENT_STATE_READY) {
-        // Receive data
         if (s_tcp_server.use_tls && client->tls) {
-            bytes_received = esp_tls_conn_read(client->tls, 
-                                               client->recv_buffer, 
-                                               TCP_SERVER_RECV_BUF_SIZE);
+            // mbedtls wants the same data again after WANT_WRITE, which is what is left here
+            written = esp_tls_conn_write(client->tls, data, remaining);
+            if (written == MBEDTLS_ERR_SSL_WANT_READ || written == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                break;
+            }
         } else {
-            bytes_received = recv(client->sock, 
-                                  client->recv_buffer, 
-                                  TCP_SERVER_RECV_BUF_SIZE, 0);
+            written = send(client->sock, data, remaining, MSG_DONTWAIT);
+            if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+        }
+        if (written <= 0) {
+            ESP_LOGW(TAG, "[client.%d] Send failed: %d, closing", tcp_server_client_index(client),
+                     (s_tcp_server.use_tls && client->tls) ? written : errno);
+            client->closing = true;
+            break;
         }
 
-        if (bytes_received > 0) {
-            // Process received data
-            if (client->data_handle) {
-                data_process_receive(client->data_handle, 
-                                    client->recv_buffer, 
-                                    bytes_received);
+        client->tx_offset += (uint16_t)written;
+        client->tx_bytes -= (uint32_t)written;
+        if (client->tx_offset == frame->len) {
+            frame_buf_unref(frame);
+            client->tx[client->tx_head] = NULL;
+            client->tx_head = (client->tx_head + 1) % TCP_SERVER_TX_QUEUE_DEPTH;
+            client->tx_count--;
+            client->tx_offset = 0;
+            sent++;
+        }
+    }
+
+    tcp_server_update_queue_stats(client, sent);
+}
+
+/**
+ * @brief Queue a frame for a client and write what the socket takes
+ * 
+ * Takes over the caller's reference, also when the frame does not fit.
+ * 
+ * @return false if the queue is full or over its byte budget
+ */
+static bool tcp_server_enqueue(tcp_client_t *client, frame_buf_t *frame)
+{
+    if (client->tx_count == TCP_SERVER_TX_QUEUE_DEPTH ||
+        (client->tx_count > 0 && client->tx_bytes + frame->len > TCP_SERVER_TX_BUDGET)) {
+        frame_buf_unref(frame);
+        return false;
+    }
+
+    uint8_t tail = (client->tx_head + client->tx_count) % TCP_SERVER_TX_QUEUE_DEPTH;
+    client->tx[tail] = frame;
+    client->tx_count++;
+    client->tx_bytes += frame->len;
+    tcp_server_flush(client);
+    return true;
+}
+
+/**
+ * @brief Client scatter-gather send callback
+ * 
+ * Queues the frame for the client being served: responses always go back
+ * to the client that asked. A client whose queue cannot take its own
+ * response is not reading, and is disconnected.
+ */
+static void tcp_client_sendv_callback(const data_process_iovec_t *iov, size_t iovcnt)
+{
+    if (iovcnt == 0 || iovcnt > DATA_PROCESS_MAX_IOV) {
+        ESP_LOGE(TAG, "Invalid segment count: %zu", iovcnt);
+        return;
+    }
+
+    tcp_client_t *client = s_tcp_server.current;
+    if (client == NULL || client->state != TCP_CLIENT_STATE_READY || client->closing) {
+        ESP_LOGD(TAG, "No client to send to");
+        return;
+    }
+    int index = tcp_server_client_index(client);
+
+    frame_buf_t *frame = tcp_server_gather(iov, iovcnt);
+    if (frame == NULL) {
+        ESP_LOGW(TAG, "[client.%d] No buffer for the response, dropped", index);
+        portENTER_CRITICAL(&s_tcp_server.lock);
+        s_tcp_server.stats.clients[index].response_drops++;
+        portEXIT_CRITICAL(&s_tcp_server.lock);
+        return;
+    }
+
+    if (!tcp_server_enqueue(client, frame)) {
+        ESP_LOGW(TAG, "[client.%d] Not reading its responses, disconnecting", index);
+        portENTER_CRITICAL(&s_tcp_server.lock);
+        s_tcp_server.stats.slow_disconnects++;
+        portEXIT_CRITICAL(&s_tcp_server.lock);
+        client->closing = true;
+    }
+}
+
+/**
+ * @brief Client send callback
+ */
+static void tcp_client_send_callback(const uint8_t *data, size_t len)
+{
+    data_process_iovec_t iov = {
+        .iov_base = data,
+        .iov_len = len,
+    };
+    tcp_client_sendv_callback(&iov, 1);
+}
+
+/**
+ * @brief Bus completion of a read-through; runs on the RS485 or bus task
+ */
+static void tcp_server_read_complete(const bus_result_t *result,
+                                     const uint8_t *frame, size_t len, void *ctx)
+{
+    tcp_server_completion_t completion = {
+        .read = (uint8_t)(uintptr_t)ctx,
+        .status = result->status,
+        .frame = NULL,
+    };
+
+    if (result->status == ESP_OK && frame != NULL) {
+        completion.frame = frame_pool_alloc(len);
+        if (completion.frame == NULL) {
+            completion.status = ESP_ERR_NO_MEM;
+        } else {
+            memcpy(completion.frame->data, frame, len);
+            completion.frame->len = (uint16_t)len;
+        }
+    }
+
+    // One queue entry per read slot: this cannot fail
+    xQueueSend(s_tcp_server.completions, &completion, 0);
+    tcp_server_wake();
+}
+
+/**
+ * @brief Answer a completed read-through, if its client is still there
+ */
+static void tcp_server_finish_read(const tcp_server_completion_t *completion)
+{
+    tcp_server_read_t *read = &s_tcp_server.reads[completion->read];
+    tcp_client_t *client = &s_tcp_server.clients[read->client];
+    const frame_buf_t *frame = completion->frame;
+
+    // Response: addr, fc, byte count, data, crc(2); the client gets byte count + data
+    if (completion->status == ESP_OK && frame != NULL && frame->len >= 5) {
+        register_cache_store(read->slave_addr, read->func_code, read->start,
+                             &frame->data[3], read->count);
+        if (client->state == TCP_CLIENT_STATE_READY && client->generation == read->generation) {
+            s_tcp_server.current = client;
+            data_process_send_to(client->data_handle, read->device_id,
+                                 PROTOCOL_FC_DATA_TRANSMISSION,
+                                 &frame->data[2], frame->len - 4, NULL);
+            s_tcp_server.current = NULL;
+            if (client->closing) {
+                tcp_server_close_client(client);
             }
-        } else if (bytes_received < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                vTaskDelay(pdMS_TO_TICKS(10));
-                continue;
+        }
+    } else {
+        ESP_LOGD(TAG, "[client.%d] Read-through failed: %d", read->client, completion->status);
+    }
+
+    if (frame != NULL) {
+        frame_buf_unref(completion->frame);
+    }
+    read->in_use = false;
+}
+
+/**
+ * @brief Offer a read-through to the bus engine
+ * 
+ * @return false if the class queue is full and the read must be offered again
+ */
+static bool tcp_server_submit_read(int slot)
+{
+    tcp_server_read_t *read = &s_tcp_server.reads[slot];
+    bus_request_t request = {
+        .slave_addr = read->slave_addr,
+        .func_code = read->func_code,
+        .start = read->start,
+        .count = read->count,
+        .retries = TCP_SERVER_BUS_RETRIES,
+        .priority = BUS_CLASS_INTERACTIVE,
+        .local = true,
+        .callback = tcp_server_read_complete,
+        .ctx = (void *)(uintptr_t)slot,
+    };
+
+    esp_err_t ret = bus_task_submit(&request);
+    if (ret == ESP_ERR_NO_MEM) {
+        return false;
+    }
+    if (ret == ESP_OK) {
+        read->queued = true;
+        return true;
+    }
+    ESP_LOGD(TAG, "[client.%d] Read-through not queued: %d", read->client, ret);
+    read->in_use = false;
+    return true;
+}
+
+/**
+ * @brief Offer the read-throughs waiting for room in the bus queue, oldest first
+ * 
+ * @return true if some are still waiting
+ */
+static bool tcp_server_submit_waiting(void)
+{
+    while (s_tcp_server.waiting > 0) {
+        int oldest = -1;
+        for (int slot = 0; slot < TCP_SERVER_MAX_READS; slot++) {
+            const tcp_server_read_t *read = &s_tcp_server.reads[slot];
+            if (read->in_use && !read->queued &&
+                (oldest < 0 || (int32_t)(read->ticket - s_tcp_server.reads[oldest].ticket) < 0)) {
+                oldest = slot;
             }
-            ESP_LOGE(TAG, "[%s] Receive error: %d", client->name, errno);
-            break;
-        } else {
-            // Connection closed
-            ESP_LOGI(TAG, "[%s] Connection closed by client", client->name);
+        }
+        if (oldest < 0) {
+            s_tcp_server.waiting = 0;
             break;
         }
+
+        // The client may have gone meanwhile
+        tcp_server_read_t *read = &s_tcp_server.reads[oldest];
+        const tcp_client_t *client = &s_tcp_server.clients[read->client];
+        if (client->state != TCP_CLIENT_STATE_READY || client->generation != read->generation) {
+            read->in_use = false;
+        } else if (!tcp_server_submit_read(oldest)) {
+            return true;
+        }
+        s_tcp_server.waiting--;
     }
+    return false;
+}
 
-    // Cleanup
-    if (xSemaphoreTake(s_tcp_server.mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-        if (client->tls) {
-            esp_tls_conn_delete(client->tls);
-            client->tls = NULL;
+/**
+ * @brief Subscription bit of a device route
+ */
+static uint8_t tcp_server_route_bit(const device_route_t *route)
+{
+    for (size_t i = 0; i < device_routes_count(); i++) {
+        if (device_routes_at(i) == route) {
+            return (uint8_t)(1u << i);
         }
-        if (client->sock >= 0) {
-            close(client->sock);
-            client->sock = -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Subscribe a client to a device's telemetry, or unsubscribe it
+ */
+static void tcp_server_subscribe(tcp_client_t *client, const device_route_t *route, bool on)
+{
+    uint8_t before = client->subscriptions;
+    uint8_t bit = tcp_server_route_bit(route);
+    client->subscriptions = on ? (before | bit) : (before & ~bit);
+
+    if (before == 0 && client->subscriptions != 0) {
+        s_tcp_server.subscribed++;
+    } else if (before != 0 && client->subscriptions == 0) {
+        s_tcp_server.subscribed--;
+    }
+
+    portENTER_CRITICAL(&s_tcp_server.lock);
+    s_tcp_server.stats.clients[tcp_server_client_index(client)].subscriptions =
+        client->subscriptions;
+    portEXIT_CRITICAL(&s_tcp_server.lock);
+
+    ESP_LOGI(TAG, "[client.%d] %s %s telemetry", tcp_server_client_index(client),
+             on ? "Subscribed to" : "Unsubscribed from", route->name);
+}
+
+/**
+ * @brief Client receive callback
+ * 
+ * Runs on the event loop with each reassembled frame. Register reads are
+ * answered from the register cache when it is fresh; otherwise they are
+ * read through the bus transaction engine and answered when the bus
+ * completes, without holding up the other clients. A read of zero
+ * registers changes the client's telemetry subscription instead.
+ */
+static void tcp_client_receive_callback(const uint8_t *data, size_t len)
+{
+    ESP_LOGD(TAG, "Received %zu bytes from client", len);
+
+    uint8_t *payload = NULL;
+    uint16_t payload_len = 0;
+    if (parse_data_transmission_frame(data, len, &payload, &payload_len) != 0) {
+        return;
+    }
+
+    tcp_client_t *client = s_tcp_server.current;
+    if (client == NULL || client->data_handle == NULL) {
+        return;
+    }
+    int index = tcp_server_client_index(client);
+
+    uint8_t device_id = data[PROTOCOL_DEVICE_OFFSET];
+    const device_route_t *route = device_routes_for_frame(device_id);
+    if (route == NULL) {
+        ESP_LOGD(TAG, "[client.%d] No route for device %u", index, device_id);
+        return;
+    }
+
+    if (payload_len == 4 && payload[2] == 0 && payload[3] == 0) {
+        tcp_server_subscribe(client, route, ((payload[0] << 8) | payload[1]) == TCP_SERVER_SUBSCRIBE);
+        data_process_send_to(client->data_handle, device_id, PROTOCOL_FC_DATA_TRANSMISSION,
+                             payload, payload_len, NULL);
+        return;
+    }
+
+    uint8_t response[TCP_SERVER_READ_RESPONSE_SIZE];
+    size_t response_len = 0;
+    esp_err_t ret = register_cache_answer_read(route->slave_addr, route->read_fc,
+                                               payload, payload_len, response,
+                                               sizeof(response), &response_len);
+    if (ret == ESP_OK) {
+        data_process_send_to(client->data_handle, device_id, PROTOCOL_FC_DATA_TRANSMISSION,
+                             response, response_len, NULL);
+        return;
+    }
+    if (ret != ESP_ERR_NOT_FOUND && ret != ESP_ERR_TIMEOUT) {
+        ESP_LOGD(TAG, "[client.%d] Not a register read: %d", index, ret);
+        return;
+    }
+
+    // Cache miss: read through on the bus and answer on completion
+    tcp_server_read_t *read = NULL;
+    int slot = 0;
+    for (; slot < TCP_SERVER_MAX_READS; slot++) {
+        if (!s_tcp_server.reads[slot].in_use) {
+            read = &s_tcp_server.reads[slot];
+            break;
         }
-        if (client->data_handle) {
-            data_process_destroy(client->data_handle);
-            client->data_handle = NULL;
+    }
+    if (read == NULL) {
+        ESP_LOGD(TAG, "[client.%d] Too many read-throughs waiting", index);
+        return;
+    }
+
+    *read = (tcp_server_read_t){
+        .in_use = true,
+        .ticket = s_tcp_server.next_ticket++,
+        .client = (uint8_t)index,
+        .generation = client->generation,
+        .device_id = device_id,
+        .slave_addr = route->slave_addr,
+        .func_code = route->read_fc,
+        .start = (payload[0] << 8) | payload[1],
+        .count = (payload[2] << 8) | payload[3],
+    };
+
+    // A full bus queue holds the read until the loop offers it again; while
+    // any read is held, newer ones queue behind it
+    if (s_tcp_server.waiting > 0 || !tcp_server_submit_read(slot)) {
+        s_tcp_server.waiting++;
+        portENTER_CRITICAL(&s_tcp_server.lock);
+        s_tcp_server.stats.held++;
+        portEXIT_CRITICAL(&s_tcp_server.lock);
+    }
+}
+
+/**
+ * @brief Telemetry handle send callback: keep the built frame for the fan-out
+ */
+static void tcp_server_telemetry_sendv(const data_process_iovec_t *iov, size_t iovcnt)
+{
+    s_tcp_server.encoded = tcp_server_gather(iov, iovcnt);
+}
+
+/**
+ * @brief Queue a telemetry block on every client subscribed to its device
+ * 
+ * The block is framed once; each subscriber's queue takes a reference to
+ * the same buffer.
+ */
+static void tcp_server_fan_out(const tcp_server_publish_t *publish)
+{
+    const device_route_t *route = device_routes_by_id(publish->device_id);
+    uint8_t bit = (route != NULL) ? tcp_server_route_bit(route) : 0;
+    frame_buf_t *frame = NULL;
+
+    if (bit != 0) {
+        s_tcp_server.encoded = NULL;
+        data_process_send_to(s_tcp_server.telemetry_handle, publish->device_id,
+                             PROTOCOL_FC_DATA_TRANSMISSION, publish->frame->data,
+                             publish->frame->len, NULL);
+        frame = s_tcp_server.encoded;
+        s_tcp_server.encoded = NULL;
+    }
+    frame_buf_unref(publish->frame);
+    if (frame == NULL) {
+        return;
+    }
+
+    uint32_t slow = 0;
+    for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+        tcp_client_t *client = &s_tcp_server.clients[i];
+        if (client->state != TCP_CLIENT_STATE_READY || client->closing ||
+            (client->subscriptions & bit) == 0) {
+            continue;
+        }
+
+        if (tcp_server_enqueue(client, frame_buf_ref(frame))) {
+            client->telemetry_drop_run = 0;
+        } else {
+            portENTER_CRITICAL(&s_tcp_server.lock);
+            s_tcp_server.stats.clients[i].telemetry_drops++;
+            portEXIT_CRITICAL(&s_tcp_server.lock);
+            if (++client->telemetry_drop_run >= TCP_SERVER_MAX_TELEMETRY_DROPS) {
+                ESP_LOGW(TAG, "[client.%d] Not keeping up with telemetry, disconnecting", i);
+                client->closing = true;
+                slow++;
+            }
         }
-        if (client->recv_buffer) {
-            free(client->recv_buffer);
-            client->recv_buffer = NULL;
+        if (client->closing) {
+            tcp_server_close_client(client);
         }
-        client->state = TCP_CLIENT_STATE_FREE;
-        xSemaphoreGive(s_tcp_server.mutex);
     }
+    frame_buf_unref(frame);
 
-    ESP_LOGI(TAG, "[%s] Client receive task ended", client->name);
-    vTaskDelete(NULL);
+    portENTER_CRITICAL(&s_tcp_server.lock);
+    s_tcp_server.stats.published++;
+    s_tcp_server.stats.slow_disconnects += slow;
+    portEXIT_CRITICAL(&s_tcp_server.lock);
 }
 
 /**
- * @brief Client send callback
+ * @brief Read what a readable client has sent and handle its frames
  */
-static void tcp_client_send_callback(const uint8_t *data, size_t len)
+static void tcp_server_receive(tcp_client_t *client)
 {
-    // Find the client that should send this data
-    // For now, send to first connected client
-    for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
-        if (s_tcp_server.clients[i].state == TCP_CLIENT_STATE_READY) {
-            tcp_client_t *client = &s_tcp_server.clients[i];
-            int sent = 0;
-            
-            if (s_tcp_server.use_tls && client->tls) {
-                sent = esp_tls_conn_write(client->tls, data, len);
-            } else {
-                sent = send(client->sock, data, len, 0);
+    uint8_t *buffer = s_tcp_server.recv_frame->data;
+    int bytes_received;
+
+    // mbedtls may hold more decrypted data than one read returns
+    do {
+        if (s_tcp_server.use_tls && client->tls) {
+            bytes_received = esp_tls_conn_read(client->tls, buffer, TCP_SERVER_RECV_BUF_SIZE);
+            if (bytes_received == MBEDTLS_ERR_SSL_WANT_READ ||
+                bytes_received == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                return;
             }
-            
-            if (sent < 0) {
-                ESP_LOGE(TAG, "[%s] Failed to send data: %d", client->name, sent);
+        } else {
+            bytes_received = recv(client->sock, buffer, TCP_SERVER_RECV_BUF_SIZE, MSG_DONTWAIT);
+            if (bytes_received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return;
             }
-            break;  // Send to first available client
         }
+
+        if (bytes_received == 0 || bytes_received == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ||
+            bytes_received == MBEDTLS_ERR_NET_CONN_RESET ||
+            (bytes_received < 0 && errno == ECONNRESET && !(s_tcp_server.use_tls && client->tls))) {
+            ESP_LOGI(TAG, "[client.%d] Connection closed by client",
+                     tcp_server_client_index(client));
+            tcp_server_close_client(client);
+            return;
+        }
+        if (bytes_received < 0) {
+            ESP_LOGE(TAG, "[client.%d] Receive error: %d", tcp_server_client_index(client),
+                     (s_tcp_server.use_tls && client->tls) ? bytes_received : errno);
+            tcp_server_close_client(client);
+            return;
+        }
+
+        s_tcp_server.current = client;
+        data_process_receive(client->data_handle, buffer, bytes_received);
+        s_tcp_server.current = NULL;
+        if (client->closing) {
+            tcp_server_close_client(client);
+            return;
+        }
+    } while (s_tcp_server.use_tls && client->tls);
+}
+
+/**
+ * @brief Give a connection its data handle and start serving its frames
+ */
+static void tcp_server_client_ready(tcp_client_t *client)
+{
+    int index = tcp_server_client_index(client);
+    client->data_handle = data_process_create(
+        tcp_client_send_callback,
+        tcp_client_receive_callback
+    );
+    if (client->data_handle == NULL) {
+        ESP_LOGE(TAG, "[client.%d] Failed to create data handle", index);
+        tcp_server_close_client(client);
+        return;
     }
+    data_process_set_sendv_callback(client->data_handle, tcp_client_sendv_callback);
+
+    client->state = TCP_CLIENT_STATE_READY;
 }
 
 /**
- * @brief Client receive callback
+ * @brief Advance a client's TLS handshake; the socket is ready or just accepted
+ */
+static void tcp_server_handshake(tcp_client_t *client)
+{
+    int index = tcp_server_client_index(client);
+    int ret = esp_tls_server_session_continue_async(client->tls);
+
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        client->handshake_write = (ret == MBEDTLS_ERR_SSL_WANT_WRITE);
+        return;
+    }
+    if (ret != 0) {
+        ESP_LOGW(TAG, "[client.%d] TLS handshake failed: -0x%04x", index, (unsigned int)-ret);
+        portENTER_CRITICAL(&s_tcp_server.lock);
+        s_tcp_server.stats.handshake_failures++;
+        portEXIT_CRITICAL(&s_tcp_server.lock);
+        tcp_server_close_client(client);
+        return;
+    }
+
+    portENTER_CRITICAL(&s_tcp_server.lock);
+    s_tcp_server.stats.handshaking--;
+    s_tcp_server.stats.handshakes++;
+    if (client->tls->resumed) {
+        s_tcp_server.stats.handshakes_resumed++;
+    }
+    portEXIT_CRITICAL(&s_tcp_server.lock);
+    ESP_LOGI(TAG, "[client.%d] TLS handshake complete%s", index,
+             client->tls->resumed ? " (resumed)" : "");
+
+    tcp_server_client_ready(client);
+    if (client->state == TCP_CLIENT_STATE_READY) {
+        // A request sent right behind the handshake may be decrypted and
+        // buffered already, with nothing left on the socket to wake select()
+        tcp_server_receive(client);
+    }
+}
+
+/**
+ * @brief Close the handshakes that have run out of time
  * 
- * Forwards received data to RS485 if needed
+ * @return Ticks until the next handshake deadline, portMAX_DELAY if none
  */
-static void tcp_client_receive_callback(const uint8_t *data, size_t len)
+static TickType_t tcp_server_expire_handshakes(void)
 {
-    ESP_LOGD(TAG, "Received %zu bytes from client", len);
-    
-    // Process received data through data processing module
-    // The data processing module will handle protocol parsing
-    // and can trigger RS485 forwarding if needed
-    // This is handled by the data_process_receive call in the receive task
+    TickType_t now = xTaskGetTickCount();
+    TickType_t next = portMAX_DELAY;
+
+    for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+        tcp_client_t *client = &s_tcp_server.clients[i];
+        if (client->state != TCP_CLIENT_STATE_TLS_HANDSHAKE) {
+            continue;
+        }
+        TickType_t left = client->handshake_deadline - now;
+        if ((int32_t)left <= 0) {
+            ESP_LOGW(TAG, "[client.%d] TLS handshake timed out", i);
+            portENTER_CRITICAL(&s_tcp_server.lock);
+            s_tcp_server.stats.handshake_timeouts++;
+            portEXIT_CRITICAL(&s_tcp_server.lock);
+            tcp_server_close_client(client);
+        } else if (left < next) {
+            next = left;
+        }
+    }
+    return next;
 }
 
 /**
- * @brief TCP server accept task
+ * @brief Accept a pending connection into a free client slot
  * 
- * Original: sub_4201427A (tcp_server_task)
+ * @return false once the backlog is empty
  */
-static void tcp_server_task(void *pvParameters)
+static bool tcp_server_accept(void)
 {
-    struct sockaddr_in server_addr;
     struct sockaddr_in client_addr;
     socklen_t client_addr_len = sizeof(client_addr);
-    int client_sock;
+    int client_sock = accept(s_tcp_server.listen_sock,
+                             (struct sockaddr *)&client_addr,
+                             &client_addr_len);
+    if (client_sock < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            ESP_LOGE(TAG, "Failed to accept connection: %d", errno);
+        }
+        return false;
+    }
+
+    ESP_LOGI(TAG, "New client connected from %s:%d",
+             inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+
+    // Find free client slot
+    tcp_client_t *client = NULL;
+    for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+        if (s_tcp_server.clients[i].state == TCP_CLIENT_STATE_FREE) {
+            client = &s_tcp_server.clients[i];
+            break;
+        }
+    }
+    if (client == NULL) {
+        ESP_LOGW(TAG, "No available client slots, closing connection");
+        close(client_sock);
+        portENTER_CRITICAL(&s_tcp_server.lock);
+        s_tcp_server.stats.rejected++;
+        portEXIT_CRITICAL(&s_tcp_server.lock);
+        return true;
+    }
+
+    int index = tcp_server_client_index(client);
+    client->sock = client_sock;
+    client->generation++;
+    client->closing = false;
+    client->telemetry_drop_run = 0;
+    client->state = TCP_CLIENT_STATE_TLS_HANDSHAKE;     // Not READY until it has a data handle
+    portENTER_CRITICAL(&s_tcp_server.lock);
+    s_tcp_server.stats.clients[index] = (tcp_server_client_stats_t){ .connected = true };
+    s_tcp_server.stats.accepted++;
+    s_tcp_server.stats.active++;
+    if (s_tcp_server.stats.active > s_tcp_server.stats.peak_active) {
+        s_tcp_server.stats.peak_active = s_tcp_server.stats.active;
+    }
+    portEXIT_CRITICAL(&s_tcp_server.lock);
+
+    // Frames arrive through select(); the loop never waits on one client
+    int flags = fcntl(client_sock, F_GETFL, 0);
+    fcntl(client_sock, F_SETFL, flags | O_NONBLOCK);
+    int opt = 1;
+    setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+    if (!s_tcp_server.use_tls) {
+        tcp_server_client_ready(client);
+        return true;
+    }
+
+    // The handshake runs on the loop as the socket becomes ready, a step at
+    // a time, so a slow peer holds up nobody else
+    client->tls = esp_tls_server_session_create(s_tcp_server.tls_cfg, client_sock);
+    if (client->tls == NULL) {
+        ESP_LOGE(TAG, "[client.%d] Failed to create TLS session", index);
+        tcp_server_close_client(client);
+        return true;
+    }
+    client->handshake_write = false;
+    client->handshake_deadline = xTaskGetTickCount() + pdMS_TO_TICKS(TCP_SERVER_TLS_TIMEOUT_MS);
+    portENTER_CRITICAL(&s_tcp_server.lock);
+    s_tcp_server.stats.handshaking++;
+    portEXIT_CRITICAL(&s_tcp_server.lock);
+
+    // The ClientHello may be here already
+    tcp_server_handshake(client);
+    return true;
+}
+
+/**
+ * @brief Create the listening socket and the loopback wake-up socket
+ */
+static esp_err_t tcp_server_open_sockets(void)
+{
+    struct sockaddr_in server_addr;
     int opt = 1;
-    
-    ESP_LOGI(TAG, "TCP server task started on port %d", s_tcp_server.port);
 
     // Create socket
     s_tcp_server.listen_sock = socket(AF_INET, SOCK_STREAM, 0);
     if (s_tcp_server.listen_sock < 0) {
         ESP_LOGE(TAG, "Failed to create socket: %d", errno);
-        return;
+        return ESP_FAIL;
     }
 
     // Set socket options
@@ -331,155 +1099,253 @@ static void tcp_server_task(void *pvParameters)
 
     if (bind(s_tcp_server.listen_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
         ESP_LOGE(TAG, "Failed to bind socket: %d", errno);
-        close(s_tcp_server.listen_sock);
-        return;
+        return ESP_FAIL;
     }
 
     // Listen
     if (listen(s_tcp_server.listen_sock, TCP_SERVER_BACKLOG) < 0) {
         ESP_LOGE(TAG, "Failed to listen: %d", errno);
-        close(s_tcp_server.listen_sock);
-        return;
+        return ESP_FAIL;
+    }
+    int flags = fcntl(s_tcp_server.listen_sock, F_GETFL, 0);
+    fcntl(s_tcp_server.listen_sock, F_SETFL, flags | O_NONBLOCK);
+
+    // Wake-up socket: bound to an ephemeral loopback port and connected to itself
+    s_tcp_server.ctrl_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (s_tcp_server.ctrl_sock < 0) {
+        ESP_LOGE(TAG, "Failed to create control socket: %d", errno);
+        return ESP_FAIL;
     }
+    socklen_t addr_len = sizeof(server_addr);
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    server_addr.sin_port = 0;
+    if (bind(s_tcp_server.ctrl_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0 ||
+        getsockname(s_tcp_server.ctrl_sock, (struct sockaddr *)&server_addr, &addr_len) < 0 ||
+        connect(s_tcp_server.ctrl_sock, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        ESP_LOGE(TAG, "Failed to set up control socket: %d", errno);
+        return ESP_FAIL;
+    }
+    flags = fcntl(s_tcp_server.ctrl_sock, F_GETFL, 0);
+    fcntl(s_tcp_server.ctrl_sock, F_SETFL, flags | O_NONBLOCK);
+
+    return ESP_OK;
+}
 
-    ESP_LOGI(TAG, "TCP server listening on port %d", s_tcp_server.port);
+/**
+ * @brief TCP server event loop
+ * 
+ * Original: sub_4201427A (tcp_server_task)
+ * 
+ * One task serves the listening socket and every client with select();
+ * there is no task per client.
+ */
+static void tcp_server_task(void *pvParameters)
+{
+    ESP_LOGI(TAG, "TCP server listening on port %d%s", s_tcp_server.port,
+             s_tcp_server.use_tls ? " (TLS)" : "");
+    bool waiting = false;
 
     while (1) {
-        // Accept connection
-        client_sock = accept(s_tcp_server.listen_sock, 
-                            (struct sockaddr *)&client_addr, 
-                            &client_addr_len);
-        
-        if (client_sock < 0) {
-            ESP_LOGE(TAG, "Failed to accept connection: %d", errno);
-            vTaskDelay(pdMS_TO_TICKS(1000));
-            continue;
+        // Wake for the next handshake deadline, sooner if reads wait for the bus
+        TickType_t timeout = tcp_server_expire_handshakes();
+        if (waiting && timeout > pdMS_TO_TICKS(TCP_SERVER_RETRY_MS)) {
+            timeout = pdMS_TO_TICKS(TCP_SERVER_RETRY_MS);
         }
 
-        ESP_LOGI(TAG, "New client connected from %s:%d", 
-                 inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
+        fd_set read_fds;
+        fd_set write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        FD_SET(s_tcp_server.listen_sock, &read_fds);
+        FD_SET(s_tcp_server.ctrl_sock, &read_fds);
+        int max_fd = (s_tcp_server.listen_sock > s_tcp_server.ctrl_sock) ?
+                     s_tcp_server.listen_sock : s_tcp_server.ctrl_sock;
 
-        // Find free client slot
-        tcp_client_t *client = NULL;
-        if (xSemaphoreTake(s_tcp_server.mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-            for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
-                if (s_tcp_server.clients[i].state == TCP_CLIENT_STATE_FREE) {
-                    client = &s_tcp_server.clients[i];
-                    break;
+        for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+            tcp_client_t *client = &s_tcp_server.clients[i];
+            if (client->state == TCP_CLIENT_STATE_FREE) {
+                continue;
+            }
+            if (client->state == TCP_CLIENT_STATE_TLS_HANDSHAKE) {
+                FD_SET(client->sock, client->handshake_write ? &write_fds : &read_fds);
+            } else {
+                FD_SET(client->sock, &read_fds);
+                if (client->tx_count > 0) {
+                    FD_SET(client->sock, &write_fds);
                 }
             }
-            
-            if (client == NULL) {
-                ESP_LOGW(TAG, "No available client slots, closing connection");
-                close(client_sock);
-                xSemaphoreGive(s_tcp_server.mutex);
-                continue;
+            if (client->sock > max_fd) {
+                max_fd = client->sock;
             }
+        }
 
-            // Initialize client
-            client->sock = client_sock;
-            client->state = TCP_CLIENT_STATE_CONNECTING;
-            snprintf(client->name, sizeof(client->name), "client.%d", client - s_tcp_server.clients);
-            
-            // Allocate receive buffer
-            client->recv_buffer = malloc(TCP_SERVER_RECV_BUF_SIZE);
-            if (client->recv_buffer == NULL) {
-                ESP_LOGE(TAG, "[%s] Failed to allocate receive buffer", client->name);
-                close(client_sock);
-                client->state = TCP_CLIENT_STATE_FREE;
-                xSemaphoreGive(s_tcp_server.mutex);
-                continue;
+        uint32_t timeout_ms = timeout * portTICK_PERIOD_MS;
+        struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+        if (select(max_fd + 1, &read_fds, &write_fds, NULL,
+                   (timeout == portMAX_DELAY) ? NULL : &tv) < 0) {
+            if (errno != EINTR) {
+                ESP_LOGE(TAG, "select failed: %d", errno);
+                vTaskDelay(pdMS_TO_TICKS(100));
             }
+            continue;
+        }
 
-            // Setup TLS if enabled
-            if (s_tcp_server.use_tls) {
-                client->state = TCP_CLIENT_STATE_TLS_HANDSHAKE;
-                
-                // Configure TLS
-                memset(&client->tls_cfg, 0, sizeof(client->tls_cfg));
-                client->tls_cfg.timeout_ms = 5000;
-                client->tls_cfg.servercert_buf = NULL;  // Would need actual certificate
-                client->tls_cfg.servercert_buf_len = 0;
-                client->tls_cfg.cacert_buf = NULL;
-                client->tls_cfg.cacert_buf_len = 0;
-                client->tls_cfg.alpn_protos = NULL;
-                client->tls_cfg.use_global_ca_store = false;
-                client->tls_cfg.sockfd = client_sock;  // Use existing socket
-
-                // Create TLS connection (server mode)
-                client->tls = esp_tls_conn_new_sync(NULL, 0, 0, &client->tls_cfg);
-                if (client->tls == NULL) {
-                    ESP_LOGE(TAG, "[%s] TLS handshake failed", client->name);
-                    free(client->recv_buffer);
-                    close(client_sock);
-                    client->state = TCP_CLIENT_STATE_FREE;
-                    xSemaphoreGive(s_tcp_server.mutex);
-                    continue;
-                }
+        if (FD_ISSET(s_tcp_server.ctrl_sock, &read_fds)) {
+            uint8_t drain[16];
+            while (recv(s_tcp_server.ctrl_sock, drain, sizeof(drain), MSG_DONTWAIT) > 0) {
             }
+        }
+
+        tcp_server_completion_t completion;
+        while (xQueueReceive(s_tcp_server.completions, &completion, 0) == pdTRUE) {
+            tcp_server_finish_read(&completion);
+        }
 
-            // Create data processing handle
-            client->data_handle = data_process_create(
-                tcp_client_send_callback,
-                tcp_client_receive_callback
-            );
-
-            client->state = TCP_CLIENT_STATE_READY;
-            xSemaphoreGive(s_tcp_server.mutex);
-
-            // Create client receive task
-            BaseType_t ret = xTaskCreate(tcp_client_receive_task, 
-                                        client->name, 
-                                        4096, 
-                                        client, 
-                                        4, 
-                                        &client->task_handle);
-            if (ret != pdPASS) {
-                ESP_LOGE(TAG, "[%s] Failed to create receive task", client->name);
-                if (xSemaphoreTake(s_tcp_server.mutex, pdMS_TO_TICKS(1000)) == pdTRUE) {
-                    if (client->tls) {
-                        esp_tls_conn_delete(client->tls);
-                    }
-                    if (client->data_handle) {
-                        data_process_destroy(client->data_handle);
-                    }
-                    free(client->recv_buffer);
-                    close(client_sock);
-                    client->state = TCP_CLIENT_STATE_FREE;
-                    xSemaphoreGive(s_tcp_server.mutex);
+        tcp_server_publish_t publish;
+        while (xQueueReceive(s_tcp_server.publishes, &publish, 0) == pdTRUE) {
+            tcp_server_fan_out(&publish);
+        }
+
+        // Write what the sockets that drained can take now
+        for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+            tcp_client_t *client = &s_tcp_server.clients[i];
+            if (client->state == TCP_CLIENT_STATE_READY && FD_ISSET(client->sock, &write_fds)) {
+                tcp_server_flush(client);
+                if (client->closing) {
+                    tcp_server_close_client(client);
                 }
             }
         }
+
+        for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+            tcp_client_t *client = &s_tcp_server.clients[i];
+            if (client->state == TCP_CLIENT_STATE_READY && FD_ISSET(client->sock, &read_fds)) {
+                tcp_server_receive(client);
+            } else if (client->state == TCP_CLIENT_STATE_TLS_HANDSHAKE &&
+                       (FD_ISSET(client->sock, &read_fds) || FD_ISSET(client->sock, &write_fds))) {
+                tcp_server_handshake(client);
+            }
+        }
+        waiting = tcp_server_submit_waiting();
+
+        // A burst of connections must not wait in the backlog for a
+        // select() each: take them all, every handshake starts now
+        if (FD_ISSET(s_tcp_server.listen_sock, &read_fds)) {
+            while (tcp_server_accept()) {
+            }
+        }
     }
 }
 
 /**
- * @brief Initialize TCP server task
+ * @brief Derive the PSK from the device SN and set up the shared TLS configuration
  * 
- * Original: sub_42012878 (TCPServerApp_Init)
+ * PSK = MD5("LuxD1ngl2X" + device_sn), the key the cloud link uses.
  */
-esp_err_t tcp_server_task_init(void)
+static esp_err_t tcp_server_tls_init(void)
 {
-    // Create mutex
-    s_tcp_server.mutex = xSemaphoreCreateMutex();
-    if (s_tcp_server.mutex == NULL) {
-        ESP_LOGE(TAG, "Failed to create mutex");
+    char device_sn[64];
+    if (param_get_string(PARAM_ID_7, device_sn, sizeof(device_sn)) != ESP_OK) {
+        strncpy(device_sn, "default", sizeof(device_sn) - 1);
+        device_sn[sizeof(device_sn) - 1] = '\0';
+    }
+
+    s_tcp_server.tls_cfg = calloc(1, sizeof(esp_tls_cfg_server_t));
+    if (s_tcp_server.tls_cfg == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate TLS configuration");
         return ESP_ERR_NO_MEM;
     }
 
+    char input[128];
+    snprintf(input, sizeof(input), "%s%s", TCP_SERVER_PSK_KEY_PREFIX, device_sn);
+    mbedtls_md5_context ctx;
+    mbedtls_md5_init(&ctx);
+    mbedtls_md5_starts(&ctx);
+    mbedtls_md5_update(&ctx, (const unsigned char *)input, strlen(input));
+    mbedtls_md5_finish(&ctx, s_tcp_server.tls_cfg->psk);
+    mbedtls_md5_free(&ctx);
+
+    if (esp_tls_cfg_server_init(s_tcp_server.tls_cfg, TCP_SERVER_PSK_IDENTITY,
+                                TCP_SERVER_TICKET_LIFETIME_S) != ESP_OK) {
+        mbedtls_ssl_ticket_free(&s_tcp_server.tls_cfg->ticket);
+        mbedtls_ssl_config_free(&s_tcp_server.tls_cfg->conf);
+        mbedtls_ctr_drbg_free(&s_tcp_server.tls_cfg->ctr_drbg);
+        mbedtls_entropy_free(&s_tcp_server.tls_cfg->entropy);
+        free(s_tcp_server.tls_cfg);
+        s_tcp_server.tls_cfg = NULL;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Initialize TCP server task
+ * 
+ * Original: sub_42012878 (TCPServerApp_Init)
+ */
+esp_err_t tcp_server_task_init(void)
+{
     // Initialize server
-    s_tcp_server.listen_sock = -1;
     s_tcp_server.port = TCP_SERVER_PORT;
-    s_tcp_server.use_tls = false;  // TLS can be enabled if certificates are available
+    s_tcp_server.use_tls = TCP_SERVER_USE_TLS;
 
     // Initialize clients
     for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
         s_tcp_server.clients[i].sock = -1;
         s_tcp_server.clients[i].tls = NULL;
         s_tcp_server.clients[i].state = TCP_CLIENT_STATE_FREE;
-        s_tcp_server.clients[i].recv_buffer = NULL;
         s_tcp_server.clients[i].data_handle = NULL;
-        s_tcp_server.clients[i].task_handle = NULL;
+    }
+
+    if (s_tcp_server.use_tls && tcp_server_tls_init() != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    // Frames are handled one at a time, so every client shares one receive buffer
+    s_tcp_server.recv_frame = frame_pool_alloc(TCP_SERVER_RECV_BUF_SIZE);
+    if (s_tcp_server.recv_frame == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate receive buffer");
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_tcp_server.completions = xQueueCreate(TCP_SERVER_MAX_READS,
+                                            sizeof(tcp_server_completion_t));
+    s_tcp_server.publishes = xQueueCreate(TCP_SERVER_PUBLISH_DEPTH,
+                                          sizeof(tcp_server_publish_t));
+    s_tcp_server.telemetry_handle = data_process_create(NULL, NULL);
+    if (s_tcp_server.completions == NULL || s_tcp_server.publishes == NULL ||
+        s_tcp_server.telemetry_handle == NULL) {
+        ESP_LOGE(TAG, "Failed to create completion and telemetry queues");
+        if (s_tcp_server.completions != NULL) {
+            vQueueDelete(s_tcp_server.completions);
+        }
+        if (s_tcp_server.publishes != NULL) {
+            vQueueDelete(s_tcp_server.publishes);
+            s_tcp_server.publishes = NULL;
+        }
+        data_process_destroy(s_tcp_server.telemetry_handle);
+        frame_buf_unref(s_tcp_server.recv_frame);
+        return ESP_ERR_NO_MEM;
+    }
+    data_process_set_sendv_callback(s_tcp_server.telemetry_handle, tcp_server_telemetry_sendv);
+
+    if (tcp_server_open_sockets() != ESP_OK) {
+        if (s_tcp_server.listen_sock >= 0) {
+            close(s_tcp_server.listen_sock);
+            s_tcp_server.listen_sock = -1;
+        }
+        if (s_tcp_server.ctrl_sock >= 0) {
+            close(s_tcp_server.ctrl_sock);
+            s_tcp_server.ctrl_sock = -1;
+        }
+        vQueueDelete(s_tcp_server.completions);
+        vQueueDelete(s_tcp_server.publishes);
+        s_tcp_server.publishes = NULL;
+        data_process_destroy(s_tcp_server.telemetry_handle);
+        frame_buf_unref(s_tcp_server.recv_frame);
+        return ESP_FAIL;
     }
 
     // Create TCP server task (priority 5)
@@ -487,14 +1353,49 @@ esp_err_t tcp_server_task_init(void)
                                   &s_tcp_server.server_task_handle);
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create TCP server task");
-        vSemaphoreDelete(s_tcp_server.mutex);
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "TCP server task initialized on port %d", s_tcp_server.port);
+    ESP_LOGI(TAG, "TCP server task initialized on port %d (%d clients)",
+             s_tcp_server.port, TCP_SERVER_MAX_CLIENTS);
     return ESP_OK;
 }
 
+/**
+ * @brief Send a polled register block to the clients subscribed to its device
+ */
+esp_err_t tcp_server_task_publish(uint8_t device_id, const uint8_t *data, size_t len)
+{
+    if (data == NULL || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_tcp_server.publishes == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (s_tcp_server.subscribed == 0) {
+        return ESP_OK;
+    }
+
+    tcp_server_publish_t publish = {
+        .device_id = device_id,
+        .frame = frame_pool_alloc(len),
+    };
+    if (publish.frame != NULL) {
+        memcpy(publish.frame->data, data, len);
+        publish.frame->len = (uint16_t)len;
+        if (xQueueSend(s_tcp_server.publishes, &publish, 0) == pdTRUE) {
+            tcp_server_wake();
+            return ESP_OK;
+        }
+        frame_buf_unref(publish.frame);
+    }
+
+    portENTER_CRITICAL(&s_tcp_server.lock);
+    s_tcp_server.stats.publish_drops++;
+    portEXIT_CRITICAL(&s_tcp_server.lock);
+    return ESP_ERR_NO_MEM;
+}
+
 /**
  * @brief Check if TCP server is running
  */
@@ -508,15 +1409,24 @@ bool tcp_server_task_is_running(void)
  */
 int tcp_server_task_get_client_count(void)
 {
-    int count = 0;
-    if (xSemaphoreTake(s_tcp_server.mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
-        for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
-            if (s_tcp_server.clients[i].state == TCP_CLIENT_STATE_READY) {
-                count++;
-            }
-        }
-        xSemaphoreGive(s_tcp_server.mutex);
-    }
+    portENTER_CRITICAL(&s_tcp_server.lock);
+    int count = (int)s_tcp_server.stats.active;
+    portEXIT_CRITICAL(&s_tcp_server.lock);
     return count;
 }
 
+/**
+ * @brief Get server statistics
+ */
+esp_err_t tcp_server_task_get_stats(tcp_server_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_tcp_server.lock);
+    *stats = s_tcp_server.stats;
+    portEXIT_CRITICAL(&s_tcp_server.lock);
+
+    return ESP_OK;
+}
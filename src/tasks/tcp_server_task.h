@@ -3,6 +3,20 @@
  * @brief TCP server task
  * 
  * Original: sub_42012878 (TCPServerApp_Init), sub_4201427A (tcp_server_task)
+ * 
+ * Every frame for a client goes through that client's bounded outbound
+ * queue, written as the socket takes it, so a client that stops reading
+ * holds up no one else. Responses go to the client that sent the request.
+ * A client that can no longer take its own responses is disconnected;
+ * telemetry it has no room for is dropped, and it is disconnected after
+ * TCP_SERVER_MAX_TELEMETRY_DROPS drops in a row.
+ * 
+ * Telemetry is the polled register blocks, sent to subscribed clients as
+ * the same 0xC2 frames the cloud gets as keyframes (byte count, register
+ * values) with the device in the header. A block is framed once and every
+ * subscriber's queue takes a reference to that one buffer. A client
+ * subscribes to a device with a 0xC2 read of zero registers whose start
+ * field is 1 (0 unsubscribes); the request is echoed back as confirmation.
  */
 
 #ifndef TCP_SERVER_TASK_H
@@ -17,16 +31,73 @@
 extern "C" {
 #endif
 
+#define TCP_SERVER_MAX_CLIENTS          16
+#define TCP_SERVER_TX_QUEUE_DEPTH       8       // Frames waiting to be written, per client
+#define TCP_SERVER_TX_BUDGET            2048    // Unwritten bytes allowed, per client
+#define TCP_SERVER_MAX_TELEMETRY_DROPS  16      // Drops in a row before a client is disconnected
+#define TCP_SERVER_SUBSCRIBE            1       // Start field of a zero-register read that subscribes
+
+/**
+ * @brief Per-client outbound queue statistics
+ * 
+ * Counters cover the current connection and restart when the slot is reused.
+ */
+typedef struct {
+    bool connected;
+    uint8_t subscriptions;      // Subscribed devices, one bit per device route
+    uint16_t queue_depth;       // Frames waiting now
+    uint16_t queue_high_water;  // Deepest the queue has been
+    uint32_t queued_bytes;      // Bytes waiting now
+    uint32_t sent;              // Frames written in full
+    uint32_t telemetry_drops;   // Telemetry frames with no room in the queue
+    uint32_t response_drops;    // Responses with no pooled buffer to hold them
+} tcp_server_client_stats_t;
+
+/**
+ * @brief TCP server statistics
+ */
+typedef struct {
+    uint32_t accepted;          // Connections accepted
+    uint32_t rejected;          // Connections refused, every client slot in use
+    uint32_t active;            // Connections open now
+    uint32_t peak_active;       // Most connections open at once
+    uint32_t held;              // Register reads that waited for room in the bus queue
+    uint32_t published;         // Telemetry blocks fanned out to subscribers
+    uint32_t publish_drops;     // Telemetry blocks dropped before the event loop saw them
+    uint32_t slow_disconnects;  // Clients disconnected for not keeping up
+    uint32_t handshaking;       // TLS handshakes in progress now
+    uint32_t handshakes;        // TLS handshakes completed
+    uint32_t handshakes_resumed;    // Of those, sessions resumed from a ticket
+    uint32_t handshake_failures;    // TLS handshakes the peer got wrong
+    uint32_t handshake_timeouts;    // TLS handshakes closed unfinished at the deadline
+    tcp_server_client_stats_t clients[TCP_SERVER_MAX_CLIENTS];
+} tcp_server_stats_t;
+
 /**
  * @brief Initialize TCP server task
  * 
  * Sets up TCP server socket and starts listening for connections.
- * Supports multiple concurrent client connections with TLS support.
+ * Supports multiple concurrent client connections with TLS support,
+ * all served by one event-loop task.
  * 
  * @return ESP_OK on success
  */
 esp_err_t tcp_server_task_init(void);
 
+/**
+ * @brief Send a polled register block to the clients subscribed to its device
+ * 
+ * Any task; never blocks. Copies the block only if some client is
+ * subscribed, and drops it if the event loop is too far behind.
+ * 
+ * @param device_id Logical device the block came from
+ * @param data Response body: byte count, register values (copied)
+ * @param len Body length
+ * @return ESP_OK if queued or nobody is subscribed, ESP_ERR_NO_MEM if
+ *         dropped, ESP_ERR_INVALID_STATE before tcp_server_task_init()
+ */
+esp_err_t tcp_server_task_publish(uint8_t device_id, const uint8_t *data, size_t len);
+
 /**
  * @brief Check if TCP server is running
  * 
@@ -41,6 +112,14 @@ bool tcp_server_task_is_running(void);
  */
 int tcp_server_task_get_client_count(void);
 
+/**
+ * @brief Get TCP server statistics
+ * 
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t tcp_server_task_get_stats(tcp_server_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,18 +6,20 @@
  * 
  * This task handles:
  * - UART initialization for terminal service
- * - Continuous data reception
+ * - Line reception: the driver's pattern detection marks each CR, so the
+ *   task sleeps on the UART event queue until a whole command has arrived
  * - Data forwarding to callback
  */
 
 #include "uart_rx_task.h"
+#include "../utils/frame_pool.h"
 #include "esp_log.h"
 #include "driver/uart.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
 #include <string.h>
 #include <stdlib.h>
-#include <errno.h>
 
 static const char *TAG = "uart_rx_task";
 
@@ -29,6 +31,10 @@ static const char *TAG = "uart_rx_task";
 #define UART_RX_PARITY            UART_PARITY_DISABLE
 #define UART_RX_STOP_BITS         UART_STOP_BITS_1
 #define UART_RX_RX_TIMEOUT        5  // 5ms timeout
+#define UART_RX_EVENT_QUEUE_DEPTH 10
+#define UART_RX_LINE_END          '\r'   // Commands end in CR LF; CR alone also works
+#define UART_RX_PATTERN_TOUT      9       // Baud cycles between pattern characters
+#define UART_RX_PATTERN_DEPTH     8       // Line ends remembered by the driver
 #define UART_RX_TX_PIN            1
 #define UART_RX_RX_PIN            3
 
@@ -36,40 +42,119 @@ static const char *TAG = "uart_rx_task";
 typedef void (*uart_rx_callback_t)(uint8_t *data, size_t len);
 
 static uart_rx_callback_t s_rx_callback = NULL;
+static QueueHandle_t s_uart_queue = NULL;
+static uart_rx_task_stats_t s_stats = {0};
+
+/**
+ * @brief Read len buffered bytes and hand them to the callback
+ */
+static void uart_rx_deliver(uint8_t *buffer, size_t len)
+{
+    while (len > 0) {
+        size_t chunk = (len < UART_RX_RX_BUF_SIZE) ? len : UART_RX_RX_BUF_SIZE;
+        int got = uart_read_bytes(UART_RX_UART_NUM, buffer, chunk, 0);
+        if (got <= 0) {
+            break;
+        }
+        if (s_rx_callback) {
+            s_rx_callback(buffer, got);
+        }
+        len -= got;
+    }
+}
+
+/**
+ * @brief Hand over everything the driver holds
+ */
+static void uart_rx_deliver_buffered(uint8_t *buffer)
+{
+    size_t buffered = 0;
+    if (uart_get_buffered_data_len(UART_RX_UART_NUM, &buffered) == ESP_OK) {
+        uart_rx_deliver(buffer, buffered);
+    }
+}
+
+/**
+ * @brief Drop received data after the driver lost some
+ */
+static void uart_rx_discard(void)
+{
+    uart_flush_input(UART_RX_UART_NUM);
+    xQueueReset(s_uart_queue);
+    uart_pattern_queue_reset(UART_RX_UART_NUM, UART_RX_PATTERN_DEPTH);
+}
 
 /**
  * @brief UART RX task
  * 
  * Original: sub_42013DE6
- * Continuously reads from UART and forwards data to callback
+ * Sleeps on the UART event queue and forwards each received line to the
+ * callback
  */
 static void uart_rx_task(void *pvParameters)
 {
-    uint8_t *rx_buffer = malloc(UART_RX_RX_BUF_SIZE);
-    if (rx_buffer == NULL) {
+    frame_buf_t *rx_frame = frame_pool_alloc(UART_RX_RX_BUF_SIZE);
+    if (rx_frame == NULL) {
         ESP_LOGE(TAG, "Failed to allocate RX buffer");
         vTaskDelete(NULL);
         return;
     }
+    uint8_t *rx_buffer = rx_frame->data;
+    uart_event_t event;
 
     ESP_LOGI(TAG, "UART RX task started on UART%d", UART_RX_UART_NUM);
 
     while (1) {
-        int len = uart_read_bytes(UART_RX_UART_NUM, rx_buffer, UART_RX_RX_BUF_SIZE,
-                                 pdMS_TO_TICKS(UART_RX_RX_TIMEOUT * 100));
+        if (xQueueReceive(s_uart_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
 
-        if (len > 0) {
-            // Forward data to callback if registered
-            if (s_rx_callback) {
-                s_rx_callback(rx_buffer, len);
+        s_stats.events++;
+        switch (event.type) {
+            case UART_PATTERN_DET: {
+                int pos = uart_pattern_pop_pos(UART_RX_UART_NUM);
+                if (pos < 0) {
+                    // The driver ran out of pattern slots; positions are lost
+                    uart_rx_deliver_buffered(rx_buffer);
+                } else {
+                    uart_rx_deliver(rx_buffer, (size_t)pos + 1);
+                }
+                s_stats.lines++;
+                break;
             }
-        } else if (len < 0 && errno != EAGAIN) {
-            ESP_LOGE(TAG, "UART read error: %d", errno);
-            vTaskDelay(pdMS_TO_TICKS(100));
+
+            case UART_DATA: {
+                // Lines wait for their CR; only a line longer than the task
+                // buffer is handed over early, so the ring buffer never fills
+                size_t buffered = 0;
+                if (uart_get_buffered_data_len(UART_RX_UART_NUM, &buffered) == ESP_OK &&
+                    buffered >= UART_RX_RX_BUF_SIZE) {
+                    uart_rx_deliver(rx_buffer, buffered);
+                }
+                break;
+            }
+
+            case UART_FIFO_OVF:
+                s_stats.fifo_overflows++;
+                uart_rx_discard();
+                break;
+
+            case UART_BUFFER_FULL:
+                s_stats.buffer_full++;
+                uart_rx_discard();
+                break;
+
+            case UART_FRAME_ERR:
+            case UART_PARITY_ERR:
+                s_stats.line_errors++;
+                break;
+
+            default:
+                break;
         }
     }
 
-    free(rx_buffer);
+    frame_buf_unref(rx_frame);
     vTaskDelete(NULL);
 }
 
@@ -91,13 +176,19 @@ esp_err_t uart_rx_task_init(void)
 
     // Configure UART parameters
     ESP_ERROR_CHECK(uart_driver_install(UART_RX_UART_NUM, UART_RX_RX_BUF_SIZE * 2,
-                                        UART_RX_TX_BUF_SIZE, 0, NULL, 0));
+                                        UART_RX_TX_BUF_SIZE, UART_RX_EVENT_QUEUE_DEPTH,
+                                        &s_uart_queue, 0));
     ESP_ERROR_CHECK(uart_param_config(UART_RX_UART_NUM, &uart_config));
     ESP_ERROR_CHECK(uart_set_pin(UART_RX_UART_NUM, UART_RX_TX_PIN, UART_RX_RX_PIN,
                                  UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
     ESP_ERROR_CHECK(uart_set_mode(UART_RX_UART_NUM, UART_MODE_UART));
     ESP_ERROR_CHECK(uart_set_rx_timeout(UART_RX_UART_NUM, UART_RX_RX_TIMEOUT));
 
+    // Raise an event at every line end
+    ESP_ERROR_CHECK(uart_enable_pattern_det_baud_intr(UART_RX_UART_NUM, UART_RX_LINE_END, 1,
+                                                      UART_RX_PATTERN_TOUT, 0, 0));
+    ESP_ERROR_CHECK(uart_pattern_queue_reset(UART_RX_UART_NUM, UART_RX_PATTERN_DEPTH));
+
     // Create UART RX task (priority 5)
     BaseType_t ret = xTaskCreate(uart_rx_task, "uart_rx", 2048, NULL, 5, NULL);
     if (ret != pdPASS) {
@@ -118,3 +209,16 @@ void uart_rx_task_set_callback(void (*callback)(uint8_t *data, size_t len))
     s_rx_callback = callback;
 }
 
+
+/**
+ * @brief Get receive event statistics
+ */
+esp_err_t uart_rx_task_get_stats(uart_rx_task_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *stats = s_stats;
+    return ESP_OK;
+}
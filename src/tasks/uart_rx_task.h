@@ -16,10 +16,23 @@
 extern "C" {
 #endif
 
+/**
+ * @brief Receive event statistics
+ */
+typedef struct {
+    uint32_t events;            // UART driver events handled (task wakeups)
+    uint32_t lines;             // Line ends detected
+    uint32_t fifo_overflows;    // Hardware FIFO overflowed, input discarded
+    uint32_t buffer_full;       // Driver ring buffer full, input discarded
+    uint32_t line_errors;       // Characters with a framing or parity error
+} uart_rx_task_stats_t;
+
 /**
  * @brief Initialize UART RX task
  * 
- * Sets up UART for terminal service and starts the receive task.
+ * Sets up UART for terminal service and starts the receive task. The
+ * callback is called once per line (up to and including its CR) rather
+ * than on a polling timeout.
  * 
  * @return ESP_OK on success
  */
@@ -32,6 +45,14 @@ esp_err_t uart_rx_task_init(void);
  */
 void uart_rx_task_set_callback(void (*callback)(uint8_t *data, size_t len));
 
+/**
+ * @brief Get receive event statistics
+ * 
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t uart_rx_task_get_stats(uart_rx_task_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,391 @@
+/**
+ * @file uplink_task.c
+ * @brief Cloud uplink writer task implementation
+ */
+
+#include "uplink_task.h"
+#include "tcp_client_task.h"
+#include "../protocol/data_process.h"
+#include "../protocol/function_codes.h"
+#include "../protocol/uplink_delta.h"
+#include "../utils/frame_pool.h"
+#include "../utils/spsc_ring.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <string.h>
+
+static const char *TAG = "uplink_task";
+
+#define UPLINK_TASK_QUEUE_DEPTH   16      // Power of two
+#define UPLINK_TASK_MAX_AGE_MS    5000    // Older responses are not worth sending
+#define UPLINK_TASK_STACK_SIZE    4096
+#define UPLINK_TASK_PRIORITY      5       // Below the RS485 task (10)
+#define UPLINK_TASK_ACK_SLOTS     8       // Acks and evictions held for the task
+#define UPLINK_TASK_FRAME_OVERHEAD 22     // Header, data length and CRC of a 0xC2/0xC5 frame
+#define UPLINK_TASK_REPORT_MS     (60 * 60 * 1000)
+
+typedef struct {
+    frame_buf_t *frame;
+    TickType_t queued_at;
+    uint8_t device_id;
+    uint8_t protocol_fc;        // Function code of the frame a plain response goes up in
+    uint8_t func_code;          // Read function code of a polled block, 0 for a plain response
+    uint16_t start;             // First register of a polled block
+} uplink_entry_t;
+
+typedef struct {
+    uint16_t sequence;
+    bool acked;                 // false: given up by the ack window, no ack will come
+} uplink_ack_t;
+
+static struct {
+    spsc_ring_t ring;
+    uplink_entry_t storage[UPLINK_TASK_QUEUE_DEPTH];
+    TaskHandle_t task_handle;
+    data_process_handle_t data_handle;
+    uplink_batcher_handle_t batcher;
+    uplink_delta_t delta;       // Uplink task only
+    uint32_t connection_id;     // Connection the baselines belong to
+    uplink_ack_t acks[UPLINK_TASK_ACK_SLOTS];
+    uint8_t ack_count;
+    portMUX_TYPE ack_lock;
+    TickType_t report_start;
+    uint32_t report_full_bytes;
+    uint32_t report_block_bytes;
+    uplink_task_stats_t stats;  // Guarded by stats_lock
+    portMUX_TYPE stats_lock;
+} s_uplink = {
+    .ack_lock = portMUX_INITIALIZER_UNLOCKED,
+    .stats_lock = portMUX_INITIALIZER_UNLOCKED,
+};
+
+/**
+ * @brief Acknowledgement callback
+ * 
+ * Acks come from the TCP client receive task; frames the ack window gives
+ * up come from the sending task, normally this one. Keyframe baselines
+ * belong to the uplink task, so the outcome is only queued for it.
+ */
+static void uplink_task_on_ack(uint16_t sequence, bool acked, void *ctx)
+{
+    portENTER_CRITICAL(&s_uplink.ack_lock);
+    bool queued = (s_uplink.ack_count < UPLINK_TASK_ACK_SLOTS);
+    if (queued) {
+        s_uplink.acks[s_uplink.ack_count].sequence = sequence;
+        s_uplink.acks[s_uplink.ack_count].acked = acked;
+        s_uplink.ack_count++;
+    }
+    portEXIT_CRITICAL(&s_uplink.ack_lock);
+
+    if (!queued) {
+        // The keyframe stays outstanding until uplink_delta replaces it
+        portENTER_CRITICAL(&s_uplink.stats_lock);
+        s_uplink.stats.ack_overflows++;
+        portEXIT_CRITICAL(&s_uplink.stats_lock);
+    }
+
+    xTaskNotifyGive(s_uplink.task_handle);
+}
+
+/**
+ * @brief Apply the acknowledgements queued since the last call
+ * 
+ * A keyframe the ack window gave up is dropped as a baseline at once, so
+ * the block's next poll goes up as a fresh keyframe instead of waiting
+ * out the acknowledgement timeout.
+ */
+static void uplink_task_apply_acks(void)
+{
+    uplink_ack_t acks[UPLINK_TASK_ACK_SLOTS];
+
+    portENTER_CRITICAL(&s_uplink.ack_lock);
+    uint8_t count = s_uplink.ack_count;
+    memcpy(acks, s_uplink.acks, count * sizeof(acks[0]));
+    s_uplink.ack_count = 0;
+    portEXIT_CRITICAL(&s_uplink.ack_lock);
+
+    for (uint8_t i = 0; i < count; i++) {
+        if (acks[i].acked) {
+            uplink_delta_ack(&s_uplink.delta, acks[i].sequence);
+        } else if (uplink_delta_lost(&s_uplink.delta, acks[i].sequence)) {
+            portENTER_CRITICAL(&s_uplink.stats_lock);
+            s_uplink.stats.keyframes_lost++;
+            portEXIT_CRITICAL(&s_uplink.stats_lock);
+        }
+    }
+}
+
+/**
+ * @brief Account for one polled block and log the savings once an hour
+ */
+static void uplink_task_account_block(size_t full_len, size_t sent_len)
+{
+    portENTER_CRITICAL(&s_uplink.stats_lock);
+    s_uplink.stats.full_bytes += full_len;
+    s_uplink.stats.block_bytes += sent_len;
+    portEXIT_CRITICAL(&s_uplink.stats_lock);
+    s_uplink.report_full_bytes += full_len;
+    s_uplink.report_block_bytes += sent_len;
+
+    TickType_t now = xTaskGetTickCount();
+    if ((now - s_uplink.report_start) < pdMS_TO_TICKS(UPLINK_TASK_REPORT_MS)) {
+        return;
+    }
+
+    uint32_t saved = s_uplink.report_full_bytes - s_uplink.report_block_bytes;
+    portENTER_CRITICAL(&s_uplink.stats_lock);
+    s_uplink.stats.saved_last_hour = saved;
+    portEXIT_CRITICAL(&s_uplink.stats_lock);
+    ESP_LOGI(TAG, "Delta uplink saved %lu of %lu bytes in the last hour "
+             "(keyframes %lu, deltas %lu, unchanged %lu)",
+             (unsigned long)saved, (unsigned long)s_uplink.report_full_bytes,
+             (unsigned long)s_uplink.stats.keyframes, (unsigned long)s_uplink.stats.deltas,
+             (unsigned long)s_uplink.stats.unchanged);
+    s_uplink.report_start = now;
+    s_uplink.report_full_bytes = 0;
+    s_uplink.report_block_bytes = 0;
+}
+
+/**
+ * @brief Send a polled register block as a keyframe, a delta or not at all
+ */
+static esp_err_t uplink_task_send_block(const uplink_entry_t *entry)
+{
+    const uint8_t *body = entry->frame->data;
+    size_t body_len = entry->frame->len;
+    uint16_t count = (uint16_t)((body_len - 1) / 2);
+    const uint8_t *values = &body[1];
+    uint32_t now_ms = pdTICKS_TO_MS(xTaskGetTickCount());
+    uint8_t delta[1 + 2 * UPLINK_DELTA_MAX_REGISTERS];
+    size_t delta_len = 0;
+    esp_err_t ret = ESP_OK;
+
+    uplink_delta_kind_t kind = uplink_delta_encode(&s_uplink.delta, entry->device_id,
+                                                   entry->func_code, entry->start, count,
+                                                   values, now_ms,
+                                                   delta, sizeof(delta), &delta_len);
+    size_t full_len = UPLINK_TASK_FRAME_OVERHEAD + body_len;
+
+    if (kind == UPLINK_DELTA_KEYFRAME) {
+        uint16_t sequence = 0;
+        ret = data_process_send_to(s_uplink.data_handle, entry->device_id,
+                                   PROTOCOL_FC_DATA_TRANSMISSION, body, body_len, &sequence);
+        if (ret == ESP_OK) {
+            uplink_delta_keyframe_sent(&s_uplink.delta, entry->device_id, entry->func_code,
+                                       entry->start, count, values, sequence, now_ms);
+            portENTER_CRITICAL(&s_uplink.stats_lock);
+            s_uplink.stats.keyframes++;
+            portEXIT_CRITICAL(&s_uplink.stats_lock);
+            uplink_task_account_block(full_len, full_len);
+        }
+    } else if (kind == UPLINK_DELTA_CHANGES) {
+        ret = data_process_send_to(s_uplink.data_handle, entry->device_id,
+                                   PROTOCOL_FC_DATA_DELTA, delta, delta_len, NULL);
+        if (ret == ESP_OK) {
+            portENTER_CRITICAL(&s_uplink.stats_lock);
+            s_uplink.stats.deltas++;
+            portEXIT_CRITICAL(&s_uplink.stats_lock);
+            uplink_task_account_block(full_len, UPLINK_TASK_FRAME_OVERHEAD + delta_len);
+        }
+    } else {
+        portENTER_CRITICAL(&s_uplink.stats_lock);
+        s_uplink.stats.unchanged++;
+        portEXIT_CRITICAL(&s_uplink.stats_lock);
+        uplink_task_account_block(full_len, 0);
+    }
+
+    return ret;
+}
+
+/**
+ * @brief Uplink writer task
+ */
+static void uplink_task(void *pvParameters)
+{
+    uplink_entry_t entry;
+
+    s_uplink.report_start = xTaskGetTickCount();
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        uplink_task_apply_acks();
+        // The batcher's deadline timer wakes us to write its batch
+        uplink_batcher_service(s_uplink.batcher);
+
+        while (spsc_ring_pop(&s_uplink.ring, &entry)) {
+            // A sweep evicts keyframes faster than the ack slots are drained on wakeup
+            uplink_task_apply_acks();
+            uint32_t connection_id = tcp_client_task_get_connection_id();
+            if (connection_id != s_uplink.connection_id) {
+                // The peer may not hold our keyframes after a reconnect
+                uplink_delta_reset(&s_uplink.delta);
+                s_uplink.connection_id = connection_id;
+            }
+            bool connected = tcp_client_task_is_connected();
+
+            if ((xTaskGetTickCount() - entry.queued_at) > pdMS_TO_TICKS(UPLINK_TASK_MAX_AGE_MS)) {
+                portENTER_CRITICAL(&s_uplink.stats_lock);
+                s_uplink.stats.stale_drops++;
+                portEXIT_CRITICAL(&s_uplink.stats_lock);
+            } else if (!connected) {
+                portENTER_CRITICAL(&s_uplink.stats_lock);
+                s_uplink.stats.offline_drops++;
+                portEXIT_CRITICAL(&s_uplink.stats_lock);
+            } else {
+                esp_err_t ret;
+                if (entry.func_code != 0) {
+                    ret = uplink_task_send_block(&entry);
+                } else {
+                    ret = data_process_send_to(s_uplink.data_handle, entry.device_id,
+                                               entry.protocol_fc,
+                                               entry.frame->data, entry.frame->len, NULL);
+                }
+                if (ret != ESP_OK) {
+                    ESP_LOGW(TAG, "Failed to forward RS485 data to TCP: %d", ret);
+                    portENTER_CRITICAL(&s_uplink.stats_lock);
+                    s_uplink.stats.send_failures++;
+                    portEXIT_CRITICAL(&s_uplink.stats_lock);
+                } else {
+                    portENTER_CRITICAL(&s_uplink.stats_lock);
+                    s_uplink.stats.sent++;
+                    portEXIT_CRITICAL(&s_uplink.stats_lock);
+                }
+            }
+            frame_buf_unref(entry.frame);
+        }
+    }
+}
+
+/**
+ * @brief Initialize uplink writer task
+ */
+esp_err_t uplink_task_init(void)
+{
+    s_uplink.data_handle = tcp_client_task_get_data_handle();
+    if (s_uplink.data_handle == NULL) {
+        ESP_LOGE(TAG, "TCP client data handle unavailable");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    esp_err_t ret = spsc_ring_init(&s_uplink.ring, s_uplink.storage,
+                                   sizeof(uplink_entry_t), UPLINK_TASK_QUEUE_DEPTH);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    uplink_delta_init(&s_uplink.delta, UPLINK_TASK_KEYFRAME_MS);
+
+    BaseType_t task_ret = xTaskCreate(uplink_task, "uplink", UPLINK_TASK_STACK_SIZE, NULL,
+                                      UPLINK_TASK_PRIORITY, &s_uplink.task_handle);
+    if (task_ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create uplink task");
+        return ESP_FAIL;
+    }
+
+    s_uplink.batcher = tcp_client_task_get_batcher();
+    uplink_batcher_set_flush_task(s_uplink.batcher, s_uplink.task_handle);
+
+    // Keyframes become delta baselines once the cloud acknowledges them
+    data_process_set_ack_callback(s_uplink.data_handle, uplink_task_on_ack, NULL);
+
+    ESP_LOGI(TAG, "Uplink task initialized (queue depth: %d)", UPLINK_TASK_QUEUE_DEPTH);
+    return ESP_OK;
+}
+
+/**
+ * @brief Copy a response into a pooled buffer and hand it to the task
+ */
+static esp_err_t uplink_task_push(uint8_t device_id, uint8_t protocol_fc, uint8_t func_code,
+                                  uint16_t start, const uint8_t *data, size_t len)
+{
+    if (data == NULL || len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (s_uplink.task_handle == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uplink_entry_t entry = {
+        .frame = frame_pool_alloc(len),
+        .queued_at = xTaskGetTickCount(),
+        .device_id = device_id,
+        .protocol_fc = protocol_fc,
+        .func_code = func_code,
+        .start = start,
+    };
+    if (entry.frame == NULL) {
+        portENTER_CRITICAL(&s_uplink.stats_lock);
+        s_uplink.stats.alloc_failures++;
+        portEXIT_CRITICAL(&s_uplink.stats_lock);
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(entry.frame->data, data, len);
+    entry.frame->len = len;
+
+    if (!spsc_ring_push(&s_uplink.ring, &entry)) {
+        frame_buf_unref(entry.frame);
+        portENTER_CRITICAL(&s_uplink.stats_lock);
+        s_uplink.stats.overflow_drops++;
+        portEXIT_CRITICAL(&s_uplink.stats_lock);
+        ESP_LOGD(TAG, "Uplink queue full, dropping %zu bytes", len);
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint32_t depth = spsc_ring_count(&s_uplink.ring);
+    portENTER_CRITICAL(&s_uplink.stats_lock);
+    s_uplink.stats.queued++;
+    if (depth > s_uplink.stats.high_water) {
+        s_uplink.stats.high_water = depth;
+    }
+    portEXIT_CRITICAL(&s_uplink.stats_lock);
+
+    xTaskNotifyGive(s_uplink.task_handle);
+    return ESP_OK;
+}
+
+/**
+ * @brief Queue a Modbus response payload for the cloud
+ */
+esp_err_t uplink_task_submit(uint8_t device_id, const uint8_t *data, size_t len)
+{
+    return uplink_task_push(device_id, PROTOCOL_FC_DATA_TRANSMISSION, 0, 0, data, len);
+}
+
+/**
+ * @brief Queue a frame body of another function code for the cloud
+ */
+esp_err_t uplink_task_submit_frame(uint8_t device_id, uint8_t protocol_fc,
+                                   const uint8_t *data, size_t len)
+{
+    return uplink_task_push(device_id, protocol_fc, 0, 0, data, len);
+}
+
+/**
+ * @brief Queue a polled register block for the cloud
+ */
+esp_err_t uplink_task_submit_block(uint8_t device_id, uint8_t func_code, uint16_t start,
+                                   const uint8_t *data, size_t len)
+{
+    if (func_code == 0 || len < 3 || (len - 1) % 2 != 0 ||
+        (len - 1) / 2 > UPLINK_DELTA_MAX_REGISTERS) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return uplink_task_push(device_id, PROTOCOL_FC_DATA_TRANSMISSION, func_code, start,
+                            data, len);
+}
+
+/**
+ * @brief Get uplink queue statistics
+ */
+esp_err_t uplink_task_get_stats(uplink_task_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_uplink.stats_lock);
+    *stats = s_uplink.stats;
+    portEXIT_CRITICAL(&s_uplink.stats_lock);
+    return ESP_OK;
+}
@@ -0,0 +1,118 @@
+/**
+ * @file uplink_task.h
+ * @brief Cloud uplink writer task
+ * 
+ * Moves RS485 responses to the cloud connection on its own task, so the
+ * bus task never waits on a TLS write. The bus task copies each response
+ * into a pooled frame buffer and hands it over through a lock-free SPSC
+ * ring; the writer task wraps it in a 0xC2 frame and sends it.
+ * 
+ * Polled register blocks are sent change-only (see uplink_delta.h): a
+ * full keyframe until the cloud acknowledges one, then only the registers
+ * that differ from it, with a fresh keyframe every UPLINK_TASK_KEYFRAME_MS.
+ */
+
+#ifndef UPLINK_TASK_H
+#define UPLINK_TASK_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UPLINK_TASK_KEYFRAME_MS     (15 * 60 * 1000)    // Longest a keyframe baseline is used
+
+/**
+ * @brief Uplink queue statistics
+ */
+typedef struct {
+    uint32_t queued;            // Responses accepted into the ring
+    uint32_t sent;              // Responses handed to the cloud connection
+    uint32_t overflow_drops;    // Ring full: newest response dropped
+    uint32_t alloc_failures;    // No pooled buffer: response dropped
+    uint32_t stale_drops;       // Older than UPLINK_TASK_MAX_AGE_MS when dequeued
+    uint32_t offline_drops;     // Cloud not connected when dequeued
+    uint32_t send_failures;     // data_process_send() returned an error
+    uint32_t high_water;        // Deepest the ring has been
+    uint32_t keyframes;         // Polled blocks sent in full
+    uint32_t deltas;            // Polled blocks sent as changed registers only
+    uint32_t unchanged;         // Polled blocks not sent because nothing changed
+    uint32_t full_bytes;        // Bytes the polled blocks would have taken in full
+    uint32_t block_bytes;       // Bytes actually sent for them
+    uint32_t saved_last_hour;   // Bytes saved over the last complete hour
+    uint32_t ack_overflows;     // Keyframe acknowledgements dropped, ack queue full
+    uint32_t keyframes_lost;    // Keyframes given up by the ack window, sent again at once
+} uplink_task_stats_t;
+
+/**
+ * @brief Initialize uplink writer task
+ * 
+ * Sends through the TCP client's data handle, so tcp_client_task_init()
+ * must have run.
+ * 
+ * @return ESP_OK on success
+ */
+esp_err_t uplink_task_init(void);
+
+/**
+ * @brief Queue a Modbus response payload for the cloud
+ * 
+ * Single producer: only the RS485 task may call this. Never blocks. When
+ * the ring is full the new response is dropped and counted; responses
+ * already queued are kept so the cloud sees an in-order prefix.
+ * 
+ * @param device_id Logical device the response came from (protocol header byte 6)
+ * @param data Payload (copied)
+ * @param len Payload length
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM if dropped
+ */
+esp_err_t uplink_task_submit(uint8_t device_id, const uint8_t *data, size_t len);
+
+/**
+ * @brief Queue a frame body of another function code for the cloud
+ * 
+ * Same rules as uplink_task_submit(); the body goes up unchanged in a
+ * frame of the given function code, e.g. a 0xC3 get-param reply read
+ * through from the bus.
+ * 
+ * @param device_id Logical device the body belongs to
+ * @param protocol_fc Protocol function code of the frame
+ * @param data Frame body (copied)
+ * @param len Body length
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM if dropped
+ */
+esp_err_t uplink_task_submit_frame(uint8_t device_id, uint8_t protocol_fc,
+                                   const uint8_t *data, size_t len);
+
+/**
+ * @brief Queue a polled register block for the cloud
+ * 
+ * Same rules as uplink_task_submit(); the block is sent as a keyframe, as
+ * a delta or not at all.
+ * 
+ * @param device_id Logical device the block came from
+ * @param func_code Read function code
+ * @param start First register
+ * @param data Response body: byte count, then the register values (copied)
+ * @param len Body length
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM if dropped
+ */
+esp_err_t uplink_task_submit_block(uint8_t device_id, uint8_t func_code, uint16_t start,
+                                   const uint8_t *data, size_t len);
+
+/**
+ * @brief Get uplink queue statistics
+ * 
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t uplink_task_get_stats(uplink_task_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // UPLINK_TASK_H
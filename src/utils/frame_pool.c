@@ -0,0 +1,176 @@
+/**
+ * @file frame_pool.c
+ * @brief Refcounted frame buffer pool implementation
+ */
+
+#include "frame_pool.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+#include <stdbool.h>
+
+static const char *TAG = "frame_pool";
+
+typedef struct {
+    frame_buf_t *free_list;
+    frame_pool_class_stats_t stats;
+} frame_pool_class_t;
+
+// Static arena, one backing array per size class
+static uint8_t s_small_arena[FRAME_POOL_SMALL_COUNT][FRAME_POOL_SMALL_SIZE];
+static uint8_t s_medium_arena[FRAME_POOL_MEDIUM_COUNT][FRAME_POOL_MEDIUM_SIZE];
+static uint8_t s_large_arena[FRAME_POOL_LARGE_COUNT][FRAME_POOL_LARGE_SIZE];
+
+static frame_buf_t s_small_bufs[FRAME_POOL_SMALL_COUNT];
+static frame_buf_t s_medium_bufs[FRAME_POOL_MEDIUM_COUNT];
+static frame_buf_t s_large_bufs[FRAME_POOL_LARGE_COUNT];
+
+static frame_pool_class_t s_classes[FRAME_POOL_CLASS_COUNT];
+static uint32_t s_oversize_requests = 0;
+static bool s_initialized = false;
+
+// Free lists are touched from tasks on both cores
+static portMUX_TYPE s_pool_lock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * @brief Thread one class's buffers onto its free list
+ */
+static void frame_pool_class_init(uint8_t index, frame_buf_t *bufs, uint8_t *arena,
+                                  uint16_t buf_size, uint16_t count)
+{
+    frame_pool_class_t *cls = &s_classes[index];
+
+    memset(cls, 0, sizeof(*cls));
+    cls->stats.buf_size = buf_size;
+    cls->stats.total = count;
+
+    for (uint16_t i = count; i > 0; i--) {
+        frame_buf_t *buf = &bufs[i - 1];
+        buf->data = &arena[(size_t)(i - 1) * buf_size];
+        buf->capacity = buf_size;
+        buf->len = 0;
+        buf->refcount = 0;
+        buf->class_index = index;
+        buf->next = cls->free_list;
+        cls->free_list = buf;
+    }
+}
+
+/**
+ * @brief Initialize frame buffer pool
+ */
+esp_err_t frame_pool_init(void)
+{
+    if (s_initialized) {
+        return ESP_OK;
+    }
+
+    frame_pool_class_init(0, s_small_bufs, &s_small_arena[0][0],
+                          FRAME_POOL_SMALL_SIZE, FRAME_POOL_SMALL_COUNT);
+    frame_pool_class_init(1, s_medium_bufs, &s_medium_arena[0][0],
+                          FRAME_POOL_MEDIUM_SIZE, FRAME_POOL_MEDIUM_COUNT);
+    frame_pool_class_init(2, s_large_bufs, &s_large_arena[0][0],
+                          FRAME_POOL_LARGE_SIZE, FRAME_POOL_LARGE_COUNT);
+    s_initialized = true;
+
+    ESP_LOGI(TAG, "Frame pool initialized: %dx%d, %dx%d, %dx%d bytes",
+             FRAME_POOL_SMALL_COUNT, FRAME_POOL_SMALL_SIZE,
+             FRAME_POOL_MEDIUM_COUNT, FRAME_POOL_MEDIUM_SIZE,
+             FRAME_POOL_LARGE_COUNT, FRAME_POOL_LARGE_SIZE);
+    return ESP_OK;
+}
+
+/**
+ * @brief Allocate a frame buffer
+ */
+frame_buf_t *frame_pool_alloc(size_t size)
+{
+    frame_buf_t *buf = NULL;
+    uint8_t first = 0;
+
+    while (first < FRAME_POOL_CLASS_COUNT && s_classes[first].stats.buf_size < size) {
+        first++;
+    }
+
+    portENTER_CRITICAL(&s_pool_lock);
+    if (first == FRAME_POOL_CLASS_COUNT) {
+        s_oversize_requests++;
+    }
+    for (uint8_t i = first; i < FRAME_POOL_CLASS_COUNT; i++) {
+        frame_pool_class_t *cls = &s_classes[i];
+        if (cls->free_list == NULL) {
+            cls->stats.alloc_failures++;
+            continue;
+        }
+        buf = cls->free_list;
+        cls->free_list = buf->next;
+        cls->stats.allocs++;
+        cls->stats.in_use++;
+        if (cls->stats.in_use > cls->stats.high_water) {
+            cls->stats.high_water = cls->stats.in_use;
+        }
+        break;
+    }
+    portEXIT_CRITICAL(&s_pool_lock);
+
+    if (buf == NULL) {
+        ESP_LOGW(TAG, "No frame buffer for %zu bytes", size);
+        return NULL;
+    }
+
+    buf->next = NULL;
+    buf->len = 0;
+    __atomic_store_n(&buf->refcount, 1, __ATOMIC_RELAXED);
+    return buf;
+}
+
+/**
+ * @brief Take an additional reference to a buffer
+ */
+frame_buf_t *frame_buf_ref(frame_buf_t *buf)
+{
+    if (buf != NULL) {
+        __atomic_fetch_add(&buf->refcount, 1, __ATOMIC_RELAXED);
+    }
+    return buf;
+}
+
+/**
+ * @brief Drop a reference, returning the buffer to the pool on the last one
+ */
+void frame_buf_unref(frame_buf_t *buf)
+{
+    if (buf == NULL) {
+        return;
+    }
+
+    if (__atomic_sub_fetch(&buf->refcount, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+
+    frame_pool_class_t *cls = &s_classes[buf->class_index];
+    portENTER_CRITICAL(&s_pool_lock);
+    buf->next = cls->free_list;
+    cls->free_list = buf;
+    cls->stats.in_use--;
+    portEXIT_CRITICAL(&s_pool_lock);
+}
+
+/**
+ * @brief Get pool statistics
+ */
+esp_err_t frame_pool_get_stats(frame_pool_stats_t *stats)
+{
+    if (stats == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_pool_lock);
+    for (uint8_t i = 0; i < FRAME_POOL_CLASS_COUNT; i++) {
+        stats->classes[i] = s_classes[i].stats;
+    }
+    stats->oversize_requests = s_oversize_requests;
+    portEXIT_CRITICAL(&s_pool_lock);
+
+    return ESP_OK;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file frame_pool.h
+ * @brief Refcounted frame buffer pool
+ * 
+ * Fixed-size frame buffers carved from a static arena at boot, grouped in
+ * size classes. Transports take their receive buffers from here instead of
+ * the heap, and a frame can be handed to several consumers by taking extra
+ * references rather than copying it. A buffer returns to its class when
+ * the last reference is dropped.
+ */
+
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Size classes: capacity and number of buffers in each
+#define FRAME_POOL_SMALL_SIZE      128     // BLE writes, short protocol frames
+#define FRAME_POOL_SMALL_COUNT     16
+#define FRAME_POOL_MEDIUM_SIZE     512     // Bus reads, uplink frames
+#define FRAME_POOL_MEDIUM_COUNT    12
+#define FRAME_POOL_LARGE_SIZE      2048    // Socket receive buffers
+#define FRAME_POOL_LARGE_COUNT     6
+
+#define FRAME_POOL_CLASS_COUNT     3
+
+/**
+ * @brief Frame buffer handle
+ * 
+ * data and capacity are fixed; len is free for the owner to record how
+ * much of the buffer is in use.
+ */
+typedef struct frame_buf {
+    uint8_t *data;
+    uint16_t capacity;
+    uint16_t len;
+    struct frame_buf *next;     // Free list link (pool internal)
+    uint32_t refcount;          // Accessed atomically (pool internal)
+    uint8_t class_index;        // Owning size class (pool internal)
+} frame_buf_t;
+
+/**
+ * @brief Per-class pool statistics
+ */
+typedef struct {
+    uint16_t buf_size;          // Capacity of each buffer in the class
+    uint16_t total;             // Buffers in the class
+    uint16_t in_use;            // Buffers currently allocated
+    uint16_t high_water;        // Largest in_use seen since boot
+    uint32_t allocs;            // Successful allocations served by this class
+    uint32_t alloc_failures;    // Requests for this class that found it empty
+} frame_pool_class_stats_t;
+
+/**
+ * @brief Pool statistics
+ */
+typedef struct {
+    frame_pool_class_stats_t classes[FRAME_POOL_CLASS_COUNT];
+    uint32_t oversize_requests; // Requests larger than the largest class
+} frame_pool_stats_t;
+
+/**
+ * @brief Initialize frame buffer pool
+ * 
+ * Threads every buffer of the static arena onto its class free list. Must
+ * run before any task allocates from the pool; calling it again is a no-op.
+ * 
+ * @return ESP_OK on success
+ */
+esp_err_t frame_pool_init(void);
+
+/**
+ * @brief Allocate a frame buffer
+ * 
+ * Served from the smallest class that fits; if that class is exhausted
+ * the next larger one is tried. The returned buffer holds one reference
+ * and has len set to 0.
+ * 
+ * @param size Required capacity in bytes
+ * @return Buffer, or NULL if no class can satisfy the request
+ */
+frame_buf_t *frame_pool_alloc(size_t size);
+
+/**
+ * @brief Take an additional reference to a buffer
+ * 
+ * @param buf Buffer (may be NULL)
+ * @return buf
+ */
+frame_buf_t *frame_buf_ref(frame_buf_t *buf);
+
+/**
+ * @brief Drop a reference, returning the buffer to the pool on the last one
+ * 
+ * @param buf Buffer (may be NULL)
+ */
+void frame_buf_unref(frame_buf_t *buf);
+
+/**
+ * @brief Get pool statistics
+ * 
+ * @param stats Output statistics
+ * @return ESP_OK on success
+ */
+esp_err_t frame_pool_get_stats(frame_pool_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_POOL_H
@@ -22,6 +22,7 @@ static const char *TAG = "poll_timer";
 
 static esp_timer_handle_t s_poll_timer = NULL;
 static void (*s_poll_callback)(void) = NULL;
+static uint32_t s_configured_period_ms = POLL_TIMER_DEFAULT_PERIOD_MS;
 
 /**
  * @brief Poll timer callback
@@ -62,6 +63,7 @@ esp_err_t poll_timer_init(void)
         return ret;
     }
 
+    s_configured_period_ms = poll_period_ms;
     ESP_LOGI(TAG, "Poll timer initialized (period: %d ms)", poll_period_ms);
     return ESP_OK;
 }
@@ -115,6 +117,14 @@ esp_err_t poll_timer_stop(void)
     return ESP_OK;
 }
 
+/**
+ * @brief Get the configured poll period
+ */
+uint32_t poll_timer_get_configured_period(void)
+{
+    return s_configured_period_ms;
+}
+
 /**
  * @brief Set poll period
  */
@@ -38,6 +38,15 @@ esp_err_t poll_timer_start(void (*callback)(void), uint32_t period_ms);
  */
 esp_err_t poll_timer_stop(void);
 
+/**
+ * @brief Get the configured poll period
+ * 
+ * Query period (param ID 8) as read by poll_timer_init(), or the default.
+ * 
+ * @return Poll period in milliseconds
+ */
+uint32_t poll_timer_get_configured_period(void);
+
 /**
  * @brief Set poll period
  * 
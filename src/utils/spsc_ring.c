@@ -0,0 +1,76 @@
+/**
+ * @file spsc_ring.c
+ * @brief Lock-free single-producer/single-consumer ring implementation
+ * 
+ * head and tail run freely and are masked on access, so a full ring is
+ * head - tail == capacity and no slot is wasted. The producer publishes a
+ * slot with a release store of head after copying it in; the consumer
+ * hands it back with a release store of tail after copying it out.
+ */
+
+#include "spsc_ring.h"
+#include <string.h>
+
+/**
+ * @brief Initialize a ring over caller-provided storage
+ */
+esp_err_t spsc_ring_init(spsc_ring_t *ring, void *storage, size_t elem_size, uint32_t capacity)
+{
+    if (ring == NULL || storage == NULL || elem_size == 0 ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ring->storage = storage;
+    ring->elem_size = elem_size;
+    ring->capacity = capacity;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief Copy an element in (producer side)
+ */
+bool spsc_ring_push(spsc_ring_t *ring, const void *elem)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if ((uint32_t)(head - tail) >= ring->capacity) {
+        return false;
+    }
+
+    memcpy(&ring->storage[(size_t)(head & (ring->capacity - 1)) * ring->elem_size],
+           elem, ring->elem_size);
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Copy the oldest element out (consumer side)
+ */
+bool spsc_ring_pop(spsc_ring_t *ring, void *elem)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (head == tail) {
+        return false;
+    }
+
+    memcpy(elem, &ring->storage[(size_t)(tail & (ring->capacity - 1)) * ring->elem_size],
+           ring->elem_size);
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Number of elements currently queued
+ */
+uint32_t spsc_ring_count(const spsc_ring_t *ring)
+{
+    uint32_t head = atomic_load_explicit(&((spsc_ring_t *)ring)->head, memory_order_acquire);
+    uint32_t tail = atomic_load_explicit(&((spsc_ring_t *)ring)->tail, memory_order_acquire);
+    return head - tail;
+}
@@ -0,0 +1,74 @@
+/**
+ * @file spsc_ring.h
+ * @brief Lock-free single-producer/single-consumer ring
+ * 
+ * Fixed-size elements copied in and out of caller-provided storage. Exactly
+ * one task may push and exactly one task may pop; under that contract no
+ * locks are taken and neither side ever blocks the other.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include "esp_err.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    uint8_t *storage;
+    size_t elem_size;
+    uint32_t capacity;          // Power of two
+    atomic_uint_fast32_t head;  // Next slot to write (producer only)
+    atomic_uint_fast32_t tail;  // Next slot to read (consumer only)
+} spsc_ring_t;
+
+/**
+ * @brief Initialize a ring over caller-provided storage
+ * 
+ * @param ring Ring to initialize
+ * @param storage capacity * elem_size bytes
+ * @param elem_size Size of one element
+ * @param capacity Number of elements, a power of two
+ * @return ESP_OK on success
+ */
+esp_err_t spsc_ring_init(spsc_ring_t *ring, void *storage, size_t elem_size, uint32_t capacity);
+
+/**
+ * @brief Copy an element in (producer side)
+ * 
+ * @param ring Ring
+ * @param elem Element to copy
+ * @return true on success, false if the ring is full
+ */
+bool spsc_ring_push(spsc_ring_t *ring, const void *elem);
+
+/**
+ * @brief Copy the oldest element out (consumer side)
+ * 
+ * @param ring Ring
+ * @param elem Output element
+ * @return true on success, false if the ring is empty
+ */
+bool spsc_ring_pop(spsc_ring_t *ring, void *elem);
+
+/**
+ * @brief Number of elements currently queued
+ * 
+ * Exact from either side for its own view; a snapshot otherwise.
+ * 
+ * @param ring Ring
+ * @return Element count
+ */
+uint32_t spsc_ring_count(const spsc_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPSC_RING_H
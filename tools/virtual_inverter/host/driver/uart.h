@@ -0,0 +1,127 @@
+/**
+ * @file uart.h
+ * @brief Host shim: ESP-IDF UART driver on a Linux serial device
+ * 
+ * A port is bound to a tty (normally the simulator's pty) with
+ * host_uart_bind() before uart_driver_install(). A reader thread fills the
+ * RX ring and posts UART_DATA events the way the driver does: when a FIFO's
+ * worth of bytes has arrived, and with timeout_flag set once the line has
+ * been idle for the RX timeout. Character time is taken from the configured
+ * baud rate, parity and stop bits, since a pty carries neither. The settings
+ * are also written to the device's termios, where the simulator checks
+ * them against its own.
+ */
+
+#ifndef HOST_DRIVER_UART_H
+#define HOST_DRIVER_UART_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int uart_port_t;
+
+#define UART_NUM_0              0
+#define UART_NUM_1              1
+#define UART_NUM_2              2
+#define UART_NUM_MAX            3
+#define UART_PIN_NO_CHANGE      (-1)
+#define UART_FIFO_LEN           128
+
+typedef enum {
+    UART_DATA_5_BITS = 0,
+    UART_DATA_6_BITS,
+    UART_DATA_7_BITS,
+    UART_DATA_8_BITS,
+} uart_word_length_t;
+
+typedef enum {
+    UART_PARITY_DISABLE = 0,
+    UART_PARITY_EVEN = 2,
+    UART_PARITY_ODD = 3,
+} uart_parity_t;
+
+typedef enum {
+    UART_STOP_BITS_1 = 1,
+    UART_STOP_BITS_1_5 = 2,
+    UART_STOP_BITS_2 = 3,
+} uart_stop_bits_t;
+
+typedef enum {
+    UART_HW_FLOWCTRL_DISABLE = 0,
+} uart_hw_flowcontrol_t;
+
+typedef enum {
+    UART_SCLK_DEFAULT = 0,
+} uart_sclk_t;
+
+typedef enum {
+    UART_MODE_UART = 0,
+    UART_MODE_RS485_HALF_DUPLEX,
+} uart_mode_t;
+
+typedef struct {
+    int baud_rate;
+    uart_word_length_t data_bits;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t rx_flow_ctrl_thresh;
+    uart_sclk_t source_clk;
+} uart_config_t;
+
+typedef enum {
+    UART_DATA,
+    UART_BREAK,
+    UART_BUFFER_FULL,
+    UART_FIFO_OVF,
+    UART_FRAME_ERR,
+    UART_PARITY_ERR,
+    UART_DATA_BREAK,
+    UART_PATTERN_DET,
+    UART_EVENT_MAX,
+} uart_event_type_t;
+
+typedef struct {
+    uart_event_type_t type;
+    size_t size;
+    bool timeout_flag;
+} uart_event_t;
+
+/**
+ * @brief Attach a port to a serial device (host only)
+ * 
+ * @param uart_num Port
+ * @param path Device path, e.g. the simulator's pty
+ * @return ESP_OK, ESP_FAIL if the device cannot be opened
+ */
+esp_err_t host_uart_bind(uart_port_t uart_num, const char *path);
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *uart_queue, int intr_alloc_flags);
+esp_err_t uart_driver_delete(uart_port_t uart_num);
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config);
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num,
+                       int rts_io_num, int cts_io_num);
+esp_err_t uart_set_mode(uart_port_t uart_num, uart_mode_t mode);
+esp_err_t uart_set_rx_timeout(uart_port_t uart_num, uint8_t tout_thresh);
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate);
+esp_err_t uart_set_parity(uart_port_t uart_num, uart_parity_t parity_mode);
+esp_err_t uart_set_stop_bits(uart_port_t uart_num, uart_stop_bits_t stop_bits);
+esp_err_t uart_flush_input(uart_port_t uart_num);
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t *size);
+int uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait);
+int uart_write_bytes(uart_port_t uart_num, const void *src, size_t size);
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_DRIVER_UART_H
@@ -0,0 +1,39 @@
+/**
+ * @file esp_log.h
+ * @brief Host shim: ESP-IDF logging to stderr
+ * 
+ * Messages above the level set with host_log_set_level() are dropped;
+ * the default is ESP_LOG_WARN so benchmark output stays readable.
+ */
+
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    ESP_LOG_NONE = 0,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+void host_log_set_level(esp_log_level_t level);
+void host_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#define ESP_LOGE(tag, ...) host_log_write(ESP_LOG_ERROR, tag, __VA_ARGS__)
+#define ESP_LOGW(tag, ...) host_log_write(ESP_LOG_WARN, tag, __VA_ARGS__)
+#define ESP_LOGI(tag, ...) host_log_write(ESP_LOG_INFO, tag, __VA_ARGS__)
+#define ESP_LOGD(tag, ...) host_log_write(ESP_LOG_DEBUG, tag, __VA_ARGS__)
+#define ESP_LOGV(tag, ...) host_log_write(ESP_LOG_VERBOSE, tag, __VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_ESP_LOG_H
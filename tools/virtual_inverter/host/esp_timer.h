@@ -0,0 +1,24 @@
+/**
+ * @file esp_timer.h
+ * @brief Host shim: microsecond clock
+ */
+
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Monotonic time in microseconds
+ */
+int64_t esp_timer_get_time(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_ESP_TIMER_H
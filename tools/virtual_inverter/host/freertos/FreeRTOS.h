@@ -0,0 +1,47 @@
+/**
+ * @file FreeRTOS.h
+ * @brief Host shim: FreeRTOS types on pthreads
+ * 
+ * One tick is one millisecond. A critical section is a recursive mutex,
+ * which is enough for the short sections the firmware takes.
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  1
+#define pdFAIL                  0
+#define portMAX_DELAY           ((TickType_t)0xFFFFFFFFUL)
+#define configTICK_RATE_HZ      1000
+#define portTICK_PERIOD_MS      1
+#define pdMS_TO_TICKS(ms)       ((TickType_t)(ms))
+#define pdTICKS_TO_MS(ticks)    ((uint32_t)(ticks))
+
+typedef struct {
+    pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP }
+
+#define portENTER_CRITICAL(mux)  pthread_mutex_lock(&(mux)->mutex)
+#define portEXIT_CRITICAL(mux)   pthread_mutex_unlock(&(mux)->mutex)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_FREERTOS_H
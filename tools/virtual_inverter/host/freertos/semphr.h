@@ -0,0 +1,38 @@
+/**
+ * @file semphr.h
+ * @brief Host shim: FreeRTOS semaphores on queues of empty items
+ */
+
+#ifndef HOST_FREERTOS_SEMPHR_H
+#define HOST_FREERTOS_SEMPHR_H
+
+#include "FreeRTOS.h"
+#include "queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef QueueHandle_t SemaphoreHandle_t;
+typedef struct {
+    uint8_t unused;
+} StaticSemaphore_t;
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+
+/**
+ * @brief Binary semaphore; the buffer is ignored and the semaphore is allocated
+ */
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer);
+
+#define xSemaphoreCreateBinary()            xSemaphoreCreateCounting(1, 0)
+#define xSemaphoreTake(sem, wait)           xQueueReceive((sem), NULL, (wait))
+#define xSemaphoreGive(sem)                 xQueueSend((sem), NULL, 0)
+#define vSemaphoreDelete(sem)               vQueueDelete(sem)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_FREERTOS_SEMPHR_H
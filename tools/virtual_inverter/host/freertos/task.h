@@ -0,0 +1,45 @@
+/**
+ * @file task.h
+ * @brief Host shim: FreeRTOS tasks as detached threads
+ * 
+ * Each task has a notification count; the thread that calls
+ * xTaskGetCurrentTaskHandle() without having been created as a task
+ * (main) gets one on first use.
+ */
+
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+/**
+ * @brief Start a task; stack size and priority are ignored
+ */
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_depth,
+                       void *param, UBaseType_t priority, TaskHandle_t *handle);
+
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+/**
+ * @brief Wait for the calling task's notification count to be non-zero
+ * 
+ * @return Count before it was cleared or decremented, 0 on timeout
+ */
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_FREERTOS_TASK_H
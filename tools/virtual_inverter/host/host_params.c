@@ -0,0 +1,68 @@
+/**
+ * @file host_params.c
+ * @brief Host shim: in-memory parameter store
+ * 
+ * Only what the host builds need: integers for the RS485 service, strings
+ * for the device SN. Nothing is persisted; the benchmarks set what they
+ * need before starting the services.
+ */
+
+#include "../../../src/config/param_manager.h"
+#include <stdbool.h>
+#include <string.h>
+
+#define HOST_PARAM_COUNT    20
+#define HOST_PARAM_STR_LEN  64
+
+static int32_t s_values[HOST_PARAM_COUNT];
+static bool s_set[HOST_PARAM_COUNT];
+static char s_strings[HOST_PARAM_COUNT][HOST_PARAM_STR_LEN];
+static bool s_string_set[HOST_PARAM_COUNT];
+
+esp_err_t param_set_int(param_id_t id, int32_t value)
+{
+    if ((int)id < 0 || (int)id >= HOST_PARAM_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_values[id] = value;
+    s_set[id] = true;
+    return ESP_OK;
+}
+
+esp_err_t param_get_int(param_id_t id, int32_t *value)
+{
+    if ((int)id < 0 || (int)id >= HOST_PARAM_COUNT || value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_set[id]) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    *value = s_values[id];
+    return ESP_OK;
+}
+
+esp_err_t param_set_string(param_id_t id, const char *value)
+{
+    if ((int)id < 0 || (int)id >= HOST_PARAM_COUNT || value == NULL ||
+        strlen(value) >= HOST_PARAM_STR_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    strcpy(s_strings[id], value);
+    s_string_set[id] = true;
+    return ESP_OK;
+}
+
+esp_err_t param_get_string(param_id_t id, char *value, size_t max_len)
+{
+    if ((int)id < 0 || (int)id >= HOST_PARAM_COUNT || value == NULL || max_len == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!s_string_set[id]) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (strlen(s_strings[id]) >= max_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    strcpy(value, s_strings[id]);
+    return ESP_OK;
+}
@@ -0,0 +1,382 @@
+/**
+ * @file host_port.c
+ * @brief Host shim: logging, clock, tasks, queues and semaphores
+ */
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+
+static esp_log_level_t s_log_level = ESP_LOG_WARN;
+static pthread_mutex_t s_log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code) {
+        case ESP_OK:                    return "ESP_OK";
+        case ESP_FAIL:                  return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:       return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:     return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:      return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:         return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:     return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:           return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE:  return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:       return "ESP_ERR_INVALID_CRC";
+        default:                        return "UNKNOWN ERROR";
+    }
+}
+
+void host_log_set_level(esp_log_level_t level)
+{
+    s_log_level = level;
+}
+
+void host_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    if (level > s_log_level) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&s_log_lock);
+    fprintf(stderr, "%c (%lld) %s: ", letters[level],
+            (long long)(esp_timer_get_time() / 1000), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    pthread_mutex_unlock(&s_log_lock);
+    va_end(args);
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Absolute CLOCK_MONOTONIC deadline ticks (ms) from now
+ */
+static struct timespec host_deadline(TickType_t ticks)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    ts.tv_sec += ticks / 1000;
+    ts.tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+struct host_task {
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify_count;
+    TaskFunction_t task;
+    void *param;
+};
+
+static __thread struct host_task *s_current_task;
+
+static struct host_task *host_task_alloc(void)
+{
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        return NULL;
+    }
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&task->notified, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&task->lock, NULL);
+    return task;
+}
+
+static void *host_task_entry(void *arg)
+{
+    s_current_task = arg;
+    s_current_task->task(s_current_task->param);
+    return NULL;
+}
+
+/**
+ * @brief Start a task; the task record is never freed, handles stay valid
+ */
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_depth,
+                       void *param, UBaseType_t priority, TaskHandle_t *handle)
+{
+    (void)name;
+    (void)stack_depth;
+    (void)priority;
+
+    struct host_task *record = host_task_alloc();
+    if (record == NULL) {
+        return pdFAIL;
+    }
+    record->task = task;
+    record->param = param;
+    if (handle != NULL) {
+        *handle = record;
+    }
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, host_task_entry, record) != 0) {
+        if (handle != NULL) {
+            *handle = NULL;
+        }
+        free(record);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (s_current_task == NULL) {
+        s_current_task = host_task_alloc();
+    }
+    return s_current_task;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait)
+{
+    struct host_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline = host_deadline(wait);
+
+    pthread_mutex_lock(&task->lock);
+    while (task->notify_count == 0 && wait != 0) {
+        if (wait == portMAX_DELAY) {
+            pthread_cond_wait(&task->notified, &task->lock);
+        } else if (pthread_cond_timedwait(&task->notified, &task->lock,
+                                          &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    uint32_t count = task->notify_count;
+    if (count > 0) {
+        task->notify_count = clear_on_exit ? 0 : count - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify_count++;
+    pthread_cond_signal(&task->notified);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == s_current_task) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = host_deadline(ticks);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    QueueSetHandle_t set;       // Told of every item sent, if a set member
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(*queue));
+    if (queue == NULL) {
+        return NULL;
+    }
+    // Semaphores are queues of empty items
+    queue->items = calloc(length, (item_size > 0) ? item_size : 1);
+    if (queue->items == NULL) {
+        free(queue);
+        return NULL;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&queue->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&queue->lock, NULL);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    if (queue == NULL) {
+        return;
+    }
+    pthread_cond_destroy(&queue->changed);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue->items);
+    free(queue);
+}
+
+/**
+ * @brief Wait on the queue condition until it has an item (or space) or the wait runs out
+ * 
+ * Called with the queue lock held.
+ */
+static bool host_queue_wait(QueueHandle_t queue, bool want_space, TickType_t wait)
+{
+    struct timespec deadline = host_deadline(wait);
+    while (want_space ? queue->count == queue->length : queue->count == 0) {
+        if (wait == 0) {
+            return false;
+        }
+        if (wait == portMAX_DELAY) {
+            pthread_cond_wait(&queue->changed, &queue->lock);
+        } else if (pthread_cond_timedwait(&queue->changed, &queue->lock,
+                                          &deadline) == ETIMEDOUT) {
+            return want_space ? queue->count < queue->length : queue->count > 0;
+        }
+    }
+    return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (!host_queue_wait(queue, true, wait)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->item_size > 0) {
+        memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_broadcast(&queue->changed);
+    QueueSetHandle_t set = queue->set;
+    pthread_mutex_unlock(&queue->lock);
+
+    // The set was sized for every member item, so there is room
+    if (set != NULL) {
+        xQueueSend(set, &queue, 0);
+    }
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t wait)
+{
+    pthread_mutex_lock(&queue->lock);
+    if (!host_queue_wait(queue, false, wait)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    if (queue->item_size > 0) {
+        memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->head = 0;
+    queue->count = 0;
+    pthread_cond_broadcast(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+QueueSetHandle_t xQueueCreateSet(UBaseType_t length)
+{
+    return xQueueCreate(length, sizeof(QueueSetMemberHandle_t));
+}
+
+/**
+ * @brief Add an empty queue or semaphore to a set, as FreeRTOS requires
+ */
+BaseType_t xQueueAddToSet(QueueSetMemberHandle_t member, QueueSetHandle_t set)
+{
+    pthread_mutex_lock(&member->lock);
+    bool added = (member->set == NULL && member->count == 0);
+    if (added) {
+        member->set = set;
+    }
+    pthread_mutex_unlock(&member->lock);
+    return added ? pdPASS : pdFAIL;
+}
+
+QueueSetMemberHandle_t xQueueSelectFromSet(QueueSetHandle_t set, TickType_t wait)
+{
+    QueueSetMemberHandle_t member = NULL;
+    if (xQueueReceive(set, &member, wait) != pdTRUE) {
+        return NULL;
+    }
+    return member;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max_count, UBaseType_t initial_count)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max_count, 0);
+    if (sem != NULL) {
+        sem->count = (initial_count < max_count) ? initial_count : max_count;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t *buffer)
+{
+    (void)buffer;
+    return xSemaphoreCreateCounting(1, 0);
+}
@@ -0,0 +1,455 @@
+/**
+ * @file host_uart.c
+ * @brief Host shim: ESP-IDF UART driver on a Linux serial device
+ */
+
+#include "driver/uart.h"
+#include "esp_timer.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define HOST_UART_FIFO_THRESH   120     // Bytes that end a UART_DATA event without a timeout
+#define HOST_UART_READ_CHUNK    256
+
+typedef struct {
+    int fd;                     // -1 until bound
+    bool installed;
+    uint32_t baud_rate;
+    uart_parity_t parity;
+    uart_stop_bits_t stop_bits;
+    uint8_t rx_tout;            // RX timeout (symbols)
+    QueueHandle_t queue;
+    pthread_mutex_t lock;
+    pthread_cond_t readable;
+    uint8_t *ring;
+    size_t ring_size;
+    size_t head;
+    size_t len;
+    int64_t tx_end_us;          // When the last queued byte leaves the wire
+    pthread_t reader;
+} host_uart_t;
+
+static host_uart_t s_uarts[UART_NUM_MAX] = {
+    { .fd = -1 }, { .fd = -1 }, { .fd = -1 },
+};
+
+static host_uart_t *host_uart_get(uart_port_t uart_num)
+{
+    if (uart_num < 0 || uart_num >= UART_NUM_MAX || s_uarts[uart_num].fd < 0) {
+        return NULL;
+    }
+    return &s_uarts[uart_num];
+}
+
+/**
+ * @brief Character time from the configured frame format
+ */
+static uint32_t host_uart_char_us(const host_uart_t *uart)
+{
+    uint32_t bits = 1 + 8 + (uart->parity != UART_PARITY_DISABLE ? 1 : 0) +
+                    (uart->stop_bits == UART_STOP_BITS_2 ? 2 : 1);
+    uint32_t baud = uart->baud_rate ? uart->baud_rate : 9600;
+    return (bits * 1000000UL + baud - 1) / baud;
+}
+
+/**
+ * @brief Mirror the line settings into the device's termios
+ * 
+ * A pty moves bytes at any setting, but its other side can read them back
+ * to tell whether the two ends agree. The pty driver clears PARENB, so the
+ * format is carried by the stop bits and PARODD: 2 stop bits for no parity
+ * (as Modbus RTU sends it), PARODD for odd, neither for even.
+ */
+static void host_uart_apply_line(host_uart_t *uart)
+{
+    static const struct {
+        uint32_t baud_rate;
+        speed_t speed;
+    } speeds[] = {
+        { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+        { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 },
+        { 230400, B230400 },
+    };
+
+    struct termios tio;
+    if (tcgetattr(uart->fd, &tio) != 0) {
+        return;
+    }
+    for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        if (speeds[i].baud_rate == uart->baud_rate) {
+            cfsetspeed(&tio, speeds[i].speed);
+            break;
+        }
+    }
+    tio.c_cflag &= ~(PARENB | PARODD | CSTOPB);
+    if (uart->parity != UART_PARITY_DISABLE) {
+        tio.c_cflag |= PARENB;
+    }
+    if (uart->parity == UART_PARITY_ODD) {
+        tio.c_cflag |= PARODD;
+    }
+    if (uart->stop_bits == UART_STOP_BITS_2) {
+        tio.c_cflag |= CSTOPB;
+    }
+    tcsetattr(uart->fd, TCSANOW, &tio);
+}
+
+static void host_uart_post(host_uart_t *uart, uart_event_type_t type, size_t size, bool idle)
+{
+    if (uart->queue == NULL) {
+        return;
+    }
+    uart_event_t event = { .type = type, .size = size, .timeout_flag = idle };
+    xQueueSend(uart->queue, &event, 0);
+}
+
+/**
+ * @brief Reader thread: fill the RX ring and post driver events
+ */
+static void *host_uart_reader(void *arg)
+{
+    host_uart_t *uart = (host_uart_t *)arg;
+    uint8_t chunk[HOST_UART_READ_CHUNK];
+    size_t pending = 0;         // Received bytes not yet reported
+    int64_t last_rx_us = 0;
+
+    while (1) {
+        struct pollfd pfd = { .fd = uart->fd, .events = POLLIN };
+        struct timespec ts;
+        struct timespec *timeout = NULL;
+        if (pending > 0) {
+            int64_t idle_at = last_rx_us + (int64_t)uart->rx_tout * host_uart_char_us(uart);
+            int64_t remaining = idle_at - esp_timer_get_time();
+            if (remaining < 0) {
+                remaining = 0;
+            }
+            ts.tv_sec = remaining / 1000000;
+            ts.tv_nsec = (remaining % 1000000) * 1000;
+            timeout = &ts;
+        }
+
+        int ret = ppoll(&pfd, 1, timeout, NULL);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        if (ret == 0) {
+            // Line idle for the RX timeout: report the rest
+            host_uart_post(uart, UART_DATA, pending, true);
+            pending = 0;
+            continue;
+        }
+
+        if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) {
+            break;
+        }
+
+        ssize_t n = read(uart->fd, chunk, sizeof(chunk));
+        if (n <= 0) {
+            if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                continue;
+            }
+            break;
+        }
+
+        pthread_mutex_lock(&uart->lock);
+        size_t space = uart->ring_size - uart->len;
+        size_t take = ((size_t)n < space) ? (size_t)n : space;
+        for (size_t i = 0; i < take; i++) {
+            uart->ring[(uart->head + uart->len + i) % uart->ring_size] = chunk[i];
+        }
+        uart->len += take;
+        pthread_cond_broadcast(&uart->readable);
+        pthread_mutex_unlock(&uart->lock);
+
+        if (take < (size_t)n) {
+            host_uart_post(uart, UART_BUFFER_FULL, 0, false);
+        }
+
+        pending += take;
+        last_rx_us = esp_timer_get_time();
+        while (pending >= HOST_UART_FIFO_THRESH) {
+            host_uart_post(uart, UART_DATA, HOST_UART_FIFO_THRESH, false);
+            pending -= HOST_UART_FIFO_THRESH;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t host_uart_bind(uart_port_t uart_num, const char *path)
+{
+    if (uart_num < 0 || uart_num >= UART_NUM_MAX || path == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int fd = open(path, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+
+    struct termios tio;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+
+    host_uart_t *uart = &s_uarts[uart_num];
+    uart->fd = fd;
+    uart->baud_rate = 9600;
+    uart->parity = UART_PARITY_DISABLE;
+    uart->stop_bits = UART_STOP_BITS_1;
+    uart->rx_tout = 10;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_install(uart_port_t uart_num, int rx_buffer_size, int tx_buffer_size,
+                              int queue_size, QueueHandle_t *uart_queue, int intr_alloc_flags)
+{
+    (void)tx_buffer_size;
+    (void)intr_alloc_flags;
+
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL || rx_buffer_size <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (uart->installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uart->ring = malloc(rx_buffer_size);
+    if (uart->ring == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    uart->ring_size = rx_buffer_size;
+    uart->head = 0;
+    uart->len = 0;
+
+    if (queue_size > 0 && uart_queue != NULL) {
+        uart->queue = xQueueCreate(queue_size, sizeof(uart_event_t));
+        if (uart->queue == NULL) {
+            free(uart->ring);
+            return ESP_ERR_NO_MEM;
+        }
+        *uart_queue = uart->queue;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&uart->readable, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&uart->lock, NULL);
+
+    if (pthread_create(&uart->reader, NULL, host_uart_reader, uart) != 0) {
+        return ESP_FAIL;
+    }
+    pthread_detach(uart->reader);
+    uart->installed = true;
+    return ESP_OK;
+}
+
+esp_err_t uart_driver_delete(uart_port_t uart_num)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // The reader ends when the device is closed
+    close(uart->fd);
+    uart->fd = -1;
+    uart->installed = false;
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t uart_num, const uart_config_t *uart_config)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL || uart_config == NULL || uart_config->baud_rate <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uart->baud_rate = (uint32_t)uart_config->baud_rate;
+    uart->parity = uart_config->parity;
+    uart->stop_bits = uart_config->stop_bits;
+    host_uart_apply_line(uart);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t uart_num, int tx_io_num, int rx_io_num,
+                       int rts_io_num, int cts_io_num)
+{
+    (void)tx_io_num;
+    (void)rx_io_num;
+    (void)rts_io_num;
+    (void)cts_io_num;
+    return host_uart_get(uart_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t uart_set_mode(uart_port_t uart_num, uart_mode_t mode)
+{
+    (void)mode;
+    return host_uart_get(uart_num) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t uart_set_rx_timeout(uart_port_t uart_num, uint8_t tout_thresh)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uart->rx_tout = tout_thresh ? tout_thresh : 1;
+    return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t uart_num, uint32_t baudrate)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL || baudrate == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uart->baud_rate = baudrate;
+    host_uart_apply_line(uart);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_parity(uart_port_t uart_num, uart_parity_t parity_mode)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uart->parity = parity_mode;
+    host_uart_apply_line(uart);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_stop_bits(uart_port_t uart_num, uart_stop_bits_t stop_bits)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uart->stop_bits = stop_bits;
+    host_uart_apply_line(uart);
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t uart_num)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL || !uart->installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_mutex_lock(&uart->lock);
+    uart->head = 0;
+    uart->len = 0;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t uart_num, size_t *size)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL || !uart->installed || size == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&uart->lock);
+    *size = uart->len;
+    pthread_mutex_unlock(&uart->lock);
+    return ESP_OK;
+}
+
+int uart_read_bytes(uart_port_t uart_num, void *buf, uint32_t length, TickType_t ticks_to_wait)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL || !uart->installed || buf == NULL) {
+        return -1;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ticks_to_wait / 1000;
+    deadline.tv_nsec += (long)(ticks_to_wait % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&uart->lock);
+    while (uart->len < length && ticks_to_wait > 0) {
+        if (pthread_cond_timedwait(&uart->readable, &uart->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    size_t n = (uart->len < length) ? uart->len : length;
+    uint8_t *out = (uint8_t *)buf;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = uart->ring[uart->head];
+        uart->head = (uart->head + 1) % uart->ring_size;
+    }
+    uart->len -= n;
+    pthread_mutex_unlock(&uart->lock);
+    return (int)n;
+}
+
+int uart_write_bytes(uart_port_t uart_num, const void *src, size_t size)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL || src == NULL) {
+        return -1;
+    }
+
+    const uint8_t *p = (const uint8_t *)src;
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(uart->fd, p + written, size - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        written += (size_t)n;
+    }
+
+    // The bytes are on the wire for their air time at the configured speed
+    int64_t now = esp_timer_get_time();
+    if (uart->tx_end_us < now) {
+        uart->tx_end_us = now;
+    }
+    uart->tx_end_us += (int64_t)size * host_uart_char_us(uart);
+    return (int)written;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t uart_num, TickType_t ticks_to_wait)
+{
+    host_uart_t *uart = host_uart_get(uart_num);
+    if (uart == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t remaining = uart->tx_end_us - esp_timer_get_time();
+    if (remaining <= 0) {
+        return ESP_OK;
+    }
+    if (ticks_to_wait != portMAX_DELAY && remaining > (int64_t)ticks_to_wait * 1000) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    struct timespec ts = {
+        .tv_sec = uart->tx_end_us / 1000000,
+        .tv_nsec = (uart->tx_end_us % 1000000) * 1000,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,11 @@
+/**
+ * @file inet.h
+ * @brief Host shim: lwIP address conversion is the POSIX one
+ */
+
+#ifndef HOST_LWIP_INET_H
+#define HOST_LWIP_INET_H
+
+#include <arpa/inet.h>
+
+#endif // HOST_LWIP_INET_H
@@ -0,0 +1,11 @@
+/**
+ * @file netdb.h
+ * @brief Host shim: lwIP name resolution is the POSIX one
+ */
+
+#ifndef HOST_LWIP_NETDB_H
+#define HOST_LWIP_NETDB_H
+
+#include <netdb.h>
+
+#endif // HOST_LWIP_NETDB_H
@@ -0,0 +1,33 @@
+/**
+ * @file sockets.h
+ * @brief Host shim: lwIP BSD sockets are the POSIX ones
+ */
+
+#ifndef HOST_LWIP_SOCKETS_H
+#define HOST_LWIP_SOCKETS_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+// lwIP's default TCP_SND_BUF (4 * TCP_MSS). Loopback sockets on Linux would
+// buffer megabytes for a client that stops reading, hiding the backpressure
+// the firmware sees, so accepted sockets get the lwIP size.
+#define HOST_LWIP_TCP_SND_BUF   5744
+
+static inline int host_lwip_accept(int sock, struct sockaddr *addr, socklen_t *addr_len)
+{
+    int fd = accept(sock, addr, addr_len);
+    if (fd >= 0) {
+        int size = HOST_LWIP_TCP_SND_BUF;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+    return fd;
+}
+#define accept host_lwip_accept
+
+#endif // HOST_LWIP_SOCKETS_H
@@ -0,0 +1,24 @@
+/**
+ * @file cipher.h
+ * @brief Host shim: the mbedtls 2.28 cipher types the firmware names
+ */
+
+#ifndef HOST_MBEDTLS_CIPHER_H
+#define HOST_MBEDTLS_CIPHER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Values as in the library's enum
+typedef enum {
+    MBEDTLS_CIPHER_NONE = 0,
+    MBEDTLS_CIPHER_AES_128_GCM = 14,
+    MBEDTLS_CIPHER_AES_256_GCM = 16,
+} mbedtls_cipher_type_t;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_MBEDTLS_CIPHER_H
@@ -0,0 +1,35 @@
+/**
+ * @file ctr_drbg.h
+ * @brief Host shim: mbedtls 2.28 random generator
+ * 
+ * Opaque, larger than the library's 392-byte context.
+ */
+
+#ifndef HOST_MBEDTLS_CTR_DRBG_H
+#define HOST_MBEDTLS_CTR_DRBG_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    union {
+        unsigned char bytes[1024];
+        long double align;
+    } opaque;
+} mbedtls_ctr_drbg_context;
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context *ctx);
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context *ctx);
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context *ctx,
+                          int (*f_entropy)(void *, unsigned char *, size_t), void *p_entropy,
+                          const unsigned char *custom, size_t len);
+int mbedtls_ctr_drbg_random(void *p_rng, unsigned char *output, size_t output_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_MBEDTLS_CTR_DRBG_H
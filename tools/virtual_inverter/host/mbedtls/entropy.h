@@ -0,0 +1,33 @@
+/**
+ * @file entropy.h
+ * @brief Host shim: mbedtls 2.28 entropy source
+ * 
+ * Opaque, larger than the library's context (about 38 KB in the system
+ * build).
+ */
+
+#ifndef HOST_MBEDTLS_ENTROPY_H
+#define HOST_MBEDTLS_ENTROPY_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    union {
+        unsigned char bytes[65536];
+        long double align;
+    } opaque;
+} mbedtls_entropy_context;
+
+void mbedtls_entropy_init(mbedtls_entropy_context *ctx);
+void mbedtls_entropy_free(mbedtls_entropy_context *ctx);
+int mbedtls_entropy_func(void *data, unsigned char *output, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_MBEDTLS_ENTROPY_H
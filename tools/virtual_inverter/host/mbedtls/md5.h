@@ -0,0 +1,34 @@
+/**
+ * @file md5.h
+ * @brief Host shim: mbedtls 2.28 MD5
+ * 
+ * Opaque, larger than the library's 88-byte context.
+ */
+
+#ifndef HOST_MBEDTLS_MD5_H
+#define HOST_MBEDTLS_MD5_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    union {
+        unsigned char bytes[128];
+        long double align;
+    } opaque;
+} mbedtls_md5_context;
+
+void mbedtls_md5_init(mbedtls_md5_context *ctx);
+void mbedtls_md5_free(mbedtls_md5_context *ctx);
+void mbedtls_md5_starts(mbedtls_md5_context *ctx);
+void mbedtls_md5_update(mbedtls_md5_context *ctx, const unsigned char *input, size_t ilen);
+void mbedtls_md5_finish(mbedtls_md5_context *ctx, unsigned char output[16]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_MBEDTLS_MD5_H
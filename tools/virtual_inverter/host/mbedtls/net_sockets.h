@@ -0,0 +1,33 @@
+/**
+ * @file net_sockets.h
+ * @brief Host shim: mbedtls 2.28 socket BIO callbacks
+ */
+
+#ifndef HOST_MBEDTLS_NET_SOCKETS_H
+#define HOST_MBEDTLS_NET_SOCKETS_H
+
+#include "ssl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBEDTLS_ERR_NET_RECV_FAILED             -0x004C
+#define MBEDTLS_ERR_NET_SEND_FAILED             -0x004E
+#define MBEDTLS_ERR_NET_CONN_RESET              -0x0050
+
+// Same layout as the library's
+typedef struct {
+    int fd;
+} mbedtls_net_context;
+
+void mbedtls_net_init(mbedtls_net_context *ctx);
+void mbedtls_net_free(mbedtls_net_context *ctx);
+int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len);
+int mbedtls_net_recv(void *ctx, unsigned char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_MBEDTLS_NET_SOCKETS_H
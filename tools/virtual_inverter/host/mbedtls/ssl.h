@@ -0,0 +1,103 @@
+/**
+ * @file ssl.h
+ * @brief Host shim: the part of the mbedtls 2.28 SSL API the firmware uses
+ * 
+ * The host build links the system's mbedtls 2.28 libraries, so TLS on the
+ * host is real. These declarations match that library; its contexts are
+ * opaque here, as buffers comfortably larger than the library's own
+ * layouts (736 bytes for an SSL context, 416 for a configuration, 160
+ * for a session).
+ */
+
+#ifndef HOST_MBEDTLS_SSL_H
+#define HOST_MBEDTLS_SSL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE     -0x7080
+#define MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY       -0x7880
+#define MBEDTLS_ERR_SSL_TIMEOUT                 -0x6800
+#define MBEDTLS_ERR_SSL_WANT_READ               -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE              -0x6880
+
+#define MBEDTLS_SSL_IS_CLIENT                   0
+#define MBEDTLS_SSL_IS_SERVER                   1
+#define MBEDTLS_SSL_TRANSPORT_STREAM            0
+#define MBEDTLS_SSL_PRESET_DEFAULT              0
+#define MBEDTLS_SSL_VERIFY_NONE                 0
+#define MBEDTLS_SSL_VERIFY_OPTIONAL             1
+#define MBEDTLS_SSL_VERIFY_REQUIRED             2
+#define MBEDTLS_SSL_SESSION_TICKETS_DISABLED    0
+#define MBEDTLS_SSL_SESSION_TICKETS_ENABLED     1
+
+typedef int mbedtls_ssl_send_t(void *ctx, const unsigned char *buf, size_t len);
+typedef int mbedtls_ssl_recv_t(void *ctx, unsigned char *buf, size_t len);
+typedef int mbedtls_ssl_recv_timeout_t(void *ctx, unsigned char *buf, size_t len,
+                                       uint32_t timeout);
+
+typedef struct {
+    union {
+        unsigned char bytes[1024];
+        long double align;
+    } opaque;
+} mbedtls_ssl_config;
+
+typedef struct {
+    union {
+        unsigned char bytes[2048];
+        long double align;
+    } opaque;
+} mbedtls_ssl_context;
+
+typedef struct {
+    union {
+        unsigned char bytes[512];
+        long double align;
+    } opaque;
+} mbedtls_ssl_session;
+
+typedef int mbedtls_ssl_ticket_write_t(void *p_ticket, const mbedtls_ssl_session *session,
+                                       unsigned char *start, const unsigned char *end,
+                                       size_t *tlen, uint32_t *lifetime);
+typedef int mbedtls_ssl_ticket_parse_t(void *p_ticket, mbedtls_ssl_session *session,
+                                       unsigned char *buf, size_t len);
+
+void mbedtls_ssl_init(mbedtls_ssl_context *ssl);
+void mbedtls_ssl_free(mbedtls_ssl_context *ssl);
+void mbedtls_ssl_config_init(mbedtls_ssl_config *conf);
+void mbedtls_ssl_config_free(mbedtls_ssl_config *conf);
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf, int endpoint, int transport,
+                                int preset);
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config *conf, int authmode);
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config *conf,
+                          int (*f_rng)(void *, unsigned char *, size_t), void *p_rng);
+int mbedtls_ssl_conf_psk(mbedtls_ssl_config *conf, const unsigned char *psk, size_t psk_len,
+                         const unsigned char *psk_identity, size_t psk_identity_len);
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config *conf, int use_tickets);
+void mbedtls_ssl_conf_session_tickets_cb(mbedtls_ssl_config *conf,
+                                         mbedtls_ssl_ticket_write_t *f_ticket_write,
+                                         mbedtls_ssl_ticket_parse_t *f_ticket_parse,
+                                         void *p_ticket);
+int mbedtls_ssl_setup(mbedtls_ssl_context *ssl, const mbedtls_ssl_config *conf);
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context *ssl, const char *hostname);
+void mbedtls_ssl_set_bio(mbedtls_ssl_context *ssl, void *p_bio, mbedtls_ssl_send_t *f_send,
+                         mbedtls_ssl_recv_t *f_recv, mbedtls_ssl_recv_timeout_t *f_recv_timeout);
+int mbedtls_ssl_handshake(mbedtls_ssl_context *ssl);
+int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len);
+int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len);
+int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl);
+void mbedtls_ssl_session_init(mbedtls_ssl_session *session);
+void mbedtls_ssl_session_free(mbedtls_ssl_session *session);
+int mbedtls_ssl_get_session(const mbedtls_ssl_context *ssl, mbedtls_ssl_session *session);
+int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_MBEDTLS_SSL_H
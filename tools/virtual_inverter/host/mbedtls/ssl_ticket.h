@@ -0,0 +1,40 @@
+/**
+ * @file ssl_ticket.h
+ * @brief Host shim: mbedtls 2.28 session ticket keys
+ * 
+ * Opaque, larger than the library's 280-byte context.
+ */
+
+#ifndef HOST_MBEDTLS_SSL_TICKET_H
+#define HOST_MBEDTLS_SSL_TICKET_H
+
+#include "ssl.h"
+#include "cipher.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    union {
+        unsigned char bytes[1024];
+        long double align;
+    } opaque;
+} mbedtls_ssl_ticket_context;
+
+void mbedtls_ssl_ticket_init(mbedtls_ssl_ticket_context *ctx);
+void mbedtls_ssl_ticket_free(mbedtls_ssl_ticket_context *ctx);
+int mbedtls_ssl_ticket_setup(mbedtls_ssl_ticket_context *ctx,
+                             int (*f_rng)(void *, unsigned char *, size_t), void *p_rng,
+                             mbedtls_cipher_type_t cipher, uint32_t lifetime);
+int mbedtls_ssl_ticket_write(void *p_ticket, const mbedtls_ssl_session *session,
+                             unsigned char *start, const unsigned char *end,
+                             size_t *tlen, uint32_t *lifetime);
+int mbedtls_ssl_ticket_parse(void *p_ticket, mbedtls_ssl_session *session,
+                             unsigned char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HOST_MBEDTLS_SSL_TICKET_H
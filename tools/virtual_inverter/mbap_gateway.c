@@ -0,0 +1,178 @@
+/**
+ * @file mbap_gateway.c
+ * @brief Modbus TCP gateway on the host, in front of the virtual inverter
+ * 
+ * Runs the firmware's RS485 service, bus transaction engine, register
+ * cache and Modbus TCP gateway on the host shims, with a virtual inverter
+ * as the slave. The gateway listens on MODBUS_TCP_PORT (1502 in this
+ * build, so no privileges are needed). Runs until interrupted or for the
+ * given time, then prints the gateway, bus and cache statistics.
+ */
+
+#include "virtual_inverter.h"
+#include "esp_log.h"
+#include "driver/uart.h"
+#include "../../src/tasks/rs485_task.h"
+#include "../../src/tasks/bus_task.h"
+#include "../../src/tasks/modbus_tcp_task.h"
+#include "../../src/protocol/register_cache.h"
+#include "../../src/protocol/device_routes.h"
+#include "../../src/config/param_manager.h"
+#include "../../src/utils/frame_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define GATEWAY_DEFAULT_BAUD_RATE     115200
+#define GATEWAY_DEFAULT_TURNAROUND_US 2000
+
+static volatile sig_atomic_t s_stop = 0;
+
+static void gateway_on_signal(int sig)
+{
+    (void)sig;
+    s_stop = 1;
+}
+
+/**
+ * @brief RS485 frame callback: every response belongs to the bus engine
+ */
+static void gateway_on_frame(uint8_t *frame, size_t len)
+{
+    bus_task_on_frame(frame, len);
+}
+
+static void gateway_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -b baud      line speed (default %d)\n"
+            "  -p N|O|E     parity (default E)\n"
+            "  -t us        simulator turnaround (default %d)\n"
+            "  -j us        simulator turnaround jitter\n"
+            "  -c rate      corrupted CRC rate (0-1)\n"
+            "  -N rate      noise burst rate (0-1)\n"
+            "  -d rate      unanswered request rate (0-1)\n"
+            "  -s rate      split response rate (0-1)\n"
+            "  -B rate      busy exception rate (0-1)\n"
+            "  -A ms        register cache staleness limit\n"
+            "  -m file      register map\n"
+            "  -S seed      fault injection seed\n"
+            "  -D seconds   exit after this long (default: on SIGINT/SIGTERM)\n"
+            "  -v           firmware log output\n",
+            prog, GATEWAY_DEFAULT_BAUD_RATE, GATEWAY_DEFAULT_TURNAROUND_US);
+}
+
+int main(int argc, char **argv)
+{
+    vi_config_t config;
+    vi_config_default(&config);
+    config.baud_rate = GATEWAY_DEFAULT_BAUD_RATE;
+    config.turnaround_us = GATEWAY_DEFAULT_TURNAROUND_US;
+
+    const char *map_path = NULL;
+    long max_age_ms = -1;
+    unsigned int duration_s = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:p:t:j:c:N:d:s:B:A:m:S:D:vh")) != -1) {
+        switch (opt) {
+            case 'b': config.baud_rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'p':
+                if (vi_parse_parity(optarg, &config.parity) != 0) {
+                    gateway_usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 't': config.turnaround_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'j': config.turnaround_jitter_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'c': config.crc_error_rate = atof(optarg); break;
+            case 'N': config.noise_rate = atof(optarg); break;
+            case 'd': config.drop_rate = atof(optarg); break;
+            case 's': config.split_rate = atof(optarg); break;
+            case 'B': config.busy_rate = atof(optarg); break;
+            case 'A': max_age_ms = strtol(optarg, NULL, 0); break;
+            case 'm': map_path = optarg; break;
+            case 'S': config.seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'D': duration_s = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'v': host_log_set_level(ESP_LOG_INFO); break;
+            default:
+                gateway_usage(argv[0]);
+                return 2;
+        }
+    }
+
+    virtual_inverter_t *vi = vi_create(&config);
+    if (vi == NULL) {
+        fprintf(stderr, "Cannot open a pseudo-terminal\n");
+        return 1;
+    }
+    if (map_path != NULL && vi_load_map(vi, map_path) != 0) {
+        fprintf(stderr, "Cannot load register map %s\n", map_path);
+        vi_destroy(vi);
+        return 1;
+    }
+    if (vi_start(vi) != 0 || host_uart_bind(UART_NUM_2, vi_pty_path(vi)) != ESP_OK) {
+        fprintf(stderr, "Cannot connect to the simulator\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    param_set_int(PARAM_ID_16, (int32_t)config.baud_rate);
+    param_set_int(PARAM_ID_17, (int32_t)config.parity);
+    if (max_age_ms >= 0) {
+        register_cache_set_max_age((uint32_t)max_age_ms);
+    }
+
+    // Same order as app_main
+    if (device_routes_init() != ESP_OK || frame_pool_init() != ESP_OK ||
+        rs485_task_init() != ESP_OK) {
+        fprintf(stderr, "RS485 service failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+    rs485_task_set_callback(gateway_on_frame);
+    if (bus_task_init() != ESP_OK || modbus_tcp_task_init() != ESP_OK) {
+        fprintf(stderr, "Gateway failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    signal(SIGINT, gateway_on_signal);
+    signal(SIGTERM, gateway_on_signal);
+    printf("Modbus TCP gateway on port %d, slave %u at %u baud\n", MODBUS_TCP_PORT,
+           config.slave_addr, config.baud_rate);
+    fflush(stdout);
+
+    for (unsigned int elapsed = 0; !s_stop && (duration_s == 0 || elapsed < duration_s);
+         elapsed++) {
+        sleep(1);
+    }
+
+    modbus_tcp_stats_t stats;
+    bus_task_stats_t bus_stats;
+    register_cache_stats_t cache_stats;
+    vi_stats_t vi_stats;
+    modbus_tcp_task_get_stats(&stats);
+    bus_task_get_stats(&bus_stats);
+    register_cache_get_stats(&cache_stats);
+    vi_get_stats(vi, &vi_stats);
+
+    printf("Gateway: %u connections (%u refused), %u requests, %u responses\n",
+           stats.connections, stats.rejected, stats.requests, stats.responses);
+    printf("  served       %u from cache, %u on the bus, most outstanding %u\n",
+           stats.cache_hits, stats.bus_requests, stats.max_pending);
+    printf("  exceptions   %u sent (%u timeouts), %u held for the bus queue, %u bad frames, "
+           "%u slow clients\n", stats.exceptions, stats.timeouts, stats.held, stats.bad_frames,
+           stats.slow_clients);
+    printf("  bus          %u completed, %u exceptions, %u timeouts, %u coalesced\n",
+           bus_stats.completed, bus_stats.exceptions, bus_stats.timeouts, bus_stats.coalesced);
+    printf("  cache        %u hits, %u misses, %u stale\n",
+           cache_stats.hits, cache_stats.misses, cache_stats.stale);
+    printf("  simulator    %u requests, %u responses, %u bad\n",
+           vi_stats.requests, vi_stats.responses, vi_stats.bad_requests);
+
+    // Tasks are still running; leave the simulator to process exit
+    return 0;
+}
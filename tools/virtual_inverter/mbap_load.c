@@ -0,0 +1,351 @@
+/**
+ * @file mbap_load.c
+ * @brief Modbus TCP load generator
+ * 
+ * Opens several connections to a Modbus TCP server and keeps a fixed
+ * number of requests outstanding on each, pipelined with distinct
+ * transaction IDs. Each response is matched to its request by transaction
+ * ID; responses may come back in any order. Reports requests per second,
+ * latency percentiles, exceptions and responses that matched no request.
+ * 
+ * Reads start at a register drawn from a window (-w), so a window wider
+ * than one read mixes cache hits with bus reads. A fraction of the
+ * requests (-W) can be single register writes, which the gateway puts
+ * ahead of reads on the bus.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define LOAD_DEFAULT_PORT           1502
+#define LOAD_DEFAULT_CONNECTIONS    4
+#define LOAD_DEFAULT_DEPTH          4
+#define LOAD_DEFAULT_REQUESTS       10000
+#define LOAD_DEFAULT_COUNT          10
+#define LOAD_MAX_CONNECTIONS        64
+#define LOAD_MAX_DEPTH              64
+#define LOAD_STALL_MS               5000    // Give up with nothing answered this long
+#define LOAD_MBAP_SIZE              7
+#define LOAD_MAX_ADU                260
+
+typedef struct {
+    bool in_use;
+    uint16_t tid;
+    uint8_t func_code;
+    int64_t sent_us;
+} load_request_t;
+
+typedef struct {
+    int sock;
+    uint16_t next_tid;
+    uint32_t outstanding;
+    uint64_t sent_seq;          // Requests sent, for in-order checking
+    load_request_t requests[LOAD_MAX_DEPTH];
+    uint8_t rx[2 * LOAD_MAX_ADU];
+    size_t rx_len;
+} load_conn_t;
+
+typedef struct {
+    uint32_t sent;
+    uint32_t answered;
+    uint32_t exceptions;
+    uint32_t exception_codes[256];
+    uint32_t unmatched;         // Transaction ID of no outstanding request
+    uint32_t mismatched;        // Function code or unit not the request's
+    uint32_t out_of_order;      // Answered while an older request was still outstanding
+} load_stats_t;
+
+static int64_t load_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int load_compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t load_percentile(const uint32_t *sorted, size_t n, unsigned int percent)
+{
+    if (n == 0) {
+        return 0;
+    }
+    size_t index = (n * percent + 99) / 100;
+    return sorted[(index > 0 ? index : 1) - 1];
+}
+
+static int load_connect(const char *host, int port)
+{
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res = NULL;
+    char port_str[8];
+    snprintf(port_str, sizeof(port_str), "%d", port);
+    if (getaddrinfo(host, port_str, &hints, &res) != 0) {
+        return -1;
+    }
+
+    int sock = socket(res->ai_family, res->ai_socktype, 0);
+    if (sock >= 0 && connect(sock, res->ai_addr, res->ai_addrlen) != 0) {
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(res);
+    if (sock >= 0) {
+        int opt = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    }
+    return sock;
+}
+
+static void load_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -H host      server (default 127.0.0.1)\n"
+            "  -P port      server port (default %d)\n"
+            "  -c count     connections (default %d)\n"
+            "  -q depth     requests outstanding per connection (default %d)\n"
+            "  -n count     requests in total (default %d)\n"
+            "  -u unit      unit ID (default 1)\n"
+            "  -f fc        read function code (default 0x03)\n"
+            "  -r start     first register of the window (default 0)\n"
+            "  -k count     registers per read (default %d)\n"
+            "  -w regs      window of read start registers (default 0: always -r)\n"
+            "  -W rate      fraction of requests that are FC 0x06 writes (0-1)\n"
+            "  -S seed      request mix seed\n",
+            prog, LOAD_DEFAULT_PORT, LOAD_DEFAULT_CONNECTIONS, LOAD_DEFAULT_DEPTH,
+            LOAD_DEFAULT_REQUESTS, LOAD_DEFAULT_COUNT);
+}
+
+int main(int argc, char **argv)
+{
+    const char *host = "127.0.0.1";
+    int port = LOAD_DEFAULT_PORT;
+    int connections = LOAD_DEFAULT_CONNECTIONS;
+    int depth = LOAD_DEFAULT_DEPTH;
+    uint32_t total = LOAD_DEFAULT_REQUESTS;
+    uint8_t unit = 1;
+    uint8_t func_code = 0x03;
+    uint16_t start = 0;
+    uint16_t count = LOAD_DEFAULT_COUNT;
+    uint16_t window = 0;
+    double write_rate = 0.0;
+    unsigned int seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "H:P:c:q:n:u:f:r:k:w:W:S:h")) != -1) {
+        switch (opt) {
+            case 'H': host = optarg; break;
+            case 'P': port = atoi(optarg); break;
+            case 'c': connections = atoi(optarg); break;
+            case 'q': depth = atoi(optarg); break;
+            case 'n': total = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'u': unit = (uint8_t)strtoul(optarg, NULL, 0); break;
+            case 'f': func_code = (uint8_t)strtoul(optarg, NULL, 0); break;
+            case 'r': start = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'k': count = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'w': window = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'W': write_rate = atof(optarg); break;
+            case 'S': seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+            default:
+                load_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (connections < 1 || connections > LOAD_MAX_CONNECTIONS || depth < 1 ||
+        depth > LOAD_MAX_DEPTH || total == 0 || count == 0 || count > 125) {
+        load_usage(argv[0]);
+        return 2;
+    }
+
+    load_conn_t *conns = calloc(connections, sizeof(load_conn_t));
+    struct pollfd *fds = calloc(connections, sizeof(struct pollfd));
+    uint32_t *latencies = malloc(total * sizeof(uint32_t));
+    if (conns == NULL || fds == NULL || latencies == NULL) {
+        return 1;
+    }
+    for (int i = 0; i < connections; i++) {
+        conns[i].sock = load_connect(host, port);
+        if (conns[i].sock < 0) {
+            fprintf(stderr, "Cannot connect to %s:%d: %s\n", host, port, strerror(errno));
+            return 1;
+        }
+        conns[i].next_tid = (uint16_t)(i * 1000);
+    }
+
+    srand(seed);
+    load_stats_t stats = {0};
+    uint32_t ok = 0;
+    int64_t bench_start = load_now_us();
+    int64_t last_progress = bench_start;
+
+    while (stats.answered < stats.sent || stats.sent < total) {
+        // Top every connection up to the pipeline depth
+        for (int i = 0; i < connections && stats.sent < total; i++) {
+            load_conn_t *conn = &conns[i];
+            uint8_t out[LOAD_MBAP_SIZE * LOAD_MAX_DEPTH + 5 * LOAD_MAX_DEPTH];
+            size_t out_len = 0;
+
+            while ((int)conn->outstanding < depth && stats.sent < total) {
+                int slot = 0;
+                while (conn->requests[slot].in_use) {
+                    slot++;
+                }
+
+                bool write = write_rate > 0 && rand() < write_rate * ((double)RAND_MAX + 1);
+                uint16_t reg = start + (window > 0 ? (uint16_t)(rand() % window) : 0);
+                uint8_t fc = write ? 0x06 : func_code;
+                uint16_t value = write ? (uint16_t)rand() : count;
+
+                uint8_t *adu = &out[out_len];
+                uint16_t tid = conn->next_tid++;
+                adu[0] = (uint8_t)(tid >> 8);
+                adu[1] = (uint8_t)(tid & 0xFF);
+                adu[2] = 0;
+                adu[3] = 0;
+                adu[4] = 0;
+                adu[5] = 6;
+                adu[6] = unit;
+                adu[7] = fc;
+                adu[8] = (uint8_t)(reg >> 8);
+                adu[9] = (uint8_t)(reg & 0xFF);
+                adu[10] = (uint8_t)(value >> 8);
+                adu[11] = (uint8_t)(value & 0xFF);
+                out_len += 12;
+
+                conn->requests[slot] = (load_request_t){
+                    .in_use = true, .tid = tid, .func_code = fc, .sent_us = load_now_us(),
+                };
+                conn->outstanding++;
+                stats.sent++;
+            }
+
+            if (out_len > 0 && send(conn->sock, out, out_len, 0) != (ssize_t)out_len) {
+                fprintf(stderr, "Send failed: %s\n", strerror(errno));
+                return 1;
+            }
+        }
+
+        for (int i = 0; i < connections; i++) {
+            fds[i].fd = conns[i].sock;
+            fds[i].events = POLLIN;
+        }
+        int ready = poll(fds, connections, 100);
+        int64_t now = load_now_us();
+        if (ready == 0 && now - last_progress > (int64_t)LOAD_STALL_MS * 1000) {
+            fprintf(stderr, "No response for %d ms, giving up\n", LOAD_STALL_MS);
+            break;
+        }
+
+        for (int i = 0; i < connections && ready > 0; i++) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            load_conn_t *conn = &conns[i];
+            ssize_t n = recv(conn->sock, &conn->rx[conn->rx_len],
+                             sizeof(conn->rx) - conn->rx_len, 0);
+            if (n <= 0) {
+                fprintf(stderr, "Connection %d closed by the server\n", i);
+                return 1;
+            }
+            conn->rx_len += n;
+            now = load_now_us();
+
+            size_t offset = 0;
+            while (conn->rx_len - offset >= LOAD_MBAP_SIZE) {
+                const uint8_t *adu = &conn->rx[offset];
+                uint16_t tid = (uint16_t)((adu[0] << 8) | adu[1]);
+                size_t adu_len = 6 + (size_t)((adu[4] << 8) | adu[5]);
+                if (adu_len < LOAD_MBAP_SIZE + 1 || adu_len > LOAD_MAX_ADU) {
+                    fprintf(stderr, "Bad MBAP header on connection %d\n", i);
+                    return 1;
+                }
+                if (conn->rx_len - offset < adu_len) {
+                    break;
+                }
+                offset += adu_len;
+
+                load_request_t *request = NULL;
+                bool older = false;
+                for (int s = 0; s < depth; s++) {
+                    if (!conn->requests[s].in_use) {
+                        continue;
+                    }
+                    if (conn->requests[s].tid == tid) {
+                        request = &conn->requests[s];
+                    } else if ((int16_t)(conn->requests[s].tid - tid) < 0) {
+                        older = true;
+                    }
+                }
+                if (request == NULL) {
+                    stats.unmatched++;
+                    continue;
+                }
+
+                uint8_t fc = adu[7];
+                if (adu[6] != unit || (fc & 0x7F) != (request->func_code & 0x7F)) {
+                    stats.mismatched++;
+                } else if ((fc & 0x80) && adu_len == LOAD_MBAP_SIZE + 2) {
+                    // An exception PDU is two bytes; 0x88 and 0xFE responses have bit 7 set too
+                    stats.exceptions++;
+                    stats.exception_codes[adu[8]]++;
+                } else {
+                    latencies[ok++] = (uint32_t)(now - request->sent_us);
+                }
+                if (older) {
+                    stats.out_of_order++;
+                }
+                request->in_use = false;
+                conn->outstanding--;
+                stats.answered++;
+                last_progress = now;
+            }
+            memmove(conn->rx, &conn->rx[offset], conn->rx_len - offset);
+            conn->rx_len -= offset;
+        }
+    }
+
+    double elapsed_s = (load_now_us() - bench_start) / 1e6;
+    qsort(latencies, ok, sizeof(uint32_t), load_compare_u32);
+
+    printf("Modbus TCP load: %d connections x %d outstanding, %u requests "
+           "(FC 0x%02X %u registers, window %u, writes %.0f%%)\n",
+           connections, depth, stats.sent, func_code, count, window, 100.0 * write_rate);
+    printf("  throughput   %.1f requests/s\n", stats.answered / elapsed_s);
+    printf("  latency      p50 %u us, p99 %u us, max %u us\n",
+           load_percentile(latencies, ok, 50), load_percentile(latencies, ok, 99),
+           ok ? latencies[ok - 1] : 0);
+    printf("  answered     %u of %u, %u out of order, %u unmatched, %u mismatched\n",
+           stats.answered, stats.sent, stats.out_of_order, stats.unmatched, stats.mismatched);
+    printf("  exceptions   %u", stats.exceptions);
+    for (int code = 0; code < 256; code++) {
+        if (stats.exception_codes[code] > 0) {
+            printf(", 0x%02X x %u", code, stats.exception_codes[code]);
+        }
+    }
+    printf("\n");
+
+    for (int i = 0; i < connections; i++) {
+        close(conns[i].sock);
+    }
+    free(latencies);
+    free(fds);
+    free(conns);
+    return (stats.answered == stats.sent && stats.unmatched == 0 && stats.mismatched == 0) ? 0 : 1;
+}
@@ -0,0 +1,194 @@
+/**
+ * @file probe_bench.c
+ * @brief RS485 line probe against the virtual inverter at given settings
+ * 
+ * Runs the firmware's RS485 service and bus transaction engine on the host
+ * shims, with no line settings stored, so the service starts at 9600 8E1
+ * as on first boot. The virtual inverter answers only at the baud rate and
+ * parity given on the command line (strict_line). bus_task_probe_line()
+ * then searches from 115200 down; once it has stored a setting, a series
+ * of reads through bus_task_submit() checks that the line works at it.
+ * 
+ * Exits non-zero unless the probe found exactly the simulator's settings
+ * and every read afterwards was answered.
+ */
+
+#include "virtual_inverter.h"
+#include "esp_log.h"
+#include "driver/uart.h"
+#include "../../src/tasks/rs485_task.h"
+#include "../../src/tasks/bus_task.h"
+#include "../../src/protocol/line_probe.h"
+#include "../../src/protocol/function_codes.h"
+#include "../../src/config/param_manager.h"
+#include "../../src/utils/frame_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_BAUD_RATE     38400
+#define BENCH_DEFAULT_TURNAROUND_US 2000
+#define BENCH_DEFAULT_READS         20
+#define BENCH_PROBE_TIMEOUT_MS      30000
+#define BENCH_READ_TIMEOUT_MS       5000
+
+static volatile uint32_t s_answered;
+static volatile uint32_t s_finished;
+
+static int64_t bench_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief RS485 frame callback: every response belongs to the bus engine
+ */
+static void bench_on_frame(uint8_t *frame, size_t len)
+{
+    bus_task_on_frame(frame, len);
+}
+
+/**
+ * @brief Completion of a read after the probe
+ */
+static void bench_read_complete(const bus_result_t *result,
+                                const uint8_t *frame, size_t len, void *ctx)
+{
+    (void)frame;
+    (void)len;
+    (void)ctx;
+    if (result->status == ESP_OK) {
+        __atomic_add_fetch(&s_answered, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&s_finished, 1, __ATOMIC_RELEASE);
+}
+
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -b baud      simulator line speed (default %d)\n"
+            "  -p N|O|E     simulator parity (default N)\n"
+            "  -t us        simulator turnaround (default %d)\n"
+            "  -n reads     reads at the probed settings (default %d)\n"
+            "  -v           firmware log output\n",
+            prog, BENCH_DEFAULT_BAUD_RATE, BENCH_DEFAULT_TURNAROUND_US, BENCH_DEFAULT_READS);
+}
+
+int main(int argc, char **argv)
+{
+    vi_config_t config;
+    vi_config_default(&config);
+    config.baud_rate = BENCH_DEFAULT_BAUD_RATE;
+    config.parity = VI_PARITY_NONE;
+    config.turnaround_us = BENCH_DEFAULT_TURNAROUND_US;
+    config.strict_line = true;
+    unsigned int reads = BENCH_DEFAULT_READS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:p:t:n:vh")) != -1) {
+        switch (opt) {
+            case 'b': config.baud_rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'p':
+                if (vi_parse_parity(optarg, &config.parity) != 0) {
+                    bench_usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 't': config.turnaround_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'n': reads = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'v': host_log_set_level(ESP_LOG_INFO); break;
+            default:
+                bench_usage(argv[0]);
+                return 2;
+        }
+    }
+
+    virtual_inverter_t *vi = vi_create(&config);
+    if (vi == NULL) {
+        fprintf(stderr, "Cannot open a pseudo-terminal\n");
+        return 1;
+    }
+    if (vi_start(vi) != 0 || host_uart_bind(UART_NUM_2, vi_pty_path(vi)) != ESP_OK) {
+        fprintf(stderr, "Cannot connect to the simulator\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    // Nothing stored: the service comes up at its defaults and needs a probe
+    if (frame_pool_init() != ESP_OK || rs485_task_init() != ESP_OK) {
+        fprintf(stderr, "RS485 service failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+    rs485_task_set_callback(bench_on_frame);
+    if (bus_task_init() != ESP_OK) {
+        fprintf(stderr, "Bus engine failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    line_settings_t start;
+    rs485_task_get_line(&start);
+    printf("Simulator at %u baud parity %d; service starts at %u baud parity %d\n",
+           config.baud_rate, config.parity, start.baud_rate, start.parity);
+
+    int64_t probe_start = bench_now_ms();
+    bus_task_probe_line();
+    while (rs485_task_needs_probe() && bench_now_ms() - probe_start < BENCH_PROBE_TIMEOUT_MS) {
+        usleep(10000);
+    }
+    int64_t probe_ms = bench_now_ms() - probe_start;
+
+    line_settings_t line;
+    rs485_task_get_line(&line);
+    int32_t stored_baud = 0;
+    int32_t stored_parity = -1;
+    param_get_int(PARAM_ID_16, &stored_baud);
+    param_get_int(PARAM_ID_17, &stored_parity);
+    bool found = !rs485_task_needs_probe() && line.baud_rate == config.baud_rate &&
+                 (int)line.parity == (int)config.parity &&
+                 stored_baud == (int32_t)line.baud_rate && stored_parity == (int32_t)line.parity;
+    printf("Probe: %u baud parity %d after %lld ms (stored %ld, %ld): %s\n",
+           line.baud_rate, line.parity, (long long)probe_ms, (long)stored_baud,
+           (long)stored_parity, found ? "ok" : "WRONG SETTINGS");
+
+    // The line must work at what the probe stored, with nothing left over from the search
+    bus_request_t request = {
+        .slave_addr = config.slave_addr,
+        .func_code = MODBUS_FC_READ_HOLDING_REGISTERS,
+        .start = 0,
+        .count = 10,
+        .retries = 0,
+        .priority = BUS_CLASS_INTERACTIVE,
+        .local = true,
+        .callback = bench_read_complete,
+    };
+    int64_t read_start = bench_now_ms();
+    for (unsigned int i = 0; i < reads; i++) {
+        // One at a time: the class queue is shorter than a long run
+        request.start = (uint16_t)(i * 10);
+        if (bus_task_submit(&request) != ESP_OK) {
+            break;
+        }
+        while (__atomic_load_n(&s_finished, __ATOMIC_ACQUIRE) <= i &&
+               bench_now_ms() - read_start < BENCH_READ_TIMEOUT_MS) {
+            usleep(1000);
+        }
+    }
+    uint32_t answered = __atomic_load_n(&s_answered, __ATOMIC_RELAXED);
+    bool reads_ok = (answered == reads);
+    printf("Reads: %u of %u answered: %s\n", answered, reads, reads_ok ? "ok" : "FAILED");
+
+    vi_stats_t vi_stats;
+    vi_get_stats(vi, &vi_stats);
+    printf("Simulator: %u requests, %u responses, %u ignored at other line settings\n",
+           vi_stats.requests, vi_stats.responses, vi_stats.line_mismatches);
+
+    // Tasks are still running; leave the simulator to process exit
+    return (found && reads_ok) ? 0 : 1;
+}
@@ -0,0 +1,346 @@
+/**
+ * @file reassembler_bench.c
+ * @brief Protocol frame reassembly throughput of data_process_receive()
+ * 
+ * Builds a stream of 0xA1 0x1A frames with the firmware's own frame
+ * builders: heartbeats, get-param requests, set-param frames of up to 250
+ * values bytes and data transmission frames of 1 to 250 bytes, optionally
+ * with garbage between them. The stream is then fed to
+ * data_process_receive() the way a socket hands it over, and every
+ * delivered frame is counted. Reports frames/s and MB/s per row.
+ * 
+ * Fixed rows read the stream in reads of one size. Random rows draw every
+ * read size from 1 to a maximum with a seeded generator, so frame
+ * boundaries land anywhere: inside the length header, inside the CRC or
+ * between two frames in one read. Each random row first counts how many
+ * headers and CRCs its reads split.
+ * 
+ * Exits non-zero if any row delivers a different number of frames than
+ * were built, or reports a CRC error.
+ */
+
+#include "esp_log.h"
+#include "../../src/protocol/data_process.h"
+#include "../../src/protocol/function_codes.h"
+#include "../../src/utils/frame_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_FRAMES    10000
+#define BENCH_DEFAULT_MS        500     // Time spent on each row
+#define BENCH_DEFAULT_READS     "1,7,64,536,1460,16384"
+#define BENCH_DEFAULT_RANDOM    "32,1460"
+#define BENCH_DEFAULT_SEED      1
+#define BENCH_HEADER_LEN        21      // Bytes the reassembler needs to know the frame length
+#define BENCH_MAX_PAYLOAD       250
+#define BENCH_MAX_GARBAGE       8
+
+static uint8_t *s_stream;
+static size_t s_stream_len;
+static size_t s_stream_size;
+static uint32_t s_delivered;
+static size_t *s_frame_end;         // Stream offset just past each frame
+
+/**
+ * @brief Header and CRC splits made by the reads of one pass
+ */
+typedef struct {
+    uint32_t header;
+    uint32_t crc;
+} bench_splits_t;
+
+static int64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Data process send callback: append the built frame to the stream
+ */
+static void bench_append(const uint8_t *data, size_t len)
+{
+    if (s_stream_len + len > s_stream_size) {
+        size_t size = s_stream_size ? s_stream_size * 2 : 65536;
+        while (size < s_stream_len + len) {
+            size *= 2;
+        }
+        uint8_t *stream = realloc(s_stream, size);
+        if (stream == NULL) {
+            fprintf(stderr, "Out of memory building the stream\n");
+            exit(1);
+        }
+        s_stream = stream;
+        s_stream_size = size;
+    }
+    memcpy(s_stream + s_stream_len, data, len);
+    s_stream_len += len;
+}
+
+/**
+ * @brief Data process receive callback: one complete, CRC-checked frame
+ */
+static void bench_receive(const uint8_t *data, size_t len)
+{
+    s_delivered++;
+}
+
+/**
+ * @brief Build the stream of frames, with garbage between them if asked
+ * 
+ * Garbage never contains 0xA1, so it cannot start a false frame and the
+ * expected frame count stays exact.
+ */
+static int bench_build_stream(unsigned int frames, double garbage)
+{
+    s_frame_end = calloc(frames, sizeof(size_t));
+    data_process_handle_t builder = data_process_create(bench_append, NULL);
+    if (s_frame_end == NULL || builder == NULL) {
+        free(s_frame_end);
+        return -1;
+    }
+
+    uint8_t payload[4 + BENCH_MAX_PAYLOAD];
+    for (size_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)rand();
+    }
+
+    for (unsigned int i = 0; i < frames; i++) {
+        if (garbage > 0 && rand() < garbage * RAND_MAX) {
+            uint8_t noise[BENCH_MAX_GARBAGE];
+            size_t n = 1 + (size_t)rand() % BENCH_MAX_GARBAGE;
+            for (size_t j = 0; j < n; j++) {
+                noise[j] = (uint8_t)rand();
+                if (noise[j] == 0xA1) {
+                    noise[j] = 0x00;
+                }
+            }
+            bench_append(noise, n);
+        }
+
+        esp_err_t err;
+        switch (i % 5) {
+            case 0:
+                err = data_process_send(builder, PROTOCOL_FC_HEARTBEAT, NULL, 0);
+                break;
+            case 1:
+                // Get-param request: first and last ID only
+                err = data_process_send(builder, PROTOCOL_FC_GET_PARAM, payload, 4);
+                break;
+            case 2:
+                // Set-param: ID, then the values
+                err = data_process_send(builder, PROTOCOL_FC_SET_PARAM, payload,
+                                        2 + (size_t)rand() % BENCH_MAX_PAYLOAD);
+                break;
+            default:
+                err = data_process_send(builder, PROTOCOL_FC_DATA_TRANSMISSION, payload,
+                                        1 + (size_t)rand() % BENCH_MAX_PAYLOAD);
+                break;
+        }
+        if (err != ESP_OK) {
+            data_process_destroy(builder);
+            return -1;
+        }
+        s_frame_end[i] = s_stream_len;
+    }
+    data_process_destroy(builder);
+    return 0;
+}
+
+/**
+ * @brief Count the header or CRC a read boundary falls inside, if any
+ * 
+ * @param frame Index of the first frame not yet wholly before the boundary,
+ *              advanced as the boundaries move through the stream
+ */
+static void bench_count_split(size_t boundary, unsigned int frames, unsigned int *frame,
+                              bench_splits_t *splits)
+{
+    while (*frame < frames && s_frame_end[*frame] <= boundary) {
+        (*frame)++;
+    }
+    if (*frame == frames) {
+        return;
+    }
+
+    size_t end = s_frame_end[*frame];
+    size_t start = *frame > 0 ? s_frame_end[*frame - 1] : 0;
+    // Garbage before the frame is not part of it: find the magic
+    while (start < end && s_stream[start] != 0xA1) {
+        start++;
+    }
+    if (boundary > start && boundary < start + BENCH_HEADER_LEN) {
+        splits->header++;
+    } else if (boundary > end - 2) {
+        splits->crc++;
+    }
+}
+
+/**
+ * @brief Feed the whole stream once
+ * 
+ * @param read_size Size of every read, or the largest read if rng is set
+ * @param rng       Generator state for random read sizes, NULL for fixed
+ * @param splits    Where to count header and CRC splits, NULL to skip
+ * @return true if every frame was delivered and none failed its CRC
+ */
+static bool bench_feed(data_process_handle_t handle, size_t read_size, unsigned int *rng,
+                       unsigned int frames, bench_splits_t *splits)
+{
+    data_process_rx_stats_t before;
+    data_process_rx_stats_t after;
+    data_process_get_rx_stats(handle, &before);
+    s_delivered = 0;
+    unsigned int frame = 0;
+
+    for (size_t pos = 0; pos < s_stream_len;) {
+        size_t n = rng != NULL ? 1 + (size_t)rand_r(rng) % read_size : read_size;
+        if (n > s_stream_len - pos) {
+            n = s_stream_len - pos;
+        }
+        data_process_receive(handle, s_stream + pos, n);
+        pos += n;
+        if (splits != NULL) {
+            bench_count_split(pos, frames, &frame, splits);
+        }
+    }
+
+    data_process_get_rx_stats(handle, &after);
+    return s_delivered == frames && after.crc_errors == before.crc_errors &&
+           after.pending_bytes == 0;
+}
+
+/**
+ * @brief Feed the stream for the run time and print one row
+ * 
+ * @param random Draw read sizes from 1 to read_size, seeded with seed
+ * @return true if every pass delivered every frame
+ */
+static bool bench_row(data_process_handle_t handle, size_t read_size, bool random,
+                      unsigned int seed, unsigned int frames, unsigned int run_ms)
+{
+    unsigned int rng = seed;
+    unsigned int *rngp = random ? &rng : NULL;
+    bench_splits_t splits = {0};
+    bool ok = true;
+    if (random) {
+        // Untimed first pass: where the reads split headers and CRCs
+        ok = bench_feed(handle, read_size, rngp, frames, &splits);
+    }
+
+    unsigned int passes = 0;
+    int64_t start_ns = bench_now_ns();
+    int64_t elapsed_ns;
+    do {
+        ok = bench_feed(handle, read_size, rngp, frames, NULL) && ok;
+        passes++;
+        elapsed_ns = bench_now_ns() - start_ns;
+    } while (elapsed_ns < (int64_t)run_ms * 1000000);
+
+    char label[24];
+    if (random) {
+        snprintf(label, sizeof(label), "1-%zu", read_size);
+    } else {
+        snprintf(label, sizeof(label), "%zu", read_size);
+    }
+    double seconds = elapsed_ns / 1e9;
+    printf("%7s %9u %12.0f %9.1f  %s", label, passes, (double)frames * passes / seconds,
+           (double)s_stream_len * passes / seconds / 1e6, ok ? "ok" : "FRAMES LOST");
+    if (random) {
+        printf(" (%u headers, %u CRCs split)", splits.header, splits.crc);
+    }
+    printf("\n");
+    return ok;
+}
+
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -n frames    frames in the stream (default %d)\n"
+            "  -r list      read sizes in bytes, comma separated (default %s)\n"
+            "  -R list      largest random read sizes, comma separated (default %s)\n"
+            "  -s seed      random read size seed (default %d)\n"
+            "  -g fraction  frames preceded by garbage bytes (default 0)\n"
+            "  -m ms        time spent on each row (default %d)\n",
+            prog, BENCH_DEFAULT_FRAMES, BENCH_DEFAULT_READS, BENCH_DEFAULT_RANDOM,
+            BENCH_DEFAULT_SEED, BENCH_DEFAULT_MS);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int frames = BENCH_DEFAULT_FRAMES;
+    unsigned int run_ms = BENCH_DEFAULT_MS;
+    double garbage = 0;
+    unsigned int seed = BENCH_DEFAULT_SEED;
+    char reads_arg[128];
+    char random_arg[128];
+    snprintf(reads_arg, sizeof(reads_arg), "%s", BENCH_DEFAULT_READS);
+    snprintf(random_arg, sizeof(random_arg), "%s", BENCH_DEFAULT_RANDOM);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:R:s:g:m:h")) != -1) {
+        switch (opt) {
+            case 'n': frames = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'r':
+                snprintf(reads_arg, sizeof(reads_arg), "%s", optarg);
+                break;
+            case 'R':
+                snprintf(random_arg, sizeof(random_arg), "%s", optarg);
+                break;
+            case 's': seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'g': garbage = atof(optarg); break;
+            case 'm': run_ms = (unsigned int)strtoul(optarg, NULL, 0); break;
+            default:
+                bench_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (frames == 0 || run_ms == 0 || garbage < 0 || garbage > 1) {
+        bench_usage(argv[0]);
+        return 2;
+    }
+
+    srand(1);
+    if (frame_pool_init() != ESP_OK || bench_build_stream(frames, garbage) != 0) {
+        fprintf(stderr, "Cannot build the frame stream\n");
+        return 1;
+    }
+    data_process_handle_t handle = data_process_create(NULL, bench_receive);
+    if (handle == NULL) {
+        fprintf(stderr, "Cannot create the receive handle\n");
+        return 1;
+    }
+
+    printf("%u frames, %zu bytes, %.0f%% preceded by garbage\n", frames, s_stream_len,
+           garbage * 100);
+    printf("   read    passes     frames/s      MB/s  result\n");
+
+    int status = 0;
+    char *lists[] = { reads_arg, random_arg };
+    for (int random = 0; random < 2; random++) {
+        char *saveptr = NULL;
+        for (char *item = strtok_r(lists[random], ",", &saveptr); item != NULL;
+             item = strtok_r(NULL, ",", &saveptr)) {
+            size_t read_size = strtoul(item, NULL, 0);
+            if (read_size == 0) {
+                continue;
+            }
+            if (!bench_row(handle, read_size, random, seed, frames, run_ms)) {
+                status = 1;
+            }
+        }
+    }
+
+    data_process_rx_stats_t stats;
+    data_process_get_rx_stats(handle, &stats);
+    printf("Receiver: %u frames, %u CRC errors, %u bytes discarded resyncing\n",
+           stats.frames, stats.crc_errors, stats.discarded_bytes);
+    return status;
+}
@@ -0,0 +1,327 @@
+/**
+ * @file retry_bench.c
+ * @brief Exception retry policy of the bus engine against the virtual inverter
+ * 
+ * Runs the firmware's RS485 service and bus transaction engine on the host
+ * shims against a simulator that answers a share of requests with a busy
+ * exception (0x06). Reads go through bus_task_submit() one at a time and
+ * each completion is recorded: status, exception code and attempts. Then
+ * reads past the end of the register bank check that an illegal address
+ * (0x02) is never retried: the only retries they may take are after the
+ * busy exceptions the simulator still mixes in.
+ * 
+ * The pseudo-terminal is not a quiet line: when the simulator thread is
+ * descheduled part way through a response, the framer takes the pause for
+ * the end of the frame and the response is lost, as rs485_bench reports.
+ * Such reads time out (timeout retries are off); they are counted as lost
+ * and only the checks that hold regardless are applied to them.
+ * 
+ * Exits non-zero unless:
+ * - every read completed with its response, a final busy exception or,
+ *   for at most BENCH_MAX_LOST_PERCENT of them, a lost response
+ * - a read that ended busy used every attempt the busy policy allows, and
+ *   no read used more
+ * - the engine's retry counters match the attempts the requesters saw, and
+ *   every busy exception the engine counted was either retried or ended
+ *   its read
+ * - every illegal-address read ended with exception 0x02 (or busy, or
+ *   lost), with no retry beyond one per busy exception
+ */
+
+#include "virtual_inverter.h"
+#include "esp_log.h"
+#include "driver/uart.h"
+#include "../../src/tasks/rs485_task.h"
+#include "../../src/tasks/bus_task.h"
+#include "../../src/protocol/function_codes.h"
+#include "../../src/config/param_manager.h"
+#include "../../src/utils/frame_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_BAUD_RATE     38400
+#define BENCH_DEFAULT_TURNAROUND_US 2000
+#define BENCH_DEFAULT_READS         200
+#define BENCH_DEFAULT_BUSY_RATE     0.3
+#define BENCH_ILLEGAL_READS         10
+#define BENCH_ILLEGAL_START         0xFFFB  // Read runs past the simulator's 64K bank
+#define BENCH_BUSY_RETRIES          3       // Busy policy in bus_task.c
+#define BENCH_READ_TIMEOUT_MS       5000
+#define BENCH_RESPONSE_TIMEOUT_MS   200     // Per attempt, well past any host scheduling delay
+#define BENCH_MAX_LOST_PERCENT      25      // More lost responses leave too few to judge the policy
+#define BENCH_READ_COUNT            10
+
+typedef struct {
+    esp_err_t status;
+    uint8_t exception_code;
+    uint8_t attempts;
+    uint32_t latency_us;
+} bench_result_t;
+
+static bench_result_t *s_results;
+static volatile uint32_t s_finished;
+
+static int64_t bench_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @brief RS485 frame callback: every response belongs to the bus engine
+ */
+static void bench_on_frame(uint8_t *frame, size_t len)
+{
+    bus_task_on_frame(frame, len);
+}
+
+/**
+ * @brief Completion of one read: record how it ended
+ */
+static void bench_read_complete(const bus_result_t *result,
+                                const uint8_t *frame, size_t len, void *ctx)
+{
+    (void)frame;
+    (void)len;
+    bench_result_t *slot = &s_results[(uintptr_t)ctx];
+    slot->status = result->status;
+    slot->exception_code = result->exception_code;
+    slot->attempts = result->attempts;
+    slot->latency_us = result->latency_us;
+    __atomic_add_fetch(&s_finished, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Submit reads one at a time and wait for each to complete
+ * 
+ * One at a time: the class queue is shorter than a long run.
+ * 
+ * @return Reads that completed
+ */
+static uint32_t bench_run(uint8_t slave_addr, uint16_t start, uint16_t step,
+                          uint32_t first, uint32_t reads)
+{
+    bus_request_t request = {
+        .slave_addr = slave_addr,
+        .func_code = MODBUS_FC_READ_HOLDING_REGISTERS,
+        .count = BENCH_READ_COUNT,
+        .timeout_ms = BENCH_RESPONSE_TIMEOUT_MS,
+        .retries = 0,
+        .priority = BUS_CLASS_INTERACTIVE,
+        .local = true,
+        .callback = bench_read_complete,
+    };
+    for (uint32_t i = 0; i < reads; i++) {
+        request.start = (uint16_t)(start + i * step);
+        request.ctx = (void *)(uintptr_t)(first + i);
+        if (bus_task_submit(&request) != ESP_OK) {
+            break;
+        }
+        int64_t read_start = bench_now_ms();
+        while (__atomic_load_n(&s_finished, __ATOMIC_ACQUIRE) <= first + i &&
+               bench_now_ms() - read_start < BENCH_READ_TIMEOUT_MS) {
+            usleep(1000);
+        }
+    }
+    return __atomic_load_n(&s_finished, __ATOMIC_ACQUIRE) - first;
+}
+
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -n reads     reads against the busy slave (default %d)\n"
+            "  -B rate      busy exception rate (0-1, default %.1f)\n"
+            "  -b baud      line speed (default %d)\n"
+            "  -t us        simulator turnaround (default %d)\n"
+            "  -S seed      fault injection seed\n"
+            "  -v           firmware log output\n",
+            prog, BENCH_DEFAULT_READS, BENCH_DEFAULT_BUSY_RATE, BENCH_DEFAULT_BAUD_RATE,
+            BENCH_DEFAULT_TURNAROUND_US);
+}
+
+int main(int argc, char **argv)
+{
+    vi_config_t config;
+    vi_config_default(&config);
+    config.baud_rate = BENCH_DEFAULT_BAUD_RATE;
+    config.turnaround_us = BENCH_DEFAULT_TURNAROUND_US;
+    config.busy_rate = BENCH_DEFAULT_BUSY_RATE;
+    uint32_t reads = BENCH_DEFAULT_READS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:B:b:t:S:vh")) != -1) {
+        switch (opt) {
+            case 'n': reads = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'B': config.busy_rate = atof(optarg); break;
+            case 'b': config.baud_rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 't': config.turnaround_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'S': config.seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'v': host_log_set_level(ESP_LOG_INFO); break;
+            default:
+                bench_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (reads == 0 || config.busy_rate < 0 || config.busy_rate >= 1) {
+        bench_usage(argv[0]);
+        return 2;
+    }
+
+    s_results = calloc(reads + BENCH_ILLEGAL_READS, sizeof(bench_result_t));
+    if (s_results == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return 1;
+    }
+
+    virtual_inverter_t *vi = vi_create(&config);
+    if (vi == NULL) {
+        fprintf(stderr, "Cannot open a pseudo-terminal\n");
+        return 1;
+    }
+    if (vi_start(vi) != 0 || host_uart_bind(UART_NUM_2, vi_pty_path(vi)) != ESP_OK) {
+        fprintf(stderr, "Cannot connect to the simulator\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    param_set_int(PARAM_ID_16, (int32_t)config.baud_rate);
+    param_set_int(PARAM_ID_17, (int32_t)config.parity);
+    if (frame_pool_init() != ESP_OK || rs485_task_init() != ESP_OK) {
+        fprintf(stderr, "RS485 service failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+    rs485_task_set_callback(bench_on_frame);
+    if (bus_task_init() != ESP_OK) {
+        fprintf(stderr, "Bus engine failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    printf("%u reads at %u baud, %.0f%% answered busy, busy retried up to %d times\n",
+           reads, config.baud_rate, config.busy_rate * 100, BENCH_BUSY_RETRIES);
+
+    uint32_t completed = bench_run(config.slave_addr, 0, BENCH_READ_COUNT, 0, reads);
+
+    uint32_t ok = 0;
+    uint32_t final_busy = 0;
+    uint32_t lost = 0;
+    uint32_t other = 0;
+    uint32_t bad_attempts = 0;
+    uint32_t seen_retries = 0;
+    uint32_t attempt_counts[BENCH_BUSY_RETRIES + 2] = {0};
+    for (uint32_t i = 0; i < completed; i++) {
+        const bench_result_t *r = &s_results[i];
+        bool attempts_ok;
+        if (r->status == ESP_OK) {
+            // A response may come on any attempt the policy allows
+            ok++;
+            attempts_ok = r->attempts <= 1 + BENCH_BUSY_RETRIES;
+        } else if (r->status == ESP_ERR_INVALID_RESPONSE &&
+                   r->exception_code == MODBUS_EXC_SLAVE_BUSY) {
+            // Busy to the end means every attempt
+            final_busy++;
+            attempts_ok = r->attempts == 1 + BENCH_BUSY_RETRIES;
+        } else if (r->status == ESP_ERR_TIMEOUT) {
+            // Response lost on the host line, after any busy retries
+            lost++;
+            attempts_ok = r->attempts <= 1 + BENCH_BUSY_RETRIES;
+        } else {
+            other++;
+            attempts_ok = true;
+        }
+        if (!attempts_ok || r->attempts == 0) {
+            bad_attempts++;
+        }
+        seen_retries += (r->attempts > 0) ? r->attempts - 1u : 0u;
+        attempt_counts[r->attempts <= BENCH_BUSY_RETRIES + 1 ? r->attempts
+                                                            : BENCH_BUSY_RETRIES + 1]++;
+    }
+
+    bus_task_stats_t busy_stats;
+    bus_task_get_stats(&busy_stats);
+    vi_stats_t vi_stats;
+    vi_get_stats(vi, &vi_stats);
+    const bus_slave_stats_t *slave = &busy_stats.slaves[0];
+    uint32_t busy_seen = slave->exception_codes[MODBUS_EXC_SLAVE_BUSY];
+
+    // Every busy exception the engine got was either retried or ended its read
+    bool counters_ok = busy_stats.exception_retries == seen_retries &&
+                       slave->exception_retries == seen_retries &&
+                       busy_seen == seen_retries + final_busy &&
+                       busy_seen <= vi_stats.busy && vi_stats.busy - busy_seen <= lost;
+    bool lost_ok = lost * 100 <= reads * BENCH_MAX_LOST_PERCENT;
+    bool busy_ok = completed == reads && other == 0 && bad_attempts == 0 && counters_ok &&
+                   lost_ok;
+
+    printf("Busy slave\n");
+    printf("  completed    %u of %u: %u ok, %u busy after every attempt, %u lost, %u other\n",
+           completed, reads, ok, final_busy, lost, other);
+    printf("  attempts     1: %u, 2: %u, 3: %u, 4: %u (%u out of policy)\n",
+           attempt_counts[1], attempt_counts[2], attempt_counts[3], attempt_counts[4],
+           bad_attempts);
+    printf("  retries      %u seen by requesters, engine %u, slave %u\n",
+           seen_retries, busy_stats.exception_retries, slave->exception_retries);
+    printf("  busy         %u sent by the simulator, %u counted by the engine\n",
+           vi_stats.busy, busy_seen);
+    printf("  expected     %.1f busy after every attempt (rate^%d * reads)\n",
+           pow(config.busy_rate, BENCH_BUSY_RETRIES + 1) * reads, BENCH_BUSY_RETRIES + 1);
+    printf("  result       %s\n",
+           busy_ok ? "ok" : !lost_ok ? "FAILED (host line lost too many responses)" : "FAILED");
+
+    // Past the end of the bank: the same answer every time, so never retried
+    uint32_t illegal_completed = bench_run(config.slave_addr, BENCH_ILLEGAL_START, 0,
+                                           reads, BENCH_ILLEGAL_READS);
+    uint32_t illegal = 0;
+    uint32_t illegal_busy = 0;
+    uint32_t illegal_lost = 0;
+    uint32_t illegal_first = 0;
+    uint32_t illegal_max_us = 0;
+    for (uint32_t i = 0; i < illegal_completed; i++) {
+        const bench_result_t *r = &s_results[reads + i];
+        if (r->status == ESP_ERR_INVALID_RESPONSE &&
+            r->exception_code == MODBUS_EXC_ILLEGAL_ADDRESS) {
+            illegal++;
+            if (r->attempts == 1) {
+                illegal_first++;
+                if (r->latency_us > illegal_max_us) {
+                    illegal_max_us = r->latency_us;
+                }
+            }
+        } else if (r->status == ESP_ERR_INVALID_RESPONSE &&
+                   r->exception_code == MODBUS_EXC_SLAVE_BUSY) {
+            illegal_busy++;
+        } else if (r->status == ESP_ERR_TIMEOUT) {
+            illegal_lost++;
+        }
+    }
+
+    bus_task_stats_t illegal_stats;
+    bus_task_get_stats(&illegal_stats);
+    uint32_t phase_retries = illegal_stats.exception_retries - busy_stats.exception_retries;
+    uint32_t phase_busy = illegal_stats.slaves[0].exception_codes[MODBUS_EXC_SLAVE_BUSY] -
+                          busy_seen;
+    // Each busy answer was retried or ended its read; a retried 0x02 would add one
+    bool illegal_pass = illegal_completed == BENCH_ILLEGAL_READS &&
+                        illegal + illegal_busy + illegal_lost == BENCH_ILLEGAL_READS &&
+                        phase_retries + illegal_busy == phase_busy &&
+                        illegal_lost <= (BENCH_ILLEGAL_READS * BENCH_MAX_LOST_PERCENT + 99) / 100;
+
+    printf("Illegal address\n");
+    printf("  completed    %u of %u with exception 0x02 (%u on the first attempt, max %u us), "
+           "%u busy, %u lost\n",
+           illegal, BENCH_ILLEGAL_READS, illegal_first, illegal_max_us, illegal_busy,
+           illegal_lost);
+    printf("  retries      %u, after %u busy exceptions\n", phase_retries, phase_busy);
+    printf("  result       %s\n", illegal_pass ? "ok" : "FAILED");
+
+    // Tasks are still running; leave the simulator to process exit
+    return (busy_ok && illegal_pass) ? 0 : 1;
+}
@@ -0,0 +1,307 @@
+/**
+ * @file rs485_bench.c
+ * @brief RS485 service benchmark against the virtual inverter
+ * 
+ * Runs the firmware's RS485 service (rs485_task.c with the Modbus framer)
+ * on the host UART shim, bound to a virtual inverter's pty, and issues
+ * back-to-back register reads. Each read waits for its response or a
+ * timeout before the next goes out, as the bus task does. Reports
+ * transactions per second, latency percentiles (send to frame callback)
+ * and frame loss, alongside the turnaround the service measured.
+ */
+
+#include "virtual_inverter.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+#include "../../src/tasks/rs485_task.h"
+#include "../../src/protocol/modbus_protocol.h"
+#include "../../src/config/param_manager.h"
+#include "../../src/utils/frame_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define BENCH_DEFAULT_TRANSACTIONS  1000
+#define BENCH_DEFAULT_BAUD_RATE     115200
+#define BENCH_DEFAULT_TURNAROUND_US 2000
+#define BENCH_DEFAULT_COUNT         10
+#define BENCH_TIMEOUT_MARGIN_MS     50  // Response wait beyond the modelled transaction
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t arrived;
+    bool waiting;
+    bool done;
+    int64_t arrived_us;
+    uint8_t frame[VI_MAX_FRAME];
+    size_t len;
+    uint32_t stray;             // Frames that arrived with no read waiting
+} bench_slot_t;
+
+static bench_slot_t s_slot = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/**
+ * @brief RS485 frame callback: hand the response to the waiting read
+ */
+static void bench_on_frame(uint8_t *frame, size_t len)
+{
+    int64_t now = esp_timer_get_time();
+    pthread_mutex_lock(&s_slot.lock);
+    if (s_slot.waiting && !s_slot.done && len <= sizeof(s_slot.frame)) {
+        memcpy(s_slot.frame, frame, len);
+        s_slot.len = len;
+        s_slot.arrived_us = now;
+        s_slot.done = true;
+        pthread_cond_signal(&s_slot.arrived);
+    } else {
+        s_slot.stray++;
+    }
+    pthread_mutex_unlock(&s_slot.lock);
+}
+
+static int bench_compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t bench_percentile(const uint32_t *sorted, size_t n, unsigned int percent)
+{
+    if (n == 0) {
+        return 0;
+    }
+    size_t index = (n * percent + 99) / 100;
+    return sorted[(index > 0 ? index : 1) - 1];
+}
+
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -n count     transactions (default %d)\n"
+            "  -b baud      line speed (default %d)\n"
+            "  -p N|O|E     parity (default E)\n"
+            "  -f fc        read function code (default 0x03)\n"
+            "  -r start     first register (default 0)\n"
+            "  -q count     registers per read (default %d)\n"
+            "  -t us        simulator turnaround (default %d)\n"
+            "  -j us        simulator turnaround jitter\n"
+            "  -c rate      corrupted CRC rate (0-1)\n"
+            "  -N rate      noise burst rate (0-1)\n"
+            "  -d rate      unanswered request rate (0-1)\n"
+            "  -s rate      split response rate (0-1)\n"
+            "  -B rate      busy exception rate (0-1)\n"
+            "  -g us        pause inside a split response (default 1000)\n"
+            "  -m file      register map\n"
+            "  -S seed      fault injection seed\n"
+            "  -v           service log output\n",
+            prog, BENCH_DEFAULT_TRANSACTIONS, BENCH_DEFAULT_BAUD_RATE, BENCH_DEFAULT_COUNT,
+            BENCH_DEFAULT_TURNAROUND_US);
+}
+
+int main(int argc, char **argv)
+{
+    vi_config_t config;
+    vi_config_default(&config);
+    config.baud_rate = BENCH_DEFAULT_BAUD_RATE;
+    config.turnaround_us = BENCH_DEFAULT_TURNAROUND_US;
+
+    uint32_t transactions = BENCH_DEFAULT_TRANSACTIONS;
+    uint8_t func_code = 0x03;
+    uint16_t start = 0;
+    uint16_t count = BENCH_DEFAULT_COUNT;
+    const char *map_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:b:p:f:r:q:t:j:c:N:d:s:B:g:m:S:vh")) != -1) {
+        switch (opt) {
+            case 'n': transactions = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'b': config.baud_rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'p':
+                if (vi_parse_parity(optarg, &config.parity) != 0) {
+                    bench_usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'f': func_code = (uint8_t)strtoul(optarg, NULL, 0); break;
+            case 'r': start = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'q': count = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 't': config.turnaround_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'j': config.turnaround_jitter_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'c': config.crc_error_rate = atof(optarg); break;
+            case 'N': config.noise_rate = atof(optarg); break;
+            case 'd': config.drop_rate = atof(optarg); break;
+            case 's': config.split_rate = atof(optarg); break;
+            case 'B': config.busy_rate = atof(optarg); break;
+            case 'g': config.split_gap_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'm': map_path = optarg; break;
+            case 'S': config.seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'v': host_log_set_level(ESP_LOG_INFO); break;
+            default:
+                bench_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (transactions == 0 || count == 0 || count > VI_MAX_READ_REGISTERS) {
+        bench_usage(argv[0]);
+        return 2;
+    }
+
+    virtual_inverter_t *vi = vi_create(&config);
+    if (vi == NULL) {
+        fprintf(stderr, "Cannot open a pseudo-terminal\n");
+        return 1;
+    }
+    if (map_path != NULL && vi_load_map(vi, map_path) != 0) {
+        fprintf(stderr, "Cannot load register map %s\n", map_path);
+        vi_destroy(vi);
+        return 1;
+    }
+    if (vi_start(vi) != 0 || host_uart_bind(UART_NUM_2, vi_pty_path(vi)) != ESP_OK) {
+        fprintf(stderr, "Cannot connect to the simulator\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    // The service reads its line settings from parameters 16 and 17
+    param_set_int(PARAM_ID_16, (int32_t)config.baud_rate);
+    param_set_int(PARAM_ID_17, (int32_t)config.parity);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_slot.arrived, &attr);
+    pthread_condattr_destroy(&attr);
+
+    if (frame_pool_init() != ESP_OK || rs485_task_init() != ESP_OK) {
+        fprintf(stderr, "RS485 service failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+    rs485_task_set_callback(bench_on_frame);
+
+    // Modelled transaction: request, turnaround, response
+    rs485_timing_t timing;
+    rs485_task_get_timing(&timing);
+    uint32_t model_us = (8 + 5 + 2 * (uint32_t)count) * timing.char_us +
+                        config.turnaround_us + config.turnaround_jitter_us;
+    uint32_t timeout_ms = model_us / 1000 + BENCH_TIMEOUT_MARGIN_MS;
+
+    uint32_t *latencies = malloc(transactions * sizeof(uint32_t));
+    if (latencies == NULL) {
+        vi_destroy(vi);
+        return 1;
+    }
+
+    uint8_t body[4] = {
+        (uint8_t)(start >> 8), (uint8_t)(start & 0xFF),
+        (uint8_t)(count >> 8), (uint8_t)(count & 0xFF),
+    };
+    uint8_t request[16];
+    uint16_t request_len = 0;
+    modbus_build_frame(request, sizeof(request), config.slave_addr, func_code,
+                       body, sizeof(body), &request_len);
+
+    uint32_t ok = 0;
+    uint32_t lost = 0;
+    uint32_t wrong = 0;
+    uint32_t exceptions = 0;
+    int64_t bench_start = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < transactions; i++) {
+        pthread_mutex_lock(&s_slot.lock);
+        s_slot.waiting = true;
+        s_slot.done = false;
+        pthread_mutex_unlock(&s_slot.lock);
+
+        int64_t sent_us = esp_timer_get_time();
+        if (rs485_task_send_frame(request, request_len) != ESP_OK) {
+            lost++;
+            continue;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_mutex_lock(&s_slot.lock);
+        while (!s_slot.done) {
+            if (pthread_cond_timedwait(&s_slot.arrived, &s_slot.lock, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+        s_slot.waiting = false;
+        bool done = s_slot.done;
+        pthread_mutex_unlock(&s_slot.lock);
+
+        if (!done) {
+            lost++;
+            continue;
+        }
+
+        if (s_slot.len == 5 && s_slot.frame[1] == (func_code | 0x80)) {
+            exceptions++;
+            continue;
+        }
+
+        // Check the response carries the simulator's register values
+        bool match = s_slot.len == 5 + 2 * (size_t)count && s_slot.frame[1] == func_code &&
+                     s_slot.frame[2] == 2 * count;
+        for (uint16_t r = 0; match && r < count; r++) {
+            uint16_t value = (uint16_t)((s_slot.frame[3 + 2 * r] << 8) | s_slot.frame[4 + 2 * r]);
+            match = (value == vi_get_register(vi, func_code, (uint16_t)(start + r)));
+        }
+        if (!match) {
+            wrong++;
+            continue;
+        }
+        latencies[ok++] = (uint32_t)(s_slot.arrived_us - sent_us);
+    }
+
+    double elapsed_s = (esp_timer_get_time() - bench_start) / 1e6;
+    qsort(latencies, ok, sizeof(uint32_t), bench_compare_u32);
+
+    rs485_rx_stats_t rx_stats;
+    vi_stats_t vi_stats;
+    rs485_task_get_timing(&timing);
+    rs485_task_get_rx_stats(&rx_stats);
+    vi_get_stats(vi, &vi_stats);
+
+    printf("RS485 benchmark: %u x FC 0x%02X %u registers, %u baud parity %d, "
+           "turnaround %u us\n", transactions, func_code, count, config.baud_rate,
+           config.parity, config.turnaround_us);
+    printf("  throughput   %.1f transactions/s (modelled best %.1f)\n",
+           ok / elapsed_s, 1e6 / model_us);
+    printf("  latency      p50 %u us, p99 %u us, max %u us\n",
+           bench_percentile(latencies, ok, 50), bench_percentile(latencies, ok, 99),
+           ok ? latencies[ok - 1] : 0);
+    printf("  frame loss   %u lost, %u wrong of %u (%.2f%%), %u stray, %u exceptions\n",
+           lost, wrong, transactions, 100.0 * (lost + wrong) / transactions, s_slot.stray,
+           exceptions);
+    printf("  turnaround   measured avg %u us, dev %u us, max %u us (%u samples)\n",
+           timing.turnaround_avg_us, timing.turnaround_dev_us, timing.turnaround_max_us,
+           timing.samples);
+    printf("  rx events    %u (%u idle), %u exceptions, dropped partial %u, overflows %u\n",
+           rx_stats.events, rx_stats.idle_events, rx_stats.exceptions, rx_stats.dropped_partial,
+           rx_stats.fifo_overflows + rx_stats.buffer_full);
+    printf("  simulator    %u requests, %u responses, %u bad\n",
+           vi_stats.requests, vi_stats.responses, vi_stats.bad_requests);
+    printf("  injected     corrupted %u, noise %u, dropped %u, split %u, busy %u\n",
+           vi_stats.corrupted, vi_stats.noise, vi_stats.dropped, vi_stats.split,
+           vi_stats.busy);
+
+    free(latencies);
+    return (ok > 0) ? 0 : 1;
+}
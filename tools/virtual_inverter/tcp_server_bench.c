@@ -0,0 +1,510 @@
+/**
+ * @file tcp_server_bench.c
+ * @brief Local TCP server connection-scaling benchmark
+ * 
+ * Runs the firmware's TCP server (one select() event loop) with the RS485
+ * service, bus transaction engine and register cache on the host shims,
+ * against a virtual inverter. For each step it opens that many client
+ * connections, keeps one register read outstanding on each for a fixed
+ * time and reports requests per second and latency percentiles. Steps
+ * past TCP_SERVER_MAX_CLIENTS show the extra connections being refused.
+ * 
+ * Heap in use is sampled before each step's connections are opened and
+ * once the server has accepted them, with every thread on one malloc arena, so the difference is
+ * the server's cost per connection. Client frames are built and parsed
+ * with the firmware's own data process module.
+ * 
+ * With -P, a thread publishes telemetry blocks at the given rate and every
+ * client subscribes to them; -s makes that many of each step's clients
+ * subscribe and then stop reading, to show them being dropped without
+ * slowing the others. The per-client queue statistics of the last step
+ * are printed at the end.
+ */
+
+#include "virtual_inverter.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+#include "../../src/tasks/rs485_task.h"
+#include "../../src/tasks/bus_task.h"
+#include "../../src/tasks/tcp_server_task.h"
+#include "../../src/protocol/data_process.h"
+#include "../../src/protocol/register_cache.h"
+#include "../../src/protocol/device_routes.h"
+#include "../../src/config/param_manager.h"
+#include "../../src/utils/frame_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <signal.h>
+
+#define BENCH_DEFAULT_BAUD_RATE     115200
+#define BENCH_DEFAULT_TURNAROUND_US 2000
+#define BENCH_DEFAULT_STEP_MS       2000
+#define BENCH_DEFAULT_COUNT         10
+#define BENCH_MAX_CONNECTIONS       64
+#define BENCH_MAX_SAMPLES           200000
+#define BENCH_SETTLE_MS             2000    // Wait for the server to see closed connections
+#define BENCH_RECV_SIZE             2048
+#define BENCH_TELEMETRY_REGISTERS   60      // Block size, distinct from any read's
+#define BENCH_ANSWER_TIMEOUT_MS     2000    // Read given up and sent again; the server
+                                            // does not answer a read the slave refused
+
+typedef struct {
+    int sock;
+    bool open;
+    bool waiting;
+    bool answered;
+    bool slow;                  // Subscribes, then never reads
+    int64_t sent_us;
+    data_process_handle_t handle;
+} bench_conn_t;
+
+typedef struct {
+    uint32_t requests;
+    uint32_t refused;           // Connections the server closed before answering
+    uint32_t unanswered;        // Reads given up after BENCH_ANSWER_TIMEOUT_MS
+    uint32_t telemetry;         // Telemetry frames received
+    uint32_t samples;
+    uint32_t latency_us[BENCH_MAX_SAMPLES];
+} bench_step_t;
+
+static bench_conn_t s_conns[BENCH_MAX_CONNECTIONS];
+static bench_conn_t *s_current;     // Connection whose frame is being sent or parsed
+static bench_step_t s_step;
+static uint16_t s_count;            // Registers per read
+static volatile bool s_publishing;
+
+static int bench_compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t bench_percentile(const uint32_t *sorted, size_t n, unsigned int percent)
+{
+    if (n == 0) {
+        return 0;
+    }
+    size_t index = (n * percent + 99) / 100;
+    return sorted[(index == 0 ? 1 : index) - 1];
+}
+
+static size_t bench_heap_in_use(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks;
+}
+
+/**
+ * @brief Data process send callback: write the frame to the current connection
+ */
+static void bench_send(const uint8_t *data, size_t len)
+{
+    if (s_current != NULL && send(s_current->sock, data, len, MSG_NOSIGNAL) != (ssize_t)len) {
+        s_current->open = false;
+    }
+}
+
+/**
+ * @brief Data process receive callback: the current connection got its answer
+ */
+static void bench_receive(const uint8_t *data, size_t len)
+{
+    uint8_t *payload = NULL;
+    uint16_t payload_len = 0;
+    if (parse_data_transmission_frame(data, len, &payload, &payload_len) != 0) {
+        return;
+    }
+    if (payload_len == 1 + 2 * BENCH_TELEMETRY_REGISTERS && s_count != BENCH_TELEMETRY_REGISTERS) {
+        s_step.telemetry++;
+        return;
+    }
+    if (payload_len != 1 + 2 * (size_t)s_count) {
+        return;     // Subscription echo
+    }
+    if (s_current != NULL && s_current->waiting) {
+        s_current->waiting = false;
+        s_current->answered = true;
+        int64_t latency = esp_timer_get_time() - s_current->sent_us;
+        if (s_step.samples < BENCH_MAX_SAMPLES) {
+            s_step.latency_us[s_step.samples++] = (uint32_t)latency;
+        }
+        s_step.requests++;
+    }
+}
+
+/**
+ * @brief RS485 frame callback: every response belongs to the bus engine
+ */
+static void bench_on_frame(uint8_t *frame, size_t len)
+{
+    bus_task_on_frame(frame, len);
+}
+
+static int bench_connect(int port, bool slow)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (slow) {
+        // Little buffered before the window closes, so the server's queue fills soon
+        int size = 4096;
+        setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return sock;
+}
+
+/**
+ * @brief Publisher thread: a telemetry block at a fixed rate, as the poll task would
+ */
+static void *bench_publisher(void *arg)
+{
+    unsigned int rate = *(const unsigned int *)arg;
+    uint8_t block[1 + 2 * BENCH_TELEMETRY_REGISTERS];
+    block[0] = 2 * BENCH_TELEMETRY_REGISTERS;
+    for (size_t i = 1; i < sizeof(block); i++) {
+        block[i] = (uint8_t)i;
+    }
+    while (s_publishing) {
+        tcp_server_task_publish(PROTOCOL_DEVICE_DEFAULT, block, sizeof(block));
+        usleep(1000000 / rate);
+    }
+    return NULL;
+}
+
+static void bench_send_read(bench_conn_t *conn, uint16_t start, uint16_t count)
+{
+    uint8_t payload[4] = {
+        (uint8_t)(start >> 8), (uint8_t)start, (uint8_t)(count >> 8), (uint8_t)count,
+    };
+    conn->waiting = true;
+    conn->sent_us = esp_timer_get_time();
+    s_current = conn;
+    data_process_send_to(conn->handle, PROTOCOL_DEVICE_DEFAULT, PROTOCOL_FC_DATA_TRANSMISSION,
+                         payload, sizeof(payload), NULL);
+    s_current = NULL;
+}
+
+/**
+ * @brief Read what a connection has received; false once it is closed
+ */
+static bool bench_receive_conn(bench_conn_t *conn)
+{
+    uint8_t buffer[BENCH_RECV_SIZE];
+    ssize_t n = recv(conn->sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return true;
+    }
+    if (n <= 0) {
+        conn->open = false;
+        return false;
+    }
+    s_current = conn;
+    data_process_receive(conn->handle, buffer, (size_t)n);
+    s_current = NULL;
+    return conn->open;
+}
+
+static void bench_close_all(int connections)
+{
+    for (int i = 0; i < connections; i++) {
+        if (s_conns[i].sock >= 0) {
+            close(s_conns[i].sock);
+            s_conns[i].sock = -1;
+        }
+        s_conns[i].open = false;
+    }
+    for (int waited = 0; waited < BENCH_SETTLE_MS && tcp_server_task_get_client_count() > 0;
+         waited += 10) {
+        usleep(10000);
+    }
+}
+
+/**
+ * @brief Run one step: open the connections, keep one read outstanding on each
+ */
+static void bench_run_step(int port, int connections, unsigned int step_ms,
+                           uint16_t count, uint16_t window, int slow, bool subscribe,
+                           tcp_server_stats_t *stats)
+{
+    memset(&s_step, 0, sizeof(s_step));
+    size_t heap_before = bench_heap_in_use();
+    int fast = connections - ((slow < connections) ? slow : connections);
+
+    for (int i = 0; i < connections; i++) {
+        bench_conn_t *conn = &s_conns[i];
+        conn->slow = (i >= fast);
+        conn->sock = bench_connect(port, conn->slow);
+        conn->open = (conn->sock >= 0);
+        conn->waiting = false;
+        conn->answered = false;
+    }
+
+    // Sample once the server has accepted what it will, before any traffic
+    int expected = (connections < TCP_SERVER_MAX_CLIENTS) ? connections : TCP_SERVER_MAX_CLIENTS;
+    for (int waited = 0; waited < BENCH_SETTLE_MS &&
+         tcp_server_task_get_client_count() < expected; waited++) {
+        usleep(1000);
+    }
+    int accepted = tcp_server_task_get_client_count();
+    size_t heap_after = bench_heap_in_use();
+
+    for (int i = 0; i < connections; i++) {
+        bench_conn_t *conn = &s_conns[i];
+        if (subscribe && conn->open) {
+            bench_send_read(conn, TCP_SERVER_SUBSCRIBE, 0);
+            conn->waiting = false;
+        }
+    }
+
+    struct pollfd fds[BENCH_MAX_CONNECTIONS];
+    uint32_t sequence = 0;
+    int64_t end_us = esp_timer_get_time() + (int64_t)step_ms * 1000;
+
+    while (esp_timer_get_time() < end_us) {
+        int nfds = 0;
+        int index[BENCH_MAX_CONNECTIONS];
+        for (int i = 0; i < connections; i++) {
+            bench_conn_t *conn = &s_conns[i];
+            if (!conn->open || conn->slow) {
+                continue;
+            }
+            if (conn->waiting &&
+                esp_timer_get_time() - conn->sent_us > BENCH_ANSWER_TIMEOUT_MS * 1000) {
+                conn->waiting = false;
+                s_step.unanswered++;
+            }
+            if (!conn->waiting) {
+                uint16_t start = (window > count) ? (uint16_t)(sequence++ % (window - count + 1)) : 0;
+                bench_send_read(conn, start, count);
+            }
+            fds[nfds].fd = conn->sock;
+            fds[nfds].events = POLLIN;
+            index[nfds++] = i;
+        }
+        if (nfds == 0) {
+            break;
+        }
+
+        if (poll(fds, nfds, 100) <= 0) {
+            continue;
+        }
+        for (int k = 0; k < nfds; k++) {
+            if (fds[k].revents != 0) {
+                bench_receive_conn(&s_conns[index[k]]);
+            }
+        }
+    }
+
+    for (int i = 0; i < fast; i++) {
+        if (!s_conns[i].answered) {
+            s_step.refused++;
+        }
+    }
+
+    qsort(s_step.latency_us, s_step.samples, sizeof(uint32_t), bench_compare_u32);
+    double seconds = step_ms / 1000.0;
+    long per_conn = (accepted > 0) ? (long)(heap_after - heap_before) / accepted : 0;
+    printf("%5d %7d %7u %9.0f %8u %8u %8u %9ld %5u %7.0f\n", connections, accepted,
+           s_step.refused, s_step.requests / seconds,
+           bench_percentile(s_step.latency_us, s_step.samples, 50),
+           bench_percentile(s_step.latency_us, s_step.samples, 99),
+           bench_percentile(s_step.latency_us, s_step.samples, 100), per_conn,
+           s_step.unanswered,
+           (accepted > slow) ? s_step.telemetry / seconds / (accepted - slow) : 0.0);
+    fflush(stdout);
+
+    tcp_server_task_get_stats(stats);
+    bench_close_all(connections);
+}
+
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -b baud      line speed (default %d)\n"
+            "  -t us        simulator turnaround (default %d)\n"
+            "  -T ms        time per step (default %d)\n"
+            "  -n regs      registers per read (default %d)\n"
+            "  -w regs      address window the reads are spread over, inside the\n"
+            "               simulator's register map (default: -n)\n"
+            "  -A ms        register cache staleness limit\n"
+            "  -C list      connection counts, comma separated (default 1,2,4,8,16,20)\n"
+            "  -P hz        publish telemetry at this rate; every client subscribes\n"
+            "  -s clients   clients per step that subscribe and stop reading\n"
+            "  -v           firmware log output\n",
+            prog, BENCH_DEFAULT_BAUD_RATE, BENCH_DEFAULT_TURNAROUND_US, BENCH_DEFAULT_STEP_MS,
+            BENCH_DEFAULT_COUNT);
+}
+
+int main(int argc, char **argv)
+{
+    // One arena, so the heap sample sees the server task's allocations
+    mallopt(M_ARENA_MAX, 1);
+
+    vi_config_t config;
+    vi_config_default(&config);
+    config.baud_rate = BENCH_DEFAULT_BAUD_RATE;
+    config.turnaround_us = BENCH_DEFAULT_TURNAROUND_US;
+
+    unsigned int step_ms = BENCH_DEFAULT_STEP_MS;
+    uint16_t count = BENCH_DEFAULT_COUNT;
+    uint16_t window = 0;
+    long max_age_ms = -1;
+    char steps_arg[128] = "1,2,4,8,16,20";
+    unsigned int publish_hz = 0;
+    int slow = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:t:T:n:w:A:C:P:s:vh")) != -1) {
+        switch (opt) {
+            case 'b': config.baud_rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 't': config.turnaround_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'T': step_ms = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'n': count = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'w': window = (uint16_t)strtoul(optarg, NULL, 0); break;
+            case 'A': max_age_ms = strtol(optarg, NULL, 0); break;
+            case 'C':
+                snprintf(steps_arg, sizeof(steps_arg), "%s", optarg);
+                break;
+            case 'P': publish_hz = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 's': slow = atoi(optarg); break;
+            case 'v': host_log_set_level(ESP_LOG_INFO); break;
+            default:
+                bench_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (count == 0 || count > 125 || (slow > 0 && publish_hz == 0)) {
+        bench_usage(argv[0]);
+        return 2;
+    }
+    s_count = count;
+    signal(SIGPIPE, SIG_IGN);
+
+    virtual_inverter_t *vi = vi_create(&config);
+    if (vi == NULL) {
+        fprintf(stderr, "Cannot open a pseudo-terminal\n");
+        return 1;
+    }
+    if (vi_start(vi) != 0 || host_uart_bind(UART_NUM_2, vi_pty_path(vi)) != ESP_OK) {
+        fprintf(stderr, "Cannot connect to the simulator\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    param_set_int(PARAM_ID_16, (int32_t)config.baud_rate);
+    param_set_int(PARAM_ID_17, (int32_t)config.parity);
+    if (max_age_ms >= 0) {
+        register_cache_set_max_age((uint32_t)max_age_ms);
+    }
+
+    // Same order as app_main
+    if (device_routes_init() != ESP_OK || frame_pool_init() != ESP_OK ||
+        rs485_task_init() != ESP_OK) {
+        fprintf(stderr, "RS485 service failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+    rs485_task_set_callback(bench_on_frame);
+    if (bus_task_init() != ESP_OK || tcp_server_task_init() != ESP_OK) {
+        fprintf(stderr, "TCP server failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    for (int i = 0; i < BENCH_MAX_CONNECTIONS; i++) {
+        s_conns[i].sock = -1;
+        s_conns[i].handle = data_process_create(bench_send, bench_receive);
+        if (s_conns[i].handle == NULL) {
+            fprintf(stderr, "Cannot create client data handles\n");
+            vi_destroy(vi);
+            return 1;
+        }
+    }
+
+    printf("TCP server on port %d, %u registers per read over a %u register window, "
+           "%u ms per step\n", TCP_SERVER_PORT, count, (window > count) ? window : count,
+           step_ms);
+    if (publish_hz > 0) {
+        printf("Telemetry: %u blocks/s of %d registers, %d slow clients per step\n",
+               publish_hz, BENCH_TELEMETRY_REGISTERS, slow);
+        s_publishing = true;
+        pthread_t publisher;
+        pthread_create(&publisher, NULL, bench_publisher, &publish_hz);
+        pthread_detach(publisher);
+    }
+    printf("conns  served refused     req/s  p50(us)  p99(us)  max(us) heap/conn  lost   tlm/s\n");
+    fflush(stdout);
+
+    tcp_server_stats_t last_step;
+    memset(&last_step, 0, sizeof(last_step));
+
+    char *saveptr = NULL;
+    for (char *item = strtok_r(steps_arg, ",", &saveptr); item != NULL;
+         item = strtok_r(NULL, ",", &saveptr)) {
+        int connections = atoi(item);
+        if (connections <= 0 || connections > BENCH_MAX_CONNECTIONS) {
+            fprintf(stderr, "Skipping step of %d connections (1-%d)\n", connections,
+                    BENCH_MAX_CONNECTIONS);
+            continue;
+        }
+        bench_run_step(TCP_SERVER_PORT, connections, step_ms, count, window, slow,
+                       publish_hz > 0, &last_step);
+    }
+    s_publishing = false;
+
+    tcp_server_stats_t stats;
+    bus_task_stats_t bus_stats;
+    register_cache_stats_t cache_stats;
+    tcp_server_task_get_stats(&stats);
+    bus_task_get_stats(&bus_stats);
+    register_cache_get_stats(&cache_stats);
+
+    printf("Server: %u accepted, %u refused, at most %u open at once, "
+           "%u reads held for the bus queue\n",
+           stats.accepted, stats.rejected, stats.peak_active, stats.held);
+    printf("  telemetry    %u published, %u dropped before fan-out, %u slow clients disconnected\n",
+           stats.published, stats.publish_drops, stats.slow_disconnects);
+    printf("  last step    client  queue  high   bytes      sent  tlm drops  resp drops\n");
+    for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+        const tcp_server_client_stats_t *client = &last_step.clients[i];
+        if (client->sent == 0 && client->telemetry_drops == 0 && !client->connected) {
+            continue;
+        }
+        printf("               %6d %6u %5u %7u %9u %10u %11u%s\n", i, client->queue_depth,
+               client->queue_high_water, client->queued_bytes, client->sent,
+               client->telemetry_drops, client->response_drops,
+               client->connected ? "" : "  disconnected");
+    }
+    printf("  bus          %u completed, %u timeouts, %u coalesced\n",
+           bus_stats.completed, bus_stats.timeouts, bus_stats.coalesced);
+    printf("  cache        %u hits, %u misses, %u stale\n",
+           cache_stats.hits, cache_stats.misses, cache_stats.stale);
+
+    // Tasks are still running; leave the simulator to process exit
+    return 0;
+}
@@ -0,0 +1,527 @@
+/**
+ * @file tls_bench.c
+ * @brief Local TLS server benchmark: handshakes next to stalled peers
+ * 
+ * Runs the firmware's TCP server with TLS (PSK from the device SN) and the
+ * RS485 service, bus transaction engine and register cache on the host
+ * shims, against a virtual inverter; TLS is the system's mbedtls. For each
+ * step it opens that many stalled connections, half of them silent and
+ * half stopping part way through a ClientHello, then connects a normal
+ * PSK client again and again and measures how long its handshake and its
+ * first register read take. With the handshakes on the event loop, the
+ * stalled peers should make no difference.
+ * 
+ * With -R each client offers the session the previous one negotiated, as
+ * the cloud link does on reconnect, and the server resumes it from its
+ * session ticket; full and resumed handshakes are reported apart.
+ * 
+ * The last step's stalled connections are left open at the end, to show
+ * the server closing them at its handshake deadline.
+ * 
+ * Exits non-zero if any probe fails, if in a step with stalled peers the
+ * p99 connect-and-handshake time passes the -T threshold, or if the server
+ * does not close every stalled peer left open at its deadline.
+ */
+
+#include "virtual_inverter.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/md5.h"
+#include "../../src/tasks/rs485_task.h"
+#include "../../src/tasks/bus_task.h"
+#include "../../src/tasks/tcp_server_task.h"
+#include "../../src/protocol/data_process.h"
+#include "../../src/protocol/register_cache.h"
+#include "../../src/protocol/device_routes.h"
+#include "../../src/config/param_manager.h"
+#include "../../src/utils/frame_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <signal.h>
+
+#define BENCH_DEFAULT_BAUD_RATE     115200
+#define BENCH_DEFAULT_TURNAROUND_US 2000
+#define BENCH_DEFAULT_PROBES        20
+#define BENCH_DEFAULT_SN            "BA00000001"
+#define BENCH_PSK_IDENTITY          "psk_identity_dongle"
+#define BENCH_PSK_KEY_PREFIX        "LuxD1ngl2X"
+#define BENCH_MAX_PROBES            1000
+#define BENCH_PROBE_TIMEOUT_MS      3000    // A probe slower than this failed
+#define BENCH_SETTLE_MS             2000
+#define BENCH_RECV_SIZE             2048
+#define BENCH_READ_REGISTERS        10
+#define BENCH_DEADLINE_MS           5000    // TCP_SERVER_TLS_TIMEOUT_MS
+#define BENCH_DEADLINE_SLACK_MS     1000
+#define BENCH_DEFAULT_MAX_P99_MS    1000    // A handshake waiting on a stalled peer takes seconds
+
+typedef struct {
+    mbedtls_ssl_config conf;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    uint8_t psk[16];
+} bench_tls_t;
+
+typedef struct {
+    mbedtls_ssl_context ssl;
+    mbedtls_net_context net;
+    bool failed;
+    bool answered;
+} bench_probe_t;
+
+static bench_tls_t s_tls;
+static mbedtls_ssl_session s_session;   // Offered by the next probe with -R
+static bool s_have_session;
+static bool s_resume;
+static bench_probe_t *s_current;    // Probe whose frame is being sent or parsed
+static int s_stalled[TCP_SERVER_MAX_CLIENTS];
+static int64_t s_stalled_since_us;
+
+static int bench_compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static uint32_t bench_percentile(const uint32_t *sorted, size_t n, unsigned int percent)
+{
+    if (n == 0) {
+        return 0;
+    }
+    size_t index = (n * percent + 99) / 100;
+    return sorted[(index == 0 ? 1 : index) - 1];
+}
+
+/**
+ * @brief RS485 frame callback: every response belongs to the bus engine
+ */
+static void bench_on_frame(uint8_t *frame, size_t len)
+{
+    bus_task_on_frame(frame, len);
+}
+
+/**
+ * @brief Client PSK and configuration, the key the server derives from the same SN
+ */
+static int bench_tls_init(const char *device_sn)
+{
+    char input[128];
+    snprintf(input, sizeof(input), "%s%s", BENCH_PSK_KEY_PREFIX, device_sn);
+    mbedtls_md5_context md5;
+    mbedtls_md5_init(&md5);
+    mbedtls_md5_starts(&md5);
+    mbedtls_md5_update(&md5, (const unsigned char *)input, strlen(input));
+    mbedtls_md5_finish(&md5, s_tls.psk);
+    mbedtls_md5_free(&md5);
+
+    mbedtls_ssl_config_init(&s_tls.conf);
+    mbedtls_entropy_init(&s_tls.entropy);
+    mbedtls_ctr_drbg_init(&s_tls.ctr_drbg);
+    const char *pers = "tls_bench";
+    if (mbedtls_ctr_drbg_seed(&s_tls.ctr_drbg, mbedtls_entropy_func, &s_tls.entropy,
+                              (const unsigned char *)pers, strlen(pers)) != 0 ||
+        mbedtls_ssl_config_defaults(&s_tls.conf, MBEDTLS_SSL_IS_CLIENT,
+                                    MBEDTLS_SSL_TRANSPORT_STREAM,
+                                    MBEDTLS_SSL_PRESET_DEFAULT) != 0 ||
+        mbedtls_ssl_conf_psk(&s_tls.conf, s_tls.psk, sizeof(s_tls.psk),
+                             (const unsigned char *)BENCH_PSK_IDENTITY,
+                             strlen(BENCH_PSK_IDENTITY)) != 0) {
+        return -1;
+    }
+    mbedtls_ssl_conf_authmode(&s_tls.conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&s_tls.conf, mbedtls_ctr_drbg_random, &s_tls.ctr_drbg);
+    mbedtls_ssl_conf_session_tickets(&s_tls.conf, s_resume ? MBEDTLS_SSL_SESSION_TICKETS_ENABLED
+                                                           : MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+    mbedtls_ssl_session_init(&s_session);
+    return 0;
+}
+
+static int bench_connect(int port, unsigned int timeout_ms)
+{
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        return -1;
+    }
+    if (timeout_ms > 0) {
+        struct timeval timeout = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_usec = (timeout_ms % 1000) * 1000,
+        };
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    return sock;
+}
+
+/**
+ * @brief Open a peer that never finishes its handshake
+ * 
+ * Odd ones send a TLS record header and the start of a ClientHello, then
+ * nothing: the server is left part way through a record.
+ */
+static int bench_open_stalled(int port, int index)
+{
+    int sock = bench_connect(port, 0);
+    if (sock >= 0 && (index & 1)) {
+        static const uint8_t partial[] = { 0x16, 0x03, 0x01, 0x00, 0x80, 0x01, 0x00, 0x00, 0x7c };
+        send(sock, partial, sizeof(partial), MSG_NOSIGNAL);
+    }
+    return sock;
+}
+
+/**
+ * @brief Data process send callback: encrypt the frame onto the current probe
+ */
+static void bench_send(const uint8_t *data, size_t len)
+{
+    if (s_current != NULL && mbedtls_ssl_write(&s_current->ssl, data, len) != (int)len) {
+        s_current->failed = true;
+    }
+}
+
+/**
+ * @brief Data process receive callback: the current probe got its answer
+ */
+static void bench_receive(const uint8_t *data, size_t len)
+{
+    uint8_t *payload = NULL;
+    uint16_t payload_len = 0;
+    if (parse_data_transmission_frame(data, len, &payload, &payload_len) == 0 &&
+        payload_len == 1 + 2 * BENCH_READ_REGISTERS && s_current != NULL) {
+        s_current->answered = true;
+    }
+}
+
+/**
+ * @brief One normal client: connect, handshake, read registers, close
+ * 
+ * With -R it offers the previous probe's session and keeps its own for the
+ * next one. Whether the server resumed it is read from the server's
+ * counter once the first read is answered, by when the server has long
+ * finished its side of the handshake.
+ * 
+ * @return false if any part failed or took longer than BENCH_PROBE_TIMEOUT_MS
+ */
+static bool bench_probe(int port, data_process_handle_t handle,
+                        uint32_t *handshake_us, uint32_t *first_read_us, bool *resumed)
+{
+    tcp_server_stats_t before;
+    tcp_server_task_get_stats(&before);
+    bench_probe_t probe;
+    memset(&probe, 0, sizeof(probe));
+    int64_t start_us = esp_timer_get_time();
+
+    probe.net.fd = bench_connect(port, BENCH_PROBE_TIMEOUT_MS);
+    if (probe.net.fd < 0) {
+        return false;
+    }
+    mbedtls_ssl_init(&probe.ssl);
+    bool ok = false;
+    if (mbedtls_ssl_setup(&probe.ssl, &s_tls.conf) != 0) {
+        goto done;
+    }
+    if (s_resume && s_have_session && mbedtls_ssl_set_session(&probe.ssl, &s_session) != 0) {
+        goto done;
+    }
+    mbedtls_ssl_set_bio(&probe.ssl, &probe.net, mbedtls_net_send, mbedtls_net_recv, NULL);
+    if (mbedtls_ssl_handshake(&probe.ssl) != 0) {
+        goto done;
+    }
+    *handshake_us = (uint32_t)(esp_timer_get_time() - start_us);
+    if (s_resume) {
+        mbedtls_ssl_session_free(&s_session);
+        mbedtls_ssl_session_init(&s_session);
+        s_have_session = mbedtls_ssl_get_session(&probe.ssl, &s_session) == 0;
+    }
+
+    uint8_t payload[4] = { 0, 0, 0, BENCH_READ_REGISTERS };
+    s_current = &probe;
+    data_process_send_to(handle, PROTOCOL_DEVICE_DEFAULT, PROTOCOL_FC_DATA_TRANSMISSION,
+                         payload, sizeof(payload), NULL);
+    uint8_t buffer[BENCH_RECV_SIZE];
+    while (!probe.answered && !probe.failed) {
+        int n = mbedtls_ssl_read(&probe.ssl, buffer, sizeof(buffer));
+        if (n <= 0) {
+            probe.failed = true;
+            break;
+        }
+        data_process_receive(handle, buffer, (size_t)n);
+    }
+    s_current = NULL;
+    *first_read_us = (uint32_t)(esp_timer_get_time() - start_us);
+    ok = probe.answered && *first_read_us < BENCH_PROBE_TIMEOUT_MS * 1000u;
+
+    tcp_server_stats_t after;
+    tcp_server_task_get_stats(&after);
+    *resumed = after.handshakes_resumed != before.handshakes_resumed;
+
+done:
+    mbedtls_ssl_close_notify(&probe.ssl);
+    mbedtls_ssl_free(&probe.ssl);
+    mbedtls_net_free(&probe.net);
+    return ok;
+}
+
+static void bench_close_stalled(int stalled)
+{
+    for (int i = 0; i < stalled; i++) {
+        if (s_stalled[i] >= 0) {
+            close(s_stalled[i]);
+            s_stalled[i] = -1;
+        }
+    }
+    for (int waited = 0; waited < BENCH_SETTLE_MS && tcp_server_task_get_client_count() > 0;
+         waited += 10) {
+        usleep(10000);
+    }
+}
+
+/**
+ * @brief Run one step: open the stalled peers, then probe one client at a time
+ * 
+ * @param max_p99_ms Handshake p99 allowed next to stalled peers, 0 for no limit
+ * @return false if a probe failed or, with stalled peers, a p99 passed max_p99_ms
+ */
+static bool bench_run_step(int port, int stalled, unsigned int probes, uint32_t max_p99_ms,
+                           data_process_handle_t handle)
+{
+    static uint32_t full_us[BENCH_MAX_PROBES];
+    static uint32_t resumed_us[BENCH_MAX_PROBES];
+    static uint32_t first_read_us[BENCH_MAX_PROBES];
+    unsigned int done = 0;
+    unsigned int full = 0;
+    unsigned int resumed = 0;
+    unsigned int failed = 0;
+
+    s_stalled_since_us = esp_timer_get_time();
+    for (int i = 0; i < stalled; i++) {
+        s_stalled[i] = bench_open_stalled(port, i);
+    }
+    // Every stalled peer holds a slot in mid-handshake before the probes start
+    tcp_server_stats_t stats;
+    for (int waited = 0; waited < BENCH_SETTLE_MS; waited++) {
+        tcp_server_task_get_stats(&stats);
+        if ((int)stats.handshaking >= stalled) {
+            break;
+        }
+        usleep(1000);
+    }
+    int pending = (int)stats.handshaking;
+
+    for (unsigned int i = 0; i < probes; i++) {
+        uint32_t handshake_us = 0;
+        bool was_resumed = false;
+        if (bench_probe(port, handle, &handshake_us, &first_read_us[done], &was_resumed)) {
+            if (was_resumed) {
+                resumed_us[resumed++] = handshake_us;
+            } else {
+                full_us[full++] = handshake_us;
+            }
+            done++;
+        } else {
+            failed++;
+        }
+        // The server sees the probe's close before the next one connects
+        for (int waited = 0; waited < BENCH_SETTLE_MS &&
+             tcp_server_task_get_client_count() > stalled; waited++) {
+            usleep(1000);
+        }
+    }
+
+    qsort(full_us, full, sizeof(uint32_t), bench_compare_u32);
+    qsort(resumed_us, resumed, sizeof(uint32_t), bench_compare_u32);
+    qsort(first_read_us, done, sizeof(uint32_t), bench_compare_u32);
+    uint32_t full_p99 = bench_percentile(full_us, full, 99);
+    uint32_t resumed_p99 = bench_percentile(resumed_us, resumed, 99);
+    // Without stalled peers there is nothing for a handshake to wait on
+    bool slow = stalled > 0 && max_p99_ms > 0 &&
+                (full_p99 > max_p99_ms * 1000 || resumed_p99 > max_p99_ms * 1000);
+    printf("%7d %8d %6u %6u %5u %8u %8u %7u %8u %8u %9u %9u  %s\n", stalled, pending, done,
+           failed, full, bench_percentile(full_us, full, 50), full_p99,
+           resumed, bench_percentile(resumed_us, resumed, 50), resumed_p99,
+           bench_percentile(first_read_us, done, 50), bench_percentile(first_read_us, done, 99),
+           failed > 0 ? "FAILED" : slow ? "SLOW" : "ok");
+    fflush(stdout);
+    return failed == 0 && !slow;
+}
+
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -b baud      line speed (default %d)\n"
+            "  -t us        simulator turnaround (default %d)\n"
+            "  -C list      stalled connections per step, comma separated (default 0,4,8,%d)\n"
+            "  -n probes    normal clients per step, one at a time (default %d)\n"
+            "  -S sn        device serial number the PSK is derived from (default %s)\n"
+            "  -R           each client resumes the previous client's session\n"
+            "  -T ms        handshake p99 allowed next to stalled peers, 0 for no limit "
+            "(default %d)\n"
+            "  -v           firmware log output\n",
+            prog, BENCH_DEFAULT_BAUD_RATE, BENCH_DEFAULT_TURNAROUND_US,
+            TCP_SERVER_MAX_CLIENTS - 1, BENCH_DEFAULT_PROBES, BENCH_DEFAULT_SN,
+            BENCH_DEFAULT_MAX_P99_MS);
+}
+
+int main(int argc, char **argv)
+{
+    vi_config_t config;
+    vi_config_default(&config);
+    config.baud_rate = BENCH_DEFAULT_BAUD_RATE;
+    config.turnaround_us = BENCH_DEFAULT_TURNAROUND_US;
+
+    unsigned int probes = BENCH_DEFAULT_PROBES;
+    uint32_t max_p99_ms = BENCH_DEFAULT_MAX_P99_MS;
+    const char *device_sn = BENCH_DEFAULT_SN;
+    char steps_arg[128];
+    snprintf(steps_arg, sizeof(steps_arg), "0,4,8,%d", TCP_SERVER_MAX_CLIENTS - 1);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:t:C:n:S:RT:vh")) != -1) {
+        switch (opt) {
+            case 'b': config.baud_rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 't': config.turnaround_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'C':
+                snprintf(steps_arg, sizeof(steps_arg), "%s", optarg);
+                break;
+            case 'n': probes = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'S': device_sn = optarg; break;
+            case 'R': s_resume = true; break;
+            case 'T': max_p99_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'v': host_log_set_level(ESP_LOG_INFO); break;
+            default:
+                bench_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (probes == 0 || probes > BENCH_MAX_PROBES) {
+        bench_usage(argv[0]);
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    virtual_inverter_t *vi = vi_create(&config);
+    if (vi == NULL) {
+        fprintf(stderr, "Cannot open a pseudo-terminal\n");
+        return 1;
+    }
+    if (vi_start(vi) != 0 || host_uart_bind(UART_NUM_2, vi_pty_path(vi)) != ESP_OK) {
+        fprintf(stderr, "Cannot connect to the simulator\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    param_set_int(PARAM_ID_16, (int32_t)config.baud_rate);
+    param_set_int(PARAM_ID_17, (int32_t)config.parity);
+    if (param_set_string(PARAM_ID_7, device_sn) != ESP_OK || bench_tls_init(device_sn) != 0) {
+        fprintf(stderr, "Cannot set up TLS for SN %s\n", device_sn);
+        vi_destroy(vi);
+        return 1;
+    }
+
+    // Same order as app_main
+    if (device_routes_init() != ESP_OK || frame_pool_init() != ESP_OK ||
+        rs485_task_init() != ESP_OK) {
+        fprintf(stderr, "RS485 service failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+    rs485_task_set_callback(bench_on_frame);
+    if (bus_task_init() != ESP_OK || tcp_server_task_init() != ESP_OK) {
+        fprintf(stderr, "TCP server failed to start\n");
+        vi_destroy(vi);
+        return 1;
+    }
+    data_process_handle_t handle = data_process_create(bench_send, bench_receive);
+    if (handle == NULL) {
+        fprintf(stderr, "Cannot create the client data handle\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    printf("TLS server on port %d, PSK for SN %s, %u clients per step, one at a time%s\n",
+           TCP_SERVER_PORT, device_sn, probes, s_resume ? ", resuming sessions" : "");
+    printf("                            --- full handshake ---  -- resumed handshake --"
+           "  - first read (us) -\n");
+    printf("stalled  pending     ok failed count  p50(us)  p99(us)   count  p50(us)  p99(us)"
+           "       p50       p99  result\n");
+    fflush(stdout);
+
+    for (int i = 0; i < TCP_SERVER_MAX_CLIENTS; i++) {
+        s_stalled[i] = -1;
+    }
+    int last = 0;
+    bool steps_ok = true;
+    char *saveptr = NULL;
+    for (char *item = strtok_r(steps_arg, ",", &saveptr); item != NULL;
+         item = strtok_r(NULL, ",", &saveptr)) {
+        int stalled = atoi(item);
+        if (stalled < 0 || stalled >= TCP_SERVER_MAX_CLIENTS) {
+            fprintf(stderr, "Skipping step of %d stalled connections (0-%d)\n", stalled,
+                    TCP_SERVER_MAX_CLIENTS - 1);
+            continue;
+        }
+        bench_close_stalled(last);
+        steps_ok = bench_run_step(TCP_SERVER_PORT, stalled, probes, max_p99_ms, handle) &&
+                   steps_ok;
+        last = stalled;
+    }
+
+    // The last step's stalled peers are still open: the server's deadline closes them
+    tcp_server_stats_t before;
+    tcp_server_stats_t stats;
+    tcp_server_task_get_stats(&before);
+    bool deadline_ok = true;
+    if (last > 0) {
+        do {
+            usleep(10000);
+            tcp_server_task_get_stats(&stats);
+        } while (stats.handshaking > 0 && esp_timer_get_time() - s_stalled_since_us <
+                 (BENCH_DEADLINE_MS + BENCH_DEADLINE_SLACK_MS) * 1000);
+        printf("Stalled peers left open: %u of %d closed at the handshake deadline, "
+               "%lld ms after they connected\n",
+               stats.handshake_timeouts - before.handshake_timeouts, last,
+               (long long)(esp_timer_get_time() - s_stalled_since_us) / 1000);
+        deadline_ok = (int)(stats.handshake_timeouts - before.handshake_timeouts) >= last;
+    }
+    bench_close_stalled(last);
+
+    bus_task_stats_t bus_stats;
+    register_cache_stats_t cache_stats;
+    tcp_server_task_get_stats(&stats);
+    bus_task_get_stats(&bus_stats);
+    register_cache_get_stats(&cache_stats);
+
+    printf("Server: %u accepted, %u refused, at most %u open at once\n",
+           stats.accepted, stats.rejected, stats.peak_active);
+    printf("  handshakes   %u completed (%u resumed), %u failed, %u timed out\n",
+           stats.handshakes, stats.handshakes_resumed, stats.handshake_failures,
+           stats.handshake_timeouts);
+    printf("  bus          %u completed, %u timeouts\n", bus_stats.completed, bus_stats.timeouts);
+    printf("  cache        %u hits, %u misses\n", cache_stats.hits, cache_stats.misses);
+
+    // Tasks are still running; leave the simulator to process exit
+    return (steps_ok && deadline_ok) ? 0 : 1;
+}
@@ -0,0 +1,300 @@
+/**
+ * @file uplink_bench.c
+ * @brief Keyframe baselines of the uplink task against a small ack window
+ * 
+ * Runs the firmware's uplink task and protocol layer on the host shims with
+ * the TCP client replaced by a simulated cloud: every 0xC2 frame sent is
+ * acknowledged after a fixed delay by feeding an empty 0xC2 frame with its
+ * sequence number back through data_process_receive(). The ack window is
+ * as deep as the TCP client's, so a sweep of more blocks than the window
+ * sent faster than the acks come back evicts most of its keyframes.
+ * 
+ * Each sweep submits every block once, with one register changed, then
+ * waits for the acks. A block goes up as a delta once its keyframe is
+ * acknowledged; a keyframe the window gave up must be dropped at once so
+ * the block's next poll is a keyframe that can be acknowledged, instead of
+ * being held outstanding for UPLINK_DELTA_ACK_TIMEOUT_MS. Each sweep then
+ * leaves at least one window's worth of blocks on deltas.
+ * 
+ * Exits non-zero unless every block is sent as a delta within
+ * blocks / window + 1 sweeps, and nothing was dropped on the way.
+ */
+
+#include "esp_log.h"
+#include "../../src/tasks/uplink_task.h"
+#include "../../src/tasks/tcp_client_task.h"
+#include "../../src/protocol/data_process.h"
+#include "../../src/protocol/function_codes.h"
+#include "../../src/protocol/crc_utils.h"
+#include "../../src/protocol/uplink_delta.h"
+#include "../../src/utils/frame_pool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_DEFAULT_BLOCKS    16
+#define BENCH_DEFAULT_WINDOW    4       // TCP_CLIENT_ACK_WINDOW
+#define BENCH_DEFAULT_ACK_MS    50
+#define BENCH_DEFAULT_GAP_MS    2
+#define BENCH_DEFAULT_SWEEPS    8
+#define BENCH_REGISTERS         40
+#define BENCH_DEVICE_ID         1
+#define BENCH_ACK_FRAME_SIZE    22      // Header, zero data length and CRC
+#define BENCH_MAX_PENDING       256
+
+typedef struct {
+    uint16_t sequence;
+    int64_t due_ms;
+} bench_pending_t;
+
+static data_process_handle_t s_data;
+static pthread_mutex_t s_pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static bench_pending_t s_pending[BENCH_MAX_PENDING];
+static unsigned int s_pending_count;
+static uint32_t s_ack_ms = BENCH_DEFAULT_ACK_MS;
+static volatile bool s_running = true;
+
+static int64_t bench_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * The TCP client, reduced to what the uplink task asks of it: always
+ * connected, one connection, no batching.
+ */
+
+data_process_handle_t tcp_client_task_get_data_handle(void)
+{
+    return s_data;
+}
+
+bool tcp_client_task_is_connected(void)
+{
+    return true;
+}
+
+uint32_t tcp_client_task_get_connection_id(void)
+{
+    return 1;
+}
+
+uplink_batcher_handle_t tcp_client_task_get_batcher(void)
+{
+    return NULL;
+}
+
+void uplink_batcher_set_flush_task(uplink_batcher_handle_t batcher, TaskHandle_t task)
+{
+}
+
+esp_err_t uplink_batcher_service(uplink_batcher_handle_t batcher)
+{
+    return ESP_OK;
+}
+
+/**
+ * @brief Data process send callback: the cloud acknowledges each 0xC2 frame later
+ */
+static void bench_on_send(const uint8_t *data, size_t len)
+{
+    if (len <= BENCH_ACK_FRAME_SIZE || data[7] != PROTOCOL_FC_DATA_TRANSMISSION) {
+        return;
+    }
+
+    pthread_mutex_lock(&s_pending_lock);
+    if (s_pending_count < BENCH_MAX_PENDING) {
+        s_pending[s_pending_count].sequence = (uint16_t)(data[2] | (data[3] << 8));
+        s_pending[s_pending_count].due_ms = bench_now_ms() + s_ack_ms;
+        s_pending_count++;
+    }
+    pthread_mutex_unlock(&s_pending_lock);
+}
+
+/**
+ * @brief Simulated cloud: acknowledge each 0xC2 frame once its delay is up
+ */
+static void *bench_cloud(void *arg)
+{
+    while (s_running) {
+        uint16_t due[BENCH_MAX_PENDING];
+        unsigned int count = 0;
+        int64_t now = bench_now_ms();
+
+        pthread_mutex_lock(&s_pending_lock);
+        unsigned int kept = 0;
+        for (unsigned int i = 0; i < s_pending_count; i++) {
+            if (s_pending[i].due_ms <= now) {
+                due[count++] = s_pending[i].sequence;
+            } else {
+                s_pending[kept++] = s_pending[i];
+            }
+        }
+        s_pending_count = kept;
+        pthread_mutex_unlock(&s_pending_lock);
+
+        for (unsigned int i = 0; i < count; i++) {
+            uint8_t ack[BENCH_ACK_FRAME_SIZE] = { 0xA1, 0x1A };
+            ack[2] = due[i] & 0xFF;
+            ack[3] = (due[i] >> 8) & 0xFF;
+            ack[6] = BENCH_DEVICE_ID;
+            ack[7] = PROTOCOL_FC_DATA_TRANSMISSION;
+            uint16_t crc = modbus_crc16(ack, BENCH_ACK_FRAME_SIZE - 2);
+            ack[20] = crc & 0xFF;
+            ack[21] = (crc >> 8) & 0xFF;
+            data_process_receive(s_data, ack, sizeof(ack));
+        }
+        usleep(1000);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Submit every block once, register 0 carrying the sweep number
+ */
+static int bench_sweep(unsigned int sweep, unsigned int blocks, uint32_t gap_ms)
+{
+    uint8_t body[1 + 2 * BENCH_REGISTERS];
+    body[0] = 2 * BENCH_REGISTERS;
+
+    for (unsigned int b = 0; b < blocks; b++) {
+        uint16_t start = (uint16_t)(b * 100);
+        for (unsigned int r = 0; r < BENCH_REGISTERS; r++) {
+            uint16_t value = (r == 0) ? (uint16_t)sweep : (uint16_t)(start + r);
+            body[1 + 2 * r] = (uint8_t)(value >> 8);
+            body[2 + 2 * r] = (uint8_t)(value & 0xFF);
+        }
+        if (uplink_task_submit_block(BENCH_DEVICE_ID, MODBUS_FC_READ_HOLDING_REGISTERS, start,
+                                     body, sizeof(body)) != ESP_OK) {
+            fprintf(stderr, "Sweep %u: block %u not queued\n", sweep, b);
+            return -1;
+        }
+        usleep(gap_ms * 1000);
+    }
+    return 0;
+}
+
+static void bench_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -b blocks    polled blocks per sweep (1-%d, default %d)\n"
+            "  -w depth     ack window depth (default %d)\n"
+            "  -a ms        cloud acknowledgement delay (default %d)\n"
+            "  -g ms        gap between blocks of a sweep (default %d)\n"
+            "  -n sweeps    sweeps to run (default %d)\n"
+            "  -v           firmware log output\n",
+            prog, UPLINK_DELTA_MAX_BLOCKS, BENCH_DEFAULT_BLOCKS, BENCH_DEFAULT_WINDOW,
+            BENCH_DEFAULT_ACK_MS, BENCH_DEFAULT_GAP_MS, BENCH_DEFAULT_SWEEPS);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int blocks = BENCH_DEFAULT_BLOCKS;
+    unsigned int window = BENCH_DEFAULT_WINDOW;
+    uint32_t gap_ms = BENCH_DEFAULT_GAP_MS;
+    unsigned int sweeps = BENCH_DEFAULT_SWEEPS;
+    esp_log_level_t log_level = ESP_LOG_ERROR;     // The window warns on every eviction
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:w:a:g:n:vh")) != -1) {
+        switch (opt) {
+            case 'b': blocks = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'w': window = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'a': s_ack_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'g': gap_ms = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'n': sweeps = (unsigned int)strtoul(optarg, NULL, 0); break;
+            case 'v': log_level = ESP_LOG_INFO; break;
+            default:
+                bench_usage(argv[0]);
+                return 2;
+        }
+    }
+    if (blocks == 0 || blocks > UPLINK_DELTA_MAX_BLOCKS || window == 0 || window > 255 ||
+        sweeps == 0) {
+        bench_usage(argv[0]);
+        return 2;
+    }
+    host_log_set_level(log_level);
+
+    s_data = data_process_create(bench_on_send, NULL);
+    if (frame_pool_init() != ESP_OK || s_data == NULL ||
+        data_process_enable_ack_window(s_data, (uint8_t)window) != ESP_OK ||
+        uplink_task_init() != ESP_OK) {
+        fprintf(stderr, "Cannot start the uplink task\n");
+        return 1;
+    }
+
+    pthread_t cloud;
+    if (pthread_create(&cloud, NULL, bench_cloud, NULL) != 0) {
+        fprintf(stderr, "Cannot start the cloud thread\n");
+        return 1;
+    }
+
+    printf("%u blocks of %d registers, ack window %u, acks after %u ms, %u ms between blocks\n",
+           blocks, BENCH_REGISTERS, window, s_ack_ms, gap_ms);
+    printf("sweep  keyframes  deltas  lost\n");
+
+    unsigned int converge_by = (blocks + window - 1) / window + 1;
+    unsigned int converged_at = 0;
+    uplink_task_stats_t before = { 0 };
+    int status = 0;
+
+    for (unsigned int sweep = 1; sweep <= sweeps && status == 0; sweep++) {
+        if (bench_sweep(sweep, blocks, gap_ms) != 0) {
+            status = 1;
+            break;
+        }
+        // Every acknowledgement back, and the uplink task idle again
+        usleep((2 * s_ack_ms + 50) * 1000);
+
+        uplink_task_stats_t stats;
+        uplink_task_get_stats(&stats);
+        uint32_t keyframes = stats.keyframes - before.keyframes;
+        uint32_t deltas = stats.deltas - before.deltas;
+        uint32_t lost = stats.keyframes_lost - before.keyframes_lost;
+        printf("%5u  %9u  %6u  %4u\n", sweep, keyframes, deltas, lost);
+        if (keyframes + deltas != blocks) {
+            fprintf(stderr, "Sweep %u: %u of %u blocks sent\n", sweep, keyframes + deltas, blocks);
+            status = 1;
+        }
+        if (keyframes == 0 && converged_at == 0) {
+            converged_at = sweep;
+        }
+        before = stats;
+    }
+
+    s_running = false;
+    pthread_join(cloud, NULL);
+
+    uplink_task_stats_t stats;
+    uplink_task_get_stats(&stats);
+    data_process_tx_stats_t tx;
+    data_process_get_tx_stats(s_data, &tx);
+    printf("window evictions %lu, keyframes lost %lu, ack overflows %lu\n",
+           (unsigned long)tx.evicted, (unsigned long)stats.keyframes_lost,
+           (unsigned long)stats.ack_overflows);
+
+    if (status == 0 && (converged_at == 0 || converged_at > converge_by)) {
+        fprintf(stderr, "Blocks still sent as keyframes after %u sweeps (expected by %u)\n",
+                converged_at ? converged_at - 1 : sweeps, converge_by);
+        status = 1;
+    }
+    if (stats.stale_drops || stats.offline_drops || stats.send_failures ||
+        stats.overflow_drops || stats.alloc_failures || stats.ack_overflows) {
+        fprintf(stderr, "Blocks dropped: stale %lu, offline %lu, failed %lu, overflow %lu, "
+                "no buffer %lu, acks dropped %lu\n",
+                (unsigned long)stats.stale_drops, (unsigned long)stats.offline_drops,
+                (unsigned long)stats.send_failures, (unsigned long)stats.overflow_drops,
+                (unsigned long)stats.alloc_failures, (unsigned long)stats.ack_overflows);
+        status = 1;
+    }
+    return status;
+}
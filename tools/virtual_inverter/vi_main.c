@@ -0,0 +1,131 @@
+/**
+ * @file vi_main.c
+ * @brief Standalone virtual inverter
+ * 
+ * Prints the pty path to connect a Modbus master to, answers until
+ * interrupted and then prints its statistics.
+ */
+
+#include "virtual_inverter.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t s_stop = 0;
+
+static void vi_on_signal(int sig)
+{
+    (void)sig;
+    s_stop = 1;
+}
+
+static void vi_usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  -a addr      slave address (default %d)\n"
+            "  -b baud      line speed (default %d)\n"
+            "  -p N|O|E     parity (default E)\n"
+            "  -L           ignore requests sent at another baud rate or parity\n"
+            "  -t us        turnaround (default %d)\n"
+            "  -j us        turnaround jitter\n"
+            "  -c rate      corrupted CRC rate (0-1)\n"
+            "  -n rate      noise burst rate (0-1)\n"
+            "  -d rate      unanswered request rate (0-1)\n"
+            "  -s rate      split response rate (0-1)\n"
+            "  -B rate      busy exception rate (0-1)\n"
+            "  -g us        pause inside a split response (default 1000)\n"
+            "  -m file      register map\n"
+            "  -l path      symlink to the pty\n"
+            "  -S seed      fault injection seed\n",
+            prog, VI_DEFAULT_SLAVE_ADDR, VI_DEFAULT_BAUD_RATE, VI_DEFAULT_TURNAROUND_US);
+}
+
+int main(int argc, char **argv)
+{
+    vi_config_t config;
+    vi_config_default(&config);
+    const char *map_path = NULL;
+    const char *link_path = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:b:p:Lt:j:c:n:d:s:B:g:m:l:S:h")) != -1) {
+        switch (opt) {
+            case 'a': config.slave_addr = (uint8_t)strtoul(optarg, NULL, 0); break;
+            case 'b': config.baud_rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'p':
+                if (vi_parse_parity(optarg, &config.parity) != 0) {
+                    vi_usage(argv[0]);
+                    return 2;
+                }
+                break;
+            case 'L': config.strict_line = true; break;
+            case 't': config.turnaround_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'j': config.turnaround_jitter_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'c': config.crc_error_rate = atof(optarg); break;
+            case 'n': config.noise_rate = atof(optarg); break;
+            case 'd': config.drop_rate = atof(optarg); break;
+            case 's': config.split_rate = atof(optarg); break;
+            case 'B': config.busy_rate = atof(optarg); break;
+            case 'g': config.split_gap_us = (uint32_t)strtoul(optarg, NULL, 0); break;
+            case 'm': map_path = optarg; break;
+            case 'l': link_path = optarg; break;
+            case 'S': config.seed = (unsigned int)strtoul(optarg, NULL, 0); break;
+            default:
+                vi_usage(argv[0]);
+                return 2;
+        }
+    }
+
+    virtual_inverter_t *vi = vi_create(&config);
+    if (vi == NULL) {
+        fprintf(stderr, "Cannot open a pseudo-terminal\n");
+        return 1;
+    }
+    if (map_path != NULL && vi_load_map(vi, map_path) != 0) {
+        fprintf(stderr, "Cannot load register map %s\n", map_path);
+        vi_destroy(vi);
+        return 1;
+    }
+    if (link_path != NULL) {
+        unlink(link_path);
+        if (symlink(vi_pty_path(vi), link_path) != 0) {
+            perror(link_path);
+            vi_destroy(vi);
+            return 1;
+        }
+    }
+
+    signal(SIGINT, vi_on_signal);
+    signal(SIGTERM, vi_on_signal);
+    if (vi_start(vi) != 0) {
+        fprintf(stderr, "Cannot start the simulator\n");
+        vi_destroy(vi);
+        return 1;
+    }
+
+    printf("Virtual inverter 0x%02X on %s, %u baud, turnaround %u us\n",
+           config.slave_addr, link_path ? link_path : vi_pty_path(vi),
+           config.baud_rate, config.turnaround_us);
+    fflush(stdout);
+
+    while (!s_stop) {
+        pause();
+    }
+
+    vi_stats_t stats;
+    vi_get_stats(vi, &stats);
+    printf("requests %u, responses %u, exceptions %u, bad requests %u, line mismatches %u\n"
+           "injected: corrupted %u, noise %u, dropped %u, split %u, busy %u\n",
+           stats.requests, stats.responses, stats.exceptions, stats.bad_requests,
+           stats.line_mismatches,
+           stats.corrupted, stats.noise, stats.dropped, stats.split, stats.busy);
+
+    if (link_path != NULL) {
+        unlink(link_path);
+    }
+    vi_destroy(vi);
+    return 0;
+}
@@ -0,0 +1,583 @@
+/**
+ * @file virtual_inverter.c
+ * @brief Virtual inverter: Modbus RTU slave simulator implementation
+ */
+
+#include "virtual_inverter.h"
+#include "../../src/protocol/crc_utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define VI_BANK_COUNT           6
+#define VI_BANK_SIZE            65536
+#define VI_FIXED_TIMING_BAUD    19200   // Above this t3.5 is fixed
+#define VI_FIXED_T35_US         1750
+#define VI_MIN_SILENCE_US       2000    // Host scheduling slack for unknown layouts
+#define VI_PACE_BYTES           1       // Bytes per write; more would look like in-frame pauses
+#define VI_POLL_MS              50      // Stop flag check interval
+
+#define VI_EXC_ILLEGAL_FUNCTION 0x01
+#define VI_EXC_ILLEGAL_ADDRESS  0x02
+#define VI_EXC_ILLEGAL_VALUE    0x03
+#define VI_EXC_SLAVE_BUSY       0x06
+
+// Read function codes with a register bank, in bank order
+static const uint8_t s_bank_codes[VI_BANK_COUNT] = { 0x03, 0x04, 0x21, 0x22, 0x88, 0xFE };
+
+struct virtual_inverter {
+    vi_config_t config;
+    int master_fd;
+    int slave_fd;               // Held open so the master never sees a hangup
+    char pty_path[64];
+    uint32_t char_us;
+    uint32_t t35_us;
+    uint16_t *banks[VI_BANK_COUNT];
+    pthread_t thread;
+    bool running;
+    pthread_mutex_t lock;       // Banks and statistics
+    vi_stats_t stats;
+    unsigned int rand_state;
+};
+
+static int64_t vi_now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void vi_sleep_until(int64_t when_us)
+{
+    struct timespec ts = {
+        .tv_sec = when_us / 1000000,
+        .tv_nsec = (when_us % 1000000) * 1000,
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static bool vi_chance(virtual_inverter_t *vi, double rate)
+{
+    return rate > 0.0 && (double)rand_r(&vi->rand_state) / RAND_MAX < rate;
+}
+
+static int vi_bank_index(uint8_t func_code)
+{
+    for (int i = 0; i < VI_BANK_COUNT; i++) {
+        if (s_bank_codes[i] == func_code) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void vi_config_default(vi_config_t *config)
+{
+    memset(config, 0, sizeof(*config));
+    config->slave_addr = VI_DEFAULT_SLAVE_ADDR;
+    config->baud_rate = VI_DEFAULT_BAUD_RATE;
+    config->parity = VI_PARITY_EVEN;
+    config->turnaround_us = VI_DEFAULT_TURNAROUND_US;
+    config->split_gap_us = 1000;
+    config->seed = 1;
+}
+
+int vi_parse_parity(const char *arg, vi_parity_t *parity)
+{
+    switch (arg[0]) {
+        case 'N': case 'n': *parity = VI_PARITY_NONE; return 0;
+        case 'O': case 'o': *parity = VI_PARITY_ODD; return 0;
+        case 'E': case 'e': *parity = VI_PARITY_EVEN; return 0;
+        default: return -1;
+    }
+}
+
+virtual_inverter_t *vi_create(const vi_config_t *config)
+{
+    if (config == NULL || config->baud_rate == 0) {
+        return NULL;
+    }
+
+    virtual_inverter_t *vi = calloc(1, sizeof(*vi));
+    if (vi == NULL) {
+        return NULL;
+    }
+    vi->config = *config;
+    vi->master_fd = -1;
+    vi->slave_fd = -1;
+    vi->rand_state = config->seed;
+    pthread_mutex_init(&vi->lock, NULL);
+
+    // Modbus RTU keeps 11 bits per character whatever the parity
+    vi->char_us = (11 * 1000000UL + config->baud_rate - 1) / config->baud_rate;
+    vi->t35_us = (config->baud_rate > VI_FIXED_TIMING_BAUD) ?
+                 VI_FIXED_T35_US : 3 * vi->char_us + vi->char_us / 2;
+
+    for (int b = 0; b < VI_BANK_COUNT; b++) {
+        vi->banks[b] = malloc(VI_BANK_SIZE * sizeof(uint16_t));
+        if (vi->banks[b] == NULL) {
+            vi_destroy(vi);
+            return NULL;
+        }
+        for (uint32_t reg = 0; reg < VI_BANK_SIZE; reg++) {
+            vi->banks[b][reg] = (uint16_t)reg;
+        }
+    }
+
+    vi->master_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (vi->master_fd < 0 || grantpt(vi->master_fd) != 0 || unlockpt(vi->master_fd) != 0 ||
+        ptsname_r(vi->master_fd, vi->pty_path, sizeof(vi->pty_path)) != 0) {
+        vi_destroy(vi);
+        return NULL;
+    }
+
+    vi->slave_fd = open(vi->pty_path, O_RDWR | O_NOCTTY);
+    if (vi->slave_fd < 0) {
+        vi_destroy(vi);
+        return NULL;
+    }
+    struct termios tio;
+    if (tcgetattr(vi->slave_fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tcsetattr(vi->slave_fd, TCSANOW, &tio);
+    }
+
+    return vi;
+}
+
+const char *vi_pty_path(const virtual_inverter_t *vi)
+{
+    return vi->pty_path;
+}
+
+int vi_set_register(virtual_inverter_t *vi, uint8_t func_code, uint16_t reg, uint16_t value)
+{
+    int bank = vi_bank_index(func_code);
+    if (bank < 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&vi->lock);
+    vi->banks[bank][reg] = value;
+    pthread_mutex_unlock(&vi->lock);
+    return 0;
+}
+
+uint16_t vi_get_register(virtual_inverter_t *vi, uint8_t func_code, uint16_t reg)
+{
+    int bank = vi_bank_index(func_code);
+    if (bank < 0) {
+        return 0;
+    }
+    pthread_mutex_lock(&vi->lock);
+    uint16_t value = vi->banks[bank][reg];
+    pthread_mutex_unlock(&vi->lock);
+    return value;
+}
+
+int vi_load_map(virtual_inverter_t *vi, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+
+    char line[1024];
+    int line_no = 0;
+    int ret = 0;
+    while (ret == 0 && fgets(line, sizeof(line), file) != NULL) {
+        line_no++;
+        char *comment = strchr(line, '#');
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+
+        char *p = line;
+        char *end;
+        unsigned long values[3 + VI_MAX_READ_REGISTERS];
+        int n = 0;
+        while (n < (int)(sizeof(values) / sizeof(values[0]))) {
+            errno = 0;
+            unsigned long value = strtoul(p, &end, 0);
+            if (end == p) {
+                break;
+            }
+            if (errno != 0 || value > 0xFFFF) {
+                n = -1;
+                break;
+            }
+            values[n++] = value;
+            p = end;
+        }
+        while (n >= 0 && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+            p++;
+        }
+
+        if (n == 0 && *p == '\0') {
+            continue;
+        }
+        if (n < 3 || *p != '\0' || vi_bank_index((uint8_t)values[0]) < 0 ||
+            values[0] > 0xFF || values[1] + (n - 2) > VI_BANK_SIZE) {
+            fprintf(stderr, "%s:%d: expected <func_code> <start> <value>...\n", path, line_no);
+            ret = -1;
+            break;
+        }
+        for (int i = 2; i < n; i++) {
+            vi_set_register(vi, (uint8_t)values[0], (uint16_t)(values[1] + i - 2),
+                            (uint16_t)values[i]);
+        }
+    }
+
+    fclose(file);
+    return ret;
+}
+
+/**
+ * @brief Length of the request at the start of buf
+ * 
+ * @return Total length with CRC, 0 if more bytes are needed, -1 if the
+ *         layout is unknown (the request then ends at t3.5 of silence)
+ */
+static int vi_request_length(const uint8_t *buf, size_t len)
+{
+    if (len < 2) {
+        return 0;
+    }
+    switch (buf[1]) {
+        case 0x03:
+        case 0x04:
+        case 0x06:
+        case 0x21:
+        case 0x22:
+        case 0x88:
+        case 0xFE:
+            return 8;
+        case 0x10:
+            return (len < 7) ? 0 : 9 + buf[6];
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief Check the master's line settings against the simulator's
+ * 
+ * The pty driver drops PARENB, so the host UART shim encodes the format
+ * in the stop bits and PARODD: 2 stop bits for no parity, PARODD for odd,
+ * neither for even. Baud rates without a termios speed are not checked.
+ */
+static bool vi_line_matches(const virtual_inverter_t *vi)
+{
+    static const struct {
+        uint32_t baud_rate;
+        speed_t speed;
+    } speeds[] = {
+        { 1200, B1200 }, { 2400, B2400 }, { 4800, B4800 }, { 9600, B9600 },
+        { 19200, B19200 }, { 38400, B38400 }, { 57600, B57600 }, { 115200, B115200 },
+        { 230400, B230400 },
+    };
+
+    struct termios tio;
+    if (tcgetattr(vi->master_fd, &tio) != 0) {
+        return true;
+    }
+    for (size_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+        if (speeds[i].baud_rate == vi->config.baud_rate &&
+            cfgetospeed(&tio) != speeds[i].speed) {
+            return false;
+        }
+    }
+
+    vi_parity_t parity = VI_PARITY_EVEN;
+    if (tio.c_cflag & CSTOPB) {
+        parity = VI_PARITY_NONE;
+    } else if (tio.c_cflag & PARODD) {
+        parity = VI_PARITY_ODD;
+    }
+    return parity == vi->config.parity;
+}
+
+static size_t vi_finish(uint8_t *resp, size_t len)
+{
+    uint16_t crc = modbus_crc16(resp, (uint16_t)len);
+    resp[len] = crc & 0xFF;
+    resp[len + 1] = (crc >> 8) & 0xFF;
+    return len + 2;
+}
+
+static size_t vi_exception(virtual_inverter_t *vi, uint8_t func_code, uint8_t code,
+                           uint8_t *resp)
+{
+    resp[0] = vi->config.slave_addr;
+    resp[1] = func_code | 0x80;
+    resp[2] = code;
+    vi->stats.exceptions++;
+    return vi_finish(resp, 3);
+}
+
+/**
+ * @brief Build the response to a CRC-valid request
+ * 
+ * Called with vi->lock held.
+ * 
+ * @return Response length, 0 for none
+ */
+static size_t vi_answer(virtual_inverter_t *vi, const uint8_t *req, size_t len, uint8_t *resp)
+{
+    uint8_t func_code = req[1];
+    uint16_t start = (len >= 4) ? (uint16_t)((req[2] << 8) | req[3]) : 0;
+    uint16_t count = (len >= 6) ? (uint16_t)((req[4] << 8) | req[5]) : 0;
+
+    int bank = vi_bank_index(func_code);
+    if (bank >= 0) {
+        if (count == 0 || count > VI_MAX_READ_REGISTERS) {
+            return vi_exception(vi, func_code, VI_EXC_ILLEGAL_VALUE, resp);
+        }
+        if ((uint32_t)start + count > VI_BANK_SIZE) {
+            return vi_exception(vi, func_code, VI_EXC_ILLEGAL_ADDRESS, resp);
+        }
+        resp[0] = vi->config.slave_addr;
+        resp[1] = func_code;
+        resp[2] = (uint8_t)(2 * count);
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t value = vi->banks[bank][start + i];
+            resp[3 + 2 * i] = (uint8_t)(value >> 8);
+            resp[4 + 2 * i] = (uint8_t)(value & 0xFF);
+        }
+        return vi_finish(resp, 3 + 2 * (size_t)count);
+    }
+
+    switch (func_code) {
+        case 0x06:
+            // Holding registers are the 0x03 bank; the response echoes the request
+            vi->banks[0][start] = count;
+            memcpy(resp, req, 6);
+            return vi_finish(resp, 6);
+
+        case 0x10:
+            if (count == 0 || count > 123 || req[6] != 2 * count) {
+                return vi_exception(vi, func_code, VI_EXC_ILLEGAL_VALUE, resp);
+            }
+            if ((uint32_t)start + count > VI_BANK_SIZE) {
+                return vi_exception(vi, func_code, VI_EXC_ILLEGAL_ADDRESS, resp);
+            }
+            for (uint16_t i = 0; i < count; i++) {
+                vi->banks[0][start + i] = (uint16_t)((req[7 + 2 * i] << 8) | req[8 + 2 * i]);
+            }
+            memcpy(resp, req, 6);
+            return vi_finish(resp, 6);
+
+        default:
+            return vi_exception(vi, func_code, VI_EXC_ILLEGAL_FUNCTION, resp);
+    }
+}
+
+/**
+ * @brief Write bytes paced at the character time, starting at start_us
+ * 
+ * @return Time the last byte finished
+ */
+static int64_t vi_send_paced(virtual_inverter_t *vi, const uint8_t *data, size_t len,
+                             int64_t start_us)
+{
+    size_t sent = 0;
+    while (sent < len) {
+        size_t n = (len - sent < VI_PACE_BYTES) ? len - sent : VI_PACE_BYTES;
+        // A byte reaches the master once its stop bit is on the wire
+        vi_sleep_until(start_us + (int64_t)(sent + n) * vi->char_us);
+        ssize_t written = write(vi->master_fd, data + sent, n);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        sent += (size_t)written;
+    }
+    return start_us + (int64_t)len * vi->char_us;
+}
+
+/**
+ * @brief Handle one received request, injecting faults as configured
+ * 
+ * @param req_end_us When the last request byte left the master's wire
+ */
+static void vi_handle_request(virtual_inverter_t *vi, const uint8_t *req, size_t len,
+                              int64_t req_end_us)
+{
+    if (vi->config.strict_line && !vi_line_matches(vi)) {
+        pthread_mutex_lock(&vi->lock);
+        vi->stats.line_mismatches++;
+        pthread_mutex_unlock(&vi->lock);
+        return;
+    }
+    if (len < 4 || modbus_verify_crc(req, (uint16_t)len) != 0) {
+        pthread_mutex_lock(&vi->lock);
+        vi->stats.bad_requests++;
+        pthread_mutex_unlock(&vi->lock);
+        return;
+    }
+    if (req[0] != vi->config.slave_addr) {
+        return;
+    }
+
+    uint8_t resp[VI_MAX_FRAME];
+    pthread_mutex_lock(&vi->lock);
+    vi->stats.requests++;
+    size_t resp_len;
+    if (vi_chance(vi, vi->config.busy_rate)) {
+        vi->stats.busy++;
+        resp_len = vi_exception(vi, req[1], VI_EXC_SLAVE_BUSY, resp);
+    } else {
+        resp_len = vi_answer(vi, req, len, resp);
+    }
+
+    bool drop = vi_chance(vi, vi->config.drop_rate);
+    bool noise = !drop && vi_chance(vi, vi->config.noise_rate);
+    bool corrupt = !drop && vi_chance(vi, vi->config.crc_error_rate);
+    bool split = !drop && resp_len > 2 && vi_chance(vi, vi->config.split_rate);
+    uint32_t jitter = vi->config.turnaround_jitter_us ?
+                      (uint32_t)rand_r(&vi->rand_state) % (vi->config.turnaround_jitter_us + 1) : 0;
+    size_t split_at = split ? 1 + (size_t)rand_r(&vi->rand_state) % (resp_len - 1) : resp_len;
+    uint8_t noise_bytes[3];
+    size_t noise_len = 1 + (size_t)rand_r(&vi->rand_state) % sizeof(noise_bytes);
+    for (size_t i = 0; i < noise_len; i++) {
+        noise_bytes[i] = (uint8_t)rand_r(&vi->rand_state);
+    }
+    if (corrupt) {
+        resp[(size_t)rand_r(&vi->rand_state) % resp_len] ^=
+            (uint8_t)(1u << (rand_r(&vi->rand_state) % 8));
+    }
+
+    if (drop) {
+        vi->stats.dropped++;
+    } else {
+        vi->stats.responses++;
+        vi->stats.corrupted += corrupt;
+        vi->stats.noise += noise;
+        vi->stats.split += split;
+        vi->stats.tx_bytes += resp_len + (noise ? noise_len : 0);
+    }
+    pthread_mutex_unlock(&vi->lock);
+
+    if (drop || resp_len == 0) {
+        return;
+    }
+
+    int64_t start_us = req_end_us + vi->config.turnaround_us + jitter;
+    if (noise) {
+        // A burst halfway through the turnaround, as from a switching transient
+        vi_send_paced(vi, noise_bytes, noise_len, req_end_us + (start_us - req_end_us) / 2);
+    }
+    int64_t end_us = vi_send_paced(vi, resp, split_at, start_us);
+    if (split_at < resp_len) {
+        vi_send_paced(vi, resp + split_at, resp_len - split_at, end_us + vi->config.split_gap_us);
+    }
+}
+
+/**
+ * @brief Simulator thread: delimit requests and answer them
+ */
+static void *vi_thread(void *arg)
+{
+    virtual_inverter_t *vi = (virtual_inverter_t *)arg;
+    uint8_t buf[VI_MAX_FRAME];
+    size_t len = 0;
+    int64_t first_rx_us = 0;
+    int64_t last_rx_us = 0;
+    uint32_t silence_us = (vi->t35_us > VI_MIN_SILENCE_US) ? vi->t35_us : VI_MIN_SILENCE_US;
+
+    while (__atomic_load_n(&vi->running, __ATOMIC_ACQUIRE)) {
+        int timeout_ms = VI_POLL_MS;
+        if (len > 0) {
+            timeout_ms = (int)((silence_us + 999) / 1000);
+        }
+
+        struct pollfd pfd = { .fd = vi->master_fd, .events = POLLIN };
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0 && errno != EINTR) {
+            break;
+        }
+
+        if (ret > 0 && (pfd.revents & POLLIN)) {
+            ssize_t n = read(vi->master_fd, buf + len, sizeof(buf) - len);
+            if (n > 0) {
+                int64_t now = vi_now_us();
+                if (len == 0) {
+                    first_rx_us = now;
+                }
+                last_rx_us = now;
+                len += (size_t)n;
+            }
+        }
+
+        // The host delivers a request at once; on the wire it ends len characters later
+        while (len > 0) {
+            int need = vi_request_length(buf, len);
+            if (need == 0 || (need < 0 && vi_now_us() - last_rx_us < silence_us)) {
+                break;
+            }
+            if (need < 0 || (size_t)need > sizeof(buf)) {
+                need = (int)len;
+            }
+            if ((size_t)need > len) {
+                if (vi_now_us() - last_rx_us < silence_us) {
+                    break;
+                }
+                need = (int)len;
+            }
+
+            vi_handle_request(vi, buf, (size_t)need,
+                              first_rx_us + (int64_t)need * vi->char_us);
+            memmove(buf, buf + need, len - need);
+            len -= (size_t)need;
+            first_rx_us = vi_now_us();
+        }
+    }
+    return NULL;
+}
+
+int vi_start(virtual_inverter_t *vi)
+{
+    __atomic_store_n(&vi->running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&vi->thread, NULL, vi_thread, vi) != 0) {
+        vi->running = false;
+        return -1;
+    }
+    return 0;
+}
+
+void vi_destroy(virtual_inverter_t *vi)
+{
+    if (vi == NULL) {
+        return;
+    }
+    if (__atomic_exchange_n(&vi->running, false, __ATOMIC_ACQ_REL)) {
+        pthread_join(vi->thread, NULL);
+    }
+    if (vi->slave_fd >= 0) {
+        close(vi->slave_fd);
+    }
+    if (vi->master_fd >= 0) {
+        close(vi->master_fd);
+    }
+    for (int b = 0; b < VI_BANK_COUNT; b++) {
+        free(vi->banks[b]);
+    }
+    pthread_mutex_destroy(&vi->lock);
+    free(vi);
+}
+
+void vi_get_stats(virtual_inverter_t *vi, vi_stats_t *stats)
+{
+    pthread_mutex_lock(&vi->lock);
+    *stats = vi->stats;
+    pthread_mutex_unlock(&vi->lock);
+}
@@ -0,0 +1,154 @@
+/**
+ * @file virtual_inverter.h
+ * @brief Virtual inverter: Modbus RTU slave simulator on a pseudo-terminal
+ * 
+ * Answers register reads (0x03, 0x04 and the custom 0x21, 0x22, 0x88,
+ * 0xFE) and writes (0x06, 0x10) from an in-memory register map, one bank
+ * per read function code. Custom function codes are taken to carry the
+ * same start/count request as 0x03 and return a byte-count response.
+ * 
+ * Responses go out at the configured line speed, one character time per
+ * byte, after the configured turnaround from the end of the request. Line
+ * faults can be injected at random: corrupted CRCs, noise bytes ahead of a
+ * response, unanswered requests, and responses split by a pause. The slave
+ * can also be made to answer some requests with a busy exception (0x06).
+ * 
+ * With strict_line set, requests sent at another baud rate or parity than
+ * the simulator's are treated as line noise and go unanswered. The master's
+ * settings are read from the pty, where the host UART shim writes them.
+ * 
+ * Register map file, one block per line ('#' starts a comment):
+ *   <func_code> <start> <value> [value...]
+ * Numbers are C literals (0x prefix for hex). Registers not in the file
+ * read back their own address.
+ */
+
+#ifndef VIRTUAL_INVERTER_H
+#define VIRTUAL_INVERTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define VI_DEFAULT_SLAVE_ADDR       0x01
+#define VI_DEFAULT_BAUD_RATE        9600
+#define VI_DEFAULT_TURNAROUND_US    5000
+#define VI_MAX_READ_REGISTERS       125
+#define VI_MAX_FRAME                256
+
+/**
+ * @brief Parity, numbered as parameter 17 (0 none, 1 odd, 2 even)
+ */
+typedef enum {
+    VI_PARITY_NONE = 0,
+    VI_PARITY_ODD = 1,
+    VI_PARITY_EVEN = 2,
+} vi_parity_t;
+
+/**
+ * @brief Simulator configuration
+ */
+typedef struct {
+    uint8_t slave_addr;
+    uint32_t baud_rate;
+    vi_parity_t parity;             // Changes the character time; see strict_line
+    bool strict_line;               // Ignore masters at other line settings
+    uint32_t turnaround_us;         // End of request to first response byte
+    uint32_t turnaround_jitter_us;  // Random extra turnaround, 0 to this
+    double crc_error_rate;          // Responses sent with one bit flipped
+    double noise_rate;              // Responses preceded by noise bytes
+    double drop_rate;               // Requests left unanswered
+    double split_rate;              // Responses sent in two parts
+    double busy_rate;               // Requests answered with exception 0x06
+    uint32_t split_gap_us;          // Pause between the parts
+    unsigned int seed;              // Fault injection random seed
+} vi_config_t;
+
+/**
+ * @brief Simulator statistics
+ */
+typedef struct {
+    uint32_t requests;              // Requests addressed to the simulator
+    uint32_t responses;             // Responses sent, exceptions included
+    uint32_t exceptions;
+    uint32_t bad_requests;          // Requests with a wrong CRC or unknown layout
+    uint32_t line_mismatches;       // Requests ignored as sent at other line settings
+    uint32_t corrupted;             // Responses sent with a bad CRC
+    uint32_t noise;                 // Noise bursts sent
+    uint32_t dropped;               // Requests deliberately left unanswered
+    uint32_t split;                 // Responses sent in two parts
+    uint32_t busy;                  // Busy exceptions sent
+    uint64_t tx_bytes;
+} vi_stats_t;
+
+typedef struct virtual_inverter virtual_inverter_t;
+
+/**
+ * @brief Fill a configuration with the defaults (8E1, 9600 baud, no faults)
+ */
+void vi_config_default(vi_config_t *config);
+
+/**
+ * @brief Parse a parity letter (N, O or E)
+ * 
+ * @return 0 on success, -1 for anything else
+ */
+int vi_parse_parity(const char *arg, vi_parity_t *parity);
+
+/**
+ * @brief Create a simulator on a new pseudo-terminal
+ * 
+ * @return Simulator, NULL if no pty could be opened
+ */
+virtual_inverter_t *vi_create(const vi_config_t *config);
+
+/**
+ * @brief Path of the pty slave side the master connects to
+ */
+const char *vi_pty_path(const virtual_inverter_t *vi);
+
+/**
+ * @brief Load register values from a map file
+ * 
+ * @return 0 on success, -1 if the file cannot be read or a line is malformed
+ */
+int vi_load_map(virtual_inverter_t *vi, const char *path);
+
+/**
+ * @brief Set one register of a read bank
+ * 
+ * @return 0 on success, -1 for a function code without a bank
+ */
+int vi_set_register(virtual_inverter_t *vi, uint8_t func_code, uint16_t reg, uint16_t value);
+
+/**
+ * @brief Get one register of a read bank (0 for a function code without a bank)
+ */
+uint16_t vi_get_register(virtual_inverter_t *vi, uint8_t func_code, uint16_t reg);
+
+/**
+ * @brief Start answering requests on a thread of its own
+ * 
+ * @return 0 on success, -1 if the thread could not be started
+ */
+int vi_start(virtual_inverter_t *vi);
+
+/**
+ * @brief Stop answering and free the simulator
+ */
+void vi_destroy(virtual_inverter_t *vi);
+
+/**
+ * @brief Get simulator statistics
+ */
+void vi_get_stats(virtual_inverter_t *vi, vi_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // VIRTUAL_INVERTER_H